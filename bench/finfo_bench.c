@@ -0,0 +1,785 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "finfo_base64.h"
+#include "finfo_flac.h"
+#include "finfo_index.h"
+#include "finfo_input.h"
+#include "finfo_output.h"
+#include "finfo_png.h"
+#include "finfo_utils.h"
+#include "finfo_gen.h"
+
+/*
+ * Benchmarks of finfo on generated files.
+ * Microbenchmarks call the parsers directly, while the end-to-end benchmark
+ * runs a finfo binary over a whole corpus, so that different versions can
+ * be compared on the same files. Results are printed as a JSON object per
+ * line.
+ */
+
+// Default number of files of the end-to-end corpus.
+#define BENCH_FILES 2000
+// Default number of timed runs of every benchmark, the best one is kept.
+#define BENCH_RUNS 5
+// Default shortest duration of a microbenchmark run, in milliseconds.
+#define BENCH_MIN_TIME 200
+// Files of the index of the microbenchmarks, and artists among them.
+#define BENCH_INDEX_FILES	1000000
+#define BENCH_INDEX_ARTISTS 10000
+
+struct bench_state {
+	// Files parsed by the microbenchmarks.
+	struct finfo_input flac;
+	struct finfo_input png;
+	// Offsets and data of the FLAC blocks, by type.
+	uint64_t flac_blocks[FLAC_PICTURE_TYPE + 1];
+	struct flac_metadata_block flac_headers[FLAC_PICTURE_TYPE + 1];
+	struct finfo_view flac_data[FLAC_PICTURE_TYPE + 1];
+	// Index of a generated library, without the files.
+	struct finfo_index index;
+	// Random bytes for the integer and base64 benchmarks.
+	unsigned char bytes[4096];
+	char base64[BASE64_ENCODED_LEN(4096)];
+	// Block type or chunk index measured by the current benchmark.
+	int arg;
+};
+
+struct bench {
+	const char *name;
+	// Bytes processed by each operation, 0 if throughput is not meaningful.
+	size_t bytes;
+	// Run ITERATIONS operations and return something depending on them.
+	uint64_t (*run)(struct bench_state *state, uint64_t iterations);
+	int arg;
+};
+
+static volatile uint64_t bench_sink;
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int cmp_double(const void *a, const void *b) {
+	double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+/*
+ * Microbenchmarks
+ */
+
+static uint64_t run_be_bytes_to_int(struct bench_state *state,
+									uint64_t iterations) {
+	uint64_t sum = 0;
+	for (uint64_t i = 0; i < iterations; i++) {
+		// Every length, at every alignment.
+		sum += BE_bytes_to_int(state->bytes + (i & 1023), (i & 7) + 1);
+	}
+	return sum;
+}
+
+static uint64_t run_le_bytes_to_int(struct bench_state *state,
+									uint64_t iterations) {
+	uint64_t sum = 0;
+	for (uint64_t i = 0; i < iterations; i++) {
+		sum += LE_bytes_to_int(state->bytes + (i & 1023), (i & 7) + 1);
+	}
+	return sum;
+}
+
+// The fixed-width loaders the parsers use, on the same bytes.
+static uint64_t run_load_be32(struct bench_state *state, uint64_t iterations) {
+	uint64_t sum = 0;
+	for (uint64_t i = 0; i < iterations; i++) {
+		sum += load_be32(state->bytes + (i & 1023));
+	}
+	return sum;
+}
+
+static uint64_t run_load_be64(struct bench_state *state, uint64_t iterations) {
+	uint64_t sum = 0;
+	for (uint64_t i = 0; i < iterations; i++) {
+		sum += load_be64(state->bytes + (i & 1023));
+	}
+	return sum;
+}
+
+static uint64_t run_load_le32(struct bench_state *state, uint64_t iterations) {
+	uint64_t sum = 0;
+	for (uint64_t i = 0; i < iterations; i++) {
+		sum += load_le32(state->bytes + (i & 1023));
+	}
+	return sum;
+}
+
+static uint64_t run_base64_encode(struct bench_state *state,
+								  uint64_t iterations) {
+	uint64_t sum = 0;
+	for (uint64_t i = 0; i < iterations; i++) {
+		sum += base64_encode(state->bytes, sizeof(state->bytes),
+							 state->base64);
+		sum += state->base64[i & 4095];
+	}
+	return sum;
+}
+
+static uint64_t run_flac_parse_block(struct bench_state *state,
+									 uint64_t iterations) {
+	uint64_t sum = 0;
+	for (uint64_t i = 0; i < iterations; i++) {
+		struct flac_metadata_block block;
+		if (flac_parse_block(&state->flac, state->flac_blocks[state->arg],
+							 &block)) {
+			sum += block.block_length;
+		}
+		// Arrays of the blocks are allocated from the arena.
+		finfo_arena_reset(&state->flac.arena);
+	}
+	return sum;
+}
+
+/*
+ * Decoding a block which was already checked, against checking it first as
+ * flac_parse_block does, to measure the cost of the checks.
+ */
+static uint64_t run_flac_decode_block(struct bench_state *state,
+									  uint64_t iterations) {
+	struct finfo_view data = state->flac_data[state->arg];
+	uint64_t sum		   = 0;
+	for (uint64_t i = 0; i < iterations; i++) {
+		struct flac_metadata_block block = state->flac_headers[state->arg];
+		flac_decode_block(&state->flac.arena, data.data, data.len, &block);
+		sum += block.type;
+		finfo_arena_reset(&state->flac.arena);
+	}
+	return sum;
+}
+
+static uint64_t run_flac_check_decode_block(struct bench_state *state,
+											uint64_t iterations) {
+	struct finfo_view data = state->flac_data[state->arg];
+	uint64_t sum		   = 0;
+	for (uint64_t i = 0; i < iterations; i++) {
+		struct flac_metadata_block block = state->flac_headers[state->arg];
+		if (flac_check_block(block.type, data.data, data.len)) {
+			flac_decode_block(&state->flac.arena, data.data, data.len,
+							  &block);
+		}
+		sum += block.type;
+		finfo_arena_reset(&state->flac.arena);
+	}
+	return sum;
+}
+
+// The checks alone, which is what checking costs on top of decoding.
+static uint64_t run_flac_check_block(struct bench_state *state,
+									 uint64_t iterations) {
+	struct finfo_view data		 = state->flac_data[state->arg];
+	enum flac_metadata_type type = state->flac_headers[state->arg].type;
+	uint64_t sum				 = 0;
+	for (uint64_t i = 0; i < iterations; i++) {
+		sum += flac_check_block(type, data.data, data.len);
+	}
+	return sum;
+}
+
+static uint64_t run_png_index_chunks(struct bench_state *state,
+									 uint64_t iterations) {
+	uint64_t sum = 0;
+	for (uint64_t i = 0; i < iterations; i++) {
+		struct png_chunk_index index;
+		png_index_chunks(&state->png, &index);
+		sum += index.entries_n;
+		png_chunk_index_free(&index);
+	}
+	return sum;
+}
+
+static uint64_t run_png_chunk_load(struct bench_state *state,
+								   uint64_t iterations) {
+	struct png_chunk_index index;
+	png_index_chunks(&state->png, &index);
+
+	uint64_t sum = 0;
+	for (uint64_t i = 0; i < iterations; i++) {
+		struct png_chunk chunk;
+		if (png_chunk_load(&state->png, &index.entries[i % index.entries_n],
+						   &chunk)) {
+			sum += chunk.length + chunk.CRC[0];
+		}
+	}
+
+	png_chunk_index_free(&index);
+	return sum;
+}
+
+enum bench_query {
+	BENCH_QUERY_EXACT,
+	BENCH_QUERY_PREFIX,
+	BENCH_QUERY_AND,
+};
+
+static uint64_t run_index_lookup(struct bench_state *state,
+								 uint64_t iterations) {
+	uint64_t sum = 0;
+	for (uint64_t i = 0; i < iterations; i++) {
+		unsigned artist = i % BENCH_INDEX_ARTISTS;
+		char query[64], other[64];
+		if (state->arg == BENCH_QUERY_PREFIX) {
+			// Artists 1NN and 1NN0 to 1NN9.
+			snprintf(query, sizeof(query), "ARTIST=artist %u*",
+					 100 + artist % 100);
+		} else {
+			snprintf(query, sizeof(query), "ARTIST=artist %u", artist);
+		}
+		snprintf(other, sizeof(other), "GENRE=genre %u", artist % 32);
+
+		struct finfo_index_result result, others;
+		if (!finfo_index_lookup(&state->index, query, &result)) { continue; }
+		if (state->arg == BENCH_QUERY_AND &&
+			finfo_index_lookup(&state->index, other, &others)) {
+			finfo_index_result_intersect(&result, &others);
+			finfo_index_result_free(&others);
+		}
+		sum += result.files_n;
+		finfo_index_result_free(&result);
+	}
+	return sum;
+}
+
+static const struct bench benches[] = {
+	{"BE_bytes_to_int", 0, run_be_bytes_to_int, 0},
+	{"LE_bytes_to_int", 0, run_le_bytes_to_int, 0},
+	{"load_be32", 0, run_load_be32, 0},
+	{"load_be64", 0, run_load_be64, 0},
+	{"load_le32", 0, run_load_le32, 0},
+	{"base64_encode", 4096, run_base64_encode, 0},
+	{"flac_parse_block/streaminfo", 0, run_flac_parse_block,
+	 FLAC_STREAMINFO_TYPE},
+	{"flac_parse_block/seek_table", 0, run_flac_parse_block,
+	 FLAC_SEEK_TABLE_TYPE},
+	{"flac_parse_block/vorbis_comment", 0, run_flac_parse_block,
+	 FLAC_VORBIS_COMMENT_TYPE},
+	{"flac_parse_block/cuesheet", 0, run_flac_parse_block,
+	 FLAC_CUESHEET_TYPE},
+	{"flac_parse_block/picture", 0, run_flac_parse_block, FLAC_PICTURE_TYPE},
+	{"flac_decode_block/seek_table", 0, run_flac_decode_block,
+	 FLAC_SEEK_TABLE_TYPE},
+	{"flac_decode_block/seek_table/checked", 0, run_flac_check_decode_block,
+	 FLAC_SEEK_TABLE_TYPE},
+	{"flac_decode_block/vorbis_comment", 0, run_flac_decode_block,
+	 FLAC_VORBIS_COMMENT_TYPE},
+	{"flac_decode_block/vorbis_comment/checked", 0,
+	 run_flac_check_decode_block, FLAC_VORBIS_COMMENT_TYPE},
+	{"flac_decode_block/cuesheet", 0, run_flac_decode_block,
+	 FLAC_CUESHEET_TYPE},
+	{"flac_decode_block/cuesheet/checked", 0, run_flac_check_decode_block,
+	 FLAC_CUESHEET_TYPE},
+	{"flac_check_block/vorbis_comment", 0, run_flac_check_block,
+	 FLAC_VORBIS_COMMENT_TYPE},
+	{"flac_check_block/cuesheet", 0, run_flac_check_block,
+	 FLAC_CUESHEET_TYPE},
+	{"png_index_chunks", 0, run_png_index_chunks, 0},
+	{"png_chunk_load", 0, run_png_chunk_load, 0},
+	{"index_lookup/exact", 0, run_index_lookup, BENCH_QUERY_EXACT},
+	{"index_lookup/prefix", 0, run_index_lookup, BENCH_QUERY_PREFIX},
+	{"index_lookup/and", 0, run_index_lookup, BENCH_QUERY_AND},
+};
+
+/*
+ * Build the index of a library of BENCH_INDEX_FILES tracks at PATH, with
+ * about a hundred tracks per artist and ten per album, and open it.
+ */
+static bool bench_index_setup(struct bench_state *state, const char *path,
+							  uint64_t seed) {
+	struct finfo_index_builder builder;
+	finfo_index_builder_init(&builder);
+
+	uint64_t rand = seed | 1;
+	bool ok		  = true;
+	for (uint32_t i = 0; ok && i < BENCH_INDEX_FILES; i++) {
+		unsigned artist = finfo_gen_rand(&rand) % BENCH_INDEX_ARTISTS;
+		unsigned album	= artist * 10 + finfo_gen_rand(&rand) % 10;
+
+		char file[64], terms[256];
+		snprintf(file, sizeof(file), "/music/%07u.flac", i);
+		int len = snprintf(terms, sizeof(terms),
+						   "ARTIST=artist %u%cALBUM=album %u%cTITLE=title "
+						   "%u%cGENRE=genre %u%cTRACKNUMBER=%u%c",
+						   artist, 0, album, 0, i, 0, artist % 32, 0,
+						   i % 12 + 1, 0);
+		ok = finfo_index_builder_add(&builder, file, terms, len);
+	}
+
+	ok = ok && finfo_index_builder_save(&builder, path);
+	finfo_index_builder_free(&builder);
+	return ok && finfo_index_open(&state->index, path);
+}
+
+// Write the files of the microbenchmarks inside DIR and open them.
+static bool bench_setup(struct bench_state *state, const char *dir,
+						uint64_t seed) {
+	uint64_t rand = seed | 1;
+	for (size_t i = 0; i < sizeof(state->bytes); i++) {
+		state->bytes[i] = finfo_gen_rand(&rand);
+	}
+
+	// A tagged album track and a PNG with many chunks.
+	struct finfo_gen_flac flac = {
+		.frames_n	   = 64,
+		.comments_n	   = 32,
+		.seek_points_n = 32,
+		.cue_tracks_n  = 12,
+		.picture_width = 300,
+		.picture_height = 300,
+		.padding_len   = 8192,
+		.seed		   = seed,
+	};
+	struct finfo_gen_png png = {
+		.width	= 512,
+		.height = 512,
+		.idat_n = 16,
+		.text_n = 8,
+		.seed	= seed,
+	};
+
+	struct finfo_buf file;
+	finfo_buf_init(&file);
+	static char flac_path[4096], png_path[4096];
+	snprintf(flac_path, sizeof(flac_path), "%s/bench.flac", dir);
+	snprintf(png_path, sizeof(png_path), "%s/bench.png", dir);
+
+	bool ok = finfo_gen_flac(&flac, &file) &&
+			  finfo_gen_write(flac_path, file.data, file.len);
+	file.len = 0;
+	ok		 = ok && finfo_gen_png(&png, &file) &&
+		  finfo_gen_write(png_path, file.data, file.len);
+	finfo_buf_free(&file);
+	if (!ok || !finfo_input_open(&state->flac, flac_path)) { return false; }
+	if (!finfo_input_open(&state->png, png_path)) {
+		finfo_input_close(&state->flac);
+		return false;
+	}
+
+	// Find the offset of every block.
+	uint64_t offset = 4;
+	while (true) {
+		struct flac_metadata_block block;
+		if (!flac_parse_block(&state->flac, offset, &block)) { break; }
+		if (block.type <= FLAC_PICTURE_TYPE) {
+			state->flac_blocks[block.type]	= offset;
+			state->flac_headers[block.type] = block;
+			finfo_input_view(&state->flac, offset + 4, block.block_length,
+							 &state->flac_data[block.type]);
+		}
+		offset += 4 + block.block_length;
+		if (block.last_block) { break; }
+	}
+	finfo_arena_reset(&state->flac.arena);
+
+	static char index_path[4096];
+	snprintf(index_path, sizeof(index_path), "%s/bench.idx", dir);
+	if (!bench_index_setup(state, index_path, seed)) {
+		finfo_input_close(&state->flac);
+		finfo_input_close(&state->png);
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Run BENCH RUNS times, each one long at least MIN_TIME seconds, and print
+ * the best and median time per operation.
+ */
+static void bench_micro(struct bench_state *state, const struct bench *bench,
+						int runs, double min_time) {
+	state->arg = bench->arg;
+
+	// Find how many iterations last MIN_TIME, which also warms up caches.
+	uint64_t iterations = 1;
+	while (true) {
+		double start = now();
+		bench_sink += bench->run(state, iterations);
+		double elapsed = now() - start;
+		if (elapsed >= min_time) { break; }
+		iterations *= elapsed > min_time / 16 ? 2 : 16;
+	}
+
+	double times[runs];
+	for (int i = 0; i < runs; i++) {
+		double start = now();
+		bench_sink += bench->run(state, iterations);
+		times[i] = (now() - start) / iterations * 1e9;
+	}
+	qsort(times, runs, sizeof(*times), cmp_double);
+
+	printf("{\"benchmark\":\"%s\",\"unit\":\"ns/op\",\"runs\":%d,"
+		   "\"iterations\":%llu,\"best\":%.3f,\"median\":%.3f",
+		   bench->name, runs, (unsigned long long)iterations, times[0],
+		   times[runs / 2]);
+	if (bench->bytes > 0) {
+		printf(",\"bytes_per_op\":%zu,\"mb_per_s\":%.1f", bench->bytes,
+			   bench->bytes / times[0] * 1e3);
+	}
+	printf("}\n");
+	fflush(stdout);
+}
+
+/*
+ * End to end
+ */
+
+/*
+ * Run the finfo binary FINFO with ARGS over DIR, discarding its output.
+ * Returns the elapsed seconds, or a negative value if it failed.
+ */
+static double run_finfo(const char *finfo, const char *const *args,
+						const char *dir) {
+	const char *argv[16];
+	int argc	 = 0;
+	argv[argc++] = finfo;
+	for (; *args != NULL && argc < 14; args++) { argv[argc++] = *args; }
+	argv[argc++] = dir;
+	argv[argc]	 = NULL;
+
+	double start = now();
+	pid_t pid	 = fork();
+	if (pid < 0) { return -1; }
+	if (pid == 0) {
+		int null = open("/dev/null", O_WRONLY);
+		if (null >= 0) { dup2(null, STDOUT_FILENO); }
+		execv(finfo, (char *const *)argv);
+		_exit(127);
+	}
+
+	int status;
+	while (waitpid(pid, &status, 0) < 0) {
+		if (errno != EINTR) { return -1; }
+	}
+	double elapsed = now() - start;
+	return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? elapsed : -1;
+}
+
+static bool bench_end_to_end(const char *name, const char *finfo,
+							 const char *const *args, const char *dir,
+							 size_t files_n, uint64_t bytes, int runs) {
+	// A first run to load the files in the page cache.
+	if (run_finfo(finfo, args, dir) < 0) {
+		fprintf(stderr, "Running %s failed.\n", finfo);
+		return false;
+	}
+
+	double rates[runs];
+	for (int i = 0; i < runs; i++) {
+		double elapsed = run_finfo(finfo, args, dir);
+		if (elapsed < 0) {
+			fprintf(stderr, "Running %s failed.\n", finfo);
+			return false;
+		}
+		rates[i] = files_n / elapsed;
+	}
+	// Sorted so that the best rate comes first.
+	qsort(rates, runs, sizeof(*rates), cmp_double);
+
+	printf("{\"benchmark\":\"%s\",\"unit\":\"files/s\",\"runs\":%d,"
+		   "\"files\":%zu,\"bytes\":%llu,\"best\":%.1f,\"median\":%.1f}\n",
+		   name, runs, files_n, (unsigned long long)bytes, rates[runs - 1],
+		   rates[runs / 2]);
+	fflush(stdout);
+	return true;
+}
+
+// Remove the files written inside DIR, then DIR itself.
+static void remove_dir(const char *dir) {
+	DIR *d = opendir(dir);
+	if (d == NULL) { return; }
+
+	char path[4096];
+	struct dirent *entry;
+	while ((entry = readdir(d)) != NULL) {
+		if (entry->d_name[0] == '.') { continue; }
+		snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+		unlink(path);
+	}
+	closedir(d);
+	rmdir(dir);
+}
+
+/*
+ * Generator commands
+ */
+
+// Parse a number from 0 to MAX, or WIDTHxHEIGHT if HEIGHT is not NULL.
+static bool parse_number(const char *str, uint64_t max, uint32_t *dst,
+						 uint32_t *height) {
+	char *end;
+	errno			 = 0;
+	unsigned long long n = strtoull(str, &end, 10);
+	if (end == str || *str == '-' || errno != 0 || n > max) { return false; }
+	*dst = n;
+
+	if (height == NULL) { return *end == '\0'; }
+	if (*end != 'x') { return false; }
+	return parse_number(end + 1, max, height, NULL);
+}
+
+static void usage(const char *name) {
+	printf("Usage: %s [OPTION]...\n", name);
+	printf("  or:  %s flac [OPTION]... FILE\n", name);
+	printf("  or:  %s png [OPTION]... FILE\n", name);
+	printf("  or:  %s corpus [OPTION]... DIR\n", name);
+	printf("Run the benchmarks, printing a JSON object per result, or "
+		   "generate files.\n\n");
+	printf("Benchmark options:\n");
+	printf("  --finfo=PATH         finfo binary of the end-to-end benchmark "
+		   "(default ./finfo)\n");
+	printf("  --files=N            number of files of the corpus "
+		   "(default %d)\n",
+		   BENCH_FILES);
+	printf("  --runs=N             timed runs of every benchmark "
+		   "(default %d)\n",
+		   BENCH_RUNS);
+	printf("  --min-time=MS        shortest run of a microbenchmark "
+		   "(default %d)\n",
+		   BENCH_MIN_TIME);
+	printf("  --jobs=N             passed to finfo\n");
+	printf("  --dir=DIR            where the corpus is written, and kept\n");
+	printf("  --micro-only         skip the end-to-end benchmark\n");
+	printf("\nGenerator options:\n");
+	printf("  --seed=N             seed of the random content (default 0)\n");
+	printf("  --frames=N           FLAC frames of 4096 samples (default 16)\n");
+	printf("  --comments=N         FLAC vorbis comment fields\n");
+	printf("  --seek-points=N      FLAC seek points\n");
+	printf("  --cue-tracks=N       FLAC cuesheet tracks\n");
+	printf("  --picture=WxH        FLAC embedded PNG picture size\n");
+	printf("  --padding=N          FLAC padding bytes\n");
+	printf("  --size=WxH           PNG size (default 64x64)\n");
+	printf("  --idat=N             PNG IDAT chunks (default 1)\n");
+	printf("  --text=N             PNG tEXt chunks\n");
+}
+
+int main(int argc, char *argv[]) {
+	enum {
+		OPT_FINFO = 256,
+		OPT_FILES,
+		OPT_RUNS,
+		OPT_MIN_TIME,
+		OPT_JOBS,
+		OPT_DIR,
+		OPT_MICRO_ONLY,
+		OPT_SEED,
+		OPT_FRAMES,
+		OPT_COMMENTS,
+		OPT_SEEK_POINTS,
+		OPT_CUE_TRACKS,
+		OPT_PICTURE,
+		OPT_PADDING,
+		OPT_SIZE,
+		OPT_IDAT,
+		OPT_TEXT,
+	};
+	static const struct option long_options[] = {
+		{"finfo", required_argument, NULL, OPT_FINFO},
+		{"files", required_argument, NULL, OPT_FILES},
+		{"runs", required_argument, NULL, OPT_RUNS},
+		{"min-time", required_argument, NULL, OPT_MIN_TIME},
+		{"jobs", required_argument, NULL, OPT_JOBS},
+		{"dir", required_argument, NULL, OPT_DIR},
+		{"micro-only", no_argument, NULL, OPT_MICRO_ONLY},
+		{"seed", required_argument, NULL, OPT_SEED},
+		{"frames", required_argument, NULL, OPT_FRAMES},
+		{"comments", required_argument, NULL, OPT_COMMENTS},
+		{"seek-points", required_argument, NULL, OPT_SEEK_POINTS},
+		{"cue-tracks", required_argument, NULL, OPT_CUE_TRACKS},
+		{"picture", required_argument, NULL, OPT_PICTURE},
+		{"padding", required_argument, NULL, OPT_PADDING},
+		{"size", required_argument, NULL, OPT_SIZE},
+		{"idat", required_argument, NULL, OPT_IDAT},
+		{"text", required_argument, NULL, OPT_TEXT},
+		{"help", no_argument, NULL, 'h'},
+		{NULL, 0, NULL, 0},
+	};
+
+	const char *finfo	= "./finfo";
+	const char *dir		= NULL;
+	const char *jobs	= NULL;
+	uint32_t files_n	= BENCH_FILES;
+	uint32_t runs		= BENCH_RUNS;
+	uint32_t min_time	= BENCH_MIN_TIME;
+	uint32_t seed		= 0;
+	bool micro_only		= false;
+	struct finfo_gen_flac flac = {.frames_n = 16};
+	struct finfo_gen_png png   = {.width = 64, .height = 64, .idat_n = 1};
+
+	int opt;
+	while ((opt = getopt_long(argc, argv, "h", long_options, NULL)) != -1) {
+		bool ok = true;
+		switch (opt) {
+		case OPT_FINFO:
+			finfo = optarg;
+			break;
+		case OPT_FILES:
+			ok = parse_number(optarg, 1000000, &files_n, NULL) && files_n;
+			break;
+		case OPT_RUNS:
+			ok = parse_number(optarg, 1000, &runs, NULL) && runs;
+			break;
+		case OPT_MIN_TIME:
+			ok = parse_number(optarg, 60000, &min_time, NULL);
+			break;
+		case OPT_JOBS:
+			jobs = optarg;
+			break;
+		case OPT_DIR:
+			dir = optarg;
+			break;
+		case OPT_MICRO_ONLY:
+			micro_only = true;
+			break;
+		case OPT_SEED:
+			ok = parse_number(optarg, UINT32_MAX, &seed, NULL);
+			break;
+		case OPT_FRAMES:
+			ok = parse_number(optarg, 1U << 24, &flac.frames_n, NULL);
+			break;
+		case OPT_COMMENTS:
+			ok = parse_number(optarg, 100000, &flac.comments_n, NULL);
+			break;
+		case OPT_SEEK_POINTS:
+			ok = parse_number(optarg, 1U << 24, &flac.seek_points_n, NULL);
+			break;
+		case OPT_CUE_TRACKS:
+			ok = parse_number(optarg, 99, &flac.cue_tracks_n, NULL);
+			break;
+		case OPT_PICTURE:
+			ok = parse_number(optarg, 1U << 14, &flac.picture_width,
+							  &flac.picture_height);
+			break;
+		case OPT_PADDING:
+			ok = parse_number(optarg, 1U << 20, &flac.padding_len, NULL);
+			break;
+		case OPT_SIZE:
+			ok = parse_number(optarg, 1U << 14, &png.width, &png.height);
+			break;
+		case OPT_IDAT:
+			ok = parse_number(optarg, 1U << 16, &png.idat_n, NULL);
+			break;
+		case OPT_TEXT:
+			ok = parse_number(optarg, 1U << 16, &png.text_n, NULL);
+			break;
+		case 'h':
+			usage(argv[0]);
+			return 0;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+		if (!ok) {
+			fprintf(stderr, "Invalid value: %s\n", optarg);
+			return 1;
+		}
+	}
+	flac.seed = seed;
+	png.seed  = seed;
+
+	// Generator commands.
+	if (optind < argc) {
+		const char *command = argv[optind];
+		if (optind + 2 != argc) {
+			usage(argv[0]);
+			return 1;
+		}
+		const char *path = argv[optind + 1];
+
+		bool ok;
+		if (strcmp(command, "corpus") == 0) {
+			ok = finfo_gen_corpus(path, files_n, seed, NULL);
+		} else {
+			struct finfo_buf file;
+			finfo_buf_init(&file);
+			if (strcmp(command, "flac") == 0) {
+				ok = finfo_gen_flac(&flac, &file);
+			} else if (strcmp(command, "png") == 0) {
+				ok = finfo_gen_png(&png, &file);
+			} else {
+				finfo_buf_free(&file);
+				usage(argv[0]);
+				return 1;
+			}
+			if (!ok) { errno = EINVAL; }
+			ok = ok && finfo_gen_write(path, file.data, file.len);
+			finfo_buf_free(&file);
+		}
+
+		if (!ok) {
+			fprintf(stderr, "Unable to generate: %s (%s).\n", path,
+					strerror(errno));
+			return 1;
+		}
+		return 0;
+	}
+
+	// The corpus is kept only if written in a given directory.
+	char tmp_dir[] = "/tmp/finfo_bench.XXXXXX";
+	bool keep	   = dir != NULL;
+	if (!keep && (dir = mkdtemp(tmp_dir)) == NULL) {
+		fprintf(stderr, "Unable to create a directory (%s).\n",
+				strerror(errno));
+		return 1;
+	}
+
+	static struct bench_state state;
+	if (!bench_setup(&state, dir, seed)) {
+		fprintf(stderr, "Unable to write the benchmark files in %s (%s).\n",
+				dir, strerror(errno));
+		if (!keep) { remove_dir(dir); }
+		return 1;
+	}
+	for (size_t i = 0; i < sizeof(benches) / sizeof(*benches); i++) {
+		bench_micro(&state, &benches[i], runs, min_time / 1000.0);
+	}
+	finfo_input_close(&state.flac);
+	finfo_input_close(&state.png);
+	finfo_index_close(&state.index);
+
+	bool ok = true;
+	if (!micro_only) {
+		// The corpus only, without the files of the microbenchmarks.
+		char corpus[4096];
+		snprintf(corpus, sizeof(corpus), "%s/corpus", dir);
+		uint64_t bytes = 0;
+		ok = (mkdir(corpus, 0755) == 0 || errno == EEXIST) &&
+			 finfo_gen_corpus(corpus, files_n, seed, &bytes);
+		if (!ok) {
+			fprintf(stderr, "Unable to write the corpus in %s (%s).\n",
+					corpus, strerror(errno));
+		}
+
+		const char *args[] = {"--format=ndjson", "-j", jobs, NULL};
+		if (jobs == NULL) { args[1] = NULL; }
+		const char *verify_args[] = {"--format=ndjson", "--verify", "-j",
+									 jobs, NULL};
+		if (jobs == NULL) { verify_args[2] = NULL; }
+
+		ok = ok && bench_end_to_end("end_to_end", finfo, args, corpus,
+									files_n, bytes, runs);
+		ok = ok && bench_end_to_end("end_to_end/verify", finfo, verify_args,
+									corpus, files_n, bytes, runs);
+		if (!keep) { remove_dir(corpus); }
+	}
+
+	if (!keep) { remove_dir(dir); }
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,488 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
+#include "finfo_crc.h"
+#include "finfo_md5.h"
+#include "finfo_gen.h"
+
+static const unsigned char flac_signature[4] = {'f', 'L', 'a', 'C'};
+static const unsigned char png_signature[8]	 = {0x89, 'P',	'N',  'G',
+												0x0D, 0x0A, 0x1A, 0x0A};
+
+static const char *const vorbis_keys[] = {
+	"TITLE", "ARTIST", "ALBUM",	  "DATE",		 "TRACKNUMBER",
+	"GENRE", "COMMENT", "COMPOSER", "DISCNUMBER", "PERFORMER",
+};
+
+uint64_t finfo_gen_rand(uint64_t *state) {
+	// xorshift64*
+	uint64_t x = *state;
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	*state = x;
+	return x * 0x2545F4914F6CDD1DULL;
+}
+
+// Seed the generator with SEED, which may be 0.
+static uint64_t gen_seed(uint64_t seed) {
+	uint64_t state = seed ^ 0x9E3779B97F4A7C15ULL;
+	return state ? state : 1;
+}
+
+static void put_be(struct finfo_buf *dst, uint64_t value, unsigned len) {
+	unsigned char bytes[8];
+	for (unsigned i = 0; i < len; i++) {
+		bytes[i] = value >> (8 * (len - 1 - i));
+	}
+	finfo_buf_append(dst, bytes, len);
+}
+
+static void put_le(struct finfo_buf *dst, uint64_t value, unsigned len) {
+	unsigned char bytes[8];
+	for (unsigned i = 0; i < len; i++) { bytes[i] = value >> (8 * i); }
+	finfo_buf_append(dst, bytes, len);
+}
+
+static void put_zeros(struct finfo_buf *dst, size_t len) {
+	static const unsigned char zeros[256];
+	for (size_t n; len > 0; len -= n) {
+		n = len < sizeof(zeros) ? len : sizeof(zeros);
+		finfo_buf_append(dst, zeros, n);
+	}
+}
+
+// Append LEN random lowercase letters.
+static void put_word(struct finfo_buf *dst, uint64_t *rand, size_t len) {
+	for (size_t i = 0; i < len; i++) {
+		char c = 'a' + finfo_gen_rand(rand) % 26;
+		finfo_buf_append(dst, &c, 1);
+	}
+}
+
+/*
+ * FLAC
+ */
+
+// Length of the UTF-8 like coding of the frame number N.
+static unsigned flac_utf8_len(uint32_t n) {
+	if (n < 0x80) { return 1; }
+	unsigned len = 2;
+	// Each continuation byte holds 6 bits, the first one 7 - LEN.
+	while (n >= 1U << (5 * len + 1)) { len++; }
+	return len;
+}
+
+static size_t flac_frame_len(uint32_t n) {
+	// Header, two constant subframes and the CRC-16.
+	return 4 + flac_utf8_len(n) + 1 + 6 + 2;
+}
+
+static void flac_put_frame(struct finfo_buf *dst, uint32_t n) {
+	size_t start = dst->len;
+
+	// Fixed block size of 4096 samples at 44.1 kHz, stereo, 16 bit.
+	static const unsigned char header[4] = {0xFF, 0xF8, 0xC9, 0x18};
+	finfo_buf_append(dst, header, sizeof(header));
+
+	unsigned len = flac_utf8_len(n);
+	unsigned char number[6];
+	if (len == 1) {
+		number[0] = n;
+	} else {
+		for (unsigned i = len - 1; i > 0; i--, n >>= 6) {
+			number[i] = 0x80 | (n & 0x3F);
+		}
+		number[0] = (0xFF << (8 - len)) | n;
+	}
+	finfo_buf_append(dst, number, len);
+
+	uint8_t crc8 = crc8_update(0, (unsigned char *)dst->data + start,
+							   dst->len - start);
+	finfo_buf_append(dst, &crc8, 1);
+
+	// Two constant subframes of value 0.
+	put_zeros(dst, 6);
+
+	uint16_t crc16 = crc16_update(0, (unsigned char *)dst->data + start,
+								  dst->len - start);
+	put_be(dst, crc16, 2);
+}
+
+static void flac_put_block_header(struct finfo_buf *dst, bool last,
+								  unsigned type, uint32_t len) {
+	put_be(dst, (last ? 0x80 : 0) | type, 1);
+	put_be(dst, len, 3);
+}
+
+static void flac_put_streaminfo(struct finfo_buf *dst,
+								const struct finfo_gen_flac *opts) {
+	size_t min_frame = flac_frame_len(0);
+	size_t max_frame = flac_frame_len(opts->frames_n - 1);
+	uint64_t samples = (uint64_t)opts->frames_n * FINFO_GEN_FLAC_BLOCK_SIZE;
+
+	put_be(dst, FINFO_GEN_FLAC_BLOCK_SIZE, 2);
+	put_be(dst, FINFO_GEN_FLAC_BLOCK_SIZE, 2);
+	put_be(dst, min_frame, 3);
+	put_be(dst, max_frame, 3);
+	// Sample rate, channels - 1, bits per sample - 1 and total samples.
+	put_be(dst, (44100ULL << 44) | (1ULL << 41) | (15ULL << 36) | samples, 8);
+
+	// MD5 of the decoded samples, all zeros.
+	static const unsigned char zeros[4096];
+	struct finfo_md5 md5;
+	finfo_md5_init(&md5);
+	for (uint64_t left = samples * 4; left > 0;) {
+		size_t n = left < sizeof(zeros) ? left : sizeof(zeros);
+		finfo_md5_update(&md5, zeros, n);
+		left -= n;
+	}
+	unsigned char digest[16];
+	finfo_md5_final(&md5, digest);
+	finfo_buf_append(dst, digest, sizeof(digest));
+}
+
+static void flac_put_seek_table(struct finfo_buf *dst,
+								const struct finfo_gen_flac *opts) {
+	uint64_t offset = 0;
+	uint32_t frame  = 0;
+	for (uint32_t i = 0; i < opts->seek_points_n; i++) {
+		uint32_t target = (uint64_t)i * opts->frames_n / opts->seek_points_n;
+		for (; frame < target; frame++) { offset += flac_frame_len(frame); }
+
+		put_be(dst, (uint64_t)frame * FINFO_GEN_FLAC_BLOCK_SIZE, 8);
+		put_be(dst, offset, 8);
+		put_be(dst, FINFO_GEN_FLAC_BLOCK_SIZE, 2);
+	}
+}
+
+static void flac_put_vorbis_comment(struct finfo_buf *dst,
+									const struct finfo_gen_flac *opts,
+									uint64_t *rand) {
+	static const char vendor[] = "finfo bench";
+	put_le(dst, sizeof(vendor) - 1, 4);
+	finfo_buf_append(dst, vendor, sizeof(vendor) - 1);
+
+	size_t keys_n = sizeof(vorbis_keys) / sizeof(*vorbis_keys);
+	put_le(dst, opts->comments_n, 4);
+	for (uint32_t i = 0; i < opts->comments_n; i++) {
+		const char *key	 = vorbis_keys[i % keys_n];
+		size_t value_len = 4 + finfo_gen_rand(rand) % 37;
+		put_le(dst, strlen(key) + 1 + value_len, 4);
+		finfo_buf_append_str(dst, key);
+		finfo_buf_append(dst, "=", 1);
+		put_word(dst, rand, value_len);
+	}
+}
+
+static void flac_put_cuesheet(struct finfo_buf *dst,
+							  const struct finfo_gen_flac *opts,
+							  uint64_t *rand) {
+	uint64_t samples = (uint64_t)opts->frames_n * FINFO_GEN_FLAC_BLOCK_SIZE;
+
+	static const char catalog[] = "1234567890123";
+	finfo_buf_append(dst, catalog, sizeof(catalog) - 1);
+	put_zeros(dst, 128 - (sizeof(catalog) - 1));
+	put_be(dst, 88200, 8);
+	// CD-DA flag, then reserved bits.
+	put_be(dst, 0x80, 1);
+	put_zeros(dst, 258);
+	put_be(dst, opts->cue_tracks_n + 1, 1);
+
+	for (uint32_t i = 0; i < opts->cue_tracks_n; i++) {
+		// Tracks of CD-DA start on a frame of 588 samples.
+		uint64_t offset = samples * i / opts->cue_tracks_n / 588 * 588;
+		put_be(dst, offset, 8);
+		put_be(dst, i + 1, 1);
+		finfo_buf_append(dst, "ZZXX0", 5);
+		put_word(dst, rand, 7);
+		// Audio track without pre-emphasis, then reserved bits.
+		put_zeros(dst, 14);
+
+		// A pregap before every track but the first one.
+		unsigned points_n = i == 0 ? 1 : 2;
+		put_be(dst, points_n, 1);
+		for (unsigned j = 0; j < points_n; j++) {
+			put_be(dst, j == 0 ? 0 : 2 * 588, 8);
+			put_be(dst, i == 0 ? 1 : j, 1);
+			put_zeros(dst, 3);
+		}
+	}
+
+	// Lead-out track.
+	put_be(dst, samples, 8);
+	put_be(dst, 170, 1);
+	put_zeros(dst, 12 + 14);
+	put_be(dst, 0, 1);
+}
+
+static bool flac_put_picture(struct finfo_buf *dst,
+							 const struct finfo_gen_flac *opts) {
+	struct finfo_buf png;
+	finfo_buf_init(&png);
+	struct finfo_gen_png png_opts = {
+		.width	= opts->picture_width,
+		.height = opts->picture_height,
+		.idat_n = 1,
+		.seed	= opts->seed,
+	};
+	if (!finfo_gen_png(&png_opts, &png)) {
+		finfo_buf_free(&png);
+		return false;
+	}
+
+	static const char media_type[]	= "image/png";
+	static const char description[] = "Cover";
+	// Front cover.
+	put_be(dst, 3, 4);
+	put_be(dst, sizeof(media_type) - 1, 4);
+	finfo_buf_append(dst, media_type, sizeof(media_type) - 1);
+	put_be(dst, sizeof(description) - 1, 4);
+	finfo_buf_append(dst, description, sizeof(description) - 1);
+	put_be(dst, opts->picture_width, 4);
+	put_be(dst, opts->picture_height, 4);
+	put_be(dst, 24, 4);
+	put_be(dst, 0, 4);
+	put_be(dst, png.len, 4);
+	finfo_buf_append(dst, png.data, png.len);
+
+	finfo_buf_free(&png);
+	return true;
+}
+
+bool finfo_gen_flac(const struct finfo_gen_flac *opts, struct finfo_buf *dst) {
+	if (opts->frames_n == 0 || opts->frames_n > 1U << 24 ||
+		opts->seek_points_n > opts->frames_n || opts->cue_tracks_n > 99) {
+		return false;
+	}
+
+	uint64_t rand = gen_seed(opts->seed);
+	bool picture  = opts->picture_width > 0 && opts->picture_height > 0;
+
+	// Blocks in the order encoders usually write them.
+	enum { STREAMINFO, SEEK_TABLE, VORBIS, CUESHEET, PICTURE, PADDING };
+	static const unsigned types[] = {0, 3, 4, 5, 6, 1};
+	bool present[] = {
+		true,
+		opts->seek_points_n > 0,
+		true,
+		opts->cue_tracks_n > 0,
+		picture,
+		opts->padding_len > 0,
+	};
+	size_t blocks_n = sizeof(types) / sizeof(*types);
+	size_t last		= 0;
+	for (size_t i = 0; i < blocks_n; i++) {
+		if (present[i]) { last = i; }
+	}
+
+	finfo_buf_append(dst, flac_signature, sizeof(flac_signature));
+	for (size_t i = 0; i < blocks_n; i++) {
+		if (!present[i]) { continue; }
+
+		// The length is filled once the block is written.
+		size_t header = dst->len;
+		flac_put_block_header(dst, i == last, types[i], 0);
+
+		switch (i) {
+		case STREAMINFO:
+			flac_put_streaminfo(dst, opts);
+			break;
+		case SEEK_TABLE:
+			flac_put_seek_table(dst, opts);
+			break;
+		case VORBIS:
+			flac_put_vorbis_comment(dst, opts, &rand);
+			break;
+		case CUESHEET:
+			flac_put_cuesheet(dst, opts, &rand);
+			break;
+		case PICTURE:
+			if (!flac_put_picture(dst, opts)) { return false; }
+			break;
+		case PADDING:
+			put_zeros(dst, opts->padding_len);
+			break;
+		}
+
+		size_t len = dst->len - header - 4;
+		if (len >= 1U << 24) { return false; }
+		unsigned char *length = (unsigned char *)dst->data + header + 1;
+		length[0]			  = len >> 16;
+		length[1]			  = len >> 8;
+		length[2]			  = len;
+	}
+
+	for (uint32_t n = 0; n < opts->frames_n; n++) { flac_put_frame(dst, n); }
+	return true;
+}
+
+/*
+ * PNG
+ */
+
+static void png_put_chunk(struct finfo_buf *dst, const char type[4],
+						  const void *data, size_t len) {
+	put_be(dst, len, 4);
+	size_t start = dst->len;
+	finfo_buf_append(dst, type, 4);
+	if (len > 0) { finfo_buf_append(dst, data, len); }
+	uint32_t crc =
+		crc32_update(0, (unsigned char *)dst->data + start, len + 4);
+	put_be(dst, crc, 4);
+}
+
+bool finfo_gen_png(const struct finfo_gen_png *opts, struct finfo_buf *dst) {
+	if (opts->width == 0 || opts->height == 0 || opts->width > 1U << 14 ||
+		opts->height > 1U << 14 || opts->idat_n == 0) {
+		return false;
+	}
+
+	uint64_t rand = gen_seed(opts->seed);
+
+	finfo_buf_append(dst, png_signature, sizeof(png_signature));
+
+	// 8 bit RGB, no interlacing.
+	unsigned char header[13];
+	for (int i = 0; i < 4; i++) {
+		header[i]	  = opts->width >> (24 - 8 * i);
+		header[4 + i] = opts->height >> (24 - 8 * i);
+	}
+	memcpy(header + 8, (unsigned char[]){8, 2, 0, 0, 0}, 5);
+	png_put_chunk(dst, "IHDR", header, sizeof(header));
+
+	struct finfo_buf text;
+	finfo_buf_init(&text);
+	for (uint32_t i = 0; i < opts->text_n; i++) {
+		text.len = 0;
+		finfo_buf_append_str(&text, "Comment");
+		finfo_buf_append(&text, "", 1);
+		put_word(&text, &rand, 8 + finfo_gen_rand(&rand) % 120);
+		png_put_chunk(dst, "tEXt", text.data, text.len);
+	}
+	finfo_buf_free(&text);
+
+	// Gradients with a noisy blue channel, each row without filter.
+	size_t row_len = 1 + 3 * (size_t)opts->width;
+	size_t raw_len = row_len * opts->height;
+	unsigned char *raw = malloc(raw_len);
+	uLongf packed_len  = compressBound(raw_len);
+	unsigned char *packed = malloc(packed_len);
+	if (raw == NULL || packed == NULL) {
+		free(raw);
+		free(packed);
+		return false;
+	}
+	for (uint32_t y = 0; y < opts->height; y++) {
+		unsigned char *row = raw + y * row_len;
+		row[0]			   = 0;
+		for (uint32_t x = 0; x < opts->width; x++) {
+			row[1 + 3 * x] = x * 255 / opts->width;
+			row[2 + 3 * x] = y * 255 / opts->height;
+			row[3 + 3 * x] = finfo_gen_rand(&rand) & 0x3F;
+		}
+	}
+	bool ok = compress2(packed, &packed_len, raw, raw_len, 6) == Z_OK;
+	free(raw);
+
+	if (ok) {
+		// Split in chunks as even as possible, the last ones may be empty.
+		size_t chunk_len =
+			(packed_len + opts->idat_n - 1) / opts->idat_n;
+		size_t offset = 0;
+		for (uint32_t i = 0; i < opts->idat_n; i++) {
+			size_t len = packed_len - offset;
+			if (len > chunk_len) { len = chunk_len; }
+			png_put_chunk(dst, "IDAT", packed + offset, len);
+			offset += len;
+		}
+		png_put_chunk(dst, "IEND", NULL, 0);
+	}
+	free(packed);
+	return ok;
+}
+
+/*
+ * Corpus
+ */
+
+bool finfo_gen_write(const char *path, const void *data, size_t len) {
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) { return false; }
+
+	const char *next = data;
+	while (len > 0) {
+		ssize_t n = write(fd, next, len);
+		if (n < 0) {
+			int err = errno;
+			close(fd);
+			errno = err;
+			return false;
+		}
+		next += n;
+		len -= n;
+	}
+	return close(fd) == 0;
+}
+
+bool finfo_gen_corpus(const char *dir, size_t files_n, uint64_t seed,
+					  uint64_t *bytes) {
+	uint64_t rand	= gen_seed(seed);
+	uint64_t total = 0;
+
+	struct finfo_buf file;
+	finfo_buf_init(&file);
+	char path[4096];
+	bool ok = true;
+
+	for (size_t i = 0; i < files_n && ok; i++) {
+		file.len		= 0;
+		uint64_t r		= finfo_gen_rand(&rand);
+		uint64_t s		= finfo_gen_rand(&rand);
+		const char *ext = i % 2 ? "png" : "flac";
+
+		// Mostly small files, some with a cuesheet or a cover.
+		if (i % 2 == 0) {
+			uint32_t frames_n	  = 1 + r % 64;
+			struct finfo_gen_flac opts = {
+				.frames_n	   = frames_n,
+				.comments_n	   = (r >> 8) % 48,
+				.seek_points_n = (r >> 16) % (frames_n < 32 ? frames_n : 32),
+				.cue_tracks_n  = (r >> 24) % 4 == 0 ? 1 + (r >> 26) % 20 : 0,
+				.padding_len   = (r >> 32) % 2 ? 8192 : 0,
+				.seed		   = s,
+			};
+			if ((r >> 34) % 3 == 0) {
+				opts.picture_width	= 64 + (r >> 36) % 256;
+				opts.picture_height = opts.picture_width;
+			}
+			ok = finfo_gen_flac(&opts, &file);
+		} else {
+			struct finfo_gen_png opts = {
+				.width	= 16 + r % 240,
+				.height = 16 + (r >> 12) % 240,
+				.idat_n = 1 + (r >> 24) % 8,
+				.text_n = (r >> 28) % 6,
+				.seed	= s,
+			};
+			ok = finfo_gen_png(&opts, &file);
+		}
+		if (!ok) {
+			errno = EINVAL;
+			break;
+		}
+
+		snprintf(path, sizeof(path), "%s/%06zu.%s", dir, i, ext);
+		ok = finfo_gen_write(path, file.data, file.len);
+		total += file.len;
+	}
+
+	finfo_buf_free(&file);
+	if (bytes != NULL) { *bytes = total; }
+	return ok;
+}
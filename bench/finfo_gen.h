@@ -0,0 +1,72 @@
+#ifndef FINFO_GEN_H
+#define FINFO_GEN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "finfo_output.h"
+
+/*
+ * Deterministic generator of synthetic FLAC and PNG files, for the
+ * benchmarks. The same options and seed always give the same bytes.
+ */
+
+// Samples in every generated FLAC frame.
+#define FINFO_GEN_FLAC_BLOCK_SIZE 4096
+
+struct finfo_gen_flac {
+	// Frames of silence, 16 bit stereo at 44.1 kHz.
+	uint32_t frames_n;
+	// Fields of the vorbis comment block, which is always present.
+	uint32_t comments_n;
+	// Seek points, no seek table if 0. At most one per frame.
+	uint32_t seek_points_n;
+	// Tracks of a CD-DA cuesheet besides the lead-out, no cuesheet if 0.
+	// At most 99.
+	uint32_t cue_tracks_n;
+	// Size of a PNG picture block, no picture if either is 0.
+	uint32_t picture_width;
+	uint32_t picture_height;
+	// Bytes of the padding block, no padding if 0.
+	uint32_t padding_len;
+	uint64_t seed;
+};
+
+struct finfo_gen_png {
+	// Size of the 8 bit RGB image.
+	uint32_t width;
+	uint32_t height;
+	// Number of IDAT chunks the compressed image is split into, at least 1.
+	uint32_t idat_n;
+	// Ancillary tEXt chunks before the image data.
+	uint32_t text_n;
+	uint64_t seed;
+};
+
+// Next value of the xorshift generator STATE, which must not be 0.
+uint64_t finfo_gen_rand(uint64_t *state);
+
+/*
+ * Append to DST the FLAC file described by OPTS, which frames decode to
+ * silence matching the MD5 of the streaminfo.
+ * Returns false if the options are out of range.
+ */
+bool finfo_gen_flac(const struct finfo_gen_flac *opts, struct finfo_buf *dst);
+/*
+ * Append to DST the PNG file described by OPTS.
+ * Returns false if the options are out of range, or on compression failure.
+ */
+bool finfo_gen_png(const struct finfo_gen_png *opts, struct finfo_buf *dst);
+
+/*
+ * Write FILES_N files with various options drawn from SEED inside the
+ * existing directory DIR, half FLAC and half PNG. If not NULL, BYTES is set
+ * to their total size. On failure returns false and sets errno.
+ */
+bool finfo_gen_corpus(const char *dir, size_t files_n, uint64_t seed,
+					  uint64_t *bytes);
+
+// Write the LEN bytes of DATA to a new file at PATH, sets errno on failure.
+bool finfo_gen_write(const char *path, const void *data, size_t len);
+
+#endif // !FINFO_GEN_H
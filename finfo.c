@@ -1,38 +1,743 @@
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
 #include <errno.h>
-#include "finfo_flac.h"
-#include "finfo_png.h"
+#include <getopt.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "finfo_cache.h"
+#include "finfo_edit.h"
+#include "finfo_emit.h"
+#include "finfo_fields.h"
+#include "finfo_format.h"
+#include "finfo_index.h"
+#include "finfo_input.h"
+#include "finfo_options.h"
+#include "finfo_output.h"
+#include "finfo_pool.h"
+#include "finfo_prefetch.h"
+#include "finfo_watch.h"
+
+// Number of files that can be completed ahead of the next one to print,
+// per worker.
+#define FINFO_REORDER_WINDOW 64
+
+// Size of the buffer of stdout when it is not a terminal.
+#define FINFO_STDOUT_BUFFER (1 << 20)
+
+struct finfo_job {
+	char *path;
+	// Output of the file, or its terms when building an index.
+	struct finfo_buf out;
+	bool recognized;
+	// Events captured for the cache, when the file wasn't found in it.
+	struct finfo_buf events;
+	struct finfo_cache_key key;
+	bool cacheable;
+	// The file was deleted, in watch mode.
+	bool deleted;
+};
+
+struct finfo_batch {
+	struct finfo_job *jobs;
+	size_t jobs_n;
+	size_t jobs_cap;
+	// Print a header before the output of each file.
+	bool headers;
+	// Number of files printed so far.
+	size_t printed_n;
+	// Tell what happened to each file, after the first pass of watch mode.
+	bool changes;
+	// True if every file was recognized.
+	bool all_recognized;
+	// Output of the files already parsed, NULL if not used.
+	struct finfo_cache *cache;
+	// Files opened and read ahead, NULL if not used.
+	struct finfo_prefetch *prefetch;
+	// Index the files are added to instead of being printed, NULL if not
+	// building one.
+	struct finfo_index_builder *index;
+	// Changes made to the files instead of printing them, NULL if none.
+	const struct finfo_edit *edit;
+};
+
+static void usage(const char *name) {
+	printf("Usage: %s [OPTION]... FILE...\n", name);
+	printf("Print information about FILEs, recursing into directories.\n\n");
+	printf("  -j, --jobs=N  number of worker threads (default: one per CPU)\n");
+	printf("      --verify  check the checksums stored in the files\n");
+	printf("      --seek=SAMPLE\n");
+	printf("                find the audio frame containing SAMPLE\n");
+	printf("      --format=FORMAT\n");
+	printf("                output format: text (default), json or ndjson\n");
+	printf("      --fields=LIST\n");
+	printf("                only print the comma separated fields in LIST, "
+		   "reading\n");
+	printf("                just the parts of the files holding them\n");
+	printf("      --build-index=INDEX\n");
+	printf("                save the vorbis comments of FILEs to INDEX instead "
+		   "of\n");
+	printf("                printing them\n");
+	printf("      --query=INDEX\n");
+	printf("                print the paths of the files in INDEX matching "
+		   "every\n");
+	printf("                NAME=VALUE or NAME=PREFIX* given instead of "
+		   "FILEs\n");
+	printf("      --set-tag=NAME=VALUE\n");
+	printf("                set the vorbis comment NAME of FILEs to VALUE, "
+		   "replacing\n");
+	printf("                the others called NAME, instead of printing "
+		   "them\n");
+	printf("      --remove-tag=NAME\n");
+	printf("                remove the vorbis comments NAME of FILEs\n");
+	printf("      --set-picture=IMAGE\n");
+	printf("                use the PNG or JPEG IMAGE as the front cover of "
+		   "FILEs\n");
+	printf("      --cache=FILE\n");
+	printf("                reuse the information of unchanged files saved in "
+		   "FILE,\n");
+	printf("                when images are not displayed\n");
+	printf("      --watch\n");
+	printf("                keep printing the files as they change, as "
+		   "ndjson unless\n");
+	printf("                another format is given\n");
+	printf("      --no-images\n");
+	printf("                don't read or display embedded images\n");
+	printf("      --transmission=MODE\n");
+	printf("                how images are sent to the terminal: auto "
+		   "(default),\n");
+	printf("                direct, file, temp or shm\n");
+	printf("  -h, --help    display this help and exit\n");
+}
+
+static bool parse_transmission(const char *mode) {
+	static const struct {
+		const char *name;
+		enum finfo_kitty_transmission value;
+	} modes[] = {
+		{"auto", FINFO_KITTY_AUTO}, {"direct", FINFO_KITTY_DIRECT},
+		{"file", FINFO_KITTY_FILE}, {"temp", FINFO_KITTY_TEMP},
+		{"shm", FINFO_KITTY_SHM},
+	};
+
+	for (size_t i = 0; i < sizeof(modes) / sizeof(*modes); i++) {
+		if (strcmp(mode, modes[i].name) == 0) {
+			finfo_opts.kitty_transmission = modes[i].value;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void batch_add(struct finfo_batch *batch, const char *path) {
+	if (batch->jobs_n == batch->jobs_cap) {
+		batch->jobs_cap = batch->jobs_cap ? batch->jobs_cap * 2 : 64;
+		batch->jobs =
+			realloc(batch->jobs, batch->jobs_cap * sizeof(*batch->jobs));
+		if (batch->jobs == NULL) {
+			perror("finfo");
+			exit(1);
+		}
+	}
+
+	struct finfo_job *job = &batch->jobs[batch->jobs_n++];
+	job->path			  = strdup(path);
+	job->recognized		  = false;
+	job->cacheable		  = false;
+	job->deleted		  = false;
+	finfo_buf_init(&job->out);
+	finfo_buf_init(&job->events);
+}
+
+/*
+ * Add every file under the directory PATH to the batch.
+ * Entries are sorted by name so that the output is the same between runs,
+ * and symbolic links to directories are not followed, to avoid loops.
+ */
+static void batch_add_dir(struct finfo_batch *batch, const char *path) {
+	struct dirent **entries;
+	int entries_n = scandir(path, &entries, NULL, alphasort);
+	if (entries_n < 0) {
+		fprintf(stderr, "Unable to open directory: %s (%s).\n", path,
+				strerror(errno));
+		batch->all_recognized = false;
+		return;
+	}
+
+	size_t path_len = strlen(path);
+	for (int i = 0; i < entries_n; i++) {
+		struct dirent *entry = entries[i];
+		if (strcmp(entry->d_name, ".") == 0 ||
+			strcmp(entry->d_name, "..") == 0) {
+			free(entry);
+			continue;
+		}
+
+		size_t child_len = path_len + 1 + strlen(entry->d_name) + 1;
+		char *child		 = malloc(child_len);
+		snprintf(child, child_len, "%s%s%s", path,
+				 path[path_len - 1] == '/' ? "" : "/", entry->d_name);
+
+		unsigned char type = entry->d_type;
+		if (type == DT_UNKNOWN) {
+			struct stat st;
+			if (lstat(child, &st) == 0 && S_ISDIR(st.st_mode)) {
+				type = DT_DIR;
+			}
+		}
+
+		if (type == DT_DIR) {
+			batch_add_dir(batch, child);
+		} else {
+			batch_add(batch, child);
+		}
+
+		free(child);
+		free(entry);
+	}
+
+	free(entries);
+}
+
+// Collect the terms of the job I, to add it to the index.
+static void batch_index_work(struct finfo_batch *batch, size_t i) {
+	struct finfo_job *job = &batch->jobs[i];
+
+	struct finfo_input in;
+	bool opened = batch->prefetch != NULL
+					  ? finfo_prefetch_open(batch->prefetch, i, &in, job->path)
+					  : finfo_input_open(&in, job->path);
+	if (!opened) {
+		fprintf(stderr, "Unable to open file: %s (%s).\n", job->path,
+				strerror(errno));
+		return;
+	}
+
+	job->recognized = true;
+	finfo_index_terms(&in, &job->out);
+	finfo_input_close(&in);
+}
+
+// Edit the file of the job I, and print how.
+static void batch_edit_work(struct finfo_batch *batch, size_t i) {
+	struct finfo_job *job = &batch->jobs[i];
+
+	bool rewritten;
+	if (!finfo_edit_file(batch->edit, job->path, &rewritten)) {
+		finfo_emit_error("Unable to edit file: %s (%s).", job->path,
+						 errno == EINVAL ? "not a valid FLAC file"
+										 : strerror(errno));
+		return;
+	}
+
+	// Files are rewritten when their padding is too small.
+	const char *how = rewritten ? "rewritten" : "in place";
+	finfo_emit_str("edit", "Edit", how, strlen(how));
+	job->recognized = true;
+}
+
+static void batch_work(void *ctx, size_t i) {
+	struct finfo_batch *batch = ctx;
+	struct finfo_job *job	  = &batch->jobs[i];
+
+	if (batch->index != NULL) {
+		batch_index_work(batch, i);
+		return;
+	}
+
+	finfo_out = &job->out;
+	finfo_emit_record_begin(job->path, batch->headers);
+
+	if (batch->edit != NULL) {
+		batch_edit_work(batch, i);
+		finfo_emit_record_end();
+		finfo_out = NULL;
+		return;
+	}
+
+	if (batch->changes) {
+		const char *event = job->deleted ? "deleted" : "changed";
+		finfo_emit_str("event", "Event", event, strlen(event));
+	}
+	if (job->deleted) {
+		job->recognized = true;
+		finfo_emit_record_end();
+		finfo_out = NULL;
+		return;
+	}
+
+	// Files found in the cache are not even opened.
+	struct stat st;
+	struct finfo_cache_entry entry;
+	if (batch->cache != NULL && stat(job->path, &st) == 0 &&
+		S_ISREG(st.st_mode)) {
+		finfo_cache_key_init(&job->key, &st);
+		if (finfo_cache_find(batch->cache, &job->key, &entry) &&
+			finfo_emit_replay(entry.events, entry.events_len)) {
+			job->recognized = entry.recognized;
+			finfo_emit_record_end();
+			finfo_out = NULL;
+			return;
+		}
+	}
+
+	struct finfo_input in;
+	bool opened = batch->prefetch != NULL
+					  ? finfo_prefetch_open(batch->prefetch, i, &in, job->path)
+					  : finfo_input_open(&in, job->path);
+	if (!opened) {
+		finfo_emit_error("Unable to open file: %s (%s).", job->path,
+						 strerror(errno));
+		finfo_emit_record_end();
+		finfo_out = NULL;
+		return;
+	}
+
+	// The key comes from the opened file, in case it was just replaced.
+	if (batch->cache != NULL && S_ISREG(in.st.st_mode)) {
+		finfo_cache_key_init(&job->key, &in.st);
+		job->cacheable = true;
+		finfo_emit_capture(&job->events);
+	}
+
+	const struct finfo_format *format = finfo_format_detect(&in);
+	if (format == NULL) {
+		finfo_emit_error("Unknown file type.");
+	} else {
+		finfo_emit_str("format", NULL, format->name, strlen(format->name));
+		job->recognized = format->parse(&in);
+		finfo_emit_bool("valid", NULL, job->recognized);
+	}
+
+	finfo_emit_capture(NULL);
+	finfo_input_close(&in);
+	finfo_emit_record_end();
+	finfo_out = NULL;
+}
+
+static void batch_done(void *ctx, size_t i) {
+	struct finfo_batch *batch = ctx;
+	struct finfo_job *job	  = &batch->jobs[i];
+
+	if (batch->index != NULL) {
+		if (!finfo_index_builder_add(batch->index, job->path, job->out.data,
+									 job->out.len)) {
+			perror("finfo");
+			exit(1);
+		}
+	} else {
+		if (batch->printed_n++ > 0) {
+			fputs(finfo_opts.emitter->separator, stdout);
+		}
+		finfo_buf_flush(&job->out, stdout);
+	}
+	finfo_buf_free(&job->out);
+	if (!job->recognized) { batch->all_recognized = false; }
+
+	if (job->cacheable) {
+		finfo_cache_add(batch->cache, &job->key, job->recognized,
+						job->events.data, job->events.len);
+	}
+	finfo_buf_free(&job->events);
+
+	free(job->path);
+	job->path = NULL;
+}
+
+static const char *batch_path(void *ctx, size_t i) {
+	struct finfo_batch *batch = ctx;
+	return batch->jobs[i].deleted ? NULL : batch->jobs[i].path;
+}
+
+static void batch_run(struct finfo_batch *batch, unsigned workers_n) {
+	// A single file gets all the workers for itself.
+	finfo_opts.file_workers = batch->jobs_n == 1 ? workers_n : 1;
+
+	// Files are opened ahead of the workers, except with the cache which
+	// doesn't need to open them at all, and when editing them.
+	struct finfo_prefetch prefetch;
+	if (batch->jobs_n > 1 && batch->cache == NULL && batch->edit == NULL &&
+		finfo_prefetch_start(&prefetch, batch->jobs_n, batch_path, batch)) {
+		batch->prefetch = &prefetch;
+	}
+
+	finfo_pool_run(batch->jobs_n, workers_n, workers_n * FINFO_REORDER_WINDOW,
+				   batch_work, batch_done, batch);
+
+	if (batch->prefetch != NULL) {
+		finfo_prefetch_stop(batch->prefetch);
+		batch->prefetch = NULL;
+	}
+	batch->jobs_n = 0;
+}
+
+/*
+ * Print the files changed under the paths of WATCH, every time a burst of
+ * changes settles, until interrupted.
+ */
+static void batch_watch(struct finfo_batch *batch, struct finfo_watch *watch,
+						unsigned workers_n) {
+	batch->changes = true;
+
+	while (finfo_watch_wait(watch)) {
+		for (size_t i = 0; i < watch->changes_n; i++) {
+			const struct finfo_watch_change *change = &watch->changes[i];
+
+			// Files can be gone by now, with the directory they were in,
+			// and the ones replaced by a rename are back.
+			struct stat st;
+			bool found = stat(change->path, &st) == 0;
+			if (!found &&
+				(change->event == FINFO_WATCH_DELETED || errno == ENOENT)) {
+				batch_add(batch, change->path);
+				batch->jobs[batch->jobs_n - 1].deleted = true;
+			} else if (found && S_ISDIR(st.st_mode)) {
+				batch_add_dir(batch, change->path);
+			} else {
+				batch_add(batch, change->path);
+			}
+		}
+
+		batch_run(batch, workers_n);
+		fflush(stdout);
+	}
+}
+
+/*
+ * Add the files of BATCH to a new index, saved to PATH.
+ * Returns false if it can't be saved.
+ */
+static bool build_index(struct finfo_batch *batch, const char *path,
+						unsigned workers_n) {
+	struct finfo_index_builder builder;
+	finfo_index_builder_init(&builder);
+	batch->index = &builder;
+	batch_run(batch, workers_n);
+	batch->index = NULL;
+
+	bool saved = finfo_index_builder_save(&builder, path);
+	if (!saved) {
+		fprintf(stderr, "Unable to save index: %s (%s).\n", path,
+				strerror(errno));
+	}
+	finfo_index_builder_free(&builder);
+	return saved;
+}
+
+/*
+ * Print the paths of the files in the index at PATH matching all the
+ * QUERIES_N QUERIES, without opening them.
+ */
+static int query(const char *path, int queries_n, char *queries[]) {
+	struct finfo_index index;
+	if (!finfo_index_open(&index, path)) {
+		fprintf(stderr, "Unable to open index: %s (%s).\n", path,
+				errno == EINVAL ? "not an index" : strerror(errno));
+		return 1;
+	}
+
+	struct finfo_index_result result = {0};
+	for (int i = 0; i < queries_n; i++) {
+		struct finfo_index_result matches;
+		if (!finfo_index_lookup(&index, queries[i], &matches)) {
+			if (errno == EINVAL) {
+				fprintf(stderr, "Invalid query: %s\n", queries[i]);
+			} else {
+				perror("finfo");
+			}
+			finfo_index_result_free(&result);
+			finfo_index_close(&index);
+			return 1;
+		}
+
+		if (i == 0) {
+			result = matches;
+		} else {
+			finfo_index_result_intersect(&result, &matches);
+			finfo_index_result_free(&matches);
+		}
+	}
+
+	for (size_t i = 0; i < result.files_n; i++) {
+		const char *file = finfo_index_path(&index, result.files[i]);
+		if (file != NULL) { puts(file); }
+	}
+
+	finfo_index_result_free(&result);
+	finfo_index_close(&index);
+	return 0;
+}
 
 int main(int argc, char *argv[]) {
+#ifdef DEBUG
 	for (int i = 0; i < argc; printf("- %s\n", argv[i++])) {}
+#endif
+
+	enum {
+		OPT_VERIFY = 256,
+		OPT_SEEK,
+		OPT_FORMAT,
+		OPT_FIELDS,
+		OPT_BUILD_INDEX,
+		OPT_QUERY,
+		OPT_SET_TAG,
+		OPT_REMOVE_TAG,
+		OPT_SET_PICTURE,
+		OPT_CACHE,
+		OPT_WATCH,
+		OPT_NO_IMAGES,
+		OPT_TRANSMISSION,
+	};
+	static const struct option long_options[] = {
+		{"jobs", required_argument, NULL, 'j'},
+		{"verify", no_argument, NULL, OPT_VERIFY},
+		{"seek", required_argument, NULL, OPT_SEEK},
+		{"format", required_argument, NULL, OPT_FORMAT},
+		{"fields", required_argument, NULL, OPT_FIELDS},
+		{"build-index", required_argument, NULL, OPT_BUILD_INDEX},
+		{"query", required_argument, NULL, OPT_QUERY},
+		{"set-tag", required_argument, NULL, OPT_SET_TAG},
+		{"remove-tag", required_argument, NULL, OPT_REMOVE_TAG},
+		{"set-picture", required_argument, NULL, OPT_SET_PICTURE},
+		{"cache", required_argument, NULL, OPT_CACHE},
+		{"watch", no_argument, NULL, OPT_WATCH},
+		{"no-images", no_argument, NULL, OPT_NO_IMAGES},
+		{"transmission", required_argument, NULL, OPT_TRANSMISSION},
+		{"help", no_argument, NULL, 'h'},
+		{NULL, 0, NULL, 0},
+	};
+
+	unsigned workers_n	   = finfo_pool_default_workers();
+	const char *cache_path = NULL;
+	const char *index_path = NULL;
+	const char *query_path = NULL;
+	bool watch_mode		   = false;
+	bool format_set		   = false;
+	struct finfo_fields fields;
+	struct finfo_edit edit;
+	finfo_edit_init(&edit);
+
+	int opt;
+	while ((opt = getopt_long(argc, argv, "j:h", long_options, NULL)) != -1) {
+		switch (opt) {
+		case 'j': {
+			char *end;
+			long n = strtol(optarg, &end, 10);
+			if (*end != '\0' || n < 1) {
+				fprintf(stderr, "Invalid number of jobs: %s\n", optarg);
+				return 1;
+			}
+			workers_n = n;
+			break;
+		}
+		case OPT_VERIFY:
+			finfo_opts.verify = true;
+			break;
+		case OPT_SEEK: {
+			char *end;
+			errno					= 0;
+			unsigned long long n	= strtoull(optarg, &end, 10);
+			if (*end != '\0' || *optarg == '-' || errno != 0) {
+				fprintf(stderr, "Invalid sample number: %s\n", optarg);
+				return 1;
+			}
+			finfo_opts.seek		   = true;
+			finfo_opts.seek_sample = n;
+			break;
+		}
+		case OPT_FORMAT:
+			finfo_opts.emitter = finfo_emitter_find(optarg);
+			if (finfo_opts.emitter == NULL) {
+				fprintf(stderr, "Invalid output format: %s\n", optarg);
+				return 1;
+			}
+			format_set = true;
+			break;
+		case OPT_FIELDS:
+			if (finfo_opts.fields != NULL) { finfo_fields_free(&fields); }
+			if (!finfo_fields_parse(&fields, optarg)) {
+				fprintf(stderr, "Invalid field list: %s\n", optarg);
+				return 1;
+			}
+			finfo_opts.fields = &fields;
+			break;
+		case OPT_BUILD_INDEX:
+			index_path = optarg;
+			break;
+		case OPT_QUERY:
+			query_path = optarg;
+			break;
+		case OPT_SET_TAG:
+			if (!finfo_edit_add_set(&edit, optarg)) {
+				fprintf(stderr, "Invalid comment: %s\n", optarg);
+				return 1;
+			}
+			break;
+		case OPT_REMOVE_TAG:
+			if (!finfo_edit_add_remove(&edit, optarg)) {
+				fprintf(stderr, "Invalid comment name: %s\n", optarg);
+				return 1;
+			}
+			break;
+		case OPT_SET_PICTURE:
+			if (!finfo_edit_set_picture(&edit, optarg)) {
+				fprintf(stderr, "Unable to read picture: %s (%s).\n", optarg,
+						errno == EINVAL ? "not a PNG or JPEG image"
+										: strerror(errno));
+				return 1;
+			}
+			break;
+		case OPT_CACHE:
+			cache_path = optarg;
+			break;
+		case OPT_WATCH:
+			watch_mode = true;
+			break;
+		case OPT_NO_IMAGES:
+			finfo_opts.no_images = true;
+			break;
+		case OPT_TRANSMISSION:
+			if (!parse_transmission(optarg)) {
+				fprintf(stderr, "Invalid transmission mode: %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'h':
+			usage(argv[0]);
+			return 0;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (optind >= argc) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	// Queries only read the index.
+	if (query_path != NULL) {
+		return query(query_path, argc - optind, argv + optind);
+	}
+	if (index_path != NULL && watch_mode) {
+		fprintf(stderr, "Watch mode can't build an index.\n");
+		return 1;
+	}
+	if (finfo_edit_any(&edit) &&
+		(watch_mode || index_path != NULL || finfo_opts.fields != NULL)) {
+		fprintf(stderr, "Files can't be edited with --watch, --build-index "
+						"or --fields.\n");
+		return 1;
+	}
 
-	if (argc != 2 || strcmp(argv[1], "-h") == 0 ||
-		strcmp(argv[1], "--help") == 0) {
-		printf("Usage: %s FILE\n", argv[0]);
+	// The fields are only read from the metadata.
+	if (finfo_opts.fields != NULL && (finfo_opts.verify || finfo_opts.seek)) {
+		fprintf(stderr, "--fields can't be used with --verify or --seek.\n");
 		return 1;
 	}
 
-	FILE *file = fopen(argv[1], "rb");
-	if (file == NULL) {
-		printf("Unable to open file: %s (%s).\n", argv[1], strerror(errno));
+	// A JSON array would never be closed.
+	if (watch_mode && !format_set) {
+		finfo_opts.emitter = &finfo_ndjson_emitter;
+	}
+	if (watch_mode && *finfo_opts.emitter->stream_end != '\0') {
+		fprintf(stderr, "Watch mode can't print the %s format.\n",
+				finfo_opts.emitter->name);
 		return 1;
 	}
 
-	enum { FILE_TYPES_N = 2 };
-	bool (*try_type[FILE_TYPES_N])(FILE *) = {try_flac, try_png};
+	// Watches are set up first, not to miss the changes made during the
+	// first pass.
+	struct finfo_watch watch = {.fd = -1};
+	if (watch_mode && !finfo_watch_init(&watch)) {
+		fprintf(stderr, "Unable to watch files (%s).\n", strerror(errno));
+		return 1;
+	}
 
-	for (int i = 0; i < FILE_TYPES_N; i++) {
-		// Reset read position in file to make it ready for next try.
-		fseek(file, 0, SEEK_SET); // TODO: check error
+	struct finfo_batch batch = {
+		.headers		= argc - optind > 1 || watch_mode,
+		.all_recognized = true,
+	};
 
-		if (try_type[i](file)) {
-			fclose(file);
-			return 0;
+	for (int i = optind; i < argc; i++) {
+		if (watch_mode && !finfo_watch_add(&watch, argv[i])) {
+			fprintf(stderr, "Unable to watch: %s (%s).\n", argv[i],
+					strerror(errno));
+		}
+
+		struct stat st;
+		if (stat(argv[i], &st) == 0 && S_ISDIR(st.st_mode)) {
+			batch.headers = true;
+			batch_add_dir(&batch, argv[i]);
+		} else {
+			batch_add(&batch, argv[i]);
+		}
+	}
+
+	// Images can't be mixed with structured output.
+	if (!finfo_opts.emitter->images) { finfo_opts.no_images = true; }
+
+	// Output going to a pipe or a file is written in large blocks, whatever
+	// the size of the output of each file.
+	if (!isatty(STDOUT_FILENO)) {
+		setvbuf(stdout, NULL, _IOFBF, FINFO_STDOUT_BUFFER);
+	}
+
+	// The output of images is not cached: files showing them are always
+	// parsed again. Neither is the output of a selection of fields, which is
+	// cheaper to read again than the cache.
+	struct finfo_cache cache;
+	if (cache_path != NULL && finfo_opts.no_images &&
+		finfo_opts.fields == NULL && !finfo_edit_any(&edit)) {
+		if (finfo_cache_open(&cache, cache_path)) {
+			batch.cache = &cache;
+		} else {
+			fprintf(stderr, "Unable to open cache: %s (%s).\n", cache_path,
+					strerror(errno));
+			finfo_cache_close(&cache);
+		}
+	}
+
+	if (index_path != NULL) {
+		bool saved = build_index(&batch, index_path, workers_n);
+		free(batch.jobs);
+		return saved && batch.all_recognized ? 0 : 1;
+	}
+
+	// Files are edited one at a time, in case one is given twice.
+	if (finfo_edit_any(&edit)) {
+		batch.edit = &edit;
+		workers_n  = 1;
+	}
+
+	fputs(finfo_opts.emitter->stream_begin, stdout);
+	batch_run(&batch, workers_n);
+	if (watch_mode) {
+		fflush(stdout);
+		// Save the first pass, which is most of the work.
+		if (batch.cache != NULL && !finfo_cache_save(batch.cache)) {
+			fprintf(stderr, "Unable to save cache: %s (%s).\n", cache_path,
+					strerror(errno));
+		}
+		batch_watch(&batch, &watch, workers_n);
+		finfo_watch_close(&watch);
+	}
+	fputs(finfo_opts.emitter->stream_end, stdout);
+
+	if (batch.cache != NULL) {
+		if (!finfo_cache_save(batch.cache)) {
+			fprintf(stderr, "Unable to save cache: %s (%s).\n", cache_path,
+					strerror(errno));
 		}
+		finfo_cache_close(batch.cache);
 	}
 
-	fclose(file);
-	return 1;
+	free(batch.jobs);
+	if (finfo_opts.fields != NULL) { finfo_fields_free(&fields); }
+	finfo_edit_free(&edit);
+	return batch.all_recognized ? 0 : 1;
 }
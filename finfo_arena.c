@@ -0,0 +1,68 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdalign.h>
+#include "finfo_arena.h"
+
+// Size of the first block of an arena. Later blocks double in size, up to
+// FINFO_ARENA_BLOCK_MAX, unless a larger allocation needs them bigger.
+#define FINFO_ARENA_BLOCK_SIZE (4 * 1024)
+#define FINFO_ARENA_BLOCK_MAX  (1024 * 1024)
+
+struct finfo_arena_block {
+	struct finfo_arena_block *next;
+	size_t size;
+	alignas(max_align_t) unsigned char data[];
+};
+
+void finfo_arena_init(struct finfo_arena *arena) {
+	*arena = (struct finfo_arena){0};
+}
+
+void finfo_arena_reset(struct finfo_arena *arena) {
+	struct finfo_arena_block *block = arena->blocks;
+	while (block != NULL) {
+		struct finfo_arena_block *next = block->next;
+		free(block);
+		block = next;
+	}
+
+	finfo_arena_init(arena);
+}
+
+void *finfo_arena_calloc(struct finfo_arena *arena, size_t n, size_t size) {
+	if (size != 0 && n > SIZE_MAX / size) { return NULL; }
+	size_t len = n * size;
+
+	// Keep every allocation aligned by rounding up its length.
+	size_t align = alignof(max_align_t);
+	if (len > SIZE_MAX - align) { return NULL; }
+	len = (len + align - 1) & ~(align - 1);
+
+	if (len > arena->left) {
+		size_t block_size =
+			arena->blocks ? arena->blocks->size * 2 : FINFO_ARENA_BLOCK_SIZE;
+		if (block_size > FINFO_ARENA_BLOCK_MAX) {
+			block_size = FINFO_ARENA_BLOCK_MAX;
+		}
+		if (block_size < len) { block_size = len; }
+
+		struct finfo_arena_block *block =
+			malloc(sizeof(struct finfo_arena_block) + block_size);
+		if (block == NULL) { return NULL; }
+
+		block->next	   = arena->blocks;
+		block->size	   = block_size;
+		arena->blocks = block;
+		arena->next	   = block->data;
+		arena->left	   = block_size;
+	}
+
+	void *ptr = arena->next;
+	arena->next += len;
+	arena->left -= len;
+
+	// Empty allocations from an empty arena have no block to point in.
+	if (len > 0) { memset(ptr, 0, len); }
+	return ptr;
+}
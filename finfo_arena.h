@@ -0,0 +1,30 @@
+#ifndef FINFO_ARENA_H
+#define FINFO_ARENA_H
+
+#include <stddef.h>
+
+struct finfo_arena_block;
+
+/*
+ * Bump pointer allocator for the values parsed from a single file.
+ * Allocations are never freed one by one: all the memory of the arena is
+ * released at once by finfo_arena_reset.
+ */
+struct finfo_arena {
+	struct finfo_arena_block *blocks;
+	// Free space left in the current block.
+	unsigned char *next;
+	size_t left;
+};
+
+void finfo_arena_init(struct finfo_arena *arena);
+// Free all the memory allocated from ARENA, which can then be reused.
+void finfo_arena_reset(struct finfo_arena *arena);
+
+/*
+ * Allocate N zeroed elements of SIZE bytes from ARENA, aligned for any type.
+ * Returns NULL if the memory can't be allocated.
+ */
+void *finfo_arena_calloc(struct finfo_arena *arena, size_t n, size_t size);
+
+#endif // !FINFO_ARENA_H
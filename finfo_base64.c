@@ -0,0 +1,180 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "finfo_base64.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FINFO_BASE64_SIMD
+#endif
+
+static const char base64_table[] =
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static size_t (*base64_impl)(const unsigned char *data, size_t len,
+							 char *dst);
+
+static size_t base64_encode_scalar(const unsigned char *data, size_t len,
+								   char *dst) {
+	size_t data_p = 0;
+	size_t enc_p  = 0;
+
+	while (len - data_p >= 3) {
+		uint32_t triple = (data[data_p] << 16) | (data[data_p + 1] << 8) |
+						  data[data_p + 2];
+
+		dst[enc_p + 0] = base64_table[triple >> 18];
+		dst[enc_p + 1] = base64_table[(triple >> 12) & 0b111111];
+		dst[enc_p + 2] = base64_table[(triple >> 6) & 0b111111];
+		dst[enc_p + 3] = base64_table[triple & 0b111111];
+
+		data_p += 3;
+		enc_p += 4;
+	}
+
+	size_t remaining = len - data_p;
+	if (remaining == 1) {
+		dst[enc_p + 0] = base64_table[data[data_p + 0] >> 2];
+		dst[enc_p + 1] = base64_table[(data[data_p + 0] & 0b11) << 4];
+		dst[enc_p + 2] = '=';
+		dst[enc_p + 3] = '=';
+		enc_p += 4;
+	} else if (remaining == 2) {
+		dst[enc_p + 0] = base64_table[data[data_p + 0] >> 2];
+		dst[enc_p + 1] = base64_table[(data[data_p + 1] >> 4) |
+									  ((data[data_p + 0] & 0b11) << 4)];
+		dst[enc_p + 2] = base64_table[(data[data_p + 1] & 0b1111) << 2];
+		dst[enc_p + 3] = '=';
+		enc_p += 4;
+	}
+
+	return enc_p;
+}
+
+#ifdef FINFO_BASE64_SIMD
+/*
+ * The vector kernels follow "Faster Base64 Encoding and Decoding Using AVX2
+ * Instructions" (Muła, Lemire): every 3 input bytes are spread over a 32 bit
+ * lane, their four 6 bit indices are moved to separate bytes with two
+ * multiplications, and the indices are turned into ASCII by adding an offset
+ * that depends on the range they fall in.
+ */
+
+// Split the 12 bytes at the start of each 16 byte lane into 16 indices.
+__attribute__((target("ssse3"))) static __m128i
+base64_split_ssse3(__m128i in) {
+	in = _mm_shuffle_epi8(
+		in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+
+	__m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+	__m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+	__m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+	__m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+
+	return _mm_or_si128(t1, t3);
+}
+
+__attribute__((target("ssse3"))) static __m128i
+base64_lookup_ssse3(__m128i indices) {
+	// Offset of each index, picked by its range: 13 for A-Z, 0 for a-z,
+	// 1-10 for 0-9, 11 for + and 12 for /.
+	__m128i range = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+	__m128i lower = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+	range = _mm_or_si128(range, _mm_and_si128(lower, _mm_set1_epi8(13)));
+
+	const __m128i offsets = _mm_setr_epi8(
+		'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+		'0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+
+	return _mm_add_epi8(_mm_shuffle_epi8(offsets, range), indices);
+}
+
+__attribute__((target("ssse3"))) static size_t
+base64_encode_ssse3(const unsigned char *data, size_t len, char *dst) {
+	char *out = dst;
+
+	// Each iteration loads 16 bytes but only encodes the first 12.
+	while (len >= 16) {
+		__m128i in = _mm_loadu_si128((const __m128i *)data);
+		_mm_storeu_si128((__m128i *)out,
+						 base64_lookup_ssse3(base64_split_ssse3(in)));
+
+		data += 12;
+		len -= 12;
+		out += 16;
+	}
+
+	return (out - dst) + base64_encode_scalar(data, len, out);
+}
+
+__attribute__((target("avx2"))) static __m256i
+base64_split_avx2(__m256i in) {
+	in = _mm256_shuffle_epi8(
+		in, _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+							 1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+
+	__m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+	__m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+	__m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+	__m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+
+	return _mm256_or_si256(t1, t3);
+}
+
+__attribute__((target("avx2"))) static __m256i
+base64_lookup_avx2(__m256i indices) {
+	// Offset of each index, picked by its range: 13 for A-Z, 0 for a-z,
+	// 1-10 for 0-9, 11 for + and 12 for /.
+	__m256i range = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+	__m256i lower = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+	range =
+		_mm256_or_si256(range, _mm256_and_si256(lower, _mm256_set1_epi8(13)));
+
+	const __m256i offsets = _mm256_setr_epi8(
+		'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+		'0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+		'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+		'0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+
+	return _mm256_add_epi8(_mm256_shuffle_epi8(offsets, range), indices);
+}
+
+__attribute__((target("avx2"))) static size_t
+base64_encode_avx2(const unsigned char *data, size_t len, char *dst) {
+	char *out = dst;
+
+	// Each iteration encodes 24 bytes, 12 per lane. The upper lane is loaded
+	// from 12 bytes after the lower one, so 28 bytes must be readable.
+	while (len >= 28) {
+		__m256i in = _mm256_inserti128_si256(
+			_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)data)),
+			_mm_loadu_si128((const __m128i *)(data + 12)), 1);
+		_mm256_storeu_si256((__m256i *)out,
+							base64_lookup_avx2(base64_split_avx2(in)));
+
+		data += 24;
+		len -= 24;
+		out += 32;
+	}
+
+	return (out - dst) + base64_encode_ssse3(data, len, out);
+}
+#endif
+
+static void base64_init(void) {
+	base64_impl = base64_encode_scalar;
+#ifdef FINFO_BASE64_SIMD
+	if (__builtin_cpu_supports("avx2")) {
+		base64_impl = base64_encode_avx2;
+	} else if (__builtin_cpu_supports("ssse3")) {
+		base64_impl = base64_encode_ssse3;
+	}
+#endif
+}
+
+size_t base64_encode(const unsigned char *data, size_t len, char *dst) {
+	static pthread_once_t once = PTHREAD_ONCE_INIT;
+	pthread_once(&once, base64_init);
+
+	return base64_impl(data, len, dst);
+}
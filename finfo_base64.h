@@ -0,0 +1,18 @@
+#ifndef FINFO_BASE64_H
+#define FINFO_BASE64_H
+
+#include <stddef.h>
+
+// Length of the base64 encoding of LEN bytes, padding included.
+#define BASE64_ENCODED_LEN(len) ((((len) + 2) / 3) * 4)
+
+/*
+ * Base64 encode LEN bytes of DATA into DST, which must have room for
+ * BASE64_ENCODED_LEN(LEN) bytes. The result is not null terminated.
+ * Returns the number of bytes written.
+ * The fastest implementation supported by the CPU is picked at runtime,
+ * all of them give the same result.
+ */
+size_t base64_encode(const unsigned char *data, size_t len, char *dst);
+
+#endif // !FINFO_BASE64_H
@@ -0,0 +1,420 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include "finfo_cache.h"
+#include "finfo_options.h"
+
+#define CACHE_MAGIC "FINFOC02"
+// Written as a native integer, to tell files from other machines apart.
+#define CACHE_BYTE_ORDER 0x01020304u
+#define CACHE_MIN_SLOTS	 64u
+
+struct cache_header {
+	char magic[8];
+	uint32_t byte_order;
+	// Number of slots of the hash table, a power of two.
+	uint32_t slots_n;
+	uint64_t entries_n;
+	uint64_t events_len;
+	// FINFO_CACHE_VERSION of the program which wrote the file.
+	uint32_t version;
+	uint32_t reserved;
+};
+
+enum cache_slot_flags {
+	CACHE_SLOT_USED		  = 1 << 0,
+	CACHE_SLOT_RECOGNIZED = 1 << 1,
+	// Only while saving: the events are in the added ones.
+	CACHE_SLOT_ADDED = 1 << 2,
+};
+
+struct finfo_cache_slot {
+	uint64_t dev;
+	uint64_t ino;
+	uint64_t size;
+	int64_t mtime_sec;
+	uint64_t seek_sample;
+	// Position of the events of the entry among the events of the file.
+	uint64_t events_offset;
+	uint64_t events_len;
+	uint32_t mtime_nsec;
+	uint16_t options;
+	uint16_t flags;
+};
+
+_Static_assert(sizeof(struct cache_header) == 40, "unexpected header size");
+_Static_assert(sizeof(struct finfo_cache_slot) == 64, "unexpected slot size");
+
+/*
+ * Hash the identity of the file, but not its version, so that the entries
+ * of every version of a file are found by the same probe sequence.
+ */
+static uint64_t cache_hash(uint64_t dev, uint64_t ino, uint16_t options,
+						   uint64_t seek_sample) {
+	uint64_t h = ino * 0x9E3779B97F4A7C15u;
+	h ^= dev + options + (h << 6) + (h >> 2);
+	h ^= seek_sample * 0xC2B2AE3D27D4EB4Fu;
+	h ^= h >> 33;
+	h *= 0xFF51AFD7ED558CCDu;
+	h ^= h >> 33;
+	return h;
+}
+
+static bool cache_same_file(const struct finfo_cache_slot *a,
+							const struct finfo_cache_slot *b) {
+	return a->dev == b->dev && a->ino == b->ino && a->options == b->options &&
+		   a->seek_sample == b->seek_sample;
+}
+
+static bool cache_matches(const struct finfo_cache_slot *slot,
+						  const struct finfo_cache_key *key) {
+	return slot->dev == key->dev && slot->ino == key->ino &&
+		   slot->size == key->size && slot->mtime_sec == key->mtime_sec &&
+		   slot->mtime_nsec == key->mtime_nsec &&
+		   slot->options == key->options &&
+		   slot->seek_sample == key->seek_sample;
+}
+
+// True if SLOT is used and its events are inside FILE.
+static bool cache_slot_valid(const struct finfo_cache_file *file,
+							 const struct finfo_cache_slot *slot) {
+	return (slot->flags & CACHE_SLOT_USED) &&
+		   slot->events_offset <= file->events_len &&
+		   file->events_len - slot->events_offset >= slot->events_len;
+}
+
+/*
+ * Check the content of the cache file MAP, long LEN bytes, and set up DST
+ * to search it. Returns false if it is not a valid cache file, or if it was
+ * written by another version.
+ */
+static bool cache_file_load(void *map, size_t len,
+							struct finfo_cache_file *dst) {
+	const struct cache_header *header = map;
+	if (len < sizeof(*header) ||
+		memcmp(header->magic, CACHE_MAGIC, sizeof(header->magic)) != 0 ||
+		header->byte_order != CACHE_BYTE_ORDER ||
+		header->version != FINFO_CACHE_VERSION || header->slots_n == 0 ||
+		(header->slots_n & (header->slots_n - 1)) != 0) {
+		return false;
+	}
+
+	uint64_t slots_len = (uint64_t)header->slots_n * sizeof(*dst->slots);
+	if (len - sizeof(*header) < slots_len ||
+		len - sizeof(*header) - slots_len != header->events_len) {
+		return false;
+	}
+
+	*dst = (struct finfo_cache_file){
+		.map		= map,
+		.map_len	= len,
+		.slots		= (const void *)((unsigned char *)map + sizeof(*header)),
+		.slots_n	= header->slots_n,
+		.events		= (unsigned char *)map + sizeof(*header) + slots_len,
+		.events_len = header->events_len,
+	};
+	return true;
+}
+
+/*
+ * Map the cache file at PATH in DST, empty if it is missing or invalid.
+ * On failure returns false and sets errno.
+ */
+static bool cache_file_open(const char *path, struct finfo_cache_file *dst) {
+	*dst = (struct finfo_cache_file){0};
+
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) { return errno == ENOENT; }
+
+	struct stat st;
+	if (fstat(fd, &st) < 0) {
+		int err = errno;
+		close(fd);
+		errno = err;
+		return false;
+	}
+
+	void *map = MAP_FAILED;
+	if (S_ISREG(st.st_mode) && st.st_size > 0) {
+		map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	}
+	close(fd);
+
+	if (map != MAP_FAILED && !cache_file_load(map, st.st_size, dst)) {
+		munmap(map, st.st_size);
+	}
+	dst->mode = st.st_mode & 07777;
+	return true;
+}
+
+static void cache_file_close(struct finfo_cache_file *file) {
+	if (file->map != NULL) { munmap(file->map, file->map_len); }
+	*file = (struct finfo_cache_file){0};
+}
+
+bool finfo_cache_open(struct finfo_cache *cache, const char *path) {
+	*cache = (struct finfo_cache){.path = strdup(path)};
+	finfo_buf_init(&cache->added_events);
+
+	return cache->path != NULL && cache_file_open(path, &cache->file);
+}
+
+void finfo_cache_close(struct finfo_cache *cache) {
+	cache_file_close(&cache->file);
+	free(cache->path);
+	free(cache->added);
+	finfo_buf_free(&cache->added_events);
+	*cache = (struct finfo_cache){0};
+}
+
+void finfo_cache_key_init(struct finfo_cache_key *dst, const struct stat *st) {
+	*dst = (struct finfo_cache_key){
+		.dev		= st->st_dev,
+		.ino		= st->st_ino,
+		.size		= st->st_size,
+		.mtime_sec	= st->st_mtim.tv_sec,
+		.mtime_nsec = st->st_mtim.tv_nsec,
+	};
+
+	if (finfo_opts.verify) { dst->options |= FINFO_CACHE_VERIFY; }
+	if (finfo_opts.seek) {
+		dst->options |= FINFO_CACHE_SEEK;
+		dst->seek_sample = finfo_opts.seek_sample;
+	}
+}
+
+bool finfo_cache_find(const struct finfo_cache *cache,
+					  const struct finfo_cache_key *key,
+					  struct finfo_cache_entry *dst) {
+	const struct finfo_cache_file *file = &cache->file;
+	if (file->slots_n == 0) { return false; }
+
+	uint32_t mask = file->slots_n - 1;
+	uint32_t i =
+		cache_hash(key->dev, key->ino, key->options, key->seek_sample) & mask;
+	for (uint32_t probes = 0; probes < file->slots_n; probes++) {
+		const struct finfo_cache_slot *slot = &file->slots[i];
+		if (!(slot->flags & CACHE_SLOT_USED)) { return false; }
+
+		if (cache_matches(slot, key)) {
+			if (!cache_slot_valid(file, slot)) { return false; }
+
+			*dst = (struct finfo_cache_entry){
+				.events		= file->events + slot->events_offset,
+				.events_len = slot->events_len,
+				.recognized = slot->flags & CACHE_SLOT_RECOGNIZED,
+			};
+			return true;
+		}
+		i = (i + 1) & mask;
+	}
+
+	return false;
+}
+
+void finfo_cache_add(struct finfo_cache *cache,
+					 const struct finfo_cache_key *key, bool recognized,
+					 const void *events, size_t len) {
+	if (cache->added_n == cache->added_cap) {
+		size_t cap	= cache->added_cap ? cache->added_cap * 2 : 64;
+		void *added = realloc(cache->added, cap * sizeof(*cache->added));
+		if (added == NULL) { return; }
+
+		cache->added	 = added;
+		cache->added_cap = cap;
+	}
+
+	cache->added[cache->added_n++] = (struct finfo_cache_slot){
+		.dev		   = key->dev,
+		.ino		   = key->ino,
+		.size		   = key->size,
+		.mtime_sec	   = key->mtime_sec,
+		.seek_sample   = key->seek_sample,
+		.events_offset = cache->added_events.len,
+		.events_len	   = len,
+		.mtime_nsec	   = key->mtime_nsec,
+		.options	   = key->options,
+		.flags = CACHE_SLOT_USED | CACHE_SLOT_ADDED |
+				 (recognized ? CACHE_SLOT_RECOGNIZED : 0),
+	};
+	finfo_buf_append(&cache->added_events, events, len);
+}
+
+/*
+ * Insert SLOT in the hash table SLOTS, of MASK + 1 slots, unless it already
+ * has an entry for the same file.
+ */
+static void cache_insert(struct finfo_cache_slot *slots, uint32_t mask,
+						 const struct finfo_cache_slot *slot) {
+	uint32_t i =
+		cache_hash(slot->dev, slot->ino, slot->options, slot->seek_sample) &
+		mask;
+	while (slots[i].flags & CACHE_SLOT_USED) {
+		if (cache_same_file(&slots[i], slot)) { return; }
+		i = (i + 1) & mask;
+	}
+	slots[i] = *slot;
+}
+
+/*
+ * Write to the new cache file OUT the hash table SLOTS, of SLOTS_N slots,
+ * followed by the events of its entries, taken from the added ones or from
+ * the current cache file CURRENT.
+ */
+static bool cache_write(FILE *out, struct finfo_cache_slot *slots,
+						uint32_t slots_n, const struct finfo_cache *cache,
+						const struct finfo_cache_file *current) {
+	struct cache_header header = {
+		.magic		= CACHE_MAGIC,
+		.byte_order = CACHE_BYTE_ORDER,
+		.slots_n	= slots_n,
+		.version	= FINFO_CACHE_VERSION,
+	};
+
+	// Events are written in the order of the slots, and the source of each
+	// entry replaced by its new position.
+	const unsigned char **sources = malloc(slots_n * sizeof(*sources));
+	if (sources == NULL) { return false; }
+
+	for (uint32_t i = 0; i < slots_n; i++) {
+		struct finfo_cache_slot *slot = &slots[i];
+		if (!(slot->flags & CACHE_SLOT_USED)) { continue; }
+
+		const unsigned char *events = slot->flags & CACHE_SLOT_ADDED
+										  ? (void *)cache->added_events.data
+										  : current->events;
+		sources[i]					= events + slot->events_offset;
+
+		slot->events_offset = header.events_len;
+		slot->flags &= ~CACHE_SLOT_ADDED;
+		header.events_len += slot->events_len;
+		header.entries_n++;
+	}
+
+	fwrite(&header, sizeof(header), 1, out);
+	fwrite(slots, sizeof(*slots), slots_n, out);
+	for (uint32_t i = 0; i < slots_n; i++) {
+		if (slots[i].flags & CACHE_SLOT_USED) {
+			fwrite(sources[i], 1, slots[i].events_len, out);
+		}
+	}
+
+	free(sources);
+	return !ferror(out);
+}
+
+/*
+ * Build in a temporary file the cache holding the added entries and the
+ * ones of CURRENT, except for older versions of the added files, and
+ * rename it over the cache file.
+ */
+static bool cache_replace(struct finfo_cache *cache,
+						  const struct finfo_cache_file *current) {
+	size_t entries_n = cache->added_n;
+	for (uint32_t i = 0; i < current->slots_n; i++) {
+		const struct finfo_cache_slot *slot = &current->slots[i];
+		if (!cache_slot_valid(current, slot)) { continue; }
+		entries_n++;
+	}
+
+	// Keep the table at most half full.
+	uint32_t slots_n = CACHE_MIN_SLOTS;
+	while (slots_n < 2 * entries_n) {
+		if (slots_n > UINT32_MAX / 2) {
+			errno = EFBIG;
+			return false;
+		}
+		slots_n *= 2;
+	}
+
+	struct finfo_cache_slot *slots = calloc(slots_n, sizeof(*slots));
+	if (slots == NULL) { return false; }
+
+	// The latest entries go first, so that they replace the older ones.
+	uint32_t mask = slots_n - 1;
+	for (size_t i = cache->added_n; i-- > 0;) {
+		cache_insert(slots, mask, &cache->added[i]);
+	}
+	for (uint32_t i = 0; i < current->slots_n; i++) {
+		const struct finfo_cache_slot *slot = &current->slots[i];
+		if (!cache_slot_valid(current, slot)) { continue; }
+
+		struct finfo_cache_slot copy = *slot;
+		copy.flags &= ~CACHE_SLOT_ADDED;
+		cache_insert(slots, mask, &copy);
+	}
+
+	size_t path_len = strlen(cache->path);
+	char *tmp_path	= malloc(path_len + sizeof(".XXXXXX"));
+	if (tmp_path == NULL) {
+		free(slots);
+		return false;
+	}
+	memcpy(tmp_path, cache->path, path_len);
+	memcpy(tmp_path + path_len, ".XXXXXX", sizeof(".XXXXXX"));
+
+	// mkstemp creates the file with mode 0600: give it the permissions of
+	// the cache it replaces, or the ones a new file would have.
+	mode_t mode = current->mode;
+	if (mode == 0) {
+		mode_t mask = umask(0);
+		umask(mask);
+		mode = 0666 & ~mask;
+	}
+
+	bool ok	 = false;
+	int fd	 = mkstemp(tmp_path);
+	FILE *out = fd >= 0 && fchmod(fd, mode) == 0 ? fdopen(fd, "wb") : NULL;
+	if (out != NULL) {
+		ok = cache_write(out, slots, slots_n, cache, current);
+		ok = fclose(out) == 0 && ok;
+		ok = ok && rename(tmp_path, cache->path) == 0;
+	} else if (fd >= 0) {
+		close(fd);
+	}
+
+	if (!ok && fd >= 0) {
+		int err = errno;
+		unlink(tmp_path);
+		errno = err;
+	}
+	free(tmp_path);
+	free(slots);
+	return ok;
+}
+
+bool finfo_cache_save(struct finfo_cache *cache) {
+	if (cache->added_n == 0) { return true; }
+
+	size_t path_len = strlen(cache->path);
+	char *lock_path = malloc(path_len + sizeof(".lock"));
+	if (lock_path == NULL) { return false; }
+	memcpy(lock_path, cache->path, path_len);
+	memcpy(lock_path + path_len, ".lock", sizeof(".lock"));
+
+	int lock_fd = open(lock_path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	free(lock_path);
+	if (lock_fd < 0) { return false; }
+
+	bool ok = false;
+	if (flock(lock_fd, LOCK_EX) == 0) {
+		// Other runs may have saved their entries since the cache was opened.
+		struct finfo_cache_file current;
+		if (cache_file_open(cache->path, &current)) {
+			ok = cache_replace(cache, &current);
+			cache_file_close(&current);
+		}
+	}
+
+	int err = errno;
+	close(lock_fd);
+	errno = err;
+
+	if (ok) { cache->added_n = 0; }
+	return ok;
+}
@@ -0,0 +1,116 @@
+#ifndef FINFO_CACHE_H
+#define FINFO_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include "finfo_output.h"
+
+/*
+ * Cache of the output of the files already parsed, saved between runs.
+ * Files are identified by their device, inode, size and modification time,
+ * so that a file found in the cache doesn't need to be opened at all: its
+ * output is replayed from the events captured when it was parsed, which
+ * works with any emitter.
+ *
+ * The cache file is a header, followed by an open addressed hash table of
+ * 64 bytes slots, and by the events of the entries. Everything is in native
+ * byte order, and lookups work directly on the mapping of the file.
+ *
+ * A file is never modified once written. finfo_cache_save builds a new one,
+ * holding the entries of the current file and the ones added since it was
+ * opened, and renames it over the old one while holding an exclusive lock
+ * on a ".lock" file next to it, so that concurrent runs don't lose each
+ * other's entries. Readers only need to map it.
+ */
+
+/*
+ * Version of the output stored in the cache, bumped whenever a parser or an
+ * emitter changes it. Caches written by another version are ignored, since
+ * their entries would otherwise be replayed until each file is modified.
+ */
+#define FINFO_CACHE_VERSION 1
+
+// Identity of the content of a file, and of the options used to parse it.
+struct finfo_cache_key {
+	uint64_t dev;
+	uint64_t ino;
+	uint64_t size;
+	int64_t mtime_sec;
+	uint32_t mtime_nsec;
+	// FINFO_CACHE_* flags of the options changing the output.
+	uint16_t options;
+	uint64_t seek_sample;
+};
+
+enum finfo_cache_options {
+	FINFO_CACHE_VERIFY = 1 << 0,
+	FINFO_CACHE_SEEK   = 1 << 1,
+};
+
+// Entry found in the cache.
+struct finfo_cache_entry {
+	const void *events;
+	size_t events_len;
+	// True if the file was recognized.
+	bool recognized;
+};
+
+struct finfo_cache_slot;
+
+// Mapping of a cache file, empty if it is missing or invalid.
+struct finfo_cache_file {
+	void *map;
+	size_t map_len;
+	const struct finfo_cache_slot *slots;
+	uint32_t slots_n;
+	const unsigned char *events;
+	uint64_t events_len;
+	// Permissions of the file, kept by the one replacing it. 0 if missing.
+	mode_t mode;
+};
+
+struct finfo_cache {
+	char *path;
+	// Cache file as it was when opened.
+	struct finfo_cache_file file;
+
+	// Entries added since the cache was opened, with their events stored
+	// one after the other in ADDED_EVENTS.
+	struct finfo_cache_slot *added;
+	size_t added_n;
+	size_t added_cap;
+	struct finfo_buf added_events;
+};
+
+/*
+ * Open the cache file at PATH. A missing or invalid file is an empty cache.
+ * Returns false if the file exists but can't be read.
+ */
+bool finfo_cache_open(struct finfo_cache *cache, const char *path);
+void finfo_cache_close(struct finfo_cache *cache);
+
+// Set DST to the key of the file with status ST, parsed with finfo_opts.
+void finfo_cache_key_init(struct finfo_cache_key *dst, const struct stat *st);
+
+/*
+ * Find in DST the entry of KEY in the cache file. Entries added since it was
+ * opened are not searched. Thread safe.
+ */
+bool finfo_cache_find(const struct finfo_cache *cache,
+					  const struct finfo_cache_key *key,
+					  struct finfo_cache_entry *dst);
+
+// Add the EVENTS, long LEN bytes, of the file identified by KEY.
+void finfo_cache_add(struct finfo_cache *cache,
+					 const struct finfo_cache_key *key, bool recognized,
+					 const void *events, size_t len);
+
+/*
+ * Write the added entries to the cache file, if any.
+ * On failure returns false and sets errno.
+ */
+bool finfo_cache_save(struct finfo_cache *cache);
+
+#endif // !FINFO_CACHE_H
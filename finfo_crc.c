@@ -0,0 +1,257 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include "finfo_crc.h"
+#include "finfo_utils.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FINFO_CRC_CLMUL
+#endif
+
+// ===== CRC-32 =====
+
+// crc32_table[k][b] is the CRC of byte B followed by K zero bytes.
+static uint32_t crc32_table[16][256];
+
+static uint32_t (*crc32_impl)(uint32_t crc, const unsigned char *data,
+							  size_t len);
+
+/*
+ * Slice-by-16: fold 16 bytes per iteration with 16 table lookups,
+ * which are independent of each other.
+ * Works on the inverted CRC.
+ */
+static uint32_t crc32_slice16(uint32_t crc, const unsigned char *data,
+							  size_t len) {
+	const uint32_t (*t)[256] = crc32_table;
+
+	while (len >= 16) {
+		uint32_t a = crc ^ load_le32(data);
+		uint32_t b = load_le32(data + 4);
+		uint32_t c = load_le32(data + 8);
+		uint32_t d = load_le32(data + 12);
+
+		crc = t[15][a & 0xFF] ^ t[14][(a >> 8) & 0xFF] ^
+			  t[13][(a >> 16) & 0xFF] ^ t[12][a >> 24] ^ t[11][b & 0xFF] ^
+			  t[10][(b >> 8) & 0xFF] ^ t[9][(b >> 16) & 0xFF] ^
+			  t[8][b >> 24] ^ t[7][c & 0xFF] ^ t[6][(c >> 8) & 0xFF] ^
+			  t[5][(c >> 16) & 0xFF] ^ t[4][c >> 24] ^ t[3][d & 0xFF] ^
+			  t[2][(d >> 8) & 0xFF] ^ t[1][(d >> 16) & 0xFF] ^ t[0][d >> 24];
+
+		data += 16;
+		len -= 16;
+	}
+
+	while (len--) { crc = (crc >> 8) ^ t[0][(crc ^ *data++) & 0xFF]; }
+
+	return crc;
+}
+
+#ifdef FINFO_CRC_CLMUL
+/*
+ * Fold 64 bytes per iteration with carry-less multiplications, as described
+ * in "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ
+ * Instruction" (Intel), then Barrett-reduce the result to 32 bits.
+ * LEN must be at least 64 and a multiple of 16.
+ * Works on the inverted CRC.
+ */
+__attribute__((target("pclmul,sse4.1"))) static uint32_t
+crc32_clmul_blocks(uint32_t crc, const unsigned char *data, size_t len) {
+	const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596, 0x0154442bd4);
+	const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+	const __m128i k5k0 = _mm_set_epi64x(0x0000000000, 0x0163cd6124);
+	const __m128i poly = _mm_set_epi64x(0x01f7011641, 0x01db710641);
+	const __m128i mask = _mm_setr_epi32(~0, 0, ~0, 0);
+
+	__m128i x1, x2, x3, x4, x5, x6, x7, x8;
+
+	x1 = _mm_loadu_si128((const __m128i *)(data + 0x00));
+	x2 = _mm_loadu_si128((const __m128i *)(data + 0x10));
+	x3 = _mm_loadu_si128((const __m128i *)(data + 0x20));
+	x4 = _mm_loadu_si128((const __m128i *)(data + 0x30));
+	x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+	data += 64;
+	len -= 64;
+
+	// Fold by 4 x 128 bits.
+	while (len >= 64) {
+		x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+		x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+		x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+		x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+
+		x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+		x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+		x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+		x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x5),
+						   _mm_loadu_si128((const __m128i *)(data + 0x00)));
+		x2 = _mm_xor_si128(_mm_xor_si128(x2, x6),
+						   _mm_loadu_si128((const __m128i *)(data + 0x10)));
+		x3 = _mm_xor_si128(_mm_xor_si128(x3, x7),
+						   _mm_loadu_si128((const __m128i *)(data + 0x20)));
+		x4 = _mm_xor_si128(_mm_xor_si128(x4, x8),
+						   _mm_loadu_si128((const __m128i *)(data + 0x30)));
+
+		data += 64;
+		len -= 64;
+	}
+
+	// Fold the 4 accumulators into one.
+	x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+	x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+	x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+	// Fold the remaining 128 bit blocks.
+	while (len >= 16) {
+		x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+		x1 = _mm_xor_si128(
+			_mm_xor_si128(x1, _mm_loadu_si128((const __m128i *)data)), x5);
+
+		data += 16;
+		len -= 16;
+	}
+
+	// Fold 128 bits to 64 bits.
+	x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+	x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+
+	x2 = _mm_srli_si128(x1, 4);
+	x1 = _mm_and_si128(x1, mask);
+	x1 = _mm_clmulepi64_si128(x1, k5k0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	// Barrett reduction to 32 bits.
+	x2 = _mm_and_si128(x1, mask);
+	x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+	x2 = _mm_and_si128(x2, mask);
+	x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	return _mm_extract_epi32(x1, 1);
+}
+
+static uint32_t crc32_clmul(uint32_t crc, const unsigned char *data,
+							size_t len) {
+	if (len >= 64) {
+		size_t blocks_len = len & ~(size_t)15;
+		crc				  = crc32_clmul_blocks(crc, data, blocks_len);
+		data += blocks_len;
+		len -= blocks_len;
+	}
+
+	return crc32_slice16(crc, data, len);
+}
+#endif
+
+static void crc32_init(void) {
+	for (uint32_t b = 0; b < 256; b++) {
+		uint32_t crc = b;
+		for (int i = 0; i < 8; i++) {
+			crc = crc & 1 ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+		}
+		crc32_table[0][b] = crc;
+	}
+
+	for (uint32_t b = 0; b < 256; b++) {
+		for (int k = 1; k < 16; k++) {
+			uint32_t prev	  = crc32_table[k - 1][b];
+			crc32_table[k][b] = (prev >> 8) ^ crc32_table[0][prev & 0xFF];
+		}
+	}
+
+	crc32_impl = crc32_slice16;
+#ifdef FINFO_CRC_CLMUL
+	if (__builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1")) {
+		crc32_impl = crc32_clmul;
+	}
+#endif
+}
+
+uint32_t crc32_update(uint32_t crc, const unsigned char *data, size_t len) {
+	static pthread_once_t once = PTHREAD_ONCE_INIT;
+	pthread_once(&once, crc32_init);
+
+	return ~crc32_impl(~crc, data, len);
+}
+
+// ===== CRC-8 =====
+
+static uint8_t crc8_table[256];
+
+static void crc8_init(void) {
+	for (uint32_t b = 0; b < 256; b++) {
+		uint8_t crc = b;
+		for (int i = 0; i < 8; i++) {
+			crc = crc & 0x80 ? (crc << 1) ^ 0x07 : crc << 1;
+		}
+		crc8_table[b] = crc;
+	}
+}
+
+uint8_t crc8_update(uint8_t crc, const unsigned char *data, size_t len) {
+	static pthread_once_t once = PTHREAD_ONCE_INIT;
+	pthread_once(&once, crc8_init);
+
+	while (len--) { crc = crc8_table[crc ^ *data++]; }
+
+	return crc;
+}
+
+// ===== CRC-16 =====
+
+// crc16_table[k][b] is the CRC of byte B followed by K zero bytes.
+static uint16_t crc16_table[8][256];
+
+static void crc16_init(void) {
+	for (uint32_t b = 0; b < 256; b++) {
+		uint16_t crc = b << 8;
+		for (int i = 0; i < 8; i++) {
+			crc = crc & 0x8000 ? (crc << 1) ^ 0x8005 : crc << 1;
+		}
+		crc16_table[0][b] = crc;
+	}
+
+	for (uint32_t b = 0; b < 256; b++) {
+		for (int k = 1; k < 8; k++) {
+			uint16_t prev	  = crc16_table[k - 1][b];
+			crc16_table[k][b] = (prev << 8) ^ crc16_table[0][prev >> 8];
+		}
+	}
+}
+
+/*
+ * Slice-by-8: the CRC is folded into the first two bytes of each group of 8,
+ * and every byte is then looked up in the table for its distance from the
+ * end of the group.
+ */
+uint16_t crc16_update(uint16_t crc, const unsigned char *data, size_t len) {
+	static pthread_once_t once = PTHREAD_ONCE_INIT;
+	pthread_once(&once, crc16_init);
+
+	const uint16_t (*t)[256] = crc16_table;
+
+	while (len >= 8) {
+		crc = t[7][data[0] ^ (crc >> 8)] ^ t[6][data[1] ^ (crc & 0xFF)] ^
+			  t[5][data[2]] ^ t[4][data[3]] ^ t[3][data[4]] ^ t[2][data[5]] ^
+			  t[1][data[6]] ^ t[0][data[7]];
+
+		data += 8;
+		len -= 8;
+	}
+
+	while (len--) { crc = (crc << 8) ^ t[0][(crc >> 8) ^ *data++]; }
+
+	return crc;
+}
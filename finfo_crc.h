@@ -0,0 +1,26 @@
+#ifndef FINFO_CRC_H
+#define FINFO_CRC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Update CRC with LEN bytes of DATA, using the CRC-32 of PNG and zlib
+ * (reflected polynomial 0xEDB88320). Start with a CRC of 0.
+ * The fastest implementation supported by the CPU is picked at runtime.
+ */
+uint32_t crc32_update(uint32_t crc, const unsigned char *data, size_t len);
+
+/*
+ * Update CRC with LEN bytes of DATA, using the CRC-8 of FLAC frame headers
+ * (polynomial 0x07). Start with a CRC of 0.
+ */
+uint8_t crc8_update(uint8_t crc, const unsigned char *data, size_t len);
+
+/*
+ * Update CRC with LEN bytes of DATA, using the CRC-16 of FLAC frames
+ * (polynomial 0x8005). Start with a CRC of 0.
+ */
+uint16_t crc16_update(uint16_t crc, const unsigned char *data, size_t len);
+
+#endif // !FINFO_CRC_H
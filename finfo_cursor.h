@@ -0,0 +1,113 @@
+#ifndef FINFO_CURSOR_H
+#define FINFO_CURSOR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "finfo_utils.h"
+
+/*
+ * Reader of the fields of a block of bytes, for the parsers.
+ * A block is parsed in two passes over the same bytes: first its layout is
+ * checked with the finfo_cursor_check_* and finfo_cursor_skip* functions,
+ * which follow the lengths and counts it holds and fail if they point past
+ * its end, then its fields are decoded from the start with the other
+ * functions, which don't check anything. Decoders are only given blocks
+ * which passed the check, and must read them exactly the way it walked them.
+ * The functions are inline, so that decoding is straight loads.
+ */
+struct finfo_cursor {
+	const unsigned char *next;
+	const unsigned char *end;
+};
+
+static inline struct finfo_cursor finfo_cursor_make(const unsigned char *data,
+													size_t len) {
+	return (struct finfo_cursor){.next = data, .end = data + len};
+}
+
+// Number of bytes left after the cursor.
+static inline size_t finfo_cursor_left(const struct finfo_cursor *cur) {
+	return cur->end - cur->next;
+}
+
+// ===== Checks =====
+
+// Move past LEN bytes. Returns false if fewer are left.
+static inline bool finfo_cursor_skip(struct finfo_cursor *cur, uint64_t len) {
+	if (len > finfo_cursor_left(cur)) { return false; }
+	cur->next += len;
+	return true;
+}
+
+/*
+ * Move past COUNT elements of SIZE bytes each. Returns false if fewer bytes
+ * are left, without overflowing on large counts.
+ * SIZE is a constant in every caller, so that the division is folded away
+ * instead of being computed from the bytes left for every array.
+ */
+static inline bool finfo_cursor_skip_array(struct finfo_cursor *cur,
+										   uint64_t count, size_t size) {
+	if (size != 0 && count > UINT64_MAX / size) { return false; }
+	return finfo_cursor_skip(cur, count * size);
+}
+
+// Read a length or count field. Returns false if it doesn't fit.
+static inline bool finfo_cursor_check_u8(struct finfo_cursor *cur,
+										 uint32_t *dst) {
+	if (finfo_cursor_left(cur) < 1) { return false; }
+	*dst = *cur->next++;
+	return true;
+}
+
+static inline bool finfo_cursor_check_be32(struct finfo_cursor *cur,
+										   uint32_t *dst) {
+	if (finfo_cursor_left(cur) < 4) { return false; }
+	*dst = load_be32(cur->next);
+	cur->next += 4;
+	return true;
+}
+
+static inline bool finfo_cursor_check_le32(struct finfo_cursor *cur,
+										   uint32_t *dst) {
+	if (finfo_cursor_left(cur) < 4) { return false; }
+	*dst = load_le32(cur->next);
+	cur->next += 4;
+	return true;
+}
+
+// ===== Unchecked reads =====
+
+// Return a pointer to the next LEN bytes, and move past them.
+static inline const unsigned char *finfo_cursor_bytes(struct finfo_cursor *cur,
+													  size_t len) {
+	const unsigned char *bytes = cur->next;
+	cur->next += len;
+	return bytes;
+}
+
+static inline uint8_t finfo_cursor_u8(struct finfo_cursor *cur) {
+	return *cur->next++;
+}
+
+static inline uint16_t finfo_cursor_be16(struct finfo_cursor *cur) {
+	return load_be16(finfo_cursor_bytes(cur, 2));
+}
+
+static inline uint32_t finfo_cursor_be24(struct finfo_cursor *cur) {
+	return load_be24(finfo_cursor_bytes(cur, 3));
+}
+
+static inline uint32_t finfo_cursor_be32(struct finfo_cursor *cur) {
+	return load_be32(finfo_cursor_bytes(cur, 4));
+}
+
+static inline uint64_t finfo_cursor_be64(struct finfo_cursor *cur) {
+	return load_be64(finfo_cursor_bytes(cur, 8));
+}
+
+static inline uint32_t finfo_cursor_le32(struct finfo_cursor *cur) {
+	return load_le32(finfo_cursor_bytes(cur, 4));
+}
+
+#endif // !FINFO_CURSOR_H
@@ -0,0 +1,692 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include "finfo_edit.h"
+#include "finfo_crc.h"
+#include "finfo_flac.h"
+#include "finfo_format.h"
+#include "finfo_input.h"
+#include "finfo_png.h"
+#include "finfo_utils.h"
+
+#define JOURNAL_MAGIC "FINFOJ01"
+// Longest block, whose length has 24 bits.
+#define BLOCK_MAX_LEN 0xFFFFFFu
+// Vendor string of the comments added to files without any.
+#define EDIT_VENDOR "finfo"
+
+struct journal_header {
+	char magic[8];
+	// Identity of the file the journal is for, when it was written.
+	uint64_t dev;
+	uint64_t ino;
+	uint64_t size;
+	// Length and CRC-32 of the metadata following the header, to write at
+	// the start of the file.
+	uint64_t len;
+	uint32_t crc;
+	uint32_t reserved;
+};
+
+_Static_assert(sizeof(struct journal_header) == 48, "unexpected header size");
+
+void finfo_edit_init(struct finfo_edit *edit) {
+	*edit = (struct finfo_edit){0};
+	finfo_buf_init(&edit->picture);
+}
+
+void finfo_edit_free(struct finfo_edit *edit) {
+	for (size_t i = 0; i < edit->set_n; i++) { free(edit->set[i]); }
+	for (size_t i = 0; i < edit->remove_n; i++) { free(edit->remove[i]); }
+	free(edit->set);
+	free(edit->remove);
+	finfo_buf_free(&edit->picture);
+	*edit = (struct finfo_edit){0};
+}
+
+bool finfo_edit_any(const struct finfo_edit *edit) {
+	return edit->set_n > 0 || edit->remove_n > 0 || edit->has_picture;
+}
+
+// Append a copy of STR to the array *STRS of *N strings.
+static bool edit_append(char ***strs, size_t *n, const char *str) {
+	char **new_strs = realloc(*strs, (*n + 1) * sizeof(**strs));
+	if (new_strs == NULL) { return false; }
+	*strs = new_strs;
+
+	char *copy = strdup(str);
+	if (copy == NULL) { return false; }
+	(*strs)[(*n)++] = copy;
+	return true;
+}
+
+bool finfo_edit_add_set(struct finfo_edit *edit, const char *comment) {
+	const char *sep = strchr(comment, '=');
+	if (sep == NULL || sep == comment) { return false; }
+	return edit_append(&edit->set, &edit->set_n, comment);
+}
+
+bool finfo_edit_add_remove(struct finfo_edit *edit, const char *name) {
+	if (*name == '\0' || strchr(name, '=') != NULL) { return false; }
+	return edit_append(&edit->remove, &edit->remove_n, name);
+}
+
+// ===== Pictures =====
+
+struct edit_image {
+	const char *media_type;
+	uint32_t width;
+	uint32_t height;
+	uint32_t color_depth;
+	uint32_t color_n;
+};
+
+// Read the size and colors of the PNG image IN from its header and palette.
+static bool edit_png_image(struct finfo_input *in, struct edit_image *dst) {
+	struct png_chunk_index index;
+	png_index_chunks(in, &index);
+
+	bool ok = false;
+	struct png_chunk chunk;
+	if (index.entries_n > 0 && index.entries[0].length == 13 &&
+		png_chunk_load(in, &index.entries[0], &chunk) &&
+		png_parse_type(chunk.type_str) == IHDR) {
+		const struct png_IHDR_chunk *header = &chunk.data.IHDR;
+
+		// Samples per pixel of each color type.
+		static const unsigned samples[] = {1, 0, 3, 1, 2, 0, 4};
+		unsigned color_type = header->color_type;
+		unsigned samples_n	= color_type < 7 ? samples[color_type] : 0;
+
+		*dst = (struct edit_image){
+			.media_type	 = "image/png",
+			.width		 = header->width,
+			.height		 = header->height,
+			.color_depth = header->bit_depth * samples_n,
+		};
+		ok = true;
+	}
+
+	// Indexed images have the number of colors of their palette.
+	for (size_t i = 1; ok && i < index.entries_n; i++) {
+		enum png_chunk_type type = png_parse_type(index.entries[i].type_str);
+		if (type == IDAT) { break; }
+		if (type == PLTE && png_chunk_load(in, &index.entries[i], &chunk)) {
+			dst->color_n = chunk.data.PLTE.palette_len;
+		}
+	}
+
+	png_chunk_index_free(&index);
+	return ok;
+}
+
+// Read the size of the JPEG image DATA, long LEN bytes, from its frame header.
+static bool edit_jpeg_image(const unsigned char *data, size_t len,
+							struct edit_image *dst) {
+	*dst = (struct edit_image){.media_type = "image/jpeg"};
+
+	// Segments start with 0xFF and a marker, then their length, except for
+	// the start of the image.
+	size_t offset = 2;
+	while (offset + 4 <= len && data[offset] == 0xFF) {
+		unsigned char marker = data[offset + 1];
+		if (marker == 0xFF) {
+			offset++;
+			continue;
+		}
+
+		// Start of frame markers, without the ones of the Huffman tables and
+		// the arithmetic coding conditioning.
+		if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 &&
+			marker != 0xC8 && marker != 0xCC) {
+			if (offset + 10 > len) { return false; }
+			dst->height		 = load_be16(data + offset + 5);
+			dst->width		 = load_be16(data + offset + 7);
+			dst->color_depth = data[offset + 4] * data[offset + 9];
+			return true;
+		}
+		offset += 2 + load_be16(data + offset + 2);
+	}
+	return false;
+}
+
+bool finfo_edit_set_picture(struct finfo_edit *edit, const char *path) {
+	struct finfo_input in;
+	if (!finfo_input_open(&in, path)) { return false; }
+
+	struct finfo_view data;
+	struct edit_image image;
+	bool ok = finfo_input_view(&in, 0, in.size, &data);
+	if (ok) {
+		static const unsigned char jpeg_signature[] = {0xFF, 0xD8, 0xFF};
+		if (finfo_format_detect(&in) == &png_format) {
+			ok = edit_png_image(&in, &image);
+		} else if (data.len >= sizeof(jpeg_signature) &&
+				   memcmp(data.data, jpeg_signature,
+						  sizeof(jpeg_signature)) == 0) {
+			ok = edit_jpeg_image(data.data, data.len, &image);
+		} else {
+			ok = false;
+		}
+		if (!ok) { errno = EINVAL; }
+	}
+
+	if (ok && data.len > BLOCK_MAX_LEN) {
+		errno = EFBIG;
+		ok	  = false;
+	}
+
+	if (ok) {
+		// Front cover, without a description.
+		size_t media_type_len = strlen(image.media_type);
+		uint32_t fields[]	  = {
+			FLAC_FRONT_COVER_PICTURE_TYPE, media_type_len, 0, image.width,
+			image.height, image.color_depth, image.color_n, data.len,
+		};
+		unsigned char bytes[sizeof(fields)];
+		for (size_t i = 0; i < sizeof(fields) / sizeof(*fields); i++) {
+			store_be32(bytes + 4 * i, fields[i]);
+		}
+
+		struct finfo_buf *picture = &edit->picture;
+		picture->len			  = 0;
+		finfo_buf_append(picture, bytes, 8);
+		finfo_buf_append(picture, image.media_type, media_type_len);
+		finfo_buf_append(picture, bytes + 8, sizeof(bytes) - 8);
+		finfo_buf_append(picture, data.data, data.len);
+		edit->has_picture = true;
+	}
+
+	int err = errno;
+	finfo_input_close(&in);
+	errno = err;
+	return ok;
+}
+
+// ===== Blocks =====
+
+// Metadata block of the edited file.
+struct edit_block {
+	enum flac_metadata_type type;
+	const unsigned char *data;
+	size_t len;
+};
+
+struct edit_blocks {
+	struct edit_block *blocks;
+	size_t blocks_n;
+	size_t blocks_cap;
+};
+
+// Insert BLOCK at position AT of BLOCKS.
+static bool edit_insert(struct edit_blocks *blocks, size_t at,
+						struct edit_block block) {
+	if (blocks->blocks_n == blocks->blocks_cap) {
+		size_t cap		 = blocks->blocks_cap ? blocks->blocks_cap * 2 : 16;
+		void *new_blocks = realloc(blocks->blocks, cap * sizeof(block));
+		if (new_blocks == NULL) { return false; }
+		blocks->blocks	   = new_blocks;
+		blocks->blocks_cap = cap;
+	}
+
+	memmove(&blocks->blocks[at + 1], &blocks->blocks[at],
+			(blocks->blocks_n - at) * sizeof(block));
+	blocks->blocks[at] = block;
+	blocks->blocks_n++;
+	return true;
+}
+
+// True if the vorbis comment FIELD, long LEN bytes, is called NAME.
+static bool edit_field_is(const char *field, size_t len, const char *name) {
+	size_t name_len = strlen(name);
+	return len > name_len && field[name_len] == '=' &&
+		   strncasecmp(field, name, name_len) == 0;
+}
+
+static bool edit_field_replaced(const struct finfo_edit *edit,
+								const char *field, size_t len) {
+	for (size_t i = 0; i < edit->remove_n; i++) {
+		if (edit_field_is(field, len, edit->remove[i])) { return true; }
+	}
+	for (size_t i = 0; i < edit->set_n; i++) {
+		// Up to the '=', which is included in the name compared.
+		size_t name_len = strchr(edit->set[i], '=') - edit->set[i] + 1;
+		if (len >= name_len &&
+			strncasecmp(field, edit->set[i], name_len) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static void edit_append_le32_string(struct finfo_buf *dst, const void *data,
+									size_t len) {
+	unsigned char bytes[4];
+	store_le32(bytes, len);
+	finfo_buf_append(dst, bytes, sizeof(bytes));
+	finfo_buf_append(dst, data, len);
+}
+
+/*
+ * Write to DST the VORBIS_COMMENT block VORBIS, or an empty one if NULL,
+ * with the changes of EDIT.
+ */
+static void edit_vorbis_comment(const struct finfo_edit *edit,
+								const struct flac_vorbis_comment *vorbis,
+								struct finfo_buf *dst) {
+	uint32_t fields_n = edit->set_n;
+	if (vorbis != NULL) {
+		edit_append_le32_string(dst, vorbis->vendor_string,
+								vorbis->vendor_string_len);
+		for (uint32_t i = 0; i < vorbis->fields_n; i++) {
+			const struct flac_vorbis_field *field = &vorbis->fields[i];
+			if (!edit_field_replaced(edit, field->data, field->length)) {
+				fields_n++;
+			}
+		}
+	} else {
+		edit_append_le32_string(dst, EDIT_VENDOR, strlen(EDIT_VENDOR));
+	}
+
+	unsigned char bytes[4];
+	store_le32(bytes, fields_n);
+	finfo_buf_append(dst, bytes, sizeof(bytes));
+
+	for (uint32_t i = 0; vorbis != NULL && i < vorbis->fields_n; i++) {
+		const struct flac_vorbis_field *field = &vorbis->fields[i];
+		if (!edit_field_replaced(edit, field->data, field->length)) {
+			edit_append_le32_string(dst, field->data, field->length);
+		}
+	}
+	for (size_t i = 0; i < edit->set_n; i++) {
+		edit_append_le32_string(dst, edit->set[i], strlen(edit->set[i]));
+	}
+}
+
+/*
+ * Read the metadata blocks of the FLAC input IN in DST, with the changes of
+ * EDIT, the new VORBIS_COMMENT block being written to VORBIS.
+ * Padding is left out. Set END to the offset of the end of the metadata.
+ * Returns false if the metadata is malformed, or on allocation failure.
+ */
+static bool edit_read_blocks(const struct finfo_edit *edit,
+							 struct finfo_input *in, struct edit_blocks *dst,
+							 struct finfo_buf *vorbis, uint64_t *end) {
+	bool edit_comments = edit->set_n > 0 || edit->remove_n > 0;
+	bool found_vorbis = false, found_picture = false;
+
+	uint64_t offset = sizeof(FLAC_SIGNATURE);
+	while (true) {
+		struct flac_metadata_block block;
+		struct finfo_view data;
+		if (!flac_parse_block(in, offset, &block) ||
+			!finfo_input_view(in, offset + 4, block.block_length, &data)) {
+			return false;
+		}
+
+		struct edit_block edited = {block.type, data.data, data.len};
+		if (block.type == FLAC_VORBIS_COMMENT_TYPE && edit_comments &&
+			!found_vorbis) {
+			edit_vorbis_comment(edit, &block.data.vorbis_comment, vorbis);
+			found_vorbis = true;
+			edited.data	 = (const unsigned char *)vorbis->data;
+			edited.len	 = vorbis->len;
+		} else if (block.type == FLAC_PICTURE_TYPE && edit->has_picture &&
+				   !found_picture &&
+				   block.data.picture.type == FLAC_FRONT_COVER_PICTURE_TYPE) {
+			found_picture = true;
+			edited.data	  = (const unsigned char *)edit->picture.data;
+			edited.len	  = edit->picture.len;
+		}
+		if (block.type != FLAC_PADDING_TYPE &&
+			!edit_insert(dst, dst->blocks_n, edited)) {
+			return false;
+		}
+
+		offset += 4 + block.block_length;
+		if (block.last_block) { break; }
+	}
+	*end = offset;
+
+	// Comments go right after the stream info, and a front cover, if there
+	// was none, at the end.
+	if (edit_comments && !found_vorbis) {
+		edit_vorbis_comment(edit, NULL, vorbis);
+		struct edit_block block = {FLAC_VORBIS_COMMENT_TYPE,
+								   (const unsigned char *)vorbis->data,
+								   vorbis->len};
+		if (!edit_insert(dst, dst->blocks_n > 0 ? 1 : 0, block)) {
+			return false;
+		}
+	}
+	if (edit->has_picture && !found_picture) {
+		struct edit_block block = {FLAC_PICTURE_TYPE,
+								   (const unsigned char *)edit->picture.data,
+								   edit->picture.len};
+		if (!edit_insert(dst, dst->blocks_n, block)) { return false; }
+	}
+	return true;
+}
+
+/*
+ * Write to DST the signature, the BLOCKS_N BLOCKS and a PADDING block
+ * PADDING bytes long, or none if PADDING is negative.
+ */
+static bool edit_write_blocks(const struct edit_block *blocks,
+							  size_t blocks_n, int64_t padding,
+							  struct finfo_buf *dst) {
+	finfo_buf_append(dst, FLAC_SIGNATURE, sizeof(FLAC_SIGNATURE));
+	for (size_t i = 0; i < blocks_n; i++) {
+		if (blocks[i].len > BLOCK_MAX_LEN) {
+			errno = EFBIG;
+			return false;
+		}
+
+		unsigned char header[4];
+		bool last = i == blocks_n - 1 && padding < 0;
+		header[0] = blocks[i].type | (last ? 0b10000000 : 0);
+		store_be24(header + 1, blocks[i].len);
+		finfo_buf_append(dst, header, sizeof(header));
+		finfo_buf_append(dst, blocks[i].data, blocks[i].len);
+	}
+
+	if (padding >= 0) {
+		unsigned char header[4] = {FLAC_PADDING_TYPE | 0b10000000};
+		store_be24(header + 1, padding);
+		finfo_buf_append(dst, header, sizeof(header));
+
+		static const char zeros[4096];
+		for (int64_t left = padding; left > 0; left -= sizeof(zeros)) {
+			finfo_buf_append(dst, zeros,
+							 left < (int64_t)sizeof(zeros) ? left
+														   : sizeof(zeros));
+		}
+	}
+	return true;
+}
+
+// ===== Writing =====
+
+// Write all the LEN bytes of DATA at OFFSET of FD.
+static bool edit_pwrite(int fd, const void *data, size_t len, off_t offset) {
+	while (len > 0) {
+		ssize_t n = pwrite(fd, data, len, offset);
+		if (n < 0) {
+			if (errno == EINTR) { continue; }
+			return false;
+		}
+		data = (const char *)data + n;
+		len -= n;
+		offset += n;
+	}
+	return true;
+}
+
+// Flush the directory holding PATH, to make a rename or unlink durable.
+static bool edit_sync_dir(const char *path) {
+	const char *slash = strrchr(path, '/');
+	char *dir		  = slash != NULL ? strndup(path, slash - path + 1)
+									  : strdup(".");
+	if (dir == NULL) { return false; }
+
+	int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	free(dir);
+	if (fd < 0) { return false; }
+
+	bool ok = fsync(fd) == 0;
+	int err = errno;
+	close(fd);
+	errno = err;
+	return ok;
+}
+
+// Return PATH followed by SUFFIX, to free.
+static char *edit_path(const char *path, const char *suffix) {
+	size_t path_len = strlen(path), suffix_len = strlen(suffix);
+	char *dst		= malloc(path_len + suffix_len + 1);
+	if (dst == NULL) { return NULL; }
+	memcpy(dst, path, path_len);
+	memcpy(dst + path_len, suffix, suffix_len + 1);
+	return dst;
+}
+
+/*
+ * Write the metadata in the journal of the file at PATH, open as FD with
+ * status ST, whose start is replaced by the journal if it is complete.
+ * Then remove the journal, whatever its state.
+ */
+static bool edit_recover(int fd, const char *path, const struct stat *st) {
+	char *journal_path = edit_path(path, FINFO_EDIT_JOURNAL);
+	if (journal_path == NULL) { return false; }
+
+	struct finfo_input journal;
+	if (!finfo_input_open(&journal, journal_path)) {
+		free(journal_path);
+		return errno == ENOENT;
+	}
+
+	// An incomplete journal was being written when the edit was
+	// interrupted, before the file was touched.
+	struct finfo_view header_view, data;
+	struct journal_header header;
+	bool ok = true;
+	if (finfo_input_view(&journal, 0, sizeof(header), &header_view)) {
+		memcpy(&header, header_view.data, sizeof(header));
+		if (memcmp(header.magic, JOURNAL_MAGIC, sizeof(header.magic)) == 0 &&
+			header.dev == (uint64_t)st->st_dev &&
+			header.ino == (uint64_t)st->st_ino &&
+			header.size == (uint64_t)st->st_size &&
+			header.len <= header.size &&
+			header.len == journal.size - sizeof(header) &&
+			finfo_input_view(&journal, sizeof(header), header.len, &data) &&
+			crc32_update(0, data.data, data.len) == header.crc) {
+			ok = edit_pwrite(fd, data.data, data.len, 0) && fsync(fd) == 0;
+		}
+	}
+	finfo_input_close(&journal);
+
+	ok = ok && unlink(journal_path) == 0 && edit_sync_dir(path);
+	free(journal_path);
+	return ok;
+}
+
+/*
+ * Replace the start of the file at PATH, open as FD with status ST, with
+ * the LEN bytes of DATA, going through the journal.
+ */
+static bool edit_in_place(int fd, const char *path, const struct stat *st,
+						  const void *data, size_t len) {
+	char *journal_path = edit_path(path, FINFO_EDIT_JOURNAL);
+	if (journal_path == NULL) { return false; }
+
+	struct journal_header header = {
+		.magic = JOURNAL_MAGIC,
+		.dev   = st->st_dev,
+		.ino   = st->st_ino,
+		.size  = st->st_size,
+		.len   = len,
+		.crc   = crc32_update(0, data, len),
+	};
+
+	// The journal must be on disk before the file is touched.
+	int journal_fd =
+		open(journal_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	bool ok = journal_fd >= 0 &&
+			  edit_pwrite(journal_fd, &header, sizeof(header), 0) &&
+			  edit_pwrite(journal_fd, data, len, sizeof(header)) &&
+			  fsync(journal_fd) == 0;
+	if (journal_fd >= 0) { ok = close(journal_fd) == 0 && ok; }
+	ok = ok && edit_sync_dir(path);
+
+	if (ok) {
+		ok = edit_pwrite(fd, data, len, 0) && fsync(fd) == 0;
+		// A failed write is completed from the journal by the next edit.
+		if (ok) { ok = unlink(journal_path) == 0 && edit_sync_dir(path); }
+	} else if (journal_fd >= 0) {
+		int err = errno;
+		unlink(journal_path);
+		errno = err;
+	}
+
+	free(journal_path);
+	return ok;
+}
+
+/*
+ * Copy the LEN bytes at OFFSET of IN_FD to the current position of OUT_FD,
+ * in the kernel when it can.
+ */
+static bool edit_copy(int in_fd, uint64_t offset, int out_fd, uint64_t len) {
+	int64_t in_offset = offset;
+	while (len > 0) {
+		ssize_t n = syscall(__NR_copy_file_range, in_fd, &in_offset, out_fd,
+							NULL, len, 0);
+		if (n > 0) {
+			len -= n;
+			continue;
+		}
+		if (n == 0) {
+			errno = EIO;
+			return false;
+		}
+		if (errno == EINTR) { continue; }
+		if (errno != ENOSYS && errno != EXDEV && errno != EINVAL &&
+			errno != EOPNOTSUPP) {
+			return false;
+		}
+		break;
+	}
+
+	// Copied through a buffer on file systems which can't.
+	static _Thread_local char buf[1 << 16];
+	while (len > 0) {
+		ssize_t n = pread(in_fd, buf, len < sizeof(buf) ? len : sizeof(buf),
+						  in_offset);
+		if (n <= 0) {
+			if (n < 0 && errno == EINTR) { continue; }
+			if (n == 0) { errno = EIO; }
+			return false;
+		}
+
+		for (ssize_t written = 0; written < n;) {
+			ssize_t w = write(out_fd, buf + written, n - written);
+			if (w < 0) {
+				if (errno == EINTR) { continue; }
+				return false;
+			}
+			written += w;
+		}
+		in_offset += n;
+		len -= n;
+	}
+	return true;
+}
+
+/*
+ * Write to a temporary file the LEN bytes of DATA, followed by the audio of
+ * the file at PATH, open as FD with status ST, which starts at AUDIO, and
+ * rename it over the file.
+ */
+static bool edit_rewrite(int fd, const char *path, const struct stat *st,
+						 const void *data, size_t len, uint64_t audio) {
+	char *tmp_path = edit_path(path, ".XXXXXX");
+	if (tmp_path == NULL) { return false; }
+
+	int tmp_fd = mkstemp(tmp_path);
+	bool ok	   = tmp_fd >= 0 && edit_pwrite(tmp_fd, data, len, 0) &&
+			  lseek(tmp_fd, len, SEEK_SET) == (off_t)len &&
+			  edit_copy(fd, audio, tmp_fd, st->st_size - audio) &&
+			  fchmod(tmp_fd, st->st_mode & 07777) == 0 && fsync(tmp_fd) == 0;
+	if (tmp_fd >= 0) { ok = close(tmp_fd) == 0 && ok; }
+	ok = ok && rename(tmp_path, path) == 0 && edit_sync_dir(path);
+
+	if (!ok && tmp_fd >= 0) {
+		int err = errno;
+		unlink(tmp_path);
+		errno = err;
+	}
+	free(tmp_path);
+	return ok;
+}
+
+bool finfo_edit_file(const struct finfo_edit *edit, const char *path,
+					 bool *rewritten) {
+	*rewritten = false;
+
+	int fd = open(path, O_RDWR | O_CLOEXEC);
+	if (fd < 0) { return false; }
+
+	struct stat st;
+	struct finfo_input in	  = {.fd = -1};
+	struct edit_blocks blocks = {0};
+	struct finfo_buf vorbis, metadata;
+	finfo_buf_init(&vorbis);
+	finfo_buf_init(&metadata);
+	bool ok = false;
+
+	// An interrupted edit is completed first.
+	if (fstat(fd, &st) < 0 || !edit_recover(fd, path, &st)) { goto end; }
+	if (!S_ISREG(st.st_mode)) {
+		errno = EINVAL;
+		goto end;
+	}
+
+	int in_fd = dup(fd);
+	if (in_fd < 0 || !finfo_input_adopt(&in, path, in_fd, NULL, 0)) {
+		goto end;
+	}
+	if (finfo_format_detect(&in) != &flac_format) {
+		errno = EINVAL;
+		goto end;
+	}
+
+	uint64_t end;
+	if (!edit_read_blocks(edit, &in, &blocks, &vorbis, &end)) {
+		if (errno != ENOMEM) { errno = EINVAL; }
+		goto end;
+	}
+
+	// The blocks fit in the old metadata if they fill it exactly, or if
+	// there is room for a PADDING block.
+	uint64_t needed = sizeof(FLAC_SIGNATURE);
+	for (size_t i = 0; i < blocks.blocks_n; i++) {
+		needed += 4 + blocks.blocks[i].len;
+	}
+	int64_t padding = -1;
+	if (needed == end) {
+		padding = -1;
+	} else if (needed + 4 <= end && end - needed - 4 <= BLOCK_MAX_LEN) {
+		padding = end - needed - 4;
+	} else {
+		padding	   = FINFO_EDIT_PADDING;
+		*rewritten = true;
+	}
+	if (!edit_write_blocks(blocks.blocks, blocks.blocks_n, padding,
+						   &metadata)) {
+		goto end;
+	}
+
+	// Everything comes from the buffers from now on.
+	finfo_input_close(&in);
+	ok = *rewritten ? edit_rewrite(fd, path, &st, metadata.data, metadata.len,
+								   end)
+					: edit_in_place(fd, path, &st, metadata.data,
+									metadata.len);
+
+end:;
+	int err = errno;
+	finfo_input_close(&in);
+	free(blocks.blocks);
+	finfo_buf_free(&vorbis);
+	finfo_buf_free(&metadata);
+	close(fd);
+	errno = err;
+	return ok;
+}
@@ -0,0 +1,68 @@
+#ifndef FINFO_EDIT_H
+#define FINFO_EDIT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "finfo_output.h"
+
+/*
+ * Editing of the vorbis comments and pictures of FLAC files.
+ *
+ * The metadata blocks are written again with the changes, followed by a
+ * single PADDING block sized so that they take the same room as before, so
+ * that only the metadata at the start of the file is written, in place.
+ * Only when the padding is too small, the file is copied with the new
+ * metadata into a temporary file, which is renamed over it.
+ *
+ * Before being written in place, the new metadata is saved to a journal
+ * next to the file, with the suffix FINFO_EDIT_JOURNAL. If the edit is
+ * interrupted, the journal is written to the file the next time it is
+ * edited, or discarded if it is incomplete, in which case the file wasn't
+ * touched yet.
+ */
+
+#define FINFO_EDIT_JOURNAL ".finfo-journal"
+// Padding left after the metadata when a file is copied.
+#define FINFO_EDIT_PADDING 8192
+
+struct finfo_edit {
+	// Comments NAME=VALUE to set, replacing the ones with the same names.
+	char **set;
+	size_t set_n;
+	// Names of the comments to remove.
+	char **remove;
+	size_t remove_n;
+	// Data of the PICTURE block to put in place of the front cover, if any.
+	struct finfo_buf picture;
+	bool has_picture;
+};
+
+void finfo_edit_init(struct finfo_edit *edit);
+void finfo_edit_free(struct finfo_edit *edit);
+// True if EDIT changes anything.
+bool finfo_edit_any(const struct finfo_edit *edit);
+
+/*
+ * Add the comment NAME=VALUE, or the name of a comment to remove.
+ * Returns false if the name is empty or holds a '=', or on allocation
+ * failure.
+ */
+bool finfo_edit_add_set(struct finfo_edit *edit, const char *comment);
+bool finfo_edit_add_remove(struct finfo_edit *edit, const char *name);
+
+/*
+ * Use the PNG or JPEG image at PATH as the front cover.
+ * On failure returns false and sets errno, to EINVAL if it is neither.
+ */
+bool finfo_edit_set_picture(struct finfo_edit *edit, const char *path);
+
+/*
+ * Apply EDIT to the FLAC file at PATH, and set REWRITTEN if it had to be
+ * copied. On failure returns false and sets errno, to EINVAL if the file
+ * is not a FLAC file or its metadata is malformed, and to EFBIG if a block
+ * would be too long.
+ */
+bool finfo_edit_file(const struct finfo_edit *edit, const char *path,
+					 bool *rewritten);
+
+#endif // !FINFO_EDIT_H
@@ -0,0 +1,794 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+#include "finfo_emit.h"
+#include "finfo_options.h"
+
+// Deeper containers are written as if they were part of their parent.
+#define FINFO_EMIT_MAX_DEPTH 16
+
+struct finfo_emit_level {
+	enum finfo_emit_kind kind;
+	unsigned flags;
+	const char *label;
+	// Number of values and containers written inside.
+	size_t items_n;
+	// Text only: indentation of the content, and whether a line of inline
+	// values was started and not ended yet.
+	unsigned indent;
+	bool line_open;
+};
+
+// Containers opened by the file processed by the calling thread.
+// Those beyond the maximum depth all share the last level.
+static _Thread_local struct {
+	struct finfo_emit_level levels[FINFO_EMIT_MAX_DEPTH + 1];
+	unsigned depth;
+	unsigned overflow;
+} emit_state;
+
+static struct finfo_emit_level *emit_top(void) {
+	if (emit_state.overflow > 0) {
+		return &emit_state.levels[FINFO_EMIT_MAX_DEPTH];
+	}
+	return &emit_state.levels[emit_state.depth];
+}
+
+static void emit_reset(void) {
+	emit_state.depth	 = 0;
+	emit_state.overflow	 = 0;
+	emit_state.levels[0] = (struct finfo_emit_level){.kind = FINFO_EMIT_OBJECT};
+}
+
+static struct finfo_emit_level *emit_push(void) {
+	if (emit_state.depth + 1 < FINFO_EMIT_MAX_DEPTH) {
+		emit_state.depth++;
+	} else {
+		emit_state.overflow++;
+	}
+	return emit_top();
+}
+
+static void emit_pop(void) {
+	if (emit_state.overflow > 0) {
+		emit_state.overflow--;
+	} else if (emit_state.depth > 0) {
+		emit_state.depth--;
+	}
+}
+
+static void emit_double(struct finfo_buf *buf, double value, int precision) {
+	char digits[64];
+	int len = snprintf(digits, sizeof(digits), "%.*f", precision, value);
+	if (len > 0) { finfo_buf_append(buf, digits, len); }
+}
+
+// ===== Text =====
+
+static void text_indent(struct finfo_buf *buf, unsigned indent) {
+	static const char tabs[] = "\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t";
+	if (indent >= sizeof(tabs)) { indent = sizeof(tabs) - 1; }
+	finfo_buf_append(buf, tabs, indent);
+}
+
+static void text_end_line(struct finfo_buf *buf,
+						  struct finfo_emit_level *level) {
+	if (level->line_open) {
+		finfo_buf_append(buf, "\n", 1);
+		level->line_open = false;
+	}
+}
+
+static void text_record_begin(struct finfo_buf *buf, const char *path,
+							  bool header) {
+	emit_reset();
+	if (header) {
+		finfo_buf_append_str(buf, "==> ");
+		finfo_buf_append_str(buf, path);
+		finfo_buf_append_str(buf, " <==\n");
+	}
+}
+
+static void text_record_end(struct finfo_buf *buf) {
+	while (emit_state.depth + emit_state.overflow > 0) {
+		text_end_line(buf, emit_top());
+		emit_pop();
+	}
+	text_end_line(buf, emit_top());
+}
+
+static void text_begin(struct finfo_buf *buf, enum finfo_emit_kind kind,
+					   const char *key, const char *label, unsigned flags) {
+	struct finfo_emit_level *parent = emit_top();
+	text_end_line(buf, parent);
+
+	struct finfo_emit_level level = {
+		.kind	= kind,
+		.flags	= flags,
+		.label	= label,
+		.indent = parent->indent,
+	};
+
+	// Objects inside a labeled array are numbered after its label.
+	if (parent->kind == FINFO_EMIT_ARRAY && parent->label != NULL &&
+		kind == FINFO_EMIT_OBJECT) {
+		text_indent(buf, parent->indent);
+		finfo_buf_append_str(buf, parent->label);
+		finfo_buf_append(buf, " ", 1);
+		finfo_buf_append_uint(buf, parent->items_n);
+		finfo_buf_append(buf, "\n", 1);
+		level.indent++;
+	} else if (kind == FINFO_EMIT_OBJECT && label != NULL &&
+			   !(flags & FINFO_EMIT_INLINE)) {
+		text_indent(buf, parent->indent);
+		finfo_buf_append_str(buf, label);
+		finfo_buf_append(buf, "\n", 1);
+		level.indent++;
+	}
+	if (flags & FINFO_EMIT_INDENT) { level.indent++; }
+
+	parent->items_n++;
+	*emit_push() = level;
+}
+
+static void text_end(struct finfo_buf *buf) {
+	text_end_line(buf, emit_top());
+	emit_pop();
+}
+
+static void text_value(struct finfo_buf *buf, const char *key,
+					   const char *label, const struct finfo_value *value) {
+	struct finfo_emit_level *level = emit_top();
+	if (label == NULL && level->kind != FINFO_EMIT_ARRAY) { return; }
+
+	if (!(level->flags & FINFO_EMIT_INLINE)) {
+		text_indent(buf, level->indent);
+	} else if (level->line_open) {
+		finfo_buf_append(buf, ", ", 2);
+	} else {
+		text_indent(buf, level->indent);
+		if (level->label != NULL) {
+			finfo_buf_append_str(buf, level->label);
+			finfo_buf_append(buf, ": ", 2);
+		}
+		level->line_open = true;
+	}
+
+	if (label != NULL) {
+		finfo_buf_append_str(buf, label);
+		finfo_buf_append(buf, ": ", 2);
+	}
+
+	switch (value->type) {
+	case FINFO_VALUE_UINT:
+		finfo_buf_append_uint(buf, value->u);
+		break;
+	case FINFO_VALUE_INT:
+		finfo_buf_append_int(buf, value->i);
+		break;
+	case FINFO_VALUE_BOOL:
+		finfo_buf_append(buf, value->b ? "1" : "0", 1);
+		break;
+	case FINFO_VALUE_DOUBLE:
+		emit_double(buf, value->d, value->precision);
+		break;
+	case FINFO_VALUE_STR:
+		finfo_buf_append(buf, value->data, value->len);
+		break;
+	case FINFO_VALUE_HEX:
+		finfo_buf_append_hex(buf, value->data, value->len);
+		break;
+	}
+
+	if (!(level->flags & FINFO_EMIT_INLINE)) { finfo_buf_append(buf, "\n", 1); }
+	level->items_n++;
+}
+
+static void text_error(struct finfo_buf *buf, const char *message) {
+	struct finfo_emit_level *level = emit_top();
+	text_end_line(buf, level);
+	text_indent(buf, level->indent);
+	finfo_buf_append_str(buf, message);
+	finfo_buf_append(buf, "\n", 1);
+}
+
+const struct finfo_emitter finfo_text_emitter = {
+	.name		  = "text",
+	.stream_begin = "",
+	.separator	  = "",
+	.stream_end	  = "",
+	.images		  = true,
+	.record_begin = text_record_begin,
+	.record_end	  = text_record_end,
+	.begin		  = text_begin,
+	.end		  = text_end,
+	.value		  = text_value,
+	.error		  = text_error,
+};
+
+// ===== JSON =====
+
+/*
+ * Return the length of the UTF-8 sequence starting S, at most LEN bytes
+ * long, or 0 if it is not valid.
+ */
+static size_t json_utf8_len(const unsigned char *s, size_t len) {
+	size_t n;
+	unsigned char min = 0x80, max = 0xBF;
+	if (s[0] >= 0xC2 && s[0] <= 0xDF) {
+		n = 2;
+	} else if (s[0] >= 0xE0 && s[0] <= 0xEF) {
+		n = 3;
+		// No overlong sequences nor surrogates.
+		if (s[0] == 0xE0) { min = 0xA0; }
+		if (s[0] == 0xED) { max = 0x9F; }
+	} else if (s[0] >= 0xF0 && s[0] <= 0xF4) {
+		n = 4;
+		// No overlong sequences nor code points after U+10FFFF.
+		if (s[0] == 0xF0) { min = 0x90; }
+		if (s[0] == 0xF4) { max = 0x8F; }
+	} else {
+		return 0;
+	}
+
+	if (len < n || s[1] < min || s[1] > max) { return 0; }
+	for (size_t i = 2; i < n; i++) {
+		if (s[i] < 0x80 || s[i] > 0xBF) { return 0; }
+	}
+	return n;
+}
+
+/*
+ * Append the string DATA, long LEN bytes, quoted and escaped.
+ * Bytes which are not valid UTF-8 are replaced by U+FFFD, so that the
+ * output is always valid JSON.
+ */
+static void json_string(struct finfo_buf *buf, const void *data, size_t len) {
+	static const char hex[16] = "0123456789abcdef";
+	const unsigned char *s	  = data;
+
+	finfo_buf_append(buf, "\"", 1);
+
+	// Runs of bytes which don't need escaping are copied at once.
+	size_t run = 0;
+	size_t i   = 0;
+	while (i < len) {
+		unsigned char c = s[i];
+		if (c >= 0x20 && c != '"' && c != '\\' && c < 0x80) {
+			i++;
+			continue;
+		}
+
+		size_t n = c >= 0x80 ? json_utf8_len(s + i, len - i) : 0;
+		if (n > 0) {
+			i += n;
+			continue;
+		}
+
+		finfo_buf_append(buf, s + run, i - run);
+		switch (c) {
+		case '"':
+			finfo_buf_append(buf, "\\\"", 2);
+			break;
+		case '\\':
+			finfo_buf_append(buf, "\\\\", 2);
+			break;
+		case '\n':
+			finfo_buf_append(buf, "\\n", 2);
+			break;
+		case '\t':
+			finfo_buf_append(buf, "\\t", 2);
+			break;
+		case '\r':
+			finfo_buf_append(buf, "\\r", 2);
+			break;
+		default:
+			if (c < 0x20) {
+				char escape[6] = {'\\', 'u', '0', '0', hex[c >> 4],
+								  hex[c & 15]};
+				finfo_buf_append(buf, escape, sizeof(escape));
+			} else {
+				finfo_buf_append(buf, "\\ufffd", 6);
+			}
+			break;
+		}
+		i++;
+		run = i;
+	}
+
+	finfo_buf_append(buf, s + run, len - run);
+	finfo_buf_append(buf, "\"", 1);
+}
+
+// Start a new line for the next item, when pretty printing.
+static void json_newline(struct finfo_buf *buf, bool pretty, unsigned depth) {
+	static const char spaces[] = "                                ";
+	if (!pretty) { return; }
+
+	finfo_buf_append(buf, "\n", 1);
+	size_t n = 2 * (size_t)depth;
+	if (n >= sizeof(spaces)) { n = sizeof(spaces) - 1; }
+	finfo_buf_append(buf, spaces, n);
+}
+
+// Write what comes before an item of the current container.
+static void json_item(struct finfo_buf *buf, bool pretty, const char *key) {
+	struct finfo_emit_level *level = emit_top();
+	if (level->items_n++ > 0) { finfo_buf_append(buf, ",", 1); }
+	json_newline(buf, pretty, emit_state.depth + 1);
+
+	if (level->kind == FINFO_EMIT_OBJECT) {
+		json_string(buf, key != NULL ? key : "", key != NULL ? strlen(key) : 0);
+		finfo_buf_append(buf, pretty ? ": " : ":", pretty ? 2 : 1);
+	}
+}
+
+static void json_record_begin(struct finfo_buf *buf) {
+	emit_reset();
+	finfo_buf_append(buf, "{", 1);
+}
+
+static void json_begin(struct finfo_buf *buf, bool pretty,
+					   enum finfo_emit_kind kind, const char *key) {
+	json_item(buf, pretty, key);
+	finfo_buf_append(buf, kind == FINFO_EMIT_OBJECT ? "{" : "[", 1);
+	*emit_push() = (struct finfo_emit_level){.kind = kind};
+}
+
+static void json_end(struct finfo_buf *buf, bool pretty) {
+	struct finfo_emit_level *level = emit_top();
+	unsigned depth				   = emit_state.depth;
+	emit_pop();
+	if (level->items_n > 0) { json_newline(buf, pretty, depth); }
+	finfo_buf_append(buf, level->kind == FINFO_EMIT_OBJECT ? "}" : "]", 1);
+}
+
+static void json_value(struct finfo_buf *buf, bool pretty, const char *key,
+					   const struct finfo_value *value) {
+	json_item(buf, pretty, key);
+
+	switch (value->type) {
+	case FINFO_VALUE_UINT:
+		finfo_buf_append_uint(buf, value->u);
+		break;
+	case FINFO_VALUE_INT:
+		finfo_buf_append_int(buf, value->i);
+		break;
+	case FINFO_VALUE_BOOL:
+		finfo_buf_append_str(buf, value->b ? "true" : "false");
+		break;
+	case FINFO_VALUE_DOUBLE:
+		// JSON has no infinities nor NaN.
+		if (isfinite(value->d)) {
+			emit_double(buf, value->d, value->precision);
+		} else {
+			finfo_buf_append_str(buf, "null");
+		}
+		break;
+	case FINFO_VALUE_STR:
+		json_string(buf, value->data, value->len);
+		break;
+	case FINFO_VALUE_HEX:
+		finfo_buf_append(buf, "\"", 1);
+		finfo_buf_append_hex(buf, value->data, value->len);
+		finfo_buf_append(buf, "\"", 1);
+		break;
+	}
+}
+
+static void json_error(struct finfo_buf *buf, bool pretty,
+					   const char *message) {
+	struct finfo_value value = {
+		.type = FINFO_VALUE_STR,
+		.data = message,
+		.len  = strlen(message),
+	};
+	json_value(buf, pretty, "error", &value);
+}
+
+static void json_record_end(struct finfo_buf *buf, bool pretty) {
+	while (emit_state.depth + emit_state.overflow > 0) {
+		json_end(buf, pretty);
+	}
+	json_end(buf, pretty);
+}
+
+// The two JSON emitters only differ by the whitespace.
+
+static void json_pretty_record_begin(struct finfo_buf *buf, const char *path,
+									 bool header) {
+	json_record_begin(buf);
+	struct finfo_value value = {
+		.type = FINFO_VALUE_STR, .data = path, .len = strlen(path)};
+	json_value(buf, true, "path", &value);
+}
+
+static void json_pretty_record_end(struct finfo_buf *buf) {
+	json_record_end(buf, true);
+}
+
+static void json_pretty_begin(struct finfo_buf *buf, enum finfo_emit_kind kind,
+							  const char *key, const char *label,
+							  unsigned flags) {
+	json_begin(buf, true, kind, key);
+}
+
+static void json_pretty_end(struct finfo_buf *buf) {
+	json_end(buf, true);
+}
+
+static void json_pretty_value(struct finfo_buf *buf, const char *key,
+							  const char *label,
+							  const struct finfo_value *value) {
+	json_value(buf, true, key, value);
+}
+
+static void json_pretty_error(struct finfo_buf *buf, const char *message) {
+	json_error(buf, true, message);
+}
+
+static void ndjson_record_begin(struct finfo_buf *buf, const char *path,
+								bool header) {
+	json_record_begin(buf);
+	struct finfo_value value = {
+		.type = FINFO_VALUE_STR, .data = path, .len = strlen(path)};
+	json_value(buf, false, "path", &value);
+}
+
+static void ndjson_record_end(struct finfo_buf *buf) {
+	json_record_end(buf, false);
+	finfo_buf_append(buf, "\n", 1);
+}
+
+static void ndjson_begin(struct finfo_buf *buf, enum finfo_emit_kind kind,
+						 const char *key, const char *label, unsigned flags) {
+	json_begin(buf, false, kind, key);
+}
+
+static void ndjson_end(struct finfo_buf *buf) {
+	json_end(buf, false);
+}
+
+static void ndjson_value(struct finfo_buf *buf, const char *key,
+						 const char *label, const struct finfo_value *value) {
+	json_value(buf, false, key, value);
+}
+
+static void ndjson_error(struct finfo_buf *buf, const char *message) {
+	json_error(buf, false, message);
+}
+
+const struct finfo_emitter finfo_json_emitter = {
+	.name		  = "json",
+	.stream_begin = "[\n",
+	.separator	  = ",\n",
+	.stream_end	  = "\n]\n",
+	.images		  = false,
+	.record_begin = json_pretty_record_begin,
+	.record_end	  = json_pretty_record_end,
+	.begin		  = json_pretty_begin,
+	.end		  = json_pretty_end,
+	.value		  = json_pretty_value,
+	.error		  = json_pretty_error,
+};
+
+const struct finfo_emitter finfo_ndjson_emitter = {
+	.name		  = "ndjson",
+	.stream_begin = "",
+	.separator	  = "",
+	.stream_end	  = "",
+	.images		  = false,
+	.record_begin = ndjson_record_begin,
+	.record_end	  = ndjson_record_end,
+	.begin		  = ndjson_begin,
+	.end		  = ndjson_end,
+	.value		  = ndjson_value,
+	.error		  = ndjson_error,
+};
+
+// ===== Events =====
+
+/*
+ * Captured events are a sequence of records starting with their type.
+ * Keys and labels are stored with a 16 bits length, 0xFFFF for NULL,
+ * followed by their bytes and a terminating NUL, so that they can be
+ * used in place when replayed. Integers are in native byte order.
+ */
+enum emit_event_type {
+	EMIT_EVENT_BEGIN = 1,
+	EMIT_EVENT_END,
+	EMIT_EVENT_VALUE,
+	EMIT_EVENT_ERROR,
+};
+
+#define EMIT_EVENT_NULL_NAME 0xFFFF
+
+// Buffer capturing the events of the file processed by the calling thread.
+static _Thread_local struct finfo_buf *emit_events;
+
+void finfo_emit_capture(struct finfo_buf *events) {
+	emit_events = events;
+}
+
+static void events_put_u8(uint8_t value) {
+	finfo_buf_append(emit_events, &value, 1);
+}
+
+static void events_put_u64(uint64_t value) {
+	finfo_buf_append(emit_events, &value, sizeof(value));
+}
+
+static void events_put_name(const char *name) {
+	uint16_t len16 = EMIT_EVENT_NULL_NAME;
+	if (name == NULL) {
+		finfo_buf_append(emit_events, &len16, sizeof(len16));
+		return;
+	}
+
+	size_t len = strlen(name);
+	if (len >= EMIT_EVENT_NULL_NAME) { len = EMIT_EVENT_NULL_NAME - 1; }
+	len16 = len;
+	finfo_buf_append(emit_events, &len16, sizeof(len16));
+	finfo_buf_append(emit_events, name, len);
+	events_put_u8(0);
+}
+
+static void events_put_bytes(const void *data, size_t len) {
+	events_put_u64(len);
+	finfo_buf_append(emit_events, data, len);
+}
+
+static void events_put_value(const char *key, const char *label,
+							 const struct finfo_value *value) {
+	events_put_u8(EMIT_EVENT_VALUE);
+	events_put_name(key);
+	events_put_name(label);
+	events_put_u8(value->type);
+
+	switch (value->type) {
+	case FINFO_VALUE_UINT:
+		events_put_u64(value->u);
+		break;
+	case FINFO_VALUE_INT:
+		events_put_u64(value->i);
+		break;
+	case FINFO_VALUE_BOOL:
+		events_put_u8(value->b);
+		break;
+	case FINFO_VALUE_DOUBLE:
+		finfo_buf_append(emit_events, &value->d, sizeof(value->d));
+		events_put_u8(value->precision);
+		break;
+	case FINFO_VALUE_STR:
+	case FINFO_VALUE_HEX:
+		events_put_bytes(value->data, value->len);
+		break;
+	}
+}
+
+// Position in captured events being replayed.
+struct events_reader {
+	const unsigned char *data;
+	size_t len;
+	size_t pos;
+	// False once a read went past the end or met an invalid value.
+	bool ok;
+};
+
+static const void *events_get(struct events_reader *r, size_t len) {
+	if (!r->ok || r->len - r->pos < len) {
+		r->ok = false;
+		return NULL;
+	}
+
+	const void *data = r->data + r->pos;
+	r->pos += len;
+	return data;
+}
+
+static uint8_t events_get_u8(struct events_reader *r) {
+	const uint8_t *data = events_get(r, 1);
+	return data != NULL ? *data : 0;
+}
+
+static uint64_t events_get_u64(struct events_reader *r) {
+	uint64_t value	 = 0;
+	const void *data = events_get(r, sizeof(value));
+	if (data != NULL) { memcpy(&value, data, sizeof(value)); }
+	return value;
+}
+
+static const char *events_get_name(struct events_reader *r) {
+	uint16_t len	 = 0;
+	const void *data = events_get(r, sizeof(len));
+	if (data != NULL) { memcpy(&len, data, sizeof(len)); }
+	if (len == EMIT_EVENT_NULL_NAME) { return NULL; }
+
+	const char *name = events_get(r, len + 1);
+	if (name != NULL && name[len] != '\0') { r->ok = false; }
+	return r->ok ? name : NULL;
+}
+
+static bool events_get_value(struct events_reader *r,
+							 struct finfo_value *dst) {
+	*dst = (struct finfo_value){.type = events_get_u8(r)};
+
+	switch (dst->type) {
+	case FINFO_VALUE_UINT:
+		dst->u = events_get_u64(r);
+		break;
+	case FINFO_VALUE_INT:
+		dst->i = events_get_u64(r);
+		break;
+	case FINFO_VALUE_BOOL:
+		dst->b = events_get_u8(r) != 0;
+		break;
+	case FINFO_VALUE_DOUBLE: {
+		const void *data = events_get(r, sizeof(dst->d));
+		if (data != NULL) { memcpy(&dst->d, data, sizeof(dst->d)); }
+		dst->precision = events_get_u8(r);
+		break;
+	}
+	case FINFO_VALUE_STR:
+	case FINFO_VALUE_HEX:
+		dst->len  = events_get_u64(r);
+		dst->data = events_get(r, dst->len);
+		break;
+	default:
+		r->ok = false;
+	}
+
+	return r->ok;
+}
+
+/*
+ * Read the events DATA, long LEN bytes, and send them to the emitter if
+ * EMIT is true. Returns false if they are invalid.
+ */
+static bool events_walk(const void *data, size_t len, bool emit) {
+	struct events_reader r = {.data = data, .len = len, .ok = true};
+	size_t depth		   = 0;
+
+	while (r.ok && r.pos < r.len) {
+		switch (events_get_u8(&r)) {
+		case EMIT_EVENT_BEGIN: {
+			enum finfo_emit_kind kind = events_get_u8(&r);
+			unsigned flags			  = events_get_u8(&r);
+			const char *key			  = events_get_name(&r);
+			const char *label		  = events_get_name(&r);
+			if (kind != FINFO_EMIT_OBJECT && kind != FINFO_EMIT_ARRAY) {
+				r.ok = false;
+			}
+			if (r.ok && emit) {
+				finfo_opts.emitter->begin(finfo_out, kind, key, label, flags);
+			}
+			depth++;
+			break;
+		}
+		case EMIT_EVENT_END:
+			if (depth-- == 0) { r.ok = false; }
+			if (r.ok && emit) { finfo_opts.emitter->end(finfo_out); }
+			break;
+		case EMIT_EVENT_VALUE: {
+			const char *key	  = events_get_name(&r);
+			const char *label = events_get_name(&r);
+			struct finfo_value value;
+			if (events_get_value(&r, &value) && emit) {
+				finfo_opts.emitter->value(finfo_out, key, label, &value);
+			}
+			break;
+		}
+		case EMIT_EVENT_ERROR: {
+			const char *message = events_get_name(&r);
+			if (message == NULL) { r.ok = false; }
+			if (r.ok && emit) { finfo_opts.emitter->error(finfo_out, message); }
+			break;
+		}
+		default:
+			r.ok = false;
+		}
+	}
+
+	return r.ok;
+}
+
+bool finfo_emit_replay(const void *events, size_t len) {
+	// Check everything first, not to print half of the events.
+	if (!events_walk(events, len, false)) { return false; }
+	return events_walk(events, len, true);
+}
+
+// ===== Front end =====
+
+const struct finfo_emitter *finfo_emitter_find(const char *name) {
+	static const struct finfo_emitter *const emitters[] = {
+		&finfo_text_emitter,
+		&finfo_json_emitter,
+		&finfo_ndjson_emitter,
+	};
+
+	for (size_t i = 0; i < sizeof(emitters) / sizeof(*emitters); i++) {
+		if (strcmp(name, emitters[i]->name) == 0) { return emitters[i]; }
+	}
+	return NULL;
+}
+
+void finfo_emit_record_begin(const char *path, bool header) {
+	finfo_opts.emitter->record_begin(finfo_out, path, header);
+}
+
+void finfo_emit_record_end(void) {
+	finfo_opts.emitter->record_end(finfo_out);
+}
+
+void finfo_emit_begin(enum finfo_emit_kind kind, const char *key,
+					  const char *label, unsigned flags) {
+	if (emit_events != NULL) {
+		events_put_u8(EMIT_EVENT_BEGIN);
+		events_put_u8(kind);
+		events_put_u8(flags);
+		events_put_name(key);
+		events_put_name(label);
+	}
+	finfo_opts.emitter->begin(finfo_out, kind, key, label, flags);
+}
+
+void finfo_emit_end(void) {
+	if (emit_events != NULL) { events_put_u8(EMIT_EVENT_END); }
+	finfo_opts.emitter->end(finfo_out);
+}
+
+void finfo_emit_value(const char *key, const char *label,
+					  const struct finfo_value *value) {
+	if (emit_events != NULL) { events_put_value(key, label, value); }
+	finfo_opts.emitter->value(finfo_out, key, label, value);
+}
+
+void finfo_emit_uint(const char *key, const char *label, uint64_t value) {
+	struct finfo_value v = {.type = FINFO_VALUE_UINT, .u = value};
+	finfo_emit_value(key, label, &v);
+}
+
+void finfo_emit_int(const char *key, const char *label, int64_t value) {
+	struct finfo_value v = {.type = FINFO_VALUE_INT, .i = value};
+	finfo_emit_value(key, label, &v);
+}
+
+void finfo_emit_bool(const char *key, const char *label, bool value) {
+	struct finfo_value v = {.type = FINFO_VALUE_BOOL, .b = value};
+	finfo_emit_value(key, label, &v);
+}
+
+void finfo_emit_double(const char *key, const char *label, double value,
+					   int precision) {
+	struct finfo_value v = {
+		.type = FINFO_VALUE_DOUBLE, .d = value, .precision = precision};
+	finfo_emit_value(key, label, &v);
+}
+
+void finfo_emit_str(const char *key, const char *label, const char *str,
+					size_t len) {
+	struct finfo_value v = {.type = FINFO_VALUE_STR, .data = str, .len = len};
+	finfo_emit_value(key, label, &v);
+}
+
+void finfo_emit_hex(const char *key, const char *label,
+					const unsigned char *data, size_t len) {
+	struct finfo_value v = {.type = FINFO_VALUE_HEX, .data = data, .len = len};
+	finfo_emit_value(key, label, &v);
+}
+
+void finfo_emit_error(const char *fmt, ...) {
+	char message[512];
+	va_list ap;
+	va_start(ap, fmt);
+	vsnprintf(message, sizeof(message), fmt, ap);
+	va_end(ap);
+
+	if (emit_events != NULL) {
+		events_put_u8(EMIT_EVENT_ERROR);
+		events_put_name(message);
+	}
+	finfo_opts.emitter->error(finfo_out, message);
+}
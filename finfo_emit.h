@@ -0,0 +1,129 @@
+#ifndef FINFO_EMIT_H
+#define FINFO_EMIT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "finfo_output.h"
+
+/*
+ * Structured output of the parsed files.
+ * Printers describe each file as nested objects and arrays of values,
+ * through the finfo_emit_* functions, and the selected emitter writes them
+ * to finfo_out as human readable text or as JSON.
+ *
+ * Every value has a KEY, used by JSON, and a LABEL, used by text. Values
+ * without a label are only part of the JSON output, except for the items
+ * of arrays, which text prints alone on their line.
+ */
+
+enum finfo_emit_kind {
+	FINFO_EMIT_OBJECT,
+	FINFO_EMIT_ARRAY,
+};
+
+// How the text emitter lays out the content of an object or array.
+enum finfo_emit_flags {
+	// Print the values on a single line, after the label if any.
+	FINFO_EMIT_INLINE = 1 << 0,
+	// Indent the content, even without a label.
+	FINFO_EMIT_INDENT = 1 << 1,
+};
+
+enum finfo_value_type {
+	FINFO_VALUE_UINT,
+	FINFO_VALUE_INT,
+	FINFO_VALUE_BOOL,
+	FINFO_VALUE_DOUBLE,
+	FINFO_VALUE_STR,
+	FINFO_VALUE_HEX,
+};
+
+struct finfo_value {
+	enum finfo_value_type type;
+	union {
+		uint64_t u;
+		int64_t i;
+		bool b;
+		double d;
+		// String or bytes, long LEN bytes.
+		const void *data;
+	};
+	size_t len;
+	// Digits after the decimal point of doubles.
+	int precision;
+};
+
+struct finfo_emitter {
+	const char *name;
+	// Written before the first file, between two files and after the last.
+	const char *stream_begin;
+	const char *separator;
+	const char *stream_end;
+	// True if images can be printed along with the output.
+	bool images;
+
+	// Start the output of the file PATH, whose name is printed by text only
+	// if HEADER is true.
+	void (*record_begin)(struct finfo_buf *buf, const char *path,
+						 bool header);
+	void (*record_end)(struct finfo_buf *buf);
+	void (*begin)(struct finfo_buf *buf, enum finfo_emit_kind kind,
+				  const char *key, const char *label, unsigned flags);
+	void (*end)(struct finfo_buf *buf);
+	void (*value)(struct finfo_buf *buf, const char *key, const char *label,
+				  const struct finfo_value *value);
+	// Report an error which stopped the parsing of the file.
+	void (*error)(struct finfo_buf *buf, const char *message);
+};
+
+// Human readable text, the default.
+extern const struct finfo_emitter finfo_text_emitter;
+// A single JSON array, with an object per file.
+extern const struct finfo_emitter finfo_json_emitter;
+// A compact JSON object per file and per line.
+extern const struct finfo_emitter finfo_ndjson_emitter;
+
+// Return the emitter called NAME, or NULL if there is none.
+const struct finfo_emitter *finfo_emitter_find(const char *name);
+
+/*
+ * Functions writing to finfo_out through the emitter selected by
+ * finfo_opts.emitter.
+ */
+void finfo_emit_record_begin(const char *path, bool header);
+void finfo_emit_record_end(void);
+void finfo_emit_begin(enum finfo_emit_kind kind, const char *key,
+					  const char *label, unsigned flags);
+void finfo_emit_end(void);
+
+void finfo_emit_value(const char *key, const char *label,
+					  const struct finfo_value *value);
+void finfo_emit_uint(const char *key, const char *label, uint64_t value);
+void finfo_emit_int(const char *key, const char *label, int64_t value);
+void finfo_emit_bool(const char *key, const char *label, bool value);
+void finfo_emit_double(const char *key, const char *label, double value,
+					   int precision);
+// Emit the string STR, long LEN bytes, which doesn't need to be terminated.
+void finfo_emit_str(const char *key, const char *label, const char *str,
+					size_t len);
+// Emit the bytes DATA, long LEN bytes, as hex digits.
+void finfo_emit_hex(const char *key, const char *label,
+					const unsigned char *data, size_t len);
+void finfo_emit_error(const char *fmt, ...)
+	__attribute__((format(printf, 1, 2)));
+
+/*
+ * Also append to EVENTS everything emitted by the calling thread, up to
+ * the next call with NULL, in a compact binary form. Records are not part
+ * of the events.
+ */
+void finfo_emit_capture(struct finfo_buf *events);
+/*
+ * Emit again the events EVENTS, long LEN bytes, captured by
+ * finfo_emit_capture. Returns false, without emitting anything, if they
+ * are not valid.
+ */
+bool finfo_emit_replay(const void *events, size_t len);
+
+#endif // !FINFO_EMIT_H
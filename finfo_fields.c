@@ -0,0 +1,104 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "finfo_fields.h"
+
+bool finfo_fields_parse(struct finfo_fields *dst, const char *list) {
+	*dst = (struct finfo_fields){0};
+
+	size_t names_n = 1;
+	for (const char *c = list; *c != '\0'; c++) { names_n += *c == ','; }
+
+	dst->names = calloc(names_n, sizeof(*dst->names));
+	if (dst->names == NULL) { return false; }
+
+	const char *start = list;
+	while (true) {
+		size_t len = strcspn(start, ",");
+		if (len == 0) { goto fail; }
+
+		char *name = malloc(len + 1);
+		if (name == NULL) { goto fail; }
+		memcpy(name, start, len);
+		name[len]					 = '\0';
+		dst->names[dst->names_n++] = name;
+
+		if (start[len] == '\0') { return true; }
+		start += len + 1;
+	}
+
+fail:
+	finfo_fields_free(dst);
+	return false;
+}
+
+void finfo_fields_free(struct finfo_fields *fields) {
+	for (size_t i = 0; i < fields->names_n; i++) { free(fields->names[i]); }
+	free(fields->names);
+	*fields = (struct finfo_fields){0};
+}
+
+bool finfo_projection_init(struct finfo_projection *proj,
+						   const struct finfo_fields *fields,
+						   struct finfo_arena *arena) {
+	size_t n = fields->names_n;
+	*proj	 = (struct finfo_projection){
+		   .fields = fields,
+		   .values = finfo_arena_calloc(arena, n, sizeof(*proj->values)),
+		   .set	   = finfo_arena_calloc(arena, n, sizeof(*proj->set)),
+		   .left   = n,
+	   };
+	return proj->values != NULL && proj->set != NULL;
+}
+
+void finfo_projection_set_at(struct finfo_projection *proj, size_t i,
+							 const struct finfo_value *value) {
+	if (proj->set[i]) { return; }
+	proj->values[i] = *value;
+	proj->set[i]	= true;
+	proj->left--;
+}
+
+void finfo_projection_set(struct finfo_projection *proj, const char *name,
+						  const struct finfo_value *value) {
+	// The same field may be selected more than once.
+	for (size_t i = 0; i < proj->fields->names_n; i++) {
+		if (strcmp(proj->fields->names[i], name) == 0) {
+			finfo_projection_set_at(proj, i, value);
+		}
+	}
+}
+
+void finfo_projection_set_uint(struct finfo_projection *proj, const char *name,
+							   uint64_t value) {
+	struct finfo_value v = {.type = FINFO_VALUE_UINT, .u = value};
+	finfo_projection_set(proj, name, &v);
+}
+
+void finfo_projection_set_double(struct finfo_projection *proj,
+								 const char *name, double value,
+								 int precision) {
+	struct finfo_value v = {
+		.type = FINFO_VALUE_DOUBLE, .d = value, .precision = precision};
+	finfo_projection_set(proj, name, &v);
+}
+
+void finfo_projection_set_str(struct finfo_projection *proj, const char *name,
+							  const char *str, size_t len) {
+	struct finfo_value v = {.type = FINFO_VALUE_STR, .data = str, .len = len};
+	finfo_projection_set(proj, name, &v);
+}
+
+void finfo_projection_set_hex(struct finfo_projection *proj, const char *name,
+							  const unsigned char *data, size_t len) {
+	struct finfo_value v = {.type = FINFO_VALUE_HEX, .data = data, .len = len};
+	finfo_projection_set(proj, name, &v);
+}
+
+void finfo_projection_emit(const struct finfo_projection *proj) {
+	for (size_t i = 0; i < proj->fields->names_n; i++) {
+		if (!proj->set[i]) { continue; }
+		const char *name = proj->fields->names[i];
+		finfo_emit_value(name, name, &proj->values[i]);
+	}
+}
@@ -0,0 +1,66 @@
+#ifndef FINFO_FIELDS_H
+#define FINFO_FIELDS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "finfo_arena.h"
+#include "finfo_emit.h"
+
+/*
+ * Fields selected with --fields, in the order they are printed.
+ * With a selection, parsers only read the blocks and chunks holding the
+ * selected fields, and stop as soon as all of them are found, instead of
+ * printing everything.
+ */
+struct finfo_fields {
+	char **names;
+	size_t names_n;
+};
+
+/*
+ * Parse the comma separated list of field names LIST into DST.
+ * Returns false if the list holds an empty name, or on allocation failure.
+ */
+bool finfo_fields_parse(struct finfo_fields *dst, const char *list);
+void finfo_fields_free(struct finfo_fields *fields);
+
+// Values found for the selected fields of a single file.
+struct finfo_projection {
+	const struct finfo_fields *fields;
+	// Value of each field, in the order of the names, valid if SET.
+	struct finfo_value *values;
+	bool *set;
+	// Number of fields not set yet.
+	size_t left;
+};
+
+/*
+ * Start the projection of FIELDS, allocated from ARENA.
+ * Returns false on allocation failure.
+ */
+bool finfo_projection_init(struct finfo_projection *proj,
+						   const struct finfo_fields *fields,
+						   struct finfo_arena *arena);
+/*
+ * Set the field called NAME to VALUE, unless it wasn't selected or was
+ * already set. Strings and bytes must stay valid until they are emitted.
+ */
+void finfo_projection_set(struct finfo_projection *proj, const char *name,
+						  const struct finfo_value *value);
+void finfo_projection_set_uint(struct finfo_projection *proj, const char *name,
+							   uint64_t value);
+void finfo_projection_set_double(struct finfo_projection *proj,
+								 const char *name, double value,
+								 int precision);
+void finfo_projection_set_str(struct finfo_projection *proj, const char *name,
+							  const char *str, size_t len);
+void finfo_projection_set_hex(struct finfo_projection *proj, const char *name,
+							  const unsigned char *data, size_t len);
+// Set the I-th field to VALUE, unless it was already set.
+void finfo_projection_set_at(struct finfo_projection *proj, size_t i,
+							 const struct finfo_value *value);
+// Emit the fields which were set, in the order they were selected.
+void finfo_projection_emit(const struct finfo_projection *proj);
+
+#endif // !FINFO_FIELDS_H
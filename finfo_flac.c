@@ -2,13 +2,27 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
-#include <sys/ioctl.h>
+#include <strings.h>
 #include "finfo_flac.h"
-#include "finfo_png.h"
+#include "finfo_cursor.h"
+#include "finfo_emit.h"
+#include "finfo_fields.h"
+#include "finfo_flac_decode.h"
+#include "finfo_flac_frame.h"
+#include "finfo_flac_seek.h"
+#include "finfo_kitty.h"
+#include "finfo_options.h"
 #include "finfo_utils.h"
 
 unsigned char FLAC_SIGNATURE[4] = {'\x66', '\x4C', '\x61', '\x43'};
 
+const struct finfo_format flac_format = {
+	.name		   = "flac",
+	.signature	   = FLAC_SIGNATURE,
+	.signature_len = sizeof(FLAC_SIGNATURE),
+	.parse		   = try_flac,
+};
+
 /*
 * Return a null terminated string representing the input flac metadata type.
 */
@@ -36,409 +50,827 @@ char *flac_metadata_type_str(enum flac_metadata_type type) {
 // ===== Block printers =====
 
 void flac_print_streaminfo(struct flac_streaminfo *info) {
-	printf("Min block size: %u\n", info->min_blk_size);
-	printf("Max block size: %u\n", info->max_blk_size);
-	printf("Min frame size: %u\n", info->min_frame_size);
-	printf("Max frame size: %u\n", info->max_frame_size);
-	printf("Sample rate: %u\n", info->sample_rate);
-	printf("Number of channels: %u\n", info->channels + 1);
-	printf("Bits per sample: %u\n", info->bits_per_sample + 1);
-	printf("Total samples: %lu\n", info->interchannel_samples);
-	printf("MD5sum:");
-	for (int i = 0; i < 16; i++) {
-		printf("%02x", (unsigned char)info->md5sum[i]);
-	}
-	printf("\n");
+	finfo_emit_begin(FINFO_EMIT_OBJECT, "streaminfo", NULL, 0);
+	finfo_emit_uint("min_block_size", "Min block size", info->min_blk_size);
+	finfo_emit_uint("max_block_size", "Max block size", info->max_blk_size);
+	finfo_emit_uint("min_frame_size", "Min frame size", info->min_frame_size);
+	finfo_emit_uint("max_frame_size", "Max frame size", info->max_frame_size);
+	finfo_emit_uint("sample_rate", "Sample rate", info->sample_rate);
+	finfo_emit_uint("channels", "Number of channels", info->channels + 1);
+	finfo_emit_uint("bits_per_sample", "Bits per sample",
+					info->bits_per_sample + 1);
+	finfo_emit_uint("total_samples", "Total samples",
+					info->interchannel_samples);
+	finfo_emit_hex("md5", "MD5sum", info->md5sum, sizeof(info->md5sum));
+	finfo_emit_end();
 }
 
 void flac_print_application(struct flac_application *application) {
 	// TODO:test
-	printf("AppId: %d, App data: %s\n", application->app_id,
-		   application->app_data);
+	finfo_emit_begin(FINFO_EMIT_OBJECT, "application", NULL, FINFO_EMIT_INLINE);
+	finfo_emit_uint("app_id", "AppId", application->app_id);
+	finfo_emit_str("app_data", "App data", (const char *)application->app_data,
+				   application->app_data_len);
+	finfo_emit_end();
 }
 
 void flac_print_seek_table(struct flac_seek_table *table) {
+	finfo_emit_begin(FINFO_EMIT_ARRAY, "seek_points", NULL, 0);
 	for (size_t i = 0; i < table->seek_points_n; i++) {
 		struct flac_seek_point point = table->seek_points[i];
-		printf("first sample: %lu, offset: %lu, samples: %ud\n",
-			   point.first_sample, point.offset, point.samples_n);
+		finfo_emit_begin(FINFO_EMIT_OBJECT, NULL, NULL, FINFO_EMIT_INLINE);
+		finfo_emit_uint("first_sample", "first sample", point.first_sample);
+		finfo_emit_uint("offset", "offset", point.offset);
+		finfo_emit_uint("samples", "samples", point.samples_n);
+		finfo_emit_end();
 	}
+	finfo_emit_end();
 }
 
 void flac_print_vorbis_comment(struct flac_vorbis_comment *vorbis) {
-	printf("vendor: %.*s\n", vorbis->vendor_string_len, vorbis->vendor_string);
+	finfo_emit_begin(FINFO_EMIT_OBJECT, "vorbis_comment", NULL, 0);
+	finfo_emit_str("vendor", "vendor", (const char *)vorbis->vendor_string,
+				   vorbis->vendor_string_len);
 
+	finfo_emit_begin(FINFO_EMIT_ARRAY, "comments", NULL, 0);
 	for (size_t i = 0; i < vorbis->fields_n; i++) {
-		printf("%.*s\n", vorbis->fields[i].length, vorbis->fields[i].data);
+		finfo_emit_str(NULL, NULL, vorbis->fields[i].data,
+					   vorbis->fields[i].length);
 	}
+	finfo_emit_end();
+	finfo_emit_end();
 }
 
 void flac_print_cuesheet(struct flac_cuesheet *cuesheet) {
-	printf("Media catalog number: %.128s\n", cuesheet->catalog_number);
-	printf("Lead-in samples: %lu\n", cuesheet->leadin_samples);
-	printf("CD-DA: %d\n", cuesheet->cd_da);
-	printf("Number of tracks: %u\n", cuesheet->tracks_n);
-
+	finfo_emit_begin(FINFO_EMIT_OBJECT, "cuesheet", NULL, 0);
+	finfo_emit_str("catalog_number", "Media catalog number",
+				   cuesheet->catalog_number,
+				   strnlen(cuesheet->catalog_number, 128));
+	finfo_emit_uint("leadin_samples", "Lead-in samples",
+					cuesheet->leadin_samples);
+	finfo_emit_bool("cd_da", "CD-DA", cuesheet->cd_da);
+	finfo_emit_uint("tracks_n", "Number of tracks", cuesheet->tracks_n);
+
+	finfo_emit_begin(FINFO_EMIT_ARRAY, "tracks", "Track", 0);
 	for (size_t i = 0; i < cuesheet->tracks_n; i++) {
-		printf("Track %lu\n", i);
-		printf("\tOffset: %lu\n", cuesheet->tracks[i].offset);
-		printf("\tNumber: %u\n", cuesheet->tracks[i].number);
-		printf("\tISRC: %.12s\n", cuesheet->tracks[i].ISRC);
-		printf("\tAudio: %d\n", cuesheet->tracks[i].audio);
-		printf("\tPre-emphasis: %d\n", cuesheet->tracks[i].pre_emphasis);
-		printf("\tNumber of index points: %u\n",
-			   cuesheet->tracks[i].idx_points_n);
-
-		for (size_t j = 0; j < cuesheet->tracks[i].idx_points_n; j++) {
-			printf("\tPoint %lu\n", j);
-			printf("\t\tOffset: %lu\n",
-				   cuesheet->tracks[i].idx_points[j].offset);
-			printf("\t\tNumber: %u\n",
-				   cuesheet->tracks[i].idx_points[j].number);
+		struct flac_cuesheet_track *track = &cuesheet->tracks[i];
+		finfo_emit_begin(FINFO_EMIT_OBJECT, NULL, NULL, 0);
+		finfo_emit_uint("offset", "Offset", track->offset);
+		finfo_emit_uint("number", "Number", track->number);
+		finfo_emit_str("isrc", "ISRC", track->ISRC, strnlen(track->ISRC, 12));
+		finfo_emit_bool("audio", "Audio", track->audio);
+		finfo_emit_bool("pre_emphasis", "Pre-emphasis", track->pre_emphasis);
+		finfo_emit_uint("index_points_n", "Number of index points",
+						track->idx_points_n);
+
+		finfo_emit_begin(FINFO_EMIT_ARRAY, "index_points", "Point", 0);
+		for (size_t j = 0; j < track->idx_points_n; j++) {
+			finfo_emit_begin(FINFO_EMIT_OBJECT, NULL, NULL, 0);
+			finfo_emit_uint("offset", "Offset", track->idx_points[j].offset);
+			finfo_emit_uint("number", "Number", track->idx_points[j].number);
+			finfo_emit_end();
 		}
+		finfo_emit_end();
+		finfo_emit_end();
+	}
+	finfo_emit_end();
+	finfo_emit_end();
+}
+
+void flac_print_picture(struct finfo_input *in,
+						struct flac_picture *picture) {
+	finfo_emit_begin(FINFO_EMIT_OBJECT, "picture", NULL, 0);
+	finfo_emit_uint("type", "Picture type", picture->type);
+	finfo_emit_uint("media_type_len", "Media type strlen",
+					picture->media_type_string_len);
+	finfo_emit_str("media_type", "Media type", picture->media_type_string,
+				   picture->media_type_string_len);
+	finfo_emit_uint("description_len", "Description strlen",
+					picture->description_len);
+	finfo_emit_str("description", "Description", picture->description,
+				   picture->description_len);
+	finfo_emit_uint("color_depth", "Color depth", picture->color_depth);
+	finfo_emit_uint("colors_n", "Number of colors", picture->color_n);
+	finfo_emit_uint("width", "Picture width", picture->picture_width);
+	finfo_emit_uint("height", "Picture height", picture->picture_height);
+	finfo_emit_uint("data_len", "Data len", picture->data_len);
+	finfo_emit_end();
+
+	if (finfo_opts.no_images) { return; }
+
+	struct finfo_view data;
+	if (!finfo_input_view(in, picture->data_offset, picture->data_len,
+						  &data)) {
+		return;
 	}
+	print_png(data.data, data.len);
 }
 
-void flac_print_picture(struct flac_picture *picture) {
-	printf("Picture type: %u\n", picture->type);
-	printf("Media type strlen: %u\n", picture->media_type_string_len);
-	printf("Media type: %s\n", picture->media_type_string);
-	printf("Description strlen: %u\n", picture->description_len);
-	printf("Description: %s\n", picture->description);
-	printf("Color depth: %u\n", picture->color_depth);
-	printf("Number of colors: %u\n", picture->color_n);
-	printf("Picture width: %u\n", picture->picture_width);
-	printf("Picture height: %u\n", picture->picture_height);
-	printf("Data len: %u\n", picture->data_len);
-
-	// TODO: check errors
-	// FILE *picture_file = fopen("./temp_picture", "wb");
-	// fwrite(picture->data, picture->data_len, 1, picture_file);
-	// fclose(picture_file);
-
-	print_png(picture->data, picture->data_len);
+// Print the metadata block BLOCK, parsed from the input IN.
+void flac_print_block(struct finfo_input *in,
+					  struct flac_metadata_block *block) {
+	finfo_emit_begin(FINFO_EMIT_OBJECT, NULL, NULL, FINFO_EMIT_INLINE);
+	finfo_emit_bool("last", "last", block->last_block);
+	const char *type = flac_metadata_type_str(block->type);
+	finfo_emit_str("type", "type", type, strlen(type));
+	finfo_emit_uint("length", "length", block->block_length);
+
+	switch (block->type) {
+	case FLAC_STREAMINFO_TYPE:
+		flac_print_streaminfo(&block->data.streaminfo);
+		break;
+	case FLAC_APPLICATION_TYPE:
+		flac_print_application(&block->data.application);
+		break;
+	case FLAC_SEEK_TABLE_TYPE:
+		flac_print_seek_table(&block->data.seek_table);
+		break;
+	case FLAC_VORBIS_COMMENT_TYPE:
+		flac_print_vorbis_comment(&block->data.vorbis_comment);
+		break;
+	case FLAC_CUESHEET_TYPE:
+		flac_print_cuesheet(&block->data.cuesheet);
+		break;
+	case FLAC_PICTURE_TYPE:
+		flac_print_picture(in, &block->data.picture);
+		break;
+	default:
+		break;
+	}
+
+	finfo_emit_end();
 }
 
 // ===== Block parsers =====
 
-// TODO: Use the SIZE argument of the functions to check for buffer overflows.
+/*
+ * Blocks are parsed in two passes over their data: flac_check_* follow the
+ * lengths and counts of the block to make sure that everything they describe
+ * fits inside it, and only then flac_parse_* decode its fields, without
+ * checking anything again.
+ */
+
+// Length of the streaminfo block.
+#define FLAC_STREAMINFO_LEN 34
+// Length of a seek point.
+#define FLAC_SEEK_POINT_LEN 18
+// Length of the cuesheet fields before the number of tracks.
+#define FLAC_CUESHEET_LEN (128 + 8 + 1 + 258)
+// Length of the track fields before the number of index points.
+#define FLAC_CUESHEET_TRACK_LEN (8 + 1 + 12 + 1 + 13)
+// Length of an index point.
+#define FLAC_CUESHEET_POINT_LEN (8 + 1 + 3)
+
+static bool flac_check_streaminfo(struct finfo_cursor cur) {
+	return finfo_cursor_skip(&cur, FLAC_STREAMINFO_LEN);
+}
 
 /*
-* Parse the given array of bytes BLOCK, long SIZE bytes, as a streaminfo metadata block,
-* and put it inside DST.
-*/
-void flac_parse_streaminfo(unsigned char *block, int size,
-						   struct flac_metadata_block *dst) {
+ * Parse the streaminfo metadata block at CUR, and put it inside DST.
+ */
+static void flac_parse_streaminfo(struct finfo_cursor cur,
+								  struct flac_metadata_block *dst) {
 	struct flac_streaminfo *streaminfo = &dst->data.streaminfo;
-	// First 16 bits
-	streaminfo->min_blk_size = BE_bytes_to_int(block, 2);
-	// Next 16 bits
-	streaminfo->max_blk_size = BE_bytes_to_int(block + 2, 2);
-	// Next 24 bits
-	streaminfo->min_frame_size = BE_bytes_to_int(block + 4, 3);
-	// Next 24 bits
-	streaminfo->max_frame_size = BE_bytes_to_int(block + 7, 3);
-
-	// Next 20 bits
-	// We have to make this: 12345678 12345678 12340000
-	// Into this:			 00001234 56781234 56781234
-	unsigned char buf[3] = {
-		((block[10] & 0b11110000) >> 4),
-		((block[11] & 0b11110000) >> 4) + ((block[10] & 0b00001111) << 4),
-		((block[12] & 0b11110000) >> 4) + ((block[11] & 0b00001111) << 4)};
-	streaminfo->sample_rate = BE_bytes_to_int(buf, 3);
-
-	// Next 3 bits
-	streaminfo->channels = (block[12] & 0b00001110) >> 1;
-
-	// Next 5 bits. The last bit of the 12th byte and the first 4 bits of the next byte.
-	streaminfo->bits_per_sample =
-		((block[12] & 1) << 4) + ((block[13] & 0b11110000) >> 4);
-
-	// Next 36 bits. The last 4 bits of the 13th byte and the next 4 bytes.
-	uint64_t first4bits_sample_rate = block[13] & 0b00001111;
-	streaminfo->interchannel_samples =
-		BE_bytes_to_int(block + 14, 4) + (first4bits_sample_rate << 8 * 4);
-
-	// Last 128 bits (16 bytes).
-	memcpy(streaminfo->md5sum, block + 18, 16);
-
-	flac_print_streaminfo(streaminfo);
+	streaminfo->min_blk_size		   = finfo_cursor_be16(&cur);
+	streaminfo->max_blk_size		   = finfo_cursor_be16(&cur);
+	streaminfo->min_frame_size		   = finfo_cursor_be24(&cur);
+	streaminfo->max_frame_size		   = finfo_cursor_be24(&cur);
+
+	// Sample rate (20 bits), channels (3 bits), bits per sample (5 bits) and
+	// total samples (36 bits).
+	uint64_t fields					 = finfo_cursor_be64(&cur);
+	streaminfo->sample_rate			 = extract_bits(fields, 0, 20);
+	streaminfo->channels			 = extract_bits(fields, 20, 3);
+	streaminfo->bits_per_sample		 = extract_bits(fields, 23, 5);
+	streaminfo->interchannel_samples = extract_bits(fields, 28, 36);
+
+	memcpy(streaminfo->md5sum, finfo_cursor_bytes(&cur, 16), 16);
+}
+
+static bool flac_check_application(struct finfo_cursor cur) {
+	// Application id.
+	return finfo_cursor_skip(&cur, 4);
 }
 
 /*
-* Parse the given array of bytes BLOCK, long SIZE bytes, as an application metadata block,
-* and put it inside DST.
-*/
-void flac_parse_application(unsigned char *block, int size,
-							struct flac_metadata_block *dst) {
+ * Parse the application metadata block at CUR, and put it inside DST.
+ */
+static void flac_parse_application(struct finfo_cursor cur,
+								   struct flac_metadata_block *dst) {
 	struct flac_application *application = &dst->data.application;
 
-	application->app_id	  = BE_bytes_to_int(block, 4);
-	application->app_data = malloc(dst->block_length - 4);
-	memcpy(application->app_data, block + 4, dst->block_length - 4);
-
-	flac_print_application(application);
+	application->app_id		  = finfo_cursor_be32(&cur);
+	application->app_data_len = finfo_cursor_left(&cur);
+	application->app_data	  = finfo_cursor_bytes(&cur, finfo_cursor_left(&cur));
 }
 
 /*
-* Parse the given array of bytes BLOCK, long SIZE bytes, as a seek table metadata block,
-* and put it inside DST.
-*/
-void flac_parse_seekTable(unsigned char *block, int size,
-						  struct flac_metadata_block *dst) {
+ * Parse the seek table metadata block at CUR, and put it inside DST.
+ * Its arrays are allocated from ARENA. Any trailing bytes too short for a
+ * seek point are ignored, so the block needs no check.
+ */
+static void flac_parse_seekTable(struct finfo_arena *arena,
+								 struct finfo_cursor cur,
+								 struct flac_metadata_block *dst) {
 	struct flac_seek_table *seek_table = &dst->data.seek_table;
 
-	// Each seek point is 18 bytes long.
-	const int seek_point_size = 18;
-	size_t points			  = dst->block_length / seek_point_size;
+	size_t points			  = finfo_cursor_left(&cur) / FLAC_SEEK_POINT_LEN;
+	seek_table->seek_points	  = finfo_arena_calloc(
+		  arena, points, sizeof(struct flac_seek_point));
+	seek_table->seek_points_n = seek_table->seek_points ? points : 0;
 
-	seek_table->seek_points_n = points;
-	seek_table->seek_points	  = calloc(points, sizeof(struct flac_seek_point));
+	for (size_t i = 0; i < seek_table->seek_points_n; i++) {
+		struct flac_seek_point *point = &seek_table->seek_points[i];
+		point->first_sample			  = finfo_cursor_be64(&cur);
+		point->offset				  = finfo_cursor_be64(&cur);
+		point->samples_n			  = finfo_cursor_be16(&cur);
+	}
+}
 
-	for (size_t i = 0; i < points; i++) {
-		unsigned char *point_p = block + (i * seek_point_size);
+static bool flac_check_vorbisComment(struct finfo_cursor cur) {
+	uint32_t len, fields_n;
+	if (!finfo_cursor_check_le32(&cur, &len) ||
+		!finfo_cursor_skip(&cur, len) ||
+		!finfo_cursor_check_le32(&cur, &fields_n)) {
+		return false;
+	}
 
-		struct flac_seek_point point = {
-			// First 64 bits of the point.
-			.first_sample = BE_bytes_to_int(point_p, 8),
-			// Next 64 bits of the point.
-			.offset = BE_bytes_to_int(point_p, 8),
-			// Last 16 bits of the point.
-			.samples_n = BE_bytes_to_int(point_p, 2),
-		};
+	// Every field has at least its length, which bounds the count before
+	// walking the fields.
+	struct finfo_cursor lengths = cur;
+	if (!finfo_cursor_skip_array(&lengths, fields_n, 4)) { return false; }
 
-		seek_table->seek_points[i] = point;
+	for (uint32_t i = 0; i < fields_n; i++) {
+		if (!finfo_cursor_check_le32(&cur, &len) ||
+			!finfo_cursor_skip(&cur, len)) {
+			return false;
+		}
 	}
-
-	flac_print_seek_table(seek_table);
+	return true;
 }
 
 /*
-* Parse the given array of bytes BLOCK, long SIZE bytes, as a vorbis comment metadata block,
-* and put it inside DST.
-*/
-void flac_parse_vorbisComment(unsigned char *block, int size,
-							  struct flac_metadata_block *dst) {
+ * Parse the vorbis comment metadata block at CUR, and put it inside DST.
+ * Its arrays are allocated from ARENA.
+ */
+static void flac_parse_vorbisComment(struct finfo_arena *arena,
+									 struct finfo_cursor cur,
+									 struct flac_metadata_block *dst) {
 	struct flac_vorbis_comment *vorbis = &dst->data.vorbis_comment;
 
-	vorbis->vendor_string_len = LE_bytes_to_int(block, 4);
-
-	vorbis->vendor_string = malloc(vorbis->vendor_string_len);
-	memcpy(vorbis->vendor_string, block + 4, vorbis->vendor_string_len);
-
-	vorbis->fields_n =
-		LE_bytes_to_int(block + 4 + vorbis->vendor_string_len, 4);
-
-	vorbis->fields = calloc(vorbis->fields_n, sizeof(struct flac_vorbis_field));
+	vorbis->vendor_string_len = finfo_cursor_le32(&cur);
+	vorbis->vendor_string =
+		finfo_cursor_bytes(&cur, vorbis->vendor_string_len);
 
-	// The fields start after the vendor string length,
-	// the vendor string, and the fields number.
-	unsigned char *fields_start = block + 4 + vorbis->vendor_string_len + 4;
+	uint32_t fields_n = finfo_cursor_le32(&cur);
+	vorbis->fields	  = finfo_arena_calloc(arena, fields_n,
+										   sizeof(struct flac_vorbis_field));
+	vorbis->fields_n  = vorbis->fields ? fields_n : 0;
 
-	int offset = 0;
 	for (size_t i = 0; i < vorbis->fields_n; i++) {
-		vorbis->fields[i].length = LE_bytes_to_int(fields_start + (offset), 4);
-
-		vorbis->fields[i].data = malloc(vorbis->fields[i].length);
-		memcpy(vorbis->fields[i].data, fields_start + offset + 4,
-			   vorbis->fields[i].length);
+		struct flac_vorbis_field *field = &vorbis->fields[i];
+		field->length					= finfo_cursor_le32(&cur);
+		field->data = (const char *)finfo_cursor_bytes(&cur, field->length);
+	}
+}
 
-		// Update the offset from the start of the vorbis fields by
-		// adding the bytes occupied by the current field's
-		// length and data.
-		offset += 4 + vorbis->fields[i].length;
+static bool flac_check_cuesheet(struct finfo_cursor cur) {
+	uint32_t tracks_n;
+	if (!finfo_cursor_skip(&cur, FLAC_CUESHEET_LEN) ||
+		!finfo_cursor_check_u8(&cur, &tracks_n)) {
+		return false;
 	}
 
-	flac_print_vorbis_comment(vorbis);
+	for (uint32_t i = 0; i < tracks_n; i++) {
+		uint32_t points_n;
+		if (!finfo_cursor_skip(&cur, FLAC_CUESHEET_TRACK_LEN) ||
+			!finfo_cursor_check_u8(&cur, &points_n) ||
+			!finfo_cursor_skip_array(&cur, points_n,
+									 FLAC_CUESHEET_POINT_LEN)) {
+			return false;
+		}
+	}
+	return true;
 }
 
 /*
-* Parse the given array of bytes BLOCK, long SIZE bytes, as a cuesheet metadata block,
-* and put it inside DST.
-*/
-void flac_parse_cuesheet(unsigned char *block, int size,
-						 struct flac_metadata_block *dst) {
+ * Parse the cuesheet metadata block at CUR, and put it inside DST.
+ * Its arrays are allocated from ARENA.
+ */
+static void flac_parse_cuesheet(struct finfo_arena *arena,
+								struct finfo_cursor cur,
+								struct flac_metadata_block *dst) {
 	struct flac_cuesheet *cuesheet = &dst->data.cuesheet;
 
-	memcpy(cuesheet->catalog_number, block, 128);
-	cuesheet->leadin_samples = BE_bytes_to_int(block + 128, 8);
-	cuesheet->cd_da			 = (block[136] & 0b10000000) >> 7;
+	memcpy(cuesheet->catalog_number, finfo_cursor_bytes(&cur, 128), 128);
+	cuesheet->leadin_samples = finfo_cursor_be64(&cur);
+	cuesheet->cd_da			 = finfo_cursor_u8(&cur) >> 7;
 	// 258 reserved bytes.
-	unsigned char *tracks_start = block + 137 + 258;
-	cuesheet->tracks_n			= BE_bytes_to_int(tracks_start, 1);
-	cuesheet->tracks =
-		calloc(cuesheet->tracks_n, sizeof(struct flac_cuesheet_track));
+	finfo_cursor_bytes(&cur, 258);
+
+	uint8_t tracks_n   = finfo_cursor_u8(&cur);
+	cuesheet->tracks   = finfo_arena_calloc(arena, tracks_n,
+											sizeof(struct flac_cuesheet_track));
+	cuesheet->tracks_n = cuesheet->tracks ? tracks_n : 0;
 
-	unsigned char *current_track_start = tracks_start + 1;
 	for (int i = 0; i < cuesheet->tracks_n; i++) {
 		struct flac_cuesheet_track *track = &cuesheet->tracks[i];
-		track->offset = BE_bytes_to_int(current_track_start, 8);
-		track->number = BE_bytes_to_int(current_track_start + 8, 1);
-		memcpy(track->ISRC, current_track_start + 9, 12);
-		track->audio		= !((current_track_start[21] & 0b10000000) >> 7);
-		track->pre_emphasis = (current_track_start[21] & 0b01000000) >> 6;
+		track->offset					  = finfo_cursor_be64(&cur);
+		track->number					  = finfo_cursor_u8(&cur);
+		memcpy(track->ISRC, finfo_cursor_bytes(&cur, 12), 12);
+		uint8_t flags		= finfo_cursor_u8(&cur);
+		track->audio		= !(flags >> 7);
+		track->pre_emphasis = (flags >> 6) & 1;
 		// 13 reserved bytes.
-		unsigned char *points_start = current_track_start + 22 + 13;
-		track->idx_points_n			= BE_bytes_to_int(points_start, 1);
-		track->idx_points			= calloc(
-			  track->idx_points_n, sizeof(struct flac_cuesheet_track_idx_point));
+		finfo_cursor_bytes(&cur, 13);
 
-		unsigned char *curr_idx_point = points_start + 1;
+		uint8_t points_n  = finfo_cursor_u8(&cur);
+		track->idx_points = finfo_arena_calloc(
+			arena, points_n, sizeof(struct flac_cuesheet_track_idx_point));
+		track->idx_points_n = track->idx_points ? points_n : 0;
 		for (int j = 0; j < track->idx_points_n; j++) {
-			track->idx_points[i].offset = BE_bytes_to_int(curr_idx_point, 8);
-			track->idx_points[i].number =
-				BE_bytes_to_int(curr_idx_point + 8, 1);
+			track->idx_points[j].offset = finfo_cursor_be64(&cur);
+			track->idx_points[j].number = finfo_cursor_u8(&cur);
 			// 3 reserved bytes.
-			curr_idx_point = curr_idx_point + 9 + 3;
+			finfo_cursor_bytes(&cur, 3);
 		}
+		// The points which couldn't be stored are skipped.
+		finfo_cursor_bytes(&cur, (size_t)(points_n - track->idx_points_n) *
+									 FLAC_CUESHEET_POINT_LEN);
+	}
+}
 
-		current_track_start = curr_idx_point;
+bool flac_check_block(enum flac_metadata_type type, const unsigned char *data,
+					  size_t len) {
+	struct finfo_cursor cur = finfo_cursor_make(data, len);
+	switch (type) {
+	case FLAC_STREAMINFO_TYPE:
+		return flac_check_streaminfo(cur);
+	case FLAC_APPLICATION_TYPE:
+		return flac_check_application(cur);
+	case FLAC_VORBIS_COMMENT_TYPE:
+		return flac_check_vorbisComment(cur);
+	case FLAC_CUESHEET_TYPE:
+		return flac_check_cuesheet(cur);
+	default:
+		return true;
 	}
+}
 
-	flac_print_cuesheet(cuesheet);
+void flac_decode_block(struct finfo_arena *arena, const unsigned char *data,
+					   size_t len, struct flac_metadata_block *dst) {
+	struct finfo_cursor cur = finfo_cursor_make(data, len);
+	switch (dst->type) {
+	case FLAC_STREAMINFO_TYPE:
+		flac_parse_streaminfo(cur, dst);
+		break;
+	case FLAC_PADDING_TYPE: {
+		struct flac_padding padding = {.bytes = dst->block_length};
+		dst->data.padding			= padding;
+		break;
+	}
+	case FLAC_APPLICATION_TYPE:
+		flac_parse_application(cur, dst);
+		break;
+	case FLAC_SEEK_TABLE_TYPE:
+		flac_parse_seekTable(arena, cur, dst);
+		break;
+	case FLAC_VORBIS_COMMENT_TYPE:
+		flac_parse_vorbisComment(arena, cur, dst);
+		break;
+	case FLAC_CUESHEET_TYPE:
+		flac_parse_cuesheet(arena, cur, dst);
+		break;
+	default:
+		dst->type = FLAC_UNKNOWN_TYPE;
+		break;
+	}
 }
 
 /*
-* Parse the given array of bytes BLOCK, long SIZE bytes, as a picture metadata block,
-* and put it inside DST.
-*/
-void flac_parse_picture(unsigned char *block, int size,
+ * Parse the picture metadata block whose data is long SIZE bytes and starts at
+ * OFFSET in the input, and put it inside DST.
+ * Only the fields describing the picture are read: the picture data, which
+ * makes up most of the block, is left in the input.
+ * Returns false if the fields don't fit in the block.
+ */
+bool flac_parse_picture(struct finfo_input *in, uint64_t offset, uint32_t size,
 						struct flac_metadata_block *dst) {
 	struct flac_picture *picture = &dst->data.picture;
+	uint64_t end				 = offset + size;
+	struct finfo_view fields;
+
+	// Picture type and length of the media type string.
+	if (size < 8 || !finfo_input_view(in, offset, 8, &fields)) { return false; }
+	picture->type				   = load_be32(fields.data);
+	picture->media_type_string_len = load_be32(fields.data + 4);
+	offset += 8;
+
+	// Media type string and length of the description.
+	uint64_t fields_len = (uint64_t)picture->media_type_string_len + 4;
+	if (end - offset < fields_len ||
+		!finfo_input_view(in, offset, fields_len, &fields)) {
+		return false;
+	}
+	picture->media_type_string = (const char *)fields.data;
+	picture->description_len =
+		load_be32(fields.data + picture->media_type_string_len);
+	offset += fields_len;
+
+	// Description, picture size, colors and length of the data.
+	fields_len = (uint64_t)picture->description_len + 20;
+	if (end - offset < fields_len ||
+		!finfo_input_view(in, offset, fields_len, &fields)) {
+		return false;
+	}
+	const unsigned char *descr_end = fields.data + picture->description_len;
+	picture->description		   = (const char *)fields.data;
+	picture->picture_width		   = load_be32(descr_end);
+	picture->picture_height		   = load_be32(descr_end + 4);
+	picture->color_depth		   = load_be32(descr_end + 8);
+	picture->color_n			   = load_be32(descr_end + 12);
+	picture->data_len			   = load_be32(descr_end + 16);
+	offset += fields_len;
+
+	if (end - offset < picture->data_len) { return false; }
+	picture->data_offset = offset;
 
-	picture->type				   = BE_bytes_to_int(block, 4);
-	picture->media_type_string_len = BE_bytes_to_int(block + 4, 4);
-	picture->media_type_string =
-		calloc(picture->media_type_string_len, sizeof(char));
-	memcpy(picture->media_type_string, block + 8,
-		   picture->media_type_string_len);
-
-	unsigned char *descr_start = block + 8 + picture->media_type_string_len;
-	picture->description_len   = BE_bytes_to_int(descr_start, 4);
-	picture->description	   = calloc(picture->description_len, sizeof(char));
-	memcpy(picture->description, descr_start + 4, picture->description_len);
-
-	unsigned char *descr_end = descr_start + 4 + picture->description_len;
-	picture->picture_width	 = BE_bytes_to_int(descr_end, 4);
-	picture->picture_height	 = BE_bytes_to_int(descr_end + 4, 4);
-	picture->color_depth	 = BE_bytes_to_int(descr_end + 8, 4);
-	picture->color_n		 = BE_bytes_to_int(descr_end + 12, 4);
-
-	picture->data_len = BE_bytes_to_int(descr_end + 16, 4);
-	picture->data	  = calloc(picture->data_len, sizeof(*picture->data));
-	memcpy(picture->data, descr_end + 20, picture->data_len);
-
-	flac_print_picture(picture);
+	return true;
 }
 
 // ===== Block functions =====
 
-// Parse the FLAC metadata block following the provided header.
-// The function assumes the file has been read up to the end of the
-// provided header, and will read up to the end of the parsed block.
-struct flac_metadata_block *flac_parse_block(unsigned char header[4],
-											 FILE *file) {
-	struct flac_metadata_block *block = malloc(sizeof(*block));
+/*
+ * Parse the FLAC metadata block whose header starts at OFFSET in the input,
+ * and put it inside DST.
+ * Returns false if the input ends before the end of the block, or if the
+ * block is malformed.
+ */
+bool flac_parse_block(struct finfo_input *in, uint64_t offset,
+					  struct flac_metadata_block *dst) {
+	struct finfo_view header;
+	if (!finfo_input_view(in, offset, 4, &header)) { return false; }
 
 	// Block is the last one if the first bit of the first byte is 1.
-	block->last_block = (header[0] & 0b10000000) >> 7;
+	dst->last_block = (header.data[0] & 0b10000000) >> 7;
 	// The next 7 bits of the first byte codes for the block type.
-	block->type = header[0] & 0b01111111;
+	dst->type = header.data[0] & 0b01111111;
 	// The next 3 bytes code for the block length.
-	block->block_length = BE_bytes_to_int(&header[1], 3);
+	dst->block_length = load_be24(&header.data[1]);
 
-	printf("%02X:%02X:%02X:%02X, last: %d, type: %s, length: %u\n", header[0],
-		   header[1], header[2], header[3], block->last_block,
-		   flac_metadata_type_str(block->type), block->block_length);
+	if (offset + 4 + dst->block_length > in->size) {
+		dst->type = FLAC_UNKNOWN_TYPE;
+		return false;
+	}
 
-	unsigned char *data = malloc(block->block_length);
-	fread(data, block->block_length, 1, file);
+	// Pictures are read field by field, to skip over their data.
+	if (dst->type == FLAC_PICTURE_TYPE) {
+		if (!flac_parse_picture(in, offset + 4, dst->block_length, dst)) {
+			dst->type = FLAC_UNKNOWN_TYPE;
+			return false;
+		}
+		return true;
+	}
 
-	switch (block->type) {
-	case FLAC_STREAMINFO_TYPE:
-		flac_parse_streaminfo(data, block->block_length, block);
-		break;
-	case FLAC_PADDING_TYPE: {
-		struct flac_padding padding = {.bytes = block->block_length};
-		block->data.padding			= padding;
-		break;
+	struct finfo_view data;
+	if (!finfo_input_view(in, offset + 4, dst->block_length, &data) ||
+		!flac_check_block(dst->type, data.data, data.len)) {
+		dst->type = FLAC_UNKNOWN_TYPE;
+		return false;
 	}
-	case FLAC_APPLICATION_TYPE:
-		flac_parse_application(data, block->block_length, block);
-		break;
-	case FLAC_SEEK_TABLE_TYPE:
-		flac_parse_seekTable(data, block->block_length, block);
-		break;
-	case FLAC_VORBIS_COMMENT_TYPE:
-		flac_parse_vorbisComment(data, block->block_length, block);
-		break;
-	case FLAC_CUESHEET_TYPE:
-		flac_parse_cuesheet(data, block->block_length, block);
-		break;
-	case FLAC_PICTURE_TYPE:
-		flac_parse_picture(data, block->block_length, block);
-		break;
-	case FLAC_UNKNOWN_TYPE:
-		break;
+	flac_decode_block(&in->arena, data.data, data.len, dst);
+
+	return true;
+}
+
+bool flac_find_block(struct finfo_input *in, enum flac_metadata_type type,
+					 struct flac_metadata_block *dst) {
+	uint64_t offset = sizeof(FLAC_SIGNATURE);
+	while (true) {
+		struct finfo_view header;
+		if (!finfo_input_view(in, offset, 4, &header)) { return false; }
+
+		if ((header.data[0] & 0b01111111) == type) {
+			return flac_parse_block(in, offset, dst);
+		}
+		if (header.data[0] & 0b10000000) { return false; }
+		offset += 4 + load_be24(header.data + 1);
+	}
+}
+
+/*
+ * Scan the audio frames starting at OFFSET in the input, and print their
+ * totals and the regions of the input which are not valid frames.
+ * Then decode them to check the MD5 stored in the streaminfo INFO.
+ * Returns false if there is any invalid region or the MD5 doesn't match.
+ */
+bool flac_verify_frames(struct finfo_input *in, uint64_t offset,
+						const struct flac_streaminfo *info) {
+	finfo_emit_begin(FINFO_EMIT_OBJECT, "frames", NULL, 0);
+
+	struct flac_frame_scan scan;
+	if (!flac_frame_scan(in, offset, info, &scan)) {
+		finfo_emit_error("Unable to scan the audio frames.");
+		finfo_emit_end();
+		flac_frame_scan_free(&scan);
+		return false;
 	}
 
-	free(data);
-	return block;
+	double duration = 0;
+	if (scan.sample_rate != 0) {
+		duration = (double)scan.samples_n / scan.sample_rate;
+	}
+
+	finfo_emit_uint("count", "Frames", scan.frames_n);
+	finfo_emit_double("duration_s", "Duration (s)", duration, 3);
+	if (duration > 0) {
+		finfo_emit_double("bitrate_kbps", "Bitrate (kb/s)",
+						  scan.frames_len * 8 / duration / 1000, 0);
+	}
+	finfo_emit_uint("corrupt_regions_n", "Corrupt regions", scan.corrupt_n);
+	finfo_emit_begin(FINFO_EMIT_ARRAY, "corrupt_regions", NULL,
+					 FINFO_EMIT_INDENT);
+	for (size_t i = 0; i < scan.corrupt_n; i++) {
+		finfo_emit_begin(FINFO_EMIT_OBJECT, NULL, NULL, FINFO_EMIT_INLINE);
+		finfo_emit_uint("offset", "Offset", scan.corrupt[i].offset);
+		finfo_emit_uint("length", "length", scan.corrupt[i].length);
+		finfo_emit_end();
+	}
+	finfo_emit_end();
+
+	bool valid = scan.corrupt_n == 0;
+
+	// An MD5 of zeros means that the encoder didn't compute it.
+	static const unsigned char no_md5[16] = {0};
+	if (memcmp(info->md5sum, no_md5, sizeof(no_md5)) != 0) {
+		unsigned char md5[16];
+		size_t errors_n =
+			flac_decode_md5(&scan, info, finfo_opts.file_workers, md5);
+		if (errors_n > 0) {
+			finfo_emit_uint("undecodable_n", "Undecodable frames", errors_n);
+		}
+
+		bool match = memcmp(md5, info->md5sum, sizeof(md5)) == 0;
+		finfo_emit_hex("decoded_md5", "Decoded MD5sum", md5, sizeof(md5));
+		finfo_emit_bool("md5_match", "MD5 match", match);
+		valid = valid && errors_n == 0 && match;
+	}
+
+	finfo_emit_end();
+	flac_frame_scan_free(&scan);
+	return valid;
 }
 
-void flac_metadata_block_free(struct flac_metadata_block *block) {
-	switch (block->type) {
-	case FLAC_STREAMINFO_TYPE:
-	case FLAC_PADDING_TYPE:
-	case FLAC_UNKNOWN_TYPE:
-		break;
-	case FLAC_APPLICATION_TYPE:
-		free(block->data.application.app_data);
-		break;
-	case FLAC_SEEK_TABLE_TYPE:
-		free(block->data.seek_table.seek_points);
-		break;
-	case FLAC_VORBIS_COMMENT_TYPE:
-		free(block->data.vorbis_comment.vendor_string);
-		for (int i = 0; i < block->data.vorbis_comment.fields_n; i++) {
-			free(block->data.vorbis_comment.fields[i].data);
+/*
+ * Print the frame containing the sample SAMPLE, of the stream whose first
+ * frame is at OFFSET in the input.
+ * The frames are found through the seek table TABLE, or through a scan of
+ * the whole stream if there is none.
+ */
+void flac_print_seek(struct finfo_input *in, uint64_t offset,
+					 const struct flac_streaminfo *info,
+					 const struct flac_seek_table *table, uint64_t sample) {
+	finfo_emit_begin(FINFO_EMIT_OBJECT, "seek", NULL, 0);
+
+	struct flac_seek_index index;
+	const char *source = "seek table";
+	bool built		   = false;
+	if (table != NULL) {
+		built = flac_seek_index_from_table(&in->arena, table, offset, &index);
+	} else {
+		struct flac_frame_scan scan;
+		source = "frame scan";
+		built  = flac_frame_scan(in, offset, info, &scan) &&
+				flac_seek_index_from_scan(&in->arena, &scan, &index);
+		flac_frame_scan_free(&scan);
+	}
+	if (!built) {
+		finfo_emit_error("Unable to build the seek index.");
+		finfo_emit_end();
+		return;
+	}
+
+	finfo_emit_uint("index_points", "Seek index points", index.points_n);
+	finfo_emit_str("index_source", "Seek index source", source,
+				   strlen(source));
+	finfo_emit_uint("sample", "Seek sample", sample);
+
+	struct flac_frame_entry frame;
+	bool found = flac_seek(in, &index, info, sample, &frame);
+	finfo_emit_bool("found", "Found", found);
+	if (found) {
+		finfo_emit_uint("frame_offset", "Frame offset", frame.offset);
+		finfo_emit_uint("frame_first_sample", "Frame first sample",
+						frame.first_sample);
+		finfo_emit_uint("frame_last_sample", "Frame last sample",
+						frame.first_sample + frame.block_size - 1);
+	}
+
+	finfo_emit_end();
+}
+
+// ===== Projection =====
+
+// Fields of the projection, and the block holding each one. Other names are
+// vorbis comments.
+static const struct {
+	const char *name;
+	enum flac_metadata_type block;
+} flac_fields[] = {
+	{"min_block_size", FLAC_STREAMINFO_TYPE},
+	{"max_block_size", FLAC_STREAMINFO_TYPE},
+	{"min_frame_size", FLAC_STREAMINFO_TYPE},
+	{"max_frame_size", FLAC_STREAMINFO_TYPE},
+	{"sample_rate", FLAC_STREAMINFO_TYPE},
+	{"channels", FLAC_STREAMINFO_TYPE},
+	{"bits_per_sample", FLAC_STREAMINFO_TYPE},
+	{"total_samples", FLAC_STREAMINFO_TYPE},
+	{"duration", FLAC_STREAMINFO_TYPE},
+	{"md5", FLAC_STREAMINFO_TYPE},
+	{"vendor", FLAC_VORBIS_COMMENT_TYPE},
+	{"picture_type", FLAC_PICTURE_TYPE},
+	{"media_type", FLAC_PICTURE_TYPE},
+	{"description", FLAC_PICTURE_TYPE},
+	{"picture_width", FLAC_PICTURE_TYPE},
+	{"picture_height", FLAC_PICTURE_TYPE},
+	{"color_depth", FLAC_PICTURE_TYPE},
+};
+
+// Return the index of NAME in flac_fields, or -1 for vorbis comments.
+static int flac_field_find(const char *name) {
+	for (size_t i = 0; i < sizeof(flac_fields) / sizeof(*flac_fields); i++) {
+		if (strcmp(flac_fields[i].name, name) == 0) { return i; }
+	}
+	return -1;
+}
+
+static void flac_project_streaminfo(struct finfo_projection *proj,
+									const struct flac_streaminfo *info,
+									struct finfo_arena *arena) {
+	finfo_projection_set_uint(proj, "min_block_size", info->min_blk_size);
+	finfo_projection_set_uint(proj, "max_block_size", info->max_blk_size);
+	finfo_projection_set_uint(proj, "min_frame_size", info->min_frame_size);
+	finfo_projection_set_uint(proj, "max_frame_size", info->max_frame_size);
+	finfo_projection_set_uint(proj, "sample_rate", info->sample_rate);
+	finfo_projection_set_uint(proj, "channels", info->channels + 1);
+	finfo_projection_set_uint(proj, "bits_per_sample",
+							  info->bits_per_sample + 1);
+	finfo_projection_set_uint(proj, "total_samples",
+							  info->interchannel_samples);
+	if (info->sample_rate != 0) {
+		finfo_projection_set_double(
+			proj, "duration",
+			(double)info->interchannel_samples / info->sample_rate, 3);
+	}
+	// The block only lives until the next one is parsed.
+	unsigned char *md5 = finfo_arena_calloc(arena, 1, sizeof(info->md5sum));
+	if (md5 != NULL) {
+		memcpy(md5, info->md5sum, sizeof(info->md5sum));
+		finfo_projection_set_hex(proj, "md5", md5, sizeof(info->md5sum));
+	}
+}
+
+static void flac_project_vorbis_comment(struct finfo_projection *proj,
+										const struct flac_vorbis_comment *vorbis) {
+	finfo_projection_set_str(proj, "vendor",
+							 (const char *)vorbis->vendor_string,
+							 vorbis->vendor_string_len);
+
+	// Comments are NAME=VALUE, with names compared ignoring case. The first
+	// comment with a name is the one printed.
+	for (size_t i = 0; i < proj->fields->names_n; i++) {
+		const char *name = proj->fields->names[i];
+		if (proj->set[i] || flac_field_find(name) >= 0) { continue; }
+
+		size_t name_len = strlen(name);
+		for (size_t j = 0; j < vorbis->fields_n; j++) {
+			const struct flac_vorbis_field *field = &vorbis->fields[j];
+			if (field->length > name_len && field->data[name_len] == '=' &&
+				strncasecmp(field->data, name, name_len) == 0) {
+				struct finfo_value value = {
+					.type = FINFO_VALUE_STR,
+					.data = field->data + name_len + 1,
+					.len  = field->length - name_len - 1,
+				};
+				finfo_projection_set_at(proj, i, &value);
+				break;
+			}
 		}
-		free(block->data.vorbis_comment.fields);
-		break;
-	case FLAC_CUESHEET_TYPE:
-		for (int i = 0; i < block->data.cuesheet.tracks_n; i++) {
-			free(block->data.cuesheet.tracks[i].idx_points);
+	}
+}
+
+static void flac_project_picture(struct finfo_projection *proj,
+								 const struct flac_picture *picture) {
+	finfo_projection_set_uint(proj, "picture_type", picture->type);
+	finfo_projection_set_str(proj, "media_type", picture->media_type_string,
+							 picture->media_type_string_len);
+	finfo_projection_set_str(proj, "description", picture->description,
+							 picture->description_len);
+	finfo_projection_set_uint(proj, "picture_width", picture->picture_width);
+	finfo_projection_set_uint(proj, "picture_height",
+							  picture->picture_height);
+	finfo_projection_set_uint(proj, "color_depth", picture->color_depth);
+}
+
+/*
+ * Print the fields selected by finfo_opts.fields from the FLAC input IN.
+ * Only the first block of each type holding a selected field is parsed:
+ * the other blocks are skipped from the length in their header, and no
+ * block is read once they are all found, so that most selections only read
+ * the start of the file.
+ */
+static bool flac_project(struct finfo_input *in) {
+	struct finfo_projection proj;
+	if (!finfo_projection_init(&proj, finfo_opts.fields, &in->arena)) {
+		finfo_emit_error("Out of memory.");
+		return false;
+	}
+
+	// Types of the blocks still needed.
+	unsigned wanted = 0;
+	for (size_t i = 0; i < proj.fields->names_n; i++) {
+		int field = flac_field_find(proj.fields->names[i]);
+		wanted |= 1u << (field < 0 ? FLAC_VORBIS_COMMENT_TYPE
+								   : flac_fields[field].block);
+	}
+
+	bool valid		= true;
+	uint64_t offset = sizeof(FLAC_SIGNATURE);
+	while (wanted != 0 && proj.left > 0) {
+		struct finfo_view header;
+		if (!finfo_input_view(in, offset, 4, &header)) {
+			valid = false;
+			break;
 		}
-		free(block->data.cuesheet.tracks);
-		break;
-	case FLAC_PICTURE_TYPE:
-		free(block->data.picture.media_type_string);
-		free(block->data.picture.description);
-		free(block->data.picture.data);
-		break;
+		unsigned type = header.data[0] & 0b01111111;
+
+		if (type <= FLAC_PICTURE_TYPE && (wanted & (1u << type))) {
+			struct flac_metadata_block block;
+			if (!flac_parse_block(in, offset, &block)) {
+				valid = false;
+				break;
+			}
+			if (type == FLAC_STREAMINFO_TYPE) {
+				flac_project_streaminfo(&proj, &block.data.streaminfo,
+										&in->arena);
+			} else if (type == FLAC_VORBIS_COMMENT_TYPE) {
+				flac_project_vorbis_comment(&proj, &block.data.vorbis_comment);
+			} else if (type == FLAC_PICTURE_TYPE) {
+				flac_project_picture(&proj, &block.data.picture);
+			}
+			wanted &= ~(1u << type);
+		}
+
+		// Block is the last one if the first bit of the first byte is 1.
+		if (header.data[0] & 0b10000000) { break; }
+		offset += 4 + load_be24(header.data + 1);
 	}
 
-	free(block);
+	finfo_projection_emit(&proj);
+	if (!valid) { finfo_emit_error("Truncated or malformed metadata block."); }
+	return valid;
 }
 
-bool try_flac(FILE *file) {
-	printf("Trying flac...\n");
-	unsigned char signature[4];
-	fread(signature, 4, 1, file);
-	if (memcmp(signature, FLAC_SIGNATURE, 4)) { return false; }
+bool try_flac(struct finfo_input *in) {
+	if (finfo_opts.fields != NULL) { return flac_project(in); }
 
+	// The first block is always the streaminfo.
+	struct flac_streaminfo info = {0};
+	// Seek points, allocated from the arena of the input.
+	struct flac_seek_table table = {0};
+	bool has_table				 = false;
+
+	// Metadata blocks follow the signature, each one after the previous.
+	finfo_emit_begin(FINFO_EMIT_ARRAY, "blocks", NULL, 0);
+	uint64_t offset = sizeof(FLAC_SIGNATURE);
 	while (true) {
-		unsigned char header[4];
-		fread(header, 4, 1, file);
+		struct flac_metadata_block block;
+		if (!flac_parse_block(in, offset, &block)) {
+			finfo_emit_end();
+			finfo_emit_error("Truncated or malformed metadata block.");
+			return false;
+		}
+		flac_print_block(in, &block);
 
-		struct flac_metadata_block *block = flac_parse_block(header, file);
-		if (block->last_block) {
-			flac_metadata_block_free(block);
-			break;
+		if (block.type == FLAC_STREAMINFO_TYPE) {
+			info = block.data.streaminfo;
+		}
+		if (block.type == FLAC_SEEK_TABLE_TYPE) {
+			table	  = block.data.seek_table;
+			has_table = true;
 		}
-		flac_metadata_block_free(block);
+
+		offset += 4 + block.block_length;
+		if (block.last_block) { break; }
+	}
+	finfo_emit_end();
+
+	// Audio frames follow the last metadata block.
+	if (finfo_opts.seek) {
+		flac_print_seek(in, offset, &info, has_table ? &table : NULL,
+						finfo_opts.seek_sample);
 	}
+	if (finfo_opts.verify) { return flac_verify_frames(in, offset, &info); }
 
 	return true;
 }
@@ -4,8 +4,11 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include "finfo_format.h"
+#include "finfo_input.h"
 
 extern unsigned char FLAC_SIGNATURE[4];
+extern const struct finfo_format flac_format;
 
 enum flac_metadata_type {
 	FLAC_STREAMINFO_TYPE	 = 0,
@@ -54,9 +57,11 @@ struct flac_padding {
 struct flac_application {
 	// Application ID (registered in IANA registry)
 	uint32_t app_id;
-	// Application data. Its length is the length contained in the block header
-	// minus the 32 bits of the application id.
-	unsigned char *app_data;
+	// Length of the application data. It is the length contained in the block
+	// header minus the 32 bits of the application id.
+	uint32_t app_data_len;
+	// Application data.
+	const unsigned char *app_data;
 };
 
 struct flac_seek_point {
@@ -81,7 +86,7 @@ struct flac_vorbis_field {
 	// Length of the data contained in the field.
 	uint32_t length;
 	// Field data. It consists of a name and the contents, separated by a '='.
-	char *data;
+	const char *data;
 };
 
 // NOTE: that the 32-bit field lengths are coded little-endian as opposed to the usual big-endian coding of fixed-length integers in the rest of the FLAC format.
@@ -89,7 +94,7 @@ struct flac_vorbis_comment {
 	// Length of the vendor string. The vendor string is not terminated in any way.
 	uint32_t vendor_string_len;
 	// Vendor string.
-	unsigned char *vendor_string; // NOTE: this is coded as UTF-8
+	const unsigned char *vendor_string; // NOTE: this is coded as UTF-8
 	// Number of fields in the vorbis comment block.
 	uint32_t fields_n;
 	// Array of vorbis fields.
@@ -165,11 +170,11 @@ struct flac_picture {
 	uint32_t media_type_string_len;
 	// Media type string or the text string --> to signify that the data part is
 	// a URI.
-	char *media_type_string;
+	const char *media_type_string;
 	// Length of the description string in bytes.
 	uint32_t description_len;
 	// Description of the picture.
-	char *description; // NOTE: this is coded as UTF-8
+	const char *description; // NOTE: this is coded as UTF-8
 	// Width of the picture in pixels.
 	uint32_t picture_width;
 	// Height of the picture in pixels.
@@ -181,12 +186,16 @@ struct flac_picture {
 	uint32_t color_n;
 	// Length of the picture data in bytes.
 	uint32_t data_len;
-	// Binary picture data.
-	unsigned char *data;
+	// Offset of the picture data in the input. The data is only read when
+	// the picture is displayed.
+	uint64_t data_offset;
 };
 
 /*
  * Metadata block for the FLAC file type.
+ * Strings and binary data point inside the input the block was parsed from,
+ * and arrays are allocated from its arena: they are valid as long as the
+ * input is open.
 */
 struct flac_metadata_block {
 	enum flac_metadata_type type;
@@ -204,8 +213,32 @@ struct flac_metadata_block {
 	} data;
 };
 
-void flac_metadata_block_free(struct flac_metadata_block *block);
+bool flac_parse_block(struct finfo_input *in, uint64_t offset,
+					  struct flac_metadata_block *dst);
+/*
+ * Parse in DST the first block of type TYPE of the FLAC input IN, skipping
+ * the blocks before it from their headers.
+ * Returns false if there is none, or if the input ends before it.
+ */
+bool flac_find_block(struct finfo_input *in, enum flac_metadata_type type,
+					 struct flac_metadata_block *dst);
 
-bool try_flac(FILE *file);
+/*
+ * Check that the lengths and counts inside DATA, the LEN bytes of a block of
+ * type TYPE, don't point past its end.
+ * Pictures are parsed from the input by flac_parse_block instead.
+ */
+bool flac_check_block(enum flac_metadata_type type, const unsigned char *data,
+					  size_t len);
+/*
+ * Decode the LEN bytes of DATA, which passed flac_check_block, as a block of
+ * the type and length of DST, and put it inside DST. Its arrays are
+ * allocated from ARENA.
+ */
+void flac_decode_block(struct finfo_arena *arena, const unsigned char *data,
+					   size_t len, struct flac_metadata_block *dst);
+
+// Parse and print the FLAC file IN, which starts with FLAC_SIGNATURE.
+bool try_flac(struct finfo_input *in);
 
 #endif // FINFO_FLAC_H
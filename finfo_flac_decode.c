@@ -0,0 +1,478 @@
+#include <stdlib.h>
+#include <string.h>
+#include "finfo_flac_decode.h"
+#include "finfo_md5.h"
+#include "finfo_pool.h"
+#include "finfo_utils.h"
+
+// Number of frames decoded by each job.
+#define FLAC_DECODE_RANGE_FRAMES 64
+// Number of decoded ranges that can wait to be hashed, per worker.
+#define FLAC_DECODE_WINDOW 4
+
+// ===== Bit reader =====
+
+/*
+ * Big endian bit reader over a frame.
+ * The next CACHE_N bits to read are the low bits of CACHE.
+ * Reading past the end sets ERROR and returns zeros.
+ */
+struct flac_bits {
+	const unsigned char *data;
+	size_t len;
+	size_t pos;
+	uint64_t cache;
+	int cache_n;
+	bool error;
+};
+
+static void flac_bits_refill(struct flac_bits *bits) {
+	// Take as many whole bytes as fit from a big endian load of 8 bytes.
+	if (bits->len - bits->pos >= 8 && bits->cache_n <= 56) {
+		uint64_t word = load_be64(bits->data + bits->pos);
+
+		int bytes = (64 - bits->cache_n) / 8;
+		bits->cache =
+			bytes == 8 ? word
+					   : (bits->cache << (8 * bytes)) | (word >> (64 - 8 * bytes));
+		bits->pos += bytes;
+		bits->cache_n += 8 * bytes;
+		return;
+	}
+
+	while (bits->cache_n <= 56 && bits->pos < bits->len) {
+		bits->cache = (bits->cache << 8) | bits->data[bits->pos++];
+		bits->cache_n += 8;
+	}
+}
+
+// Read N bits, with N at most 32.
+static inline uint32_t flac_bits_read(struct flac_bits *bits, int n) {
+	if (bits->cache_n < n) {
+		flac_bits_refill(bits);
+		if (bits->cache_n < n) {
+			bits->error = true;
+			return 0;
+		}
+	}
+
+	bits->cache_n -= n;
+	return (bits->cache >> bits->cache_n) & ((1ull << n) - 1);
+}
+
+// Read N bits as a two's complement number, with N at most 32.
+static inline int32_t flac_bits_read_signed(struct flac_bits *bits, int n) {
+	if (n == 0) { return 0; }
+
+	uint32_t value = flac_bits_read(bits, n);
+	return (int32_t)(value << (32 - n)) >> (32 - n);
+}
+
+// Read a unary number: the count of 0 bits before the next 1 bit.
+static inline uint32_t flac_bits_read_unary(struct flac_bits *bits) {
+	uint32_t zeros = 0;
+	while (true) {
+		if (bits->cache_n == 0) {
+			flac_bits_refill(bits);
+			if (bits->cache_n == 0) {
+				bits->error = true;
+				return 0;
+			}
+		}
+
+		// Drop the bits above the lowest CACHE_N ones, already read.
+		int read	  = 64 - bits->cache_n;
+		uint64_t left = bits->cache << read >> read;
+		if (left == 0) {
+			zeros += bits->cache_n;
+			bits->cache_n = 0;
+			continue;
+		}
+
+		int top = 63 - __builtin_clzll(left);
+		zeros += bits->cache_n - 1 - top;
+		bits->cache_n = top;
+		return zeros;
+	}
+}
+
+// Read a Rice coded number with parameter PARAM, before its zigzag decoding.
+static inline uint32_t flac_bits_read_rice(struct flac_bits *bits,
+										   int param) {
+	if (bits->cache_n < 32) { flac_bits_refill(bits); }
+
+	// Fast path for codes within the cache, the bits left aligned to the top.
+	if (bits->cache_n > 0) {
+		uint64_t left = bits->cache << (64 - bits->cache_n);
+		if (left != 0) {
+			int zeros = __builtin_clzll(left);
+			int len	  = zeros + 1 + param;
+			if (len <= bits->cache_n) {
+				bits->cache_n -= len;
+				uint32_t low =
+					(bits->cache >> bits->cache_n) & ((1ull << param) - 1);
+				return ((uint32_t)zeros << param) | low;
+			}
+		}
+	}
+
+	uint32_t q = flac_bits_read_unary(bits);
+	return (q << param) | flac_bits_read(bits, param);
+}
+
+// ===== Subframes =====
+
+/*
+ * Decode the residual of a subframe with predictor order ORDER, and put it
+ * in RESIDUAL, after the ORDER warm-up samples.
+ */
+static bool flac_decode_residual(struct flac_bits *bits, uint32_t block_size,
+								 uint32_t order, int32_t *residual) {
+	uint32_t method = flac_bits_read(bits, 2);
+	if (method > 1) { return false; }
+
+	// Rice parameters have 4 bits, or 5 bits with the second method.
+	// The highest one marks an escaped partition.
+	int param_bits = method == 0 ? 4 : 5;
+	uint32_t escape = (1u << param_bits) - 1;
+
+	uint32_t partition_order = flac_bits_read(bits, 4);
+	uint32_t partition_len	 = block_size >> partition_order;
+	if ((partition_len << partition_order) != block_size ||
+		partition_len < order) {
+		return false;
+	}
+
+	uint32_t i = order;
+	for (uint32_t p = 0; p < (1u << partition_order); p++) {
+		uint32_t end   = (p + 1) * partition_len;
+		uint32_t param = flac_bits_read(bits, param_bits);
+
+		if (param == escape) {
+			int sample_bits = flac_bits_read(bits, 5);
+			for (; i < end; i++) {
+				residual[i] = flac_bits_read_signed(bits, sample_bits);
+			}
+			continue;
+		}
+
+		for (; i < end; i++) {
+			uint32_t u	= flac_bits_read_rice(bits, param);
+			residual[i] = (int32_t)(u >> 1) ^ -(int32_t)(u & 1);
+		}
+
+		if (bits->error) { return false; }
+	}
+
+	return !bits->error;
+}
+
+static void flac_predict_fixed(int32_t *samples, uint32_t block_size,
+							   uint32_t order) {
+	for (uint32_t i = order; i < block_size; i++) {
+		int64_t prediction = 0;
+		switch (order) {
+		case 1:
+			prediction = samples[i - 1];
+			break;
+		case 2:
+			prediction = 2 * (int64_t)samples[i - 1] - samples[i - 2];
+			break;
+		case 3:
+			prediction = 3 * ((int64_t)samples[i - 1] - samples[i - 2]) +
+						 samples[i - 3];
+			break;
+		case 4:
+			prediction = 4 * ((int64_t)samples[i - 1] + samples[i - 3]) -
+						 6 * (int64_t)samples[i - 2] - samples[i - 4];
+			break;
+		}
+		samples[i] = samples[i] + prediction;
+	}
+}
+
+/*
+ * With BPS bits per sample and PRECISION bits per coefficient, the sum of
+ * the products fits in 32 bits for most streams, which is cheaper than
+ * summing in 64 bits.
+ */
+static void flac_predict_lpc(int32_t *samples, uint32_t block_size,
+							 uint32_t order, const int32_t *coefs,
+							 int precision, int shift, int bps) {
+	int order_bits = 32 - __builtin_clz(order);
+	if (bps + precision + order_bits <= 32) {
+		// Summed as unsigned, so that corrupt samples wrap around.
+		for (uint32_t i = order; i < block_size; i++) {
+			uint32_t sum = 0;
+			for (uint32_t j = 0; j < order; j++) {
+				sum += (uint32_t)coefs[j] * (uint32_t)samples[i - 1 - j];
+			}
+			samples[i] = (uint32_t)samples[i] + ((int32_t)sum >> shift);
+		}
+		return;
+	}
+
+	for (uint32_t i = order; i < block_size; i++) {
+		int64_t sum = 0;
+		for (uint32_t j = 0; j < order; j++) {
+			sum += (int64_t)coefs[j] * samples[i - 1 - j];
+		}
+		samples[i] = samples[i] + (sum >> shift);
+	}
+}
+
+// Decode a subframe with BPS bits per sample into SAMPLES.
+static bool flac_decode_subframe(struct flac_bits *bits, uint32_t block_size,
+								 int bps, int32_t *samples) {
+	if (flac_bits_read(bits, 1) != 0) { return false; }
+	uint32_t type = flac_bits_read(bits, 6);
+
+	// Wasted bits are low bits which are 0 in every sample.
+	int wasted = 0;
+	if (flac_bits_read(bits, 1)) { wasted = flac_bits_read_unary(bits) + 1; }
+	if (wasted >= bps) { return false; }
+	bps -= wasted;
+
+	if (type == 0) {
+		// Constant.
+		int32_t value = flac_bits_read_signed(bits, bps);
+		for (uint32_t i = 0; i < block_size; i++) { samples[i] = value; }
+	} else if (type == 1) {
+		// Verbatim.
+		for (uint32_t i = 0; i < block_size; i++) {
+			samples[i] = flac_bits_read_signed(bits, bps);
+		}
+	} else if (type >= 8 && type <= 12) {
+		// Fixed predictor.
+		uint32_t order = type - 8;
+		if (order > block_size) { return false; }
+		for (uint32_t i = 0; i < order; i++) {
+			samples[i] = flac_bits_read_signed(bits, bps);
+		}
+		if (!flac_decode_residual(bits, block_size, order, samples)) {
+			return false;
+		}
+		flac_predict_fixed(samples, block_size, order);
+	} else if (type >= 32) {
+		// Linear predictor.
+		uint32_t order = type - 31;
+		if (order > block_size) { return false; }
+		for (uint32_t i = 0; i < order; i++) {
+			samples[i] = flac_bits_read_signed(bits, bps);
+		}
+
+		int precision = flac_bits_read(bits, 4) + 1;
+		int shift	  = flac_bits_read_signed(bits, 5);
+		if (precision == 16 || shift < 0) { return false; }
+
+		int32_t coefs[32];
+		for (uint32_t i = 0; i < order; i++) {
+			coefs[i] = flac_bits_read_signed(bits, precision);
+		}
+		if (!flac_decode_residual(bits, block_size, order, samples)) {
+			return false;
+		}
+		flac_predict_lpc(samples, block_size, order, coefs, precision, shift,
+						 bps);
+	} else {
+		return false;
+	}
+
+	if (wasted > 0) {
+		for (uint32_t i = 0; i < block_size; i++) {
+			samples[i] = (uint32_t)samples[i] << wasted;
+		}
+	}
+
+	return !bits->error;
+}
+
+bool flac_frame_decode(const unsigned char *data, size_t len,
+					   const struct flac_frame_header *header,
+					   int32_t *const samples[]) {
+	if (len < header->length + 2u || header->bits_per_sample == 0) {
+		return false;
+	}
+
+	struct flac_bits bits = {
+		.data = data + header->length,
+		// The frame ends with its CRC-16.
+		.len = len - header->length - 2,
+	};
+
+	// The side channel of stereo frames has an extra bit per sample.
+	uint8_t assignment = header->channel_assignment;
+	for (int c = 0; c < header->channels; c++) {
+		int bps = header->bits_per_sample;
+		if ((assignment == 8 && c == 1) || (assignment == 9 && c == 0) ||
+			(assignment == 10 && c == 1)) {
+			bps++;
+		}
+		if (bps > 32 ||
+			!flac_decode_subframe(&bits, header->block_size, bps, samples[c])) {
+			return false;
+		}
+	}
+
+	if (assignment < 8) { return true; }
+
+	// Stereo frames hold the difference between the channels.
+	int32_t *left  = samples[0];
+	int32_t *right = samples[1];
+	for (uint32_t i = 0; i < header->block_size; i++) {
+		if (assignment == 8) {
+			// Left and side.
+			right[i] = (uint32_t)left[i] - (uint32_t)right[i];
+		} else if (assignment == 9) {
+			// Side and right.
+			left[i] = (uint32_t)left[i] + (uint32_t)right[i];
+		} else {
+			// Mid and side: the lowest bit of the mid channel is the one
+			// lost by halving the sum of the channels.
+			int64_t side = right[i];
+			int64_t mid	 = ((int64_t)left[i] * 2) | (side & 1);
+			left[i]		 = (mid + side) >> 1;
+			right[i]	 = (mid - side) >> 1;
+		}
+	}
+
+	return true;
+}
+
+// ===== MD5 verification =====
+
+struct flac_decode_range {
+	// Interleaved little endian samples of the range.
+	unsigned char *pcm;
+	size_t pcm_len;
+	size_t errors_n;
+};
+
+struct flac_decode_ctx {
+	const struct flac_frame_scan *scan;
+	const struct flac_streaminfo *info;
+	struct flac_decode_range *ranges;
+	struct finfo_md5 md5;
+	size_t errors_n;
+};
+
+// Store the samples of BLOCK_SIZE x CHANNELS as BYTES bytes each in DST.
+static unsigned char *flac_decode_pack(unsigned char *dst,
+									   int32_t *const samples[], int channels,
+									   uint32_t block_size, int bytes) {
+	// 16 bits is by far the most common sample size.
+	if (bytes == 2) {
+		for (uint32_t i = 0; i < block_size; i++) {
+			for (int c = 0; c < channels; c++) {
+				uint32_t sample = samples[c][i];
+				dst[0]			= sample;
+				dst[1]			= sample >> 8;
+				dst += 2;
+			}
+		}
+		return dst;
+	}
+
+	for (uint32_t i = 0; i < block_size; i++) {
+		for (int c = 0; c < channels; c++) {
+			uint32_t sample = samples[c][i];
+			for (int b = 0; b < bytes; b++) { *dst++ = sample >> (8 * b); }
+		}
+	}
+
+	return dst;
+}
+
+static void flac_decode_range_work(void *ctx, size_t job) {
+	struct flac_decode_ctx *decode	  = ctx;
+	const struct flac_frame_scan *scan = decode->scan;
+	struct flac_decode_range *range	  = &decode->ranges[job];
+
+	size_t first = job * FLAC_DECODE_RANGE_FRAMES;
+	size_t last	 = first + FLAC_DECODE_RANGE_FRAMES;
+	if (last > scan->frames_n) { last = scan->frames_n; }
+
+	int channels		= decode->info->channels + 1;
+	int bytes			= (decode->info->bits_per_sample + 1 + 7) / 8;
+	uint32_t block_max	= 0;
+	size_t samples_n	= 0;
+	for (size_t i = first; i < last; i++) {
+		uint32_t block_size = scan->frames[i].block_size;
+		if (block_size > block_max) { block_max = block_size; }
+		samples_n += block_size;
+	}
+
+	range->pcm_len = samples_n * channels * bytes;
+	range->pcm	   = malloc(range->pcm_len);
+	int32_t *buf   = malloc((size_t)block_max * channels * sizeof(int32_t));
+	if (range->pcm == NULL || buf == NULL) {
+		free(buf);
+		range->errors_n = last - first;
+		return;
+	}
+
+	int32_t *samples[8];
+	for (int c = 0; c < channels; c++) { samples[c] = buf + c * block_max; }
+
+	unsigned char *pcm = range->pcm;
+	for (size_t i = first; i < last; i++) {
+		const struct flac_frame_entry *frame = &scan->frames[i];
+		const unsigned char *data =
+			scan->audio.data + (frame->offset - scan->audio_offset);
+
+		struct flac_frame_header header;
+		bool decoded =
+			flac_frame_header_parse(data, frame->length, decode->info,
+									&header) &&
+			header.channels == channels &&
+			flac_frame_decode(data, frame->length, &header, samples);
+		if (!decoded) {
+			memset(buf, 0, (size_t)block_max * channels * sizeof(int32_t));
+			range->errors_n++;
+		}
+
+		pcm = flac_decode_pack(pcm, samples, channels, frame->block_size,
+							   bytes);
+	}
+
+	free(buf);
+}
+
+static void flac_decode_range_done(void *ctx, size_t job) {
+	struct flac_decode_ctx *decode	= ctx;
+	struct flac_decode_range *range = &decode->ranges[job];
+
+	if (range->pcm != NULL) {
+		finfo_md5_update(&decode->md5, range->pcm, range->pcm_len);
+	}
+	decode->errors_n += range->errors_n;
+
+	free(range->pcm);
+	range->pcm = NULL;
+}
+
+size_t flac_decode_md5(const struct flac_frame_scan *scan,
+					   const struct flac_streaminfo *info, unsigned workers_n,
+					   unsigned char digest[16]) {
+	size_t ranges_n = (scan->frames_n + FLAC_DECODE_RANGE_FRAMES - 1) /
+					  FLAC_DECODE_RANGE_FRAMES;
+
+	struct flac_decode_ctx decode = {
+		.scan	= scan,
+		.info	= info,
+		.ranges = calloc(ranges_n ? ranges_n : 1, sizeof(*decode.ranges)),
+	};
+	finfo_md5_init(&decode.md5);
+
+	if (decode.ranges == NULL) {
+		finfo_md5_final(&decode.md5, digest);
+		return scan->frames_n;
+	}
+
+	finfo_pool_run(ranges_n, workers_n, workers_n * FLAC_DECODE_WINDOW,
+				   flac_decode_range_work, flac_decode_range_done, &decode);
+
+	free(decode.ranges);
+	finfo_md5_final(&decode.md5, digest);
+	return decode.errors_n;
+}
@@ -0,0 +1,29 @@
+#ifndef FINFO_FLAC_DECODE_H
+#define FINFO_FLAC_DECODE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "finfo_flac.h"
+#include "finfo_flac_frame.h"
+
+/*
+ * Decode the frame DATA, long LEN bytes, whose header is HEADER.
+ * SAMPLES holds one array of HEADER->block_size samples per channel.
+ * Returns false if the frame can't be decoded.
+ */
+bool flac_frame_decode(const unsigned char *data, size_t len,
+					   const struct flac_frame_header *header,
+					   int32_t *const samples[]);
+
+/*
+ * Decode the frames found by SCAN, and compute in DIGEST the MD5 of their
+ * samples, laid out like for the MD5 of the streaminfo INFO.
+ * Ranges of frames are decoded by WORKERS_N threads, and hashed in order.
+ * Returns the number of frames which couldn't be decoded, hashed as silence.
+ */
+size_t flac_decode_md5(const struct flac_frame_scan *scan,
+					   const struct flac_streaminfo *info, unsigned workers_n,
+					   unsigned char digest[16]);
+
+#endif // !FINFO_FLAC_DECODE_H
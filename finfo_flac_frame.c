@@ -0,0 +1,320 @@
+#include <stdlib.h>
+#include <string.h>
+#include "finfo_flac_frame.h"
+#include "finfo_crc.h"
+#include "finfo_utils.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/*
+ * Return the position of the first frame sync code (0xFFF8 or 0xFFF9) at or
+ * after FROM in DATA, long LEN bytes, or LEN if there is none.
+ */
+static size_t flac_frame_sync_find(const unsigned char *data, size_t len,
+								   size_t from) {
+	size_t i = from;
+
+#ifdef __SSE2__
+	// Compare 16 positions at once: each byte with 0xFF, and the byte after
+	// it with 0xF8 once the blocking strategy bit is masked out.
+	const __m128i ff	= _mm_set1_epi8((char)0xFF);
+	const __m128i f8	= _mm_set1_epi8((char)0xF8);
+	const __m128i fe	= _mm_set1_epi8((char)0xFE);
+	while (i + 17 <= len) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(data + i));
+		__m128i b = _mm_loadu_si128((const __m128i *)(data + i + 1));
+		__m128i m = _mm_and_si128(_mm_cmpeq_epi8(a, ff),
+								  _mm_cmpeq_epi8(_mm_and_si128(b, fe), f8));
+
+		int mask = _mm_movemask_epi8(m);
+		if (mask != 0) { return i + __builtin_ctz(mask); }
+		i += 16;
+	}
+#endif
+
+	for (; i + 1 < len; i++) {
+		if (data[i] == 0xFF && (data[i + 1] & 0xFE) == 0xF8) { return i; }
+	}
+
+	return len;
+}
+
+bool flac_frame_header_parse(const unsigned char *data, size_t len,
+							 const struct flac_streaminfo *info,
+							 struct flac_frame_header *dst) {
+	// Sync code, block size, sample rate, channels, sample size,
+	// and the first byte of the coded number.
+	if (len < 5) { return false; }
+	if (data[0] != 0xFF || (data[1] & 0xFE) != 0xF8) { return false; }
+
+	uint8_t block_size_code	 = data[2] >> 4;
+	uint8_t sample_rate_code = data[2] & 0x0F;
+	uint8_t channels_code	 = data[3] >> 4;
+	uint8_t sample_size_code = (data[3] >> 1) & 0x07;
+	if (block_size_code == 0 || sample_rate_code == 15 || channels_code > 10 ||
+		sample_size_code == 3 || (data[3] & 1) != 0) {
+		return false;
+	}
+
+	dst->variable_block_size = data[1] & 1;
+
+	// The frame or sample number is coded like UTF-8, with up to 36 bits:
+	// the leading ones of the first byte give the number of bytes.
+	size_t i	  = 4;
+	uint8_t first = data[i++];
+	int ones	  = 0;
+	while (ones < 8 && (first & (0x80 >> ones))) { ones++; }
+	if (ones == 1 || ones == 8) { return false; }
+
+	int extra	   = ones ? ones - 1 : 0;
+	uint64_t value = ones ? first & (0x7F >> ones) : first;
+	// Frame numbers have at most 31 bits.
+	if (!dst->variable_block_size && extra > 5) { return false; }
+
+	size_t block_size_len = 0;
+	if (block_size_code == 6 || block_size_code == 7) {
+		block_size_len = block_size_code - 5;
+	}
+	size_t sample_rate_len = 0;
+	if (sample_rate_code >= 12 && sample_rate_code <= 14) {
+		sample_rate_len = sample_rate_code == 12 ? 1 : 2;
+	}
+	if (len < i + extra + block_size_len + sample_rate_len + 1) {
+		return false;
+	}
+
+	for (int j = 0; j < extra; j++) {
+		if ((data[i] & 0xC0) != 0x80) { return false; }
+		value = (value << 6) | (data[i++] & 0x3F);
+	}
+	dst->number = value;
+
+	if (block_size_code == 1) {
+		dst->block_size = 192;
+	} else if (block_size_code <= 5) {
+		dst->block_size = 576 << (block_size_code - 2);
+	} else if (block_size_code == 6) {
+		dst->block_size = data[i++] + 1;
+	} else if (block_size_code == 7) {
+		dst->block_size = load_be16(data + i) + 1;
+		i += 2;
+	} else {
+		dst->block_size = 256 << (block_size_code - 8);
+	}
+
+	static const uint32_t sample_rates[] = {
+		0,	   88200, 176400, 192000, 8000,	 16000, 22050,
+		24000, 32000, 44100,  48000,  96000,
+	};
+	if (sample_rate_code == 0) {
+		dst->sample_rate = info != NULL ? info->sample_rate : 0;
+	} else if (sample_rate_code < 12) {
+		dst->sample_rate = sample_rates[sample_rate_code];
+	} else if (sample_rate_code == 12) {
+		dst->sample_rate = data[i++] * 1000;
+	} else {
+		dst->sample_rate = load_be16(data + i);
+		if (sample_rate_code == 14) { dst->sample_rate *= 10; }
+		i += 2;
+	}
+
+	static const uint8_t sample_sizes[] = {0, 8, 12, 0, 16, 20, 24, 32};
+	if (sample_size_code == 0) {
+		dst->bits_per_sample = info != NULL ? info->bits_per_sample + 1 : 0;
+	} else {
+		dst->bits_per_sample = sample_sizes[sample_size_code];
+	}
+
+	dst->channel_assignment = channels_code;
+	dst->channels			= channels_code < 8 ? channels_code + 1 : 2;
+
+	if (crc8_update(0, data, i) != data[i]) { return false; }
+	dst->length = i + 1;
+
+	return true;
+}
+
+/*
+ * Return an upper bound of the length of the frame with header HEADER.
+ * Encoders store the samples verbatim when compression doesn't pay off, so
+ * a frame is never much bigger than its uncompressed samples, unless the
+ * streaminfo INFO says otherwise.
+ */
+static uint64_t flac_frame_max_len(const struct flac_frame_header *header,
+								   const struct flac_streaminfo *info) {
+	// The side channel of stereo frames has an extra bit per sample.
+	uint64_t bits = header->bits_per_sample ? header->bits_per_sample : 32;
+	uint64_t samples_len = (header->block_size * (bits + 1) + 7) / 8;
+
+	// Subframe header, with its wasted bits, and padding to the byte.
+	uint64_t subframe_len = 8 + samples_len;
+	uint64_t max_len = header->length + header->channels * subframe_len + 2;
+
+	if (info != NULL && info->max_frame_size > max_len) {
+		max_len = info->max_frame_size;
+	}
+	return max_len;
+}
+
+/*
+ * Return the position of the first valid frame header at or after FROM
+ * in DATA, long LEN bytes, or LEN if there is none.
+ */
+static size_t flac_frame_resync(const unsigned char *data, size_t len,
+								size_t from,
+								const struct flac_streaminfo *info) {
+	struct flac_frame_header header;
+	size_t i = flac_frame_sync_find(data, len, from);
+	while (i < len && !flac_frame_header_parse(data + i, len - i, info,
+											   &header)) {
+		i = flac_frame_sync_find(data, len, i + 1);
+	}
+
+	return i;
+}
+
+/*
+ * Return the end of the frame with header HEADER at position START in DATA,
+ * long LEN bytes, or 0 if no end matches the CRC-16 of the frame.
+ * The frame can only end where the next one starts, or at the end of the
+ * data: each sync code up to the maximum length of the frame is tried,
+ * updating the CRC-16 up to it.
+ */
+static size_t flac_frame_end(const unsigned char *data, size_t len,
+							 size_t start,
+							 const struct flac_frame_header *header,
+							 const struct flac_streaminfo *info) {
+	size_t limit	 = len;
+	uint64_t max_len = flac_frame_max_len(header, info);
+	if (max_len < len - start) { limit = start + max_len; }
+
+	uint16_t crc   = crc16_update(0, data + start, header->length);
+	size_t crc_end = start + header->length;
+
+	size_t end = crc_end;
+	while (true) {
+		end = flac_frame_sync_find(data, limit, end);
+
+		// The frame is followed by its CRC-16.
+		if (end - start >= header->length + 2u) {
+			crc		= crc16_update(crc, data + crc_end, end - 2 - crc_end);
+			crc_end = end - 2;
+
+			uint16_t stored = load_be16(data + end - 2);
+			struct flac_frame_header next;
+			if (crc == stored &&
+				(end == len ||
+				 (flac_frame_header_parse(data + end, len - end, info, &next) &&
+				  next.variable_block_size == header->variable_block_size))) {
+				return end;
+			}
+		}
+
+		if (end >= limit) { return 0; }
+		end++;
+	}
+}
+
+size_t flac_frame_find(const unsigned char *data, size_t len, size_t start,
+					   const struct flac_streaminfo *info,
+					   struct flac_frame_header *header) {
+	if (!flac_frame_header_parse(data + start, len - start, info, header)) {
+		return 0;
+	}
+
+	return flac_frame_end(data, len, start, header, info);
+}
+
+uint64_t flac_frame_first_sample(const struct flac_frame_header *header,
+								 const struct flac_streaminfo *info) {
+	if (header->variable_block_size) { return header->number; }
+
+	// Fixed size frames are numbered, and all but the last one have the
+	// maximum block size.
+	uint32_t block_size = info != NULL && info->max_blk_size != 0
+							  ? info->max_blk_size
+							  : header->block_size;
+	return header->number * block_size;
+}
+
+/*
+ * Make room for one more element of SIZE bytes in the growable ARRAY,
+ * which holds N elements out of CAP.
+ */
+static bool flac_frame_scan_grow(void **array, size_t *cap, size_t n,
+								 size_t size) {
+	if (n < *cap) { return true; }
+
+	size_t new_cap = *cap ? *cap * 2 : 64;
+	void *new_array = realloc(*array, new_cap * size);
+	if (new_array == NULL) { return false; }
+
+	*array = new_array;
+	*cap	= new_cap;
+	return true;
+}
+
+bool flac_frame_scan(struct finfo_input *in, uint64_t offset,
+					 const struct flac_streaminfo *info,
+					 struct flac_frame_scan *dst) {
+	*dst = (struct flac_frame_scan){0};
+	if (offset > in->size) { return false; }
+
+	struct finfo_view audio;
+	if (!finfo_input_view(in, offset, in->size - offset, &audio)) {
+		return false;
+	}
+
+	dst->audio		  = audio;
+	dst->audio_offset = offset;
+
+	const unsigned char *data = audio.data;
+	size_t len				  = audio.len;
+	size_t pos				  = 0;
+	while (pos < len) {
+		struct flac_frame_header header;
+		size_t end = flac_frame_find(data, len, pos, info, &header);
+
+		// Skip to the next frame header after a corrupt frame.
+		if (end == 0) {
+			size_t next = flac_frame_resync(data, len, pos + 1, info);
+			if (!flac_frame_scan_grow((void **)&dst->corrupt, &dst->corrupt_cap,
+									  dst->corrupt_n, sizeof(*dst->corrupt))) {
+				return false;
+			}
+			dst->corrupt[dst->corrupt_n++] = (struct flac_frame_region){
+				.offset = offset + pos,
+				.length = next - pos,
+			};
+			pos = next;
+			continue;
+		}
+
+		if (!flac_frame_scan_grow((void **)&dst->frames, &dst->frames_cap,
+								  dst->frames_n, sizeof(*dst->frames))) {
+			return false;
+		}
+
+		dst->frames[dst->frames_n++] = (struct flac_frame_entry){
+			.offset		  = offset + pos,
+			.first_sample = flac_frame_first_sample(&header, info),
+			.length		  = end - pos,
+			.block_size	  = header.block_size,
+		};
+
+		if (dst->frames_n == 1) { dst->sample_rate = header.sample_rate; }
+		dst->samples_n += header.block_size;
+		dst->frames_len += end - pos;
+		pos = end;
+	}
+
+	return true;
+}
+
+void flac_frame_scan_free(struct flac_frame_scan *scan) {
+	free(scan->frames);
+	free(scan->corrupt);
+	*scan = (struct flac_frame_scan){0};
+}
@@ -0,0 +1,101 @@
+#ifndef FINFO_FLAC_FRAME_H
+#define FINFO_FLAC_FRAME_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "finfo_flac.h"
+#include "finfo_input.h"
+
+// Header of a FLAC audio frame.
+struct flac_frame_header {
+	// True if frames have a variable block size, and NUMBER is the number
+	// of the first sample of the frame instead of the number of the frame.
+	bool variable_block_size;
+	uint64_t number;
+	// Number of samples per channel in the frame.
+	uint32_t block_size;
+	// Sample rate in Hz. 0 if not stored in the frame nor in the streaminfo.
+	uint32_t sample_rate;
+	// Channel assignment: 0-7 for 1-8 independent channels, 8 for left/side,
+	// 9 for side/right and 10 for mid/side stereo.
+	uint8_t channel_assignment;
+	uint8_t channels;
+	// Bits per sample. 0 if not stored in the frame nor in the streaminfo.
+	uint8_t bits_per_sample;
+	// Length of the header in bytes, including its CRC-8.
+	uint8_t length;
+};
+
+// Valid frame found by a scan.
+struct flac_frame_entry {
+	// Offset of the frame header in the input.
+	uint64_t offset;
+	// Number of the first sample of the frame in the stream.
+	uint64_t first_sample;
+	uint32_t length;
+	uint32_t block_size;
+};
+
+// Range of the input which is not made of valid frames.
+struct flac_frame_region {
+	uint64_t offset;
+	uint64_t length;
+};
+
+struct flac_frame_scan {
+	// View of the scanned input, from the first frame to the end.
+	struct finfo_view audio;
+	// Offset of the view in the input.
+	uint64_t audio_offset;
+
+	// Valid frames, in stream order.
+	struct flac_frame_entry *frames;
+	size_t frames_n;
+	size_t frames_cap;
+	// Number of samples per channel in the valid frames.
+	uint64_t samples_n;
+	// Number of bytes in the valid frames.
+	uint64_t frames_len;
+	// Sample rate of the first valid frame.
+	uint32_t sample_rate;
+
+	struct flac_frame_region *corrupt;
+	size_t corrupt_n;
+	size_t corrupt_cap;
+};
+
+/*
+ * Parse the frame header at the start of DATA, long LEN bytes, into DST.
+ * INFO, which can be NULL, gives the sample rate and bits per sample of
+ * frames that don't store them.
+ * Returns false if DATA doesn't start with a valid header, CRC-8 included.
+ */
+bool flac_frame_header_parse(const unsigned char *data, size_t len,
+							 const struct flac_streaminfo *info,
+							 struct flac_frame_header *dst);
+
+/*
+ * Find the frame starting at START in DATA, long LEN bytes, and parse its
+ * header into HEADER.
+ * Returns the end of the frame, or 0 if there is no valid frame at START.
+ */
+size_t flac_frame_find(const unsigned char *data, size_t len, size_t start,
+					   const struct flac_streaminfo *info,
+					   struct flac_frame_header *header);
+
+// Return the number of the first sample of the frame with header HEADER.
+uint64_t flac_frame_first_sample(const struct flac_frame_header *header,
+								 const struct flac_streaminfo *info);
+
+/*
+ * Scan the audio frames from OFFSET to the end of the input, checking the
+ * CRC-8 of their headers and the CRC-16 of the frames without decoding them.
+ * Returns false if the input can't be read.
+ */
+bool flac_frame_scan(struct finfo_input *in, uint64_t offset,
+					 const struct flac_streaminfo *info,
+					 struct flac_frame_scan *dst);
+void flac_frame_scan_free(struct flac_frame_scan *scan);
+
+#endif // !FINFO_FLAC_FRAME_H
@@ -0,0 +1,124 @@
+#include "finfo_flac_seek.h"
+
+// Sample number of the placeholder points of seek tables.
+#define FLAC_SEEK_PLACEHOLDER UINT64_MAX
+
+static bool flac_seek_index_alloc(struct finfo_arena *arena, size_t n,
+								  struct flac_seek_index *dst) {
+	*dst		 = (struct flac_seek_index){0};
+	dst->samples = finfo_arena_calloc(arena, n, sizeof(*dst->samples));
+	dst->offsets = finfo_arena_calloc(arena, n, sizeof(*dst->offsets));
+	return dst->samples != NULL && dst->offsets != NULL;
+}
+
+bool flac_seek_index_from_table(struct finfo_arena *arena,
+								const struct flac_seek_table *table,
+								uint64_t audio_offset,
+								struct flac_seek_index *dst) {
+	if (!flac_seek_index_alloc(arena, table->seek_points_n + 1, dst)) {
+		return false;
+	}
+
+	dst->samples[0] = 0;
+	dst->offsets[0] = audio_offset;
+	dst->points_n	= 1;
+
+	for (size_t i = 0; i < table->seek_points_n; i++) {
+		const struct flac_seek_point *point = &table->seek_points[i];
+		if (point->first_sample == FLAC_SEEK_PLACEHOLDER ||
+			point->first_sample <= dst->samples[dst->points_n - 1] ||
+			point->offset > UINT64_MAX - audio_offset) {
+			continue;
+		}
+
+		dst->samples[dst->points_n] = point->first_sample;
+		dst->offsets[dst->points_n] = audio_offset + point->offset;
+		dst->points_n++;
+	}
+
+	return true;
+}
+
+bool flac_seek_index_from_scan(struct finfo_arena *arena,
+							   const struct flac_frame_scan *scan,
+							   struct flac_seek_index *dst) {
+	if (!flac_seek_index_alloc(arena, scan->frames_n + 1, dst)) {
+		return false;
+	}
+
+	dst->samples[0] = 0;
+	dst->offsets[0] = scan->audio_offset;
+	dst->points_n	= 1;
+
+	for (size_t i = 0; i < scan->frames_n; i++) {
+		const struct flac_frame_entry *frame = &scan->frames[i];
+		if (frame->first_sample <= dst->samples[dst->points_n - 1]) {
+			// The first frame replaces the implicit point at sample 0.
+			if (frame->first_sample == 0 && dst->points_n == 1) {
+				dst->offsets[0] = frame->offset;
+			}
+			continue;
+		}
+
+		dst->samples[dst->points_n] = frame->first_sample;
+		dst->offsets[dst->points_n] = frame->offset;
+		dst->points_n++;
+	}
+
+	return true;
+}
+
+size_t flac_seek_index_find(const struct flac_seek_index *index,
+							uint64_t sample) {
+	// Halve the range at each step without branching on the comparison,
+	// which is compiled to a conditional move: the loop runs the same number
+	// of times for every sample, and the CPU has nothing to mispredict.
+	const uint64_t *base = index->samples;
+	size_t n			 = index->points_n;
+	while (n > 1) {
+		size_t half = n / 2;
+		base		= base[half] <= sample ? base + half : base;
+		n -= half;
+	}
+
+	return base - index->samples;
+}
+
+bool flac_seek(struct finfo_input *in, const struct flac_seek_index *index,
+			   const struct flac_streaminfo *info, uint64_t sample,
+			   struct flac_frame_entry *dst) {
+	if (index->points_n == 0) { return false; }
+
+	size_t point	= flac_seek_index_find(index, sample);
+	uint64_t offset = index->offsets[point];
+	if (offset >= in->size) { return false; }
+
+	// Only the frames between the point and the sample are read.
+	struct finfo_view audio;
+	if (!finfo_input_view(in, offset, in->size - offset, &audio)) {
+		return false;
+	}
+
+	size_t pos = 0;
+	while (pos < audio.len) {
+		struct flac_frame_header header;
+		size_t end = flac_frame_find(audio.data, audio.len, pos, info, &header);
+		if (end == 0) { return false; }
+
+		uint64_t first_sample = flac_frame_first_sample(&header, info);
+		if (first_sample > sample) { return false; }
+		if (sample - first_sample < header.block_size) {
+			*dst = (struct flac_frame_entry){
+				.offset		  = offset + pos,
+				.first_sample = first_sample,
+				.length		  = end - pos,
+				.block_size	  = header.block_size,
+			};
+			return true;
+		}
+
+		pos = end;
+	}
+
+	return false;
+}
@@ -0,0 +1,58 @@
+#ifndef FINFO_FLAC_SEEK_H
+#define FINFO_FLAC_SEEK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "finfo_arena.h"
+#include "finfo_flac.h"
+#include "finfo_flac_frame.h"
+#include "finfo_input.h"
+
+/*
+ * Sorted index from sample numbers to the offsets of the frames starting
+ * with them. The first point is always the first frame, at sample 0.
+ * Samples and offsets are kept in separate arrays, so that searching only
+ * goes through the samples.
+ */
+struct flac_seek_index {
+	size_t points_n;
+	uint64_t *samples;
+	// Offsets of the frame headers in the input.
+	uint64_t *offsets;
+};
+
+/*
+ * Build in DST the index of the seek table TABLE, of the stream whose first
+ * frame is at AUDIO_OFFSET in the input.
+ * Placeholder points and points out of order are left out.
+ * Returns false if the index can't be allocated from ARENA.
+ */
+bool flac_seek_index_from_table(struct finfo_arena *arena,
+								const struct flac_seek_table *table,
+								uint64_t audio_offset,
+								struct flac_seek_index *dst);
+
+/*
+ * Build in DST the index of every frame found by SCAN.
+ * Returns false if the index can't be allocated from ARENA.
+ */
+bool flac_seek_index_from_scan(struct finfo_arena *arena,
+							   const struct flac_frame_scan *scan,
+							   struct flac_seek_index *dst);
+
+// Return the last point of INDEX at or before SAMPLE.
+size_t flac_seek_index_find(const struct flac_seek_index *index,
+							uint64_t sample);
+
+/*
+ * Find the frame containing SAMPLE, starting from the closest point of INDEX
+ * and walking the frames after it.
+ * Returns false if the sample is past the end of the stream or a frame
+ * on the way is corrupt.
+ */
+bool flac_seek(struct finfo_input *in, const struct flac_seek_index *index,
+			   const struct flac_streaminfo *info, uint64_t sample,
+			   struct flac_frame_entry *dst);
+
+#endif // !FINFO_FLAC_SEEK_H
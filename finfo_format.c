@@ -0,0 +1,24 @@
+#include <stddef.h>
+#include <string.h>
+#include "finfo_format.h"
+#include "finfo_flac.h"
+#include "finfo_png.h"
+
+const struct finfo_format *const finfo_formats[] = {
+	&flac_format,
+	&png_format,
+	NULL,
+};
+
+const struct finfo_format *finfo_format_detect(struct finfo_input *in) {
+	for (size_t i = 0; finfo_formats[i] != NULL; i++) {
+		const struct finfo_format *format = finfo_formats[i];
+		if (format->signature_len <= in->prefix_len &&
+			memcmp(in->prefix, format->signature, format->signature_len) ==
+				0) {
+			return format;
+		}
+	}
+
+	return NULL;
+}
@@ -0,0 +1,32 @@
+#ifndef FINFO_FORMAT_H
+#define FINFO_FORMAT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "finfo_input.h"
+
+/*
+ * A file format finfo can describe.
+ * Formats are recognized from the signature at the start of the file, so that
+ * detection only needs the input prefix, whatever the number of formats.
+ */
+struct finfo_format {
+	const char *name;
+	const unsigned char *signature;
+	size_t signature_len;
+	// Parse and print the input, which is known to start with the signature.
+	// Returns false if the input is not valid.
+	bool (*parse)(struct finfo_input *in);
+};
+
+/*
+ * Registered formats, terminated by NULL.
+ * To add a format, define its struct finfo_format next to its parser and
+ * list it here.
+ */
+extern const struct finfo_format *const finfo_formats[];
+
+// Return the format whose signature starts the input, or NULL if none does.
+const struct finfo_format *finfo_format_detect(struct finfo_input *in);
+
+#endif // !FINFO_FORMAT_H
@@ -0,0 +1,657 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "finfo_index.h"
+#include "finfo_flac.h"
+#include "finfo_format.h"
+
+#define INDEX_MAGIC "FINFOI01"
+// Written as a native integer, to tell files from other machines apart.
+#define INDEX_BYTE_ORDER 0x01020304u
+#define INDEX_MIN_SLOTS	 1024u
+
+struct index_header {
+	char magic[8];
+	uint32_t byte_order;
+	uint32_t files_n;
+	uint32_t terms_n;
+	uint32_t reserved;
+	uint64_t paths_len;
+	uint64_t strings_len;
+	uint64_t postings_len;
+};
+
+struct finfo_index_term {
+	// Position of the bytes of the term among the strings.
+	uint64_t string_offset;
+	// Position of the list of files among the postings. While building,
+	// the last file added plus one, to add every file once.
+	uint64_t postings_offset;
+	uint32_t string_len;
+	// Number of files in the list.
+	uint32_t postings_n;
+};
+
+_Static_assert(sizeof(struct index_header) == 48, "unexpected header size");
+_Static_assert(sizeof(struct finfo_index_term) == 24, "unexpected term size");
+
+// ===== Terms =====
+
+void finfo_index_terms(struct finfo_input *in, struct finfo_buf *dst) {
+	if (finfo_format_detect(in) != &flac_format) { return; }
+
+	struct flac_metadata_block block;
+	if (!flac_find_block(in, FLAC_VORBIS_COMMENT_TYPE, &block)) { return; }
+
+	const struct flac_vorbis_comment *vorbis = &block.data.vorbis_comment;
+	for (uint32_t i = 0; i < vorbis->fields_n; i++) {
+		const struct flac_vorbis_field *field = &vorbis->fields[i];
+
+		// Null bytes would split the term.
+		const char *sep = memchr(field->data, '=', field->length);
+		if (sep == NULL || sep == field->data ||
+			memchr(field->data, '\0', field->length) != NULL) {
+			continue;
+		}
+
+		size_t start = dst->len;
+		finfo_buf_append(dst, field->data, field->length);
+		finfo_buf_append(dst, "", 1);
+
+		// Names are ASCII, compared ignoring case.
+		for (char *c = dst->data + start; *c != '='; c++) {
+			if (*c >= 'a' && *c <= 'z') { *c -= 'a' - 'A'; }
+		}
+	}
+}
+
+// ===== Building =====
+
+static uint64_t index_hash(const char *data, size_t len) {
+	// FNV-1a.
+	uint64_t h = 0xCBF29CE484222325u;
+	for (size_t i = 0; i < len; i++) {
+		h ^= (unsigned char)data[i];
+		h *= 0x100000001B3u;
+	}
+	return h;
+}
+
+void finfo_index_builder_init(struct finfo_index_builder *builder) {
+	*builder = (struct finfo_index_builder){0};
+	finfo_buf_init(&builder->paths);
+	finfo_buf_init(&builder->strings);
+}
+
+void finfo_index_builder_free(struct finfo_index_builder *builder) {
+	finfo_buf_free(&builder->paths);
+	finfo_buf_free(&builder->strings);
+	free(builder->path_offsets);
+	free(builder->terms);
+	free(builder->slots);
+	free(builder->occurrences);
+	free(builder->occurrence_files);
+	*builder = (struct finfo_index_builder){0};
+}
+
+// Grow the array *ARRAY of *CAP elements of SIZE bytes to hold N of them.
+static bool index_reserve(void **array, size_t *cap, size_t n, size_t size) {
+	if (n <= *cap) { return true; }
+
+	size_t new_cap = *cap ? *cap : 64;
+	while (new_cap < n) { new_cap *= 2; }
+	void *new_array = realloc(*array, new_cap * size);
+	if (new_array == NULL) { return false; }
+
+	*array = new_array;
+	*cap   = new_cap;
+	return true;
+}
+
+// Double the hash table of the terms, which is kept at most half full.
+static bool index_grow_slots(struct finfo_index_builder *builder) {
+	size_t slots_n = builder->slots_n ? builder->slots_n * 2 : INDEX_MIN_SLOTS;
+	uint32_t *slots = calloc(slots_n, sizeof(*slots));
+	if (slots == NULL) { return false; }
+
+	for (uint32_t t = 0; t < builder->terms_n; t++) {
+		const struct finfo_index_term *term = &builder->terms[t];
+		size_t i = index_hash(builder->strings.data + term->string_offset,
+							  term->string_len) &
+				   (slots_n - 1);
+		while (slots[i] != 0) { i = (i + 1) & (slots_n - 1); }
+		slots[i] = t + 1;
+	}
+
+	free(builder->slots);
+	builder->slots	 = slots;
+	builder->slots_n = slots_n;
+	return true;
+}
+
+// Return the index of the term DATA, long LEN bytes, adding it if missing.
+static bool index_intern(struct finfo_index_builder *builder, const char *data,
+						 size_t len, uint32_t *dst) {
+	if (2 * (builder->terms_n + 1) > builder->slots_n &&
+		!index_grow_slots(builder)) {
+		return false;
+	}
+
+	size_t mask = builder->slots_n - 1;
+	size_t i	= index_hash(data, len) & mask;
+	for (; builder->slots[i] != 0; i = (i + 1) & mask) {
+		uint32_t t							= builder->slots[i] - 1;
+		const struct finfo_index_term *term = &builder->terms[t];
+		if (term->string_len == len &&
+			memcmp(builder->strings.data + term->string_offset, data, len) ==
+				0) {
+			*dst = t;
+			return true;
+		}
+	}
+
+	if (builder->terms_n == UINT32_MAX ||
+		!index_reserve((void **)&builder->terms, &builder->terms_cap,
+					   builder->terms_n + 1, sizeof(*builder->terms))) {
+		return false;
+	}
+
+	builder->terms[builder->terms_n] = (struct finfo_index_term){
+		.string_offset = builder->strings.len,
+		.string_len	   = len,
+	};
+	finfo_buf_append(&builder->strings, data, len);
+	builder->slots[i] = builder->terms_n + 1;
+	*dst			  = builder->terms_n++;
+	return true;
+}
+
+bool finfo_index_builder_add(struct finfo_index_builder *builder,
+							 const char *path, const char *terms, size_t len) {
+	if (len == 0) { return true; }
+	if (builder->files_n == UINT32_MAX - 1 ||
+		!index_reserve((void **)&builder->path_offsets, &builder->files_cap,
+					   builder->files_n + 1, sizeof(*builder->path_offsets))) {
+		return false;
+	}
+
+	uint32_t file				= builder->files_n++;
+	builder->path_offsets[file] = builder->paths.len;
+	finfo_buf_append(&builder->paths, path, strlen(path) + 1);
+
+	for (const char *end = terms + len; terms < end;) {
+		size_t term_len = strlen(terms);
+
+		uint32_t t;
+		if (!index_intern(builder, terms, term_len, &t)) { return false; }
+		terms += term_len + 1;
+
+		// The same comment can appear more than once in a file.
+		struct finfo_index_term *term = &builder->terms[t];
+		if (term->postings_offset == file + 1) { continue; }
+		term->postings_offset = file + 1;
+		term->postings_n++;
+
+		size_t cap = builder->occurrences_cap;
+		if (!index_reserve((void **)&builder->occurrences, &cap,
+						   builder->occurrences_n + 1,
+						   sizeof(*builder->occurrences)) ||
+			!index_reserve((void **)&builder->occurrence_files,
+						   &builder->occurrences_cap,
+						   builder->occurrences_n + 1,
+						   sizeof(*builder->occurrence_files))) {
+			return false;
+		}
+		builder->occurrences[builder->occurrences_n]		= t;
+		builder->occurrence_files[builder->occurrences_n++] = file;
+	}
+	return true;
+}
+
+// Term to sort, with its bytes.
+struct index_sort_term {
+	const char *data;
+	uint32_t len;
+	uint32_t term;
+};
+
+static int index_compare(const char *a, size_t a_len, const char *b,
+						 size_t b_len) {
+	int cmp = memcmp(a, b, a_len < b_len ? a_len : b_len);
+	if (cmp != 0) { return cmp; }
+	return (a_len > b_len) - (a_len < b_len);
+}
+
+static int index_sort_compare(const void *a, const void *b) {
+	const struct index_sort_term *x = a, *y = b;
+	return index_compare(x->data, x->len, y->data, y->len);
+}
+
+// Append VALUE to BUF as a varint, seven bits per byte from the lowest.
+static void index_append_varint(struct finfo_buf *buf, uint32_t value) {
+	unsigned char bytes[5];
+	size_t len = 0;
+	do {
+		bytes[len++] = (value & 0x7F) | (value > 0x7F ? 0x80 : 0);
+		value >>= 7;
+	} while (value != 0);
+	finfo_buf_append(buf, bytes, len);
+}
+
+/*
+ * Write to OUT the index of BUILDER, with its terms in the order of SORTED
+ * and the lists of files FILES, grouped by term in the same order.
+ */
+static bool index_write(FILE *out, const struct finfo_index_builder *builder,
+						const struct index_sort_term *sorted,
+						const uint32_t *files) {
+	struct finfo_index_term *terms = calloc(builder->terms_n, sizeof(*terms));
+	if (builder->terms_n > 0 && terms == NULL) { return false; }
+
+	struct finfo_buf postings;
+	finfo_buf_init(&postings);
+
+	uint64_t string_offset = 0;
+	for (uint32_t r = 0; r < builder->terms_n; r++) {
+		const struct finfo_index_term *term = &builder->terms[sorted[r].term];
+
+		terms[r] = (struct finfo_index_term){
+			.string_offset	 = string_offset,
+			.postings_offset = postings.len,
+			.string_len		 = term->string_len,
+			.postings_n		 = term->postings_n,
+		};
+		string_offset += term->string_len;
+
+		// Files are sorted, so each one is stored as the distance from the
+		// previous one.
+		uint32_t prev = 0;
+		for (uint32_t i = 0; i < term->postings_n; i++) {
+			index_append_varint(&postings, files[i] - prev);
+			prev = files[i];
+		}
+		files += term->postings_n;
+	}
+
+	struct index_header header = {
+		.magic		  = INDEX_MAGIC,
+		.byte_order	  = INDEX_BYTE_ORDER,
+		.files_n	  = builder->files_n,
+		.terms_n	  = builder->terms_n,
+		.paths_len	  = builder->paths.len,
+		.strings_len  = string_offset,
+		.postings_len = postings.len,
+	};
+	uint64_t paths_end = builder->paths.len;
+
+	fwrite(&header, sizeof(header), 1, out);
+	fwrite(builder->path_offsets, sizeof(*builder->path_offsets),
+		   builder->files_n, out);
+	fwrite(&paths_end, sizeof(paths_end), 1, out);
+	fwrite(terms, sizeof(*terms), builder->terms_n, out);
+	fwrite(builder->paths.data, 1, builder->paths.len, out);
+	for (uint32_t r = 0; r < builder->terms_n; r++) {
+		fwrite(sorted[r].data, 1, sorted[r].len, out);
+	}
+	fwrite(postings.data, 1, postings.len, out);
+
+	finfo_buf_free(&postings);
+	free(terms);
+	return !ferror(out);
+}
+
+/*
+ * Sort the terms of BUILDER and group the files of their occurrences by
+ * term, then write the index to OUT.
+ */
+static bool index_build(FILE *out, const struct finfo_index_builder *builder) {
+	size_t terms_n				   = builder->terms_n;
+	struct index_sort_term *sorted = malloc(terms_n * sizeof(*sorted));
+	uint32_t *starts			   = malloc((terms_n + 1) * sizeof(*starts));
+	uint32_t *files = malloc(builder->occurrences_n * sizeof(*files));
+	bool ok			= (terms_n == 0 || sorted != NULL) && starts != NULL &&
+			  (builder->occurrences_n == 0 || files != NULL);
+
+	if (ok) {
+		for (uint32_t t = 0; t < terms_n; t++) {
+			const struct finfo_index_term *term = &builder->terms[t];
+
+			sorted[t] = (struct index_sort_term){
+				.data = builder->strings.data + term->string_offset,
+				.len  = term->string_len,
+				.term = t,
+			};
+		}
+		if (terms_n > 0) {
+			qsort(sorted, terms_n, sizeof(*sorted), index_sort_compare);
+		}
+
+		// Start of the files of each term, indexed by term, in sorted order.
+		uint32_t start = 0;
+		for (uint32_t r = 0; r < terms_n; r++) {
+			starts[sorted[r].term] = start;
+			start += builder->terms[sorted[r].term].postings_n;
+		}
+
+		// Occurrences are in file order, which this keeps inside each term.
+		for (size_t i = 0; i < builder->occurrences_n; i++) {
+			files[starts[builder->occurrences[i]]++] =
+				builder->occurrence_files[i];
+		}
+
+		ok = index_write(out, builder, sorted, files);
+	} else {
+		errno = ENOMEM;
+	}
+
+	free(sorted);
+	free(starts);
+	free(files);
+	return ok;
+}
+
+bool finfo_index_builder_save(struct finfo_index_builder *builder,
+							  const char *path) {
+	size_t path_len = strlen(path);
+	char *tmp_path	= malloc(path_len + sizeof(".XXXXXX"));
+	if (tmp_path == NULL) { return false; }
+	memcpy(tmp_path, path, path_len);
+	memcpy(tmp_path + path_len, ".XXXXXX", sizeof(".XXXXXX"));
+
+	bool ok	 = false;
+	int fd	 = mkstemp(tmp_path);
+	FILE *out = fd >= 0 ? fdopen(fd, "wb") : NULL;
+	if (out != NULL) {
+		ok = index_build(out, builder);
+		ok = fclose(out) == 0 && ok;
+		ok = ok && rename(tmp_path, path) == 0;
+	} else if (fd >= 0) {
+		close(fd);
+	}
+
+	if (!ok && fd >= 0) {
+		int err = errno;
+		unlink(tmp_path);
+		errno = err;
+	}
+	free(tmp_path);
+	return ok;
+}
+
+// ===== Queries =====
+
+/*
+ * Check the content of the index file MAP, long LEN bytes, and set up DST
+ * to search it. Returns false if it is not a valid index file.
+ */
+static bool index_load(void *map, size_t len, struct finfo_index *dst) {
+	const struct index_header *header = map;
+	if (len < sizeof(*header) ||
+		memcmp(header->magic, INDEX_MAGIC, sizeof(header->magic)) != 0 ||
+		header->byte_order != INDEX_BYTE_ORDER) {
+		return false;
+	}
+
+	uint64_t offsets_len = ((uint64_t)header->files_n + 1) * sizeof(uint64_t);
+	uint64_t terms_len =
+		(uint64_t)header->terms_n * sizeof(struct finfo_index_term);
+	uint64_t left = len - sizeof(*header);
+	if (left < offsets_len + terms_len) { return false; }
+	left -= offsets_len + terms_len;
+	if (header->paths_len > left ||
+		header->strings_len > left - header->paths_len ||
+		header->postings_len !=
+			left - header->paths_len - header->strings_len) {
+		return false;
+	}
+
+	const unsigned char *next = (unsigned char *)map + sizeof(*header);
+
+	*dst = (struct finfo_index){
+		.map		  = map,
+		.map_len	  = len,
+		.files_n	  = header->files_n,
+		.terms_n	  = header->terms_n,
+		.path_offsets = (const void *)next,
+		.terms		  = (const void *)(next + offsets_len),
+		.paths		  = (const char *)next + offsets_len + terms_len,
+		.paths_len	  = header->paths_len,
+		.strings_len  = header->strings_len,
+		.postings_len = header->postings_len,
+	};
+	dst->strings  = dst->paths + dst->paths_len;
+	dst->postings = (const unsigned char *)dst->strings + dst->strings_len;
+	return true;
+}
+
+bool finfo_index_open(struct finfo_index *index, const char *path) {
+	*index = (struct finfo_index){0};
+
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) { return false; }
+
+	struct stat st;
+	if (fstat(fd, &st) < 0) {
+		int err = errno;
+		close(fd);
+		errno = err;
+		return false;
+	}
+
+	void *map = MAP_FAILED;
+	if (S_ISREG(st.st_mode) && st.st_size > 0) {
+		map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	}
+	int err = errno;
+	close(fd);
+
+	if (map == MAP_FAILED) {
+		errno = S_ISREG(st.st_mode) && st.st_size > 0 ? err : EINVAL;
+		return false;
+	}
+	if (!index_load(map, st.st_size, index)) {
+		munmap(map, st.st_size);
+		errno = EINVAL;
+		return false;
+	}
+	return true;
+}
+
+void finfo_index_close(struct finfo_index *index) {
+	if (index->map != NULL) { munmap(index->map, index->map_len); }
+	*index = (struct finfo_index){0};
+}
+
+const char *finfo_index_path(const struct finfo_index *index, uint32_t file) {
+	if (file >= index->files_n) { return NULL; }
+
+	uint64_t start = index->path_offsets[file];
+	uint64_t end   = index->path_offsets[file + 1];
+	if (start >= end || end > index->paths_len ||
+		index->paths[end - 1] != '\0') {
+		return NULL;
+	}
+	return index->paths + start;
+}
+
+// Bytes of TERM, or NULL if they are outside of the index.
+static const char *index_term_string(const struct finfo_index *index,
+									 const struct finfo_index_term *term) {
+	if (term->string_offset > index->strings_len ||
+		index->strings_len - term->string_offset < term->string_len) {
+		return NULL;
+	}
+	return index->strings + term->string_offset;
+}
+
+// Position of the first term not lower than KEY, long LEN bytes.
+static uint32_t index_lower_bound(const struct finfo_index *index,
+								  const char *key, size_t len) {
+	uint32_t lo = 0, hi = index->terms_n;
+	while (lo < hi) {
+		uint32_t mid						= lo + (hi - lo) / 2;
+		const struct finfo_index_term *term = &index->terms[mid];
+		const char *string					= index_term_string(index, term);
+		if (string == NULL) { return index->terms_n; }
+
+		if (index_compare(string, term->string_len, key, len) < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+/*
+ * Decode the files of TERM, and pass each one to ADD with CTX. Stops at the
+ * first file which is out of order, in corrupt indexes.
+ */
+static void index_decode(const struct finfo_index *index,
+						 const struct finfo_index_term *term,
+						 void (*add)(void *ctx, uint32_t file), void *ctx) {
+	if (term->postings_offset > index->postings_len) { return; }
+	const unsigned char *next = index->postings + term->postings_offset;
+	const unsigned char *end  = index->postings + index->postings_len;
+
+	uint64_t file = 0;
+	for (uint32_t i = 0; i < term->postings_n; i++) {
+		uint64_t delta = 0;
+		for (int shift = 0;; shift += 7) {
+			if (next == end || shift > 28) { return; }
+			delta |= (uint64_t)(*next & 0x7F) << shift;
+			if (!(*next++ & 0x80)) { break; }
+		}
+
+		file += delta;
+		if ((i > 0 && delta == 0) || file >= index->files_n) { return; }
+		add(ctx, file);
+	}
+}
+
+static void index_add_file(void *ctx, uint32_t file) {
+	struct finfo_index_result *result = ctx;
+	result->files[result->files_n++]  = file;
+}
+
+static void index_mark_file(void *ctx, uint32_t file) {
+	uint64_t *bitmap = ctx;
+	bitmap[file / 64] |= (uint64_t)1 << (file % 64);
+}
+
+/*
+ * Put in DST the files of the terms FIRST to LAST, excluded. The files of
+ * several terms are merged through a bitmap of every file, which also
+ * sorts them.
+ */
+static bool index_collect(const struct finfo_index *index, uint32_t first,
+						  uint32_t last, struct finfo_index_result *dst) {
+	if (last - first == 1) {
+		const struct finfo_index_term *term = &index->terms[first];
+		if (term->postings_n > index->files_n) { return true; }
+
+		dst->files = malloc(term->postings_n * sizeof(*dst->files));
+		if (term->postings_n > 0 && dst->files == NULL) { return false; }
+		index_decode(index, term, index_add_file, dst);
+		return true;
+	}
+
+	size_t words_n	 = (index->files_n + 63) / 64;
+	uint64_t *bitmap = calloc(words_n, sizeof(*bitmap));
+	if (words_n > 0 && bitmap == NULL) { return false; }
+
+	size_t files_n = 0;
+	for (uint32_t t = first; t < last; t++) {
+		index_decode(index, &index->terms[t], index_mark_file, bitmap);
+	}
+	for (size_t w = 0; w < words_n; w++) {
+		files_n += __builtin_popcountll(bitmap[w]);
+	}
+
+	dst->files = malloc(files_n * sizeof(*dst->files));
+	if (files_n > 0 && dst->files == NULL) {
+		free(bitmap);
+		return false;
+	}
+	for (size_t w = 0; w < words_n; w++) {
+		for (uint64_t bits = bitmap[w]; bits != 0; bits &= bits - 1) {
+			dst->files[dst->files_n++] = w * 64 + __builtin_ctzll(bits);
+		}
+	}
+
+	free(bitmap);
+	return true;
+}
+
+bool finfo_index_lookup(const struct finfo_index *index, const char *query,
+						struct finfo_index_result *dst) {
+	*dst = (struct finfo_index_result){0};
+
+	const char *sep = strchr(query, '=');
+	if (sep == NULL || sep == query) {
+		errno = EINVAL;
+		return false;
+	}
+
+	// The key is the query as a term, without the star of prefixes.
+	size_t len	= strlen(query);
+	bool prefix = query[len - 1] == '*';
+	if (prefix) { len--; }
+
+	char *key = malloc(len);
+	if (len > 0 && key == NULL) { return false; }
+	memcpy(key, query, len);
+	for (char *c = key; *c != '='; c++) {
+		if (*c >= 'a' && *c <= 'z') { *c -= 'a' - 'A'; }
+	}
+
+	uint32_t first = index_lower_bound(index, key, len);
+	uint32_t last  = first;
+	while (last < index->terms_n) {
+		const struct finfo_index_term *term = &index->terms[last];
+		const char *string					= index_term_string(index, term);
+		if (string == NULL ||
+			(prefix ? term->string_len < len
+					: term->string_len != len) ||
+			memcmp(string, key, len) != 0) {
+			break;
+		}
+		last++;
+		if (!prefix) { break; }
+	}
+	free(key);
+
+	if (first == last) { return true; }
+	if (!index_collect(index, first, last, dst)) {
+		finfo_index_result_free(dst);
+		errno = ENOMEM;
+		return false;
+	}
+	return true;
+}
+
+void finfo_index_result_intersect(struct finfo_index_result *dst,
+								  const struct finfo_index_result *other) {
+	size_t n = 0;
+	for (size_t i = 0, j = 0; i < dst->files_n && j < other->files_n;) {
+		if (dst->files[i] < other->files[j]) {
+			i++;
+		} else if (dst->files[i] > other->files[j]) {
+			j++;
+		} else {
+			dst->files[n++] = dst->files[i++];
+			j++;
+		}
+	}
+	dst->files_n = n;
+}
+
+void finfo_index_result_free(struct finfo_index_result *result) {
+	free(result->files);
+	*result = (struct finfo_index_result){0};
+}
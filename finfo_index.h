@@ -0,0 +1,122 @@
+#ifndef FINFO_INDEX_H
+#define FINFO_INDEX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "finfo_input.h"
+#include "finfo_output.h"
+
+/*
+ * Inverted index of the vorbis comments of a library of FLAC files, to find
+ * the files with a tag without opening any of them.
+ *
+ * Every comment is a term, NAME=VALUE with the name in uppercase, since
+ * names are compared ignoring case, and the value as it is. Files are
+ * identified by their position in the index, and each term has the sorted
+ * list of the files holding it, stored as varint encoded differences.
+ *
+ * The index file is a header, followed by the offsets of the paths of the
+ * files, by the terms sorted by their bytes, and by the paths, the bytes of
+ * the terms and the lists of files. Everything is in native byte order,
+ * and lookups binary search the terms directly on the mapping of the file.
+ * An index is always built from scratch, and renamed over the previous one.
+ */
+
+struct finfo_index_term;
+
+// Index being built, holding every term once.
+struct finfo_index_builder {
+	// Paths of the files, each terminated by a null byte.
+	struct finfo_buf paths;
+	uint64_t *path_offsets;
+	uint32_t files_n;
+	size_t files_cap;
+
+	// Terms, with their bytes stored one after the other in STRINGS.
+	struct finfo_index_term *terms;
+	uint32_t terms_n;
+	size_t terms_cap;
+	struct finfo_buf strings;
+	// Open addressed hash table of the indexes of the terms, plus one.
+	uint32_t *slots;
+	size_t slots_n;
+
+	// Term of every occurrence, in file order, and the file holding it.
+	uint32_t *occurrences;
+	uint32_t *occurrence_files;
+	size_t occurrences_n;
+	size_t occurrences_cap;
+};
+
+/*
+ * Append to DST the terms of the input IN, each one terminated by a null
+ * byte. Inputs which are not FLAC files, or without vorbis comments, have
+ * no terms.
+ */
+void finfo_index_terms(struct finfo_input *in, struct finfo_buf *dst);
+
+void finfo_index_builder_init(struct finfo_index_builder *builder);
+void finfo_index_builder_free(struct finfo_index_builder *builder);
+
+/*
+ * Add the file at PATH with the LEN bytes of TERMS, as given by
+ * finfo_index_terms. Files without terms are not added.
+ * Returns false on allocation failure.
+ */
+bool finfo_index_builder_add(struct finfo_index_builder *builder,
+							 const char *path, const char *terms, size_t len);
+
+/*
+ * Write the index to PATH, through a temporary file renamed over it.
+ * On failure returns false and sets errno.
+ */
+bool finfo_index_builder_save(struct finfo_index_builder *builder,
+							  const char *path);
+
+// Mapping of an index file.
+struct finfo_index {
+	void *map;
+	size_t map_len;
+	uint32_t files_n;
+	uint32_t terms_n;
+	const uint64_t *path_offsets;
+	const struct finfo_index_term *terms;
+	const char *paths;
+	uint64_t paths_len;
+	const char *strings;
+	uint64_t strings_len;
+	const unsigned char *postings;
+	uint64_t postings_len;
+};
+
+/*
+ * Map the index file at PATH.
+ * On failure returns false and sets errno, to EINVAL if it is not an index.
+ */
+bool finfo_index_open(struct finfo_index *index, const char *path);
+void finfo_index_close(struct finfo_index *index);
+
+// Sorted identifiers of the files matching a query.
+struct finfo_index_result {
+	uint32_t *files;
+	size_t files_n;
+};
+
+/*
+ * Find in DST the files matching QUERY: NAME=VALUE for the files with that
+ * comment, or NAME=PREFIX* for the ones with a NAME starting with PREFIX.
+ * On failure returns false and sets errno, to EINVAL if the query has no
+ * '='.
+ */
+bool finfo_index_lookup(const struct finfo_index *index, const char *query,
+						struct finfo_index_result *dst);
+// Keep in DST only the files which are also in OTHER.
+void finfo_index_result_intersect(struct finfo_index_result *dst,
+								  const struct finfo_index_result *other);
+void finfo_index_result_free(struct finfo_index_result *result);
+
+// Path of the file FILE, or NULL if the index is corrupt.
+const char *finfo_index_path(const struct finfo_index *index, uint32_t file);
+
+#endif // !FINFO_INDEX_H
@@ -0,0 +1,214 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "finfo_input.h"
+
+// Buffer holding a view read from the FILE fallback.
+struct finfo_input_buf {
+	struct finfo_input_buf *next;
+	unsigned char data[];
+};
+
+// Read the whole stream FILE in memory, for inputs that can't be seeked.
+static bool finfo_input_slurp(struct finfo_input *in) {
+	size_t cap			= 64 * 1024;
+	size_t len			= 0;
+	unsigned char *data = malloc(cap);
+
+	while (data != NULL) {
+		len += fread(data + len, 1, cap - len, in->file);
+		if (len < cap) { break; }
+
+		cap *= 2;
+		unsigned char *new_data = realloc(data, cap);
+		if (new_data == NULL) { free(data); }
+		data = new_data;
+	}
+
+	if (data == NULL || ferror(in->file)) {
+		free(data);
+		return false;
+	}
+
+	in->data = data;
+	in->size = len;
+	fclose(in->file);
+	in->file = NULL;
+	return true;
+}
+
+bool finfo_input_open(struct finfo_input *in, const char *path) {
+	*in = (struct finfo_input){.fd = -1};
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) { return false; }
+
+	return finfo_input_adopt(in, path, fd, NULL, 0);
+}
+
+bool finfo_input_adopt(struct finfo_input *in, const char *path, int fd,
+					   unsigned char *data, size_t len) {
+	*in = (struct finfo_input){.path = path, .fd = fd, .prefetched = data};
+	int err;
+
+	if (fstat(in->fd, &in->st) < 0) { goto fail; }
+
+	if (S_ISREG(in->st.st_mode) && in->st.st_size > 0) {
+		in->size = in->st.st_size;
+
+		// The file was read whole, or its start at least.
+		if (len > 0 && len >= in->size) {
+			in->data	   = data;
+			in->prefetched = NULL;
+			in->prefix	   = data;
+			in->prefix_len = in->size;
+			close(in->fd);
+			in->fd = -1;
+			return true;
+		}
+		if (len > 0) {
+			in->prefix	   = data;
+			in->prefix_len = len;
+			return true;
+		}
+
+		size_t want = in->size < FINFO_PREFIX_LEN ? in->size : FINFO_PREFIX_LEN;
+		ssize_t n	= pread(in->fd, in->prefix_buf, want, 0);
+		if (n < 0) { goto fail; }
+
+		in->prefix	   = in->prefix_buf;
+		in->prefix_len = n;
+		return true;
+	}
+
+	// Pipes must be read from their start, and with blocking reads.
+	if (data != NULL) {
+		free(data);
+		in->prefetched = NULL;
+		close(in->fd);
+		in->fd = open(path, O_RDONLY);
+		if (in->fd < 0) { goto fail; }
+	}
+
+	// Pipes and files of unknown size, such as the ones in /proc.
+	in->file = fdopen(in->fd, "rb");
+	if (in->file == NULL) { goto fail; }
+	in->fd = -1;
+
+	if (!finfo_input_slurp(in)) { goto fail; }
+
+	in->prefix	   = in->data;
+	in->prefix_len = in->size < FINFO_PREFIX_LEN ? in->size : FINFO_PREFIX_LEN;
+	return true;
+
+fail:
+	err = errno;
+	finfo_input_close(in);
+	errno = err;
+	return false;
+}
+
+void finfo_input_open_memory(struct finfo_input *in, const char *path,
+							 const unsigned char *data, size_t len) {
+	*in = (struct finfo_input){
+		.path		= path,
+		.size		= len,
+		.prefix		= data,
+		.prefix_len = len,
+		.data		= data,
+		.borrowed	= true,
+		.fd			= -1,
+	};
+}
+
+void finfo_input_close(struct finfo_input *in) {
+	if (in->mapped) {
+		munmap((void *)in->data, in->size);
+	} else if (!in->borrowed) {
+		free((void *)in->data);
+	}
+
+	free(in->prefetched);
+
+	if (in->fd >= 0) { close(in->fd); }
+	if (in->file != NULL) { fclose(in->file); }
+
+	struct finfo_input_buf *buf = in->bufs;
+	while (buf != NULL) {
+		struct finfo_input_buf *next = buf->next;
+		free(buf);
+		buf = next;
+	}
+
+	finfo_arena_reset(&in->arena);
+	*in = (struct finfo_input){.fd = -1};
+}
+
+// Map the whole file, or switch to the FILE fallback if it can't be mapped.
+static bool finfo_input_map(struct finfo_input *in) {
+	void *map = mmap(NULL, in->size, PROT_READ, MAP_PRIVATE, in->fd, 0);
+	if (map != MAP_FAILED) {
+		in->data   = map;
+		in->mapped = true;
+		close(in->fd);
+		in->fd = -1;
+		return true;
+	}
+
+	in->file = fdopen(in->fd, "rb");
+	if (in->file == NULL) { return false; }
+	in->fd = -1;
+	return true;
+}
+
+bool finfo_input_view(struct finfo_input *in, uint64_t offset, size_t len,
+					  struct finfo_view *dst) {
+	if (offset > in->size || len > in->size - offset) { return false; }
+
+	if (offset + len <= in->prefix_len) {
+		dst->data = in->prefix + offset;
+		dst->len  = len;
+		return true;
+	}
+
+	if (in->data == NULL && in->file == NULL && !finfo_input_map(in)) {
+		return false;
+	}
+
+	if (in->data != NULL) {
+		dst->data = in->data + offset;
+		dst->len  = len;
+		return true;
+	}
+
+	struct finfo_input_buf *buf = malloc(sizeof(*buf) + len);
+	if (buf == NULL) { return false; }
+
+	if (fseeko(in->file, offset, SEEK_SET) < 0 ||
+		fread(buf->data, 1, len, in->file) != len) {
+		free(buf);
+		return false;
+	}
+
+	buf->next = in->bufs;
+	in->bufs  = buf;
+
+	dst->data = buf->data;
+	dst->len  = len;
+	return true;
+}
+
+bool finfo_view_sub(struct finfo_view view, size_t offset, size_t len,
+					struct finfo_view *dst) {
+	if (offset > view.len || len > view.len - offset) { return false; }
+
+	dst->data = view.data + offset;
+	dst->len  = len;
+	return true;
+}
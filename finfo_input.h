@@ -0,0 +1,98 @@
+#ifndef FINFO_INPUT_H
+#define FINFO_INPUT_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/stat.h>
+#include "finfo_arena.h"
+
+/*
+ * Read-only view of LEN bytes of an input.
+ * DATA points either inside the memory mapping of the file,
+ * or inside a buffer owned by the input.
+ */
+struct finfo_view {
+	const unsigned char *data;
+	size_t len;
+};
+
+struct finfo_input_buf;
+
+// Number of bytes read from the start of every input when it is opened.
+#define FINFO_PREFIX_LEN 64
+
+/*
+ * Input file the parsers decode from.
+ * The first FINFO_PREFIX_LEN bytes are read with a single call when the input
+ * is opened, which is enough to detect the format of the file, unless a
+ * longer start of the file was read ahead of time.
+ * The rest of the file is memory mapped the first time it is needed, so that
+ * views are just pointers inside the mapping. Inputs that can't be mapped
+ * are read through a buffered FILE: seekable ones are read on demand,
+ * one buffer per view, while streams such as pipes are read whole at open
+ * time.
+ */
+struct finfo_input {
+	const char *path;
+	// Size of the input in bytes.
+	uint64_t size;
+	// Status of the file when it was opened.
+	struct stat st;
+	// Start of the input.
+	const unsigned char *prefix;
+	size_t prefix_len;
+	// Whole content of the input, either mapped or read in memory.
+	// NULL until mapped, or when views are read on demand from FILE.
+	const unsigned char *data;
+	// True if DATA is a memory mapping, false if it is heap allocated.
+	bool mapped;
+	// True if DATA belongs to the caller, and is not freed.
+	bool borrowed;
+	// Descriptor of the file, until it is mapped.
+	int fd;
+	// Fallback for inputs that can't be mapped.
+	FILE *file;
+	// Buffers backing the views read from FILE.
+	struct finfo_input_buf *bufs;
+	// Start of the file read ahead of time, when it is not all of DATA.
+	unsigned char *prefetched;
+	// Memory for the values parsed from the input, freed when it is closed.
+	struct finfo_arena arena;
+	unsigned char prefix_buf[FINFO_PREFIX_LEN];
+};
+
+// Open the file at PATH. On failure returns false and sets errno.
+bool finfo_input_open(struct finfo_input *in, const char *path);
+/*
+ * Open the file at PATH from its descriptor FD, whose first LEN bytes were
+ * already read into the heap allocated DATA, if not NULL. The input takes
+ * FD and DATA over, even on failure, which sets errno.
+ */
+bool finfo_input_adopt(struct finfo_input *in, const char *path, int fd,
+					   unsigned char *data, size_t len);
+/*
+ * Open the LEN bytes of DATA as an input named PATH, without copying them.
+ * DATA must stay valid until the input is closed.
+ */
+void finfo_input_open_memory(struct finfo_input *in, const char *path,
+							 const unsigned char *data, size_t len);
+void finfo_input_close(struct finfo_input *in);
+
+/*
+ * Get in DST a view of LEN bytes of the input starting at OFFSET.
+ * Returns false if the input ends before OFFSET + LEN.
+ * Views stay valid until the input is closed.
+ */
+bool finfo_input_view(struct finfo_input *in, uint64_t offset, size_t len,
+					  struct finfo_view *dst);
+
+/*
+ * Get in DST the view of LEN bytes starting at OFFSET inside VIEW.
+ * Returns false if VIEW ends before OFFSET + LEN.
+ */
+bool finfo_view_sub(struct finfo_view view, size_t offset, size_t len,
+					struct finfo_view *dst);
+
+#endif // !FINFO_INPUT_H
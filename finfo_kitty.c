@@ -0,0 +1,352 @@
+#include <stdio.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <zlib.h>
+#include "finfo_kitty.h"
+#include "finfo_base64.h"
+#include "finfo_md5.h"
+#include "finfo_options.h"
+#include "finfo_output.h"
+#include "finfo_png_preview.h"
+#include "finfo_utils.h"
+
+#define KITTY_ESCAPE_START "\033_G"
+#define KITTY_ESCAPE_END "\033\\"
+#define KITTY_CHUNK_SIZE 4096
+
+// Kitty only deletes temporary files whose name contains this string.
+#define KITTY_TEMP_TEMPLATE "tty-graphics-protocol-finfo-XXXXXX"
+
+/*
+ * Build in DST the control codes to display an image in the format given
+ * by the control codes FORMAT, scaled to COLUMNS columns, or to the terminal
+ * width when COLUMNS is 0 and the width is known.
+ * If ID is not 0, the image is stored by the terminal with that id, and
+ * its responses are suppressed.
+ */
+static void kitty_control_codes(char *dst, size_t size, const char *format,
+								uint32_t columns, uint32_t id) {
+	struct winsize sz = {0};
+	ioctl(0, TIOCGWINSZ, &sz);
+	if (columns == 0) { columns = sz.ws_col; }
+
+	int len = snprintf(dst, size, "a=T,%s", format);
+	if (id != 0) { len += snprintf(dst + len, size - len, ",i=%u,q=2", id); }
+	if (columns > 0) { snprintf(dst + len, size - len, ",c=%u", columns); }
+}
+
+// Display again the image with id ID, already transmitted to the terminal.
+static void kitty_send_placement(uint32_t id) {
+	struct winsize sz = {0};
+	ioctl(0, TIOCGWINSZ, &sz);
+
+	finfo_printf("%sa=p,i=%u,q=2", KITTY_ESCAPE_START, id);
+	if (sz.ws_col > 0) { finfo_printf(",c=%d", sz.ws_col); }
+	finfo_printf(";%s\n", KITTY_ESCAPE_END);
+}
+
+/*
+ * Hash all of DATA into the key identifying an image, and into ID its Kitty
+ * image id, which can't be 0. Both are taken from the MD5 digest of the
+ * image.
+ */
+static uint64_t kitty_image_key(const unsigned char *data, size_t data_len,
+								uint32_t *id) {
+	struct finfo_md5 md5;
+	unsigned char digest[16];
+	finfo_md5_init(&md5);
+	finfo_md5_update(&md5, data, data_len);
+	finfo_md5_final(&md5, digest);
+
+	*id = load_be32(digest + 8);
+	if (*id == 0) { *id = 1; }
+	return load_be64(digest);
+}
+
+/*
+ * The image can only be read from somewhere else than the escape stream
+ * if the terminal runs on this machine. Assume it doesn't when the output
+ * isn't a terminal, or when running over SSH.
+ */
+static bool kitty_terminal_is_local(void) {
+	return isatty(STDOUT_FILENO) && getenv("SSH_CONNECTION") == NULL &&
+		   getenv("SSH_TTY") == NULL;
+}
+
+// Send DATA inline, base64 encoded and split in chunks.
+static void kitty_send_direct(const unsigned char *data, size_t data_len,
+							  const char *control_codes) {
+	char encoded[BASE64_ENCODED_LEN(KITTY_CHUNK_SIZE)];
+
+	size_t read_data = 0;
+	while (data_len > read_data) {
+		size_t to_read = (data_len - read_data) < KITTY_CHUNK_SIZE
+							 ? (data_len - read_data)
+							 : KITTY_CHUNK_SIZE;
+
+		size_t encoded_len = base64_encode(&data[read_data], to_read, encoded);
+
+		int first = read_data == 0;
+		read_data += to_read;
+		int last = read_data == data_len;
+
+		// Control codes should be specified only in first chunk
+		finfo_printf("%sm=%d%s%s;", KITTY_ESCAPE_START, !last,
+					 first ? "," : "", first ? control_codes : "");
+		finfo_buf_append(finfo_out, encoded, encoded_len);
+		finfo_printf("%s", KITTY_ESCAPE_END);
+	}
+
+	finfo_putchar('\n');
+}
+
+/*
+ * Send the location LOCATION of an image of DATA_LEN bytes, to be read by
+ * the terminal through the transmission medium MEDIUM.
+ */
+static void kitty_send_location(char medium, const char *location,
+								size_t data_len, const char *control_codes) {
+	size_t location_len = strlen(location);
+	char *encoded		= malloc(BASE64_ENCODED_LEN(location_len));
+	if (encoded == NULL) { return; }
+
+	size_t encoded_len =
+		base64_encode((const unsigned char *)location, location_len, encoded);
+
+	finfo_printf("%st=%c,S=%zu,%s;", KITTY_ESCAPE_START, medium, data_len,
+				 control_codes);
+	finfo_buf_append(finfo_out, encoded, encoded_len);
+	finfo_printf("%s\n", KITTY_ESCAPE_END);
+
+	free(encoded);
+}
+
+// Write all of DATA to FD.
+static bool kitty_write_all(int fd, const unsigned char *data, size_t len) {
+	while (len > 0) {
+		ssize_t n = write(fd, data, len);
+		if (n < 0) { return false; }
+		data += n;
+		len -= n;
+	}
+
+	return true;
+}
+
+/*
+ * Copy DATA to a new temporary file, whose path is put inside DST.
+ * The terminal deletes the file once it has read it.
+ */
+static bool kitty_write_temp(const unsigned char *data, size_t data_len,
+							 char dst[PATH_MAX]) {
+	const char *dir = getenv("TMPDIR");
+	if (dir == NULL || *dir == '\0') { dir = "/tmp"; }
+
+	int len = snprintf(dst, PATH_MAX, "%s/%s", dir, KITTY_TEMP_TEMPLATE);
+	if (len < 0 || len >= PATH_MAX) { return false; }
+
+	int fd = mkstemp(dst);
+	if (fd < 0) { return false; }
+
+	bool written = kitty_write_all(fd, data, data_len);
+	if (close(fd) < 0 || !written) {
+		unlink(dst);
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Copy DATA to a new POSIX shared memory object, whose name is put
+ * inside DST.
+ * The terminal unlinks the object once it has read it.
+ */
+static bool kitty_write_shm(const unsigned char *data, size_t data_len,
+							char dst[NAME_MAX]) {
+	static atomic_uint counter;
+
+	snprintf(dst, NAME_MAX, "/finfo-%d-%u", getpid(),
+			 atomic_fetch_add(&counter, 1));
+
+	int fd = shm_open(dst, O_CREAT | O_EXCL | O_RDWR, 0600);
+	if (fd < 0) { return false; }
+
+	bool written = ftruncate(fd, data_len) == 0 &&
+				   kitty_write_all(fd, data, data_len);
+	close(fd);
+	if (!written) {
+		shm_unlink(dst);
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Send an image held in memory through a temporary file or a shared memory
+ * object, as selected by the options.
+ * The location of the copy is put inside LOCATION, and the function to
+ * remove it, if the terminal never reads it, inside REMOVE_COPY.
+ * Returns false if the selected medium is not available, in which case
+ * nothing was sent.
+ */
+static bool kitty_send_copy(const unsigned char *data, size_t data_len,
+							const char *control_codes,
+							char location[PATH_MAX],
+							int (**remove_copy)(const char *)) {
+	switch (finfo_opts.kitty_transmission) {
+	case FINFO_KITTY_AUTO:
+		if (!kitty_terminal_is_local()) { return false; }
+		if (kitty_write_shm(data, data_len, location)) {
+			kitty_send_location('s', location, data_len, control_codes);
+			*remove_copy = shm_unlink;
+			return true;
+		}
+		// Fall back to a temporary file.
+	case FINFO_KITTY_FILE:
+	case FINFO_KITTY_TEMP:
+		if (!kitty_write_temp(data, data_len, location)) { return false; }
+		kitty_send_location('t', location, data_len, control_codes);
+		*remove_copy = unlink;
+		return true;
+	case FINFO_KITTY_SHM:
+		if (!kitty_write_shm(data, data_len, location)) { return false; }
+		kitty_send_location('s', location, data_len, control_codes);
+		*remove_copy = shm_unlink;
+		return true;
+	case FINFO_KITTY_DIRECT:
+		break;
+	}
+
+	return false;
+}
+
+/*
+ * Send the RGBA pixels of PREVIEW, over the columns it takes in the
+ * terminal SZ. They are zlib compressed when sent inline, through the
+ * terminal.
+ */
+static void kitty_send_preview(const struct png_preview *preview,
+							   const struct winsize *sz) {
+	char format[64];
+	snprintf(format, sizeof(format), "f=32,s=%u,v=%u", preview->width,
+			 preview->height);
+
+	uint32_t columns = ((uint64_t)preview->width * sz->ws_col +
+						sz->ws_xpixel - 1) /
+					   sz->ws_xpixel;
+	char control_codes[128];
+	kitty_control_codes(control_codes, sizeof(control_codes), format,
+						columns > 0 ? columns : 1, 0);
+
+	size_t pixels_len = 4 * (size_t)preview->width * preview->height;
+	char location[PATH_MAX];
+	int (*remove_copy)(const char *);
+	if (kitty_send_copy(preview->pixels, pixels_len, control_codes, location,
+						&remove_copy)) {
+		return;
+	}
+
+	uLongf compressed_len	 = compressBound(pixels_len);
+	unsigned char *compressed = malloc(compressed_len);
+	if (compressed != NULL &&
+		compress2(compressed, &compressed_len, preview->pixels, pixels_len,
+				  Z_BEST_SPEED) == Z_OK) {
+		strncat(control_codes, ",o=z",
+				sizeof(control_codes) - strlen(control_codes) - 1);
+		kitty_send_direct(compressed, compressed_len, control_codes);
+	} else {
+		kitty_send_direct(preview->pixels, pixels_len, control_codes);
+	}
+	free(compressed);
+}
+
+/*
+ * Images wider or taller than the terminal are shrunk to fit its size in
+ * pixels before being sent, instead of letting the terminal scale the
+ * original.
+ */
+void print_png_file(struct finfo_input *in) {
+	struct winsize sz = {0};
+	ioctl(0, TIOCGWINSZ, &sz);
+
+	struct png_preview preview;
+	if (sz.ws_xpixel > 0 && sz.ws_col > 0 &&
+		png_preview_decode(in, sz.ws_xpixel, sz.ws_ypixel, &preview)) {
+		kitty_send_preview(&preview, &sz);
+		png_preview_free(&preview);
+		return;
+	}
+
+	char control_codes[64];
+	kitty_control_codes(control_codes, sizeof(control_codes), "f=100", 0, 0);
+
+	enum finfo_kitty_transmission mode = finfo_opts.kitty_transmission;
+	if (mode == FINFO_KITTY_FILE ||
+		(mode == FINFO_KITTY_AUTO && kitty_terminal_is_local())) {
+		// The terminal can read the file itself: only send its path.
+		char path[PATH_MAX];
+		if (realpath(in->path, path) != NULL) {
+			kitty_send_location('f', path, in->size, control_codes);
+			return;
+		}
+	}
+
+	struct finfo_view file;
+	if (!finfo_input_view(in, 0, in->size, &file)) { return; }
+
+	if (mode == FINFO_KITTY_TEMP || mode == FINFO_KITTY_SHM) {
+		char location[PATH_MAX];
+		int (*remove_copy)(const char *);
+		if (kitty_send_copy(file.data, file.len, control_codes, location,
+							&remove_copy)) {
+			return;
+		}
+	}
+
+	kitty_send_direct(file.data, file.len, control_codes);
+}
+
+/*
+ * Identical images, such as the cover art shared by all the tracks of an
+ * album, are transmitted once with an id derived from their content, and
+ * only placed again by id afterwards.
+ */
+void print_png(const unsigned char *data, size_t data_len) {
+	uint32_t id;
+	uint64_t key = kitty_image_key(data, data_len, &id);
+
+	// A previous file already transmitted the image.
+	if (finfo_key_flushed(key)) {
+		kitty_send_placement(id);
+		return;
+	}
+
+	// Whether this file is the first to print the image is only known once
+	// the files before it are printed: prepare both outputs.
+	size_t transmission_offset = finfo_out->len;
+
+	// The copy is left to be removed if the placement is printed instead.
+	char control_codes[64];
+	kitty_control_codes(control_codes, sizeof(control_codes), "f=100", 0,
+						id);
+	char location[PATH_MAX];
+	int (*remove_copy)(const char *) = NULL;
+	bool copied = kitty_send_copy(data, data_len, control_codes, location,
+								  &remove_copy);
+	if (!copied) { kitty_send_direct(data, data_len, control_codes); }
+
+	size_t placement_offset = finfo_out->len;
+	kitty_send_placement(id);
+
+	finfo_buf_add_alt(finfo_out, key, transmission_offset, placement_offset,
+					  copied ? location : NULL, remove_copy);
+}
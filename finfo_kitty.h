@@ -0,0 +1,21 @@
+#ifndef FINFO_KITTY_H
+#define FINFO_KITTY_H
+
+#include <stddef.h>
+#include "finfo_input.h"
+
+/*
+ * Printers showing images in the terminal through the Kitty graphics
+ * protocol.
+ * Depending on finfo_opts.kitty_transmission the image is sent inline,
+ * base64 encoded in the escape sequence, or only its location is sent:
+ * a file path (t=f), a temporary file (t=t) or a POSIX shared memory
+ * object (t=s) the terminal reads the image from.
+ */
+
+// Print the PNG file IN.
+void print_png_file(struct finfo_input *in);
+// Print the PNG image held in memory by DATA.
+void print_png(const unsigned char *data, size_t data_len);
+
+#endif // !FINFO_KITTY_H
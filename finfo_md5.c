@@ -0,0 +1,159 @@
+#include <string.h>
+#include "finfo_md5.h"
+#include "finfo_utils.h"
+
+static const uint32_t md5_k[64] = {
+	0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a,
+	0xa8304613, 0xfd469501, 0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be,
+	0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821, 0xf61e2562, 0xc040b340,
+	0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+	0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8,
+	0x676f02d9, 0x8d2a4c8a, 0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c,
+	0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70, 0x289b7ec6, 0xeaa127fa,
+	0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+	0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92,
+	0xffeff47d, 0x85845dd1, 0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1,
+	0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391,
+};
+
+#define MD5_F(b, c, d) ((d) ^ ((b) & ((c) ^ (d))))
+#define MD5_G(b, c, d) ((c) ^ ((d) & ((b) ^ (c))))
+#define MD5_H(b, c, d) ((b) ^ (c) ^ (d))
+#define MD5_I(b, c, d) ((c) ^ ((b) | ~(d)))
+
+// A = B + ((A + F(B, C, D) + M + K) rotated left by R).
+#define MD5_STEP(f, a, b, c, d, m, k, r)         \
+	do {                                         \
+		a += f(b, c, d) + (m) + (k);             \
+		a = b + ((a << (r)) | (a >> (32 - (r)))); \
+	} while (0)
+
+// The 64 steps are unrolled, with the message word and rotation of each one.
+static void md5_transform(uint32_t state[4], const unsigned char *block) {
+	uint32_t m[16];
+	for (int i = 0; i < 16; i++) {
+		m[i] = load_le32(block + i * 4);
+	}
+
+	uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+
+	MD5_STEP(MD5_F, a, b, c, d, m[0], md5_k[0], 7);
+	MD5_STEP(MD5_F, d, a, b, c, m[1], md5_k[1], 12);
+	MD5_STEP(MD5_F, c, d, a, b, m[2], md5_k[2], 17);
+	MD5_STEP(MD5_F, b, c, d, a, m[3], md5_k[3], 22);
+	MD5_STEP(MD5_F, a, b, c, d, m[4], md5_k[4], 7);
+	MD5_STEP(MD5_F, d, a, b, c, m[5], md5_k[5], 12);
+	MD5_STEP(MD5_F, c, d, a, b, m[6], md5_k[6], 17);
+	MD5_STEP(MD5_F, b, c, d, a, m[7], md5_k[7], 22);
+	MD5_STEP(MD5_F, a, b, c, d, m[8], md5_k[8], 7);
+	MD5_STEP(MD5_F, d, a, b, c, m[9], md5_k[9], 12);
+	MD5_STEP(MD5_F, c, d, a, b, m[10], md5_k[10], 17);
+	MD5_STEP(MD5_F, b, c, d, a, m[11], md5_k[11], 22);
+	MD5_STEP(MD5_F, a, b, c, d, m[12], md5_k[12], 7);
+	MD5_STEP(MD5_F, d, a, b, c, m[13], md5_k[13], 12);
+	MD5_STEP(MD5_F, c, d, a, b, m[14], md5_k[14], 17);
+	MD5_STEP(MD5_F, b, c, d, a, m[15], md5_k[15], 22);
+
+	MD5_STEP(MD5_G, a, b, c, d, m[1], md5_k[16], 5);
+	MD5_STEP(MD5_G, d, a, b, c, m[6], md5_k[17], 9);
+	MD5_STEP(MD5_G, c, d, a, b, m[11], md5_k[18], 14);
+	MD5_STEP(MD5_G, b, c, d, a, m[0], md5_k[19], 20);
+	MD5_STEP(MD5_G, a, b, c, d, m[5], md5_k[20], 5);
+	MD5_STEP(MD5_G, d, a, b, c, m[10], md5_k[21], 9);
+	MD5_STEP(MD5_G, c, d, a, b, m[15], md5_k[22], 14);
+	MD5_STEP(MD5_G, b, c, d, a, m[4], md5_k[23], 20);
+	MD5_STEP(MD5_G, a, b, c, d, m[9], md5_k[24], 5);
+	MD5_STEP(MD5_G, d, a, b, c, m[14], md5_k[25], 9);
+	MD5_STEP(MD5_G, c, d, a, b, m[3], md5_k[26], 14);
+	MD5_STEP(MD5_G, b, c, d, a, m[8], md5_k[27], 20);
+	MD5_STEP(MD5_G, a, b, c, d, m[13], md5_k[28], 5);
+	MD5_STEP(MD5_G, d, a, b, c, m[2], md5_k[29], 9);
+	MD5_STEP(MD5_G, c, d, a, b, m[7], md5_k[30], 14);
+	MD5_STEP(MD5_G, b, c, d, a, m[12], md5_k[31], 20);
+
+	MD5_STEP(MD5_H, a, b, c, d, m[5], md5_k[32], 4);
+	MD5_STEP(MD5_H, d, a, b, c, m[8], md5_k[33], 11);
+	MD5_STEP(MD5_H, c, d, a, b, m[11], md5_k[34], 16);
+	MD5_STEP(MD5_H, b, c, d, a, m[14], md5_k[35], 23);
+	MD5_STEP(MD5_H, a, b, c, d, m[1], md5_k[36], 4);
+	MD5_STEP(MD5_H, d, a, b, c, m[4], md5_k[37], 11);
+	MD5_STEP(MD5_H, c, d, a, b, m[7], md5_k[38], 16);
+	MD5_STEP(MD5_H, b, c, d, a, m[10], md5_k[39], 23);
+	MD5_STEP(MD5_H, a, b, c, d, m[13], md5_k[40], 4);
+	MD5_STEP(MD5_H, d, a, b, c, m[0], md5_k[41], 11);
+	MD5_STEP(MD5_H, c, d, a, b, m[3], md5_k[42], 16);
+	MD5_STEP(MD5_H, b, c, d, a, m[6], md5_k[43], 23);
+	MD5_STEP(MD5_H, a, b, c, d, m[9], md5_k[44], 4);
+	MD5_STEP(MD5_H, d, a, b, c, m[12], md5_k[45], 11);
+	MD5_STEP(MD5_H, c, d, a, b, m[15], md5_k[46], 16);
+	MD5_STEP(MD5_H, b, c, d, a, m[2], md5_k[47], 23);
+
+	MD5_STEP(MD5_I, a, b, c, d, m[0], md5_k[48], 6);
+	MD5_STEP(MD5_I, d, a, b, c, m[7], md5_k[49], 10);
+	MD5_STEP(MD5_I, c, d, a, b, m[14], md5_k[50], 15);
+	MD5_STEP(MD5_I, b, c, d, a, m[5], md5_k[51], 21);
+	MD5_STEP(MD5_I, a, b, c, d, m[12], md5_k[52], 6);
+	MD5_STEP(MD5_I, d, a, b, c, m[3], md5_k[53], 10);
+	MD5_STEP(MD5_I, c, d, a, b, m[10], md5_k[54], 15);
+	MD5_STEP(MD5_I, b, c, d, a, m[1], md5_k[55], 21);
+	MD5_STEP(MD5_I, a, b, c, d, m[8], md5_k[56], 6);
+	MD5_STEP(MD5_I, d, a, b, c, m[15], md5_k[57], 10);
+	MD5_STEP(MD5_I, c, d, a, b, m[6], md5_k[58], 15);
+	MD5_STEP(MD5_I, b, c, d, a, m[13], md5_k[59], 21);
+	MD5_STEP(MD5_I, a, b, c, d, m[4], md5_k[60], 6);
+	MD5_STEP(MD5_I, d, a, b, c, m[11], md5_k[61], 10);
+	MD5_STEP(MD5_I, c, d, a, b, m[2], md5_k[62], 15);
+	MD5_STEP(MD5_I, b, c, d, a, m[9], md5_k[63], 21);
+
+	state[0] += a;
+	state[1] += b;
+	state[2] += c;
+	state[3] += d;
+}
+
+void finfo_md5_init(struct finfo_md5 *md5) {
+	*md5 = (struct finfo_md5){
+		.state = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476},
+	};
+}
+
+void finfo_md5_update(struct finfo_md5 *md5, const unsigned char *data,
+					  size_t len) {
+	size_t used = md5->len % 64;
+	md5->len += len;
+
+	// Complete the block left over by the previous update.
+	if (used != 0) {
+		size_t fill = 64 - used < len ? 64 - used : len;
+		memcpy(md5->block + used, data, fill);
+		data += fill;
+		len -= fill;
+		if (used + fill < 64) { return; }
+		md5_transform(md5->state, md5->block);
+	}
+
+	for (; len >= 64; data += 64, len -= 64) {
+		md5_transform(md5->state, data);
+	}
+	memcpy(md5->block, data, len);
+}
+
+void finfo_md5_final(struct finfo_md5 *md5, unsigned char digest[16]) {
+	uint64_t bits = md5->len * 8;
+
+	// Pad with a 1 bit, then zeros up to 8 bytes before the end of a block,
+	// then the length in bits.
+	static const unsigned char padding[64] = {0x80};
+	size_t used = md5->len % 64;
+	finfo_md5_update(md5, padding, used < 56 ? 56 - used : 120 - used);
+
+	unsigned char len_le[8];
+	for (int i = 0; i < 8; i++) { len_le[i] = bits >> (8 * i); }
+	finfo_md5_update(md5, len_le, 8);
+
+	for (int i = 0; i < 4; i++) {
+		for (int j = 0; j < 4; j++) {
+			digest[i * 4 + j] = md5->state[i] >> (8 * j);
+		}
+	}
+}
@@ -0,0 +1,20 @@
+#ifndef FINFO_MD5_H
+#define FINFO_MD5_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Incremental MD5 (RFC 1321), as used by the FLAC streaminfo.
+struct finfo_md5 {
+	uint32_t state[4];
+	// Number of bytes hashed so far.
+	uint64_t len;
+	unsigned char block[64];
+};
+
+void finfo_md5_init(struct finfo_md5 *md5);
+void finfo_md5_update(struct finfo_md5 *md5, const unsigned char *data,
+					  size_t len);
+void finfo_md5_final(struct finfo_md5 *md5, unsigned char digest[16]);
+
+#endif // !FINFO_MD5_H
@@ -0,0 +1,13 @@
+#include "finfo_options.h"
+#include "finfo_emit.h"
+
+struct finfo_options finfo_opts = {
+	.emitter			= &finfo_text_emitter,
+	.fields				= NULL,
+	.verify				= false,
+	.no_images			= false,
+	.seek				= false,
+	.seek_sample		= 0,
+	.kitty_transmission = FINFO_KITTY_AUTO,
+	.file_workers		= 1,
+};
@@ -0,0 +1,46 @@
+#ifndef FINFO_OPTIONS_H
+#define FINFO_OPTIONS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// How images are transmitted to the terminal.
+enum finfo_kitty_transmission {
+	// Send files by path and in-memory images through shared memory,
+	// or inline if the terminal is not on this machine.
+	FINFO_KITTY_AUTO,
+	// Inline, base64 encoded in the escape sequence.
+	FINFO_KITTY_DIRECT,
+	// By file path. In-memory images are written to a temporary file.
+	FINFO_KITTY_FILE,
+	// Through a temporary file.
+	FINFO_KITTY_TEMP,
+	// Through a POSIX shared memory object.
+	FINFO_KITTY_SHM,
+};
+
+struct finfo_emitter;
+struct finfo_fields;
+
+// Command line options affecting how files are parsed and printed.
+struct finfo_options {
+	// Format of the output.
+	const struct finfo_emitter *emitter;
+	// Fields to print instead of everything, NULL for everything.
+	const struct finfo_fields *fields;
+	// Check the checksums stored in the files.
+	bool verify;
+	// Don't read or display the images embedded in the files.
+	bool no_images;
+	// Find the frame containing the sample SEEK_SAMPLE.
+	bool seek;
+	uint64_t seek_sample;
+	enum finfo_kitty_transmission kitty_transmission;
+	// Number of threads working on a single file, used when files are not
+	// processed in parallel.
+	unsigned file_workers;
+};
+
+extern struct finfo_options finfo_opts;
+
+#endif // !FINFO_OPTIONS_H
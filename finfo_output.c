@@ -0,0 +1,268 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "finfo_output.h"
+
+_Thread_local struct finfo_buf *finfo_out = NULL;
+
+/*
+ * Keys of the alternatives flushed so far, in an open addressing hash set.
+ * 0 marks an empty slot, so the key 0 is stored as 1.
+ */
+static struct {
+	pthread_mutex_t lock;
+	uint64_t *keys;
+	size_t keys_n;
+	size_t cap;
+} flushed_keys = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+static size_t flushed_keys_slot(uint64_t key) {
+	// Fibonacci hashing of the key, then linear probing.
+	size_t i = (key * 0x9E3779B97F4A7C15ull) & (flushed_keys.cap - 1);
+	while (flushed_keys.keys[i] != 0 && flushed_keys.keys[i] != key) {
+		i = (i + 1) & (flushed_keys.cap - 1);
+	}
+
+	return i;
+}
+
+bool finfo_key_flushed(uint64_t key) {
+	if (key == 0) { key = 1; }
+
+	pthread_mutex_lock(&flushed_keys.lock);
+	bool found = flushed_keys.cap > 0 &&
+				 flushed_keys.keys[flushed_keys_slot(key)] == key;
+	pthread_mutex_unlock(&flushed_keys.lock);
+
+	return found;
+}
+
+// Add KEY to the flushed keys. Returns false if it was already there.
+static bool flushed_keys_add(uint64_t key) {
+	if (key == 0) { key = 1; }
+
+	pthread_mutex_lock(&flushed_keys.lock);
+
+	// Keep the load factor under 1/2.
+	if (2 * (flushed_keys.keys_n + 1) > flushed_keys.cap) {
+		uint64_t *old_keys = flushed_keys.keys;
+		size_t old_cap	   = flushed_keys.cap;
+
+		flushed_keys.cap  = old_cap ? old_cap * 2 : 64;
+		flushed_keys.keys = calloc(flushed_keys.cap, sizeof(uint64_t));
+		if (flushed_keys.keys == NULL) {
+			perror("finfo");
+			exit(1);
+		}
+
+		for (size_t i = 0; i < old_cap; i++) {
+			if (old_keys[i] != 0) {
+				flushed_keys.keys[flushed_keys_slot(old_keys[i])] =
+					old_keys[i];
+			}
+		}
+		free(old_keys);
+	}
+
+	size_t slot = flushed_keys_slot(key);
+	bool added	= flushed_keys.keys[slot] == 0;
+	if (added) {
+		flushed_keys.keys[slot] = key;
+		flushed_keys.keys_n++;
+	}
+
+	pthread_mutex_unlock(&flushed_keys.lock);
+	return added;
+}
+
+void finfo_buf_init(struct finfo_buf *buf) {
+	*buf = (struct finfo_buf){0};
+}
+
+// Remove the copies of the alternatives of BUF which were not printed.
+static void finfo_buf_remove_copies(struct finfo_buf *buf) {
+	for (size_t i = 0; i < buf->alts_n; i++) {
+		struct finfo_buf_alt *alt = &buf->alts[i];
+		if (alt->copy != NULL) {
+			alt->remove(alt->copy);
+			free(alt->copy);
+		}
+	}
+	buf->alts_n = 0;
+}
+
+void finfo_buf_free(struct finfo_buf *buf) {
+	finfo_buf_remove_copies(buf);
+	free(buf->data);
+	free(buf->alts);
+	finfo_buf_init(buf);
+}
+
+// Make room for at least EXTRA more bytes in BUF.
+static void finfo_buf_reserve(struct finfo_buf *buf, size_t extra) {
+	if (buf->len + extra <= buf->cap) { return; }
+
+	size_t new_cap = buf->cap ? buf->cap : 256;
+	while (new_cap < buf->len + extra) { new_cap *= 2; }
+
+	char *new_data = realloc(buf->data, new_cap);
+	if (new_data == NULL) {
+		perror("finfo");
+		exit(1);
+	}
+
+	buf->data = new_data;
+	buf->cap  = new_cap;
+}
+
+void finfo_buf_append(struct finfo_buf *buf, const void *data, size_t len) {
+	finfo_buf_reserve(buf, len);
+	memcpy(buf->data + buf->len, data, len);
+	buf->len += len;
+}
+
+void finfo_buf_vprintf(struct finfo_buf *buf, const char *fmt, va_list ap) {
+	va_list ap_copy;
+	va_copy(ap_copy, ap);
+
+	// Try to format directly in the free space, and grow the buffer only
+	// if the result did not fit.
+	size_t avail = buf->cap - buf->len;
+	int n = vsnprintf(avail ? buf->data + buf->len : NULL, avail, fmt, ap);
+	if (n < 0) {
+		va_end(ap_copy);
+		return;
+	}
+
+	if ((size_t)n >= avail) {
+		finfo_buf_reserve(buf, n + 1);
+		vsnprintf(buf->data + buf->len, n + 1, fmt, ap_copy);
+	}
+
+	buf->len += n;
+	va_end(ap_copy);
+}
+
+void finfo_buf_append_str(struct finfo_buf *buf, const char *str) {
+	finfo_buf_append(buf, str, strlen(str));
+}
+
+void finfo_buf_append_uint(struct finfo_buf *buf, uint64_t value) {
+	// Two digits at a time, from the end.
+	static const char pairs[201] = "00010203040506070809"
+								   "10111213141516171819"
+								   "20212223242526272829"
+								   "30313233343536373839"
+								   "40414243444546474849"
+								   "50515253545556575859"
+								   "60616263646566676869"
+								   "70717273747576777879"
+								   "80818283848586878889"
+								   "90919293949596979899";
+	char digits[20];
+	char *p = digits + sizeof(digits);
+	while (value >= 100) {
+		const char *pair = pairs + 2 * (value % 100);
+		value /= 100;
+		*--p = pair[1];
+		*--p = pair[0];
+	}
+	if (value >= 10) {
+		*--p = pairs[2 * value + 1];
+		*--p = pairs[2 * value];
+	} else {
+		*--p = '0' + value;
+	}
+
+	finfo_buf_append(buf, p, digits + sizeof(digits) - p);
+}
+
+void finfo_buf_append_int(struct finfo_buf *buf, int64_t value) {
+	if (value < 0) {
+		finfo_buf_append(buf, "-", 1);
+		finfo_buf_append_uint(buf, -(uint64_t)value);
+		return;
+	}
+	finfo_buf_append_uint(buf, value);
+}
+
+void finfo_buf_append_hex(struct finfo_buf *buf, const unsigned char *data,
+						  size_t len) {
+	static const char digits[16] = "0123456789abcdef";
+
+	finfo_buf_reserve(buf, 2 * len);
+	char *p = buf->data + buf->len;
+	for (size_t i = 0; i < len; i++) {
+		*p++ = digits[data[i] >> 4];
+		*p++ = digits[data[i] & 0x0F];
+	}
+	buf->len += 2 * len;
+}
+
+void finfo_buf_add_alt(struct finfo_buf *buf, uint64_t key, size_t offset,
+					   size_t other_offset, const char *copy,
+					   int (*remove_copy)(const char *)) {
+	if (buf->alts_n == buf->alts_cap) {
+		buf->alts_cap = buf->alts_cap ? buf->alts_cap * 2 : 4;
+		buf->alts = realloc(buf->alts, buf->alts_cap * sizeof(*buf->alts));
+		if (buf->alts == NULL) {
+			perror("finfo");
+			exit(1);
+		}
+	}
+
+	buf->alts[buf->alts_n++] = (struct finfo_buf_alt){
+		.offset	   = offset,
+		.first_len = other_offset - offset,
+		.other_len = buf->len - other_offset,
+		.key	   = key,
+		.copy	   = NULL,
+		.remove	   = remove_copy,
+	};
+
+	if (copy != NULL) {
+		char *dup = strdup(copy);
+		if (dup == NULL) {
+			perror("finfo");
+			exit(1);
+		}
+		buf->alts[buf->alts_n - 1].copy = dup;
+	}
+}
+
+void finfo_buf_flush(struct finfo_buf *buf, FILE *stream) {
+	size_t pos = 0;
+	for (size_t i = 0; i < buf->alts_n; i++) {
+		struct finfo_buf_alt *alt = &buf->alts[i];
+		fwrite(buf->data + pos, 1, alt->offset - pos, stream);
+
+		if (flushed_keys_add(alt->key)) {
+			fwrite(buf->data + alt->offset, 1, alt->first_len, stream);
+			// The terminal removes the copy once it has read it.
+			free(alt->copy);
+			alt->copy = NULL;
+		} else {
+			fwrite(buf->data + alt->offset + alt->first_len, 1,
+				   alt->other_len, stream);
+		}
+
+		pos = alt->offset + alt->first_len + alt->other_len;
+	}
+
+	if (buf->len > pos) { fwrite(buf->data + pos, 1, buf->len - pos, stream); }
+	buf->len = 0;
+	finfo_buf_remove_copies(buf);
+}
+
+void finfo_printf(const char *fmt, ...) {
+	va_list ap;
+	va_start(ap, fmt);
+	finfo_buf_vprintf(finfo_out, fmt, ap);
+	va_end(ap);
+}
+
+void finfo_putchar(char c) {
+	finfo_buf_append(finfo_out, &c, 1);
+}
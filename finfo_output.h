@@ -0,0 +1,82 @@
+#ifndef FINFO_OUTPUT_H
+#define FINFO_OUTPUT_H
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Part of a buffer holding two alternative outputs for the same content,
+ * identified by KEY: FIRST_LEN bytes to print if no output for KEY was
+ * flushed yet, followed by OTHER_LEN bytes to print otherwise.
+ * Since files processed in parallel are flushed in input order, this is how
+ * the first file printing some content can be told apart from the others.
+ */
+struct finfo_buf_alt {
+	size_t offset;
+	size_t first_len;
+	size_t other_len;
+	uint64_t key;
+	// Copy of the content read by the terminal from the first alternative,
+	// removed by REMOVE if the other one is printed instead. NULL if none.
+	char *copy;
+	int (*remove)(const char *);
+};
+
+/*
+ * Growable byte buffer holding the output produced for a single file,
+ * so that files processed in parallel can be printed in input order.
+ */
+struct finfo_buf {
+	char *data;
+	size_t len;
+	size_t cap;
+
+	struct finfo_buf_alt *alts;
+	size_t alts_n;
+	size_t alts_cap;
+};
+
+void finfo_buf_init(struct finfo_buf *buf);
+void finfo_buf_free(struct finfo_buf *buf);
+void finfo_buf_append(struct finfo_buf *buf, const void *data, size_t len);
+void finfo_buf_vprintf(struct finfo_buf *buf, const char *fmt, va_list ap);
+
+/*
+ * Formatters appending to BUF without going through printf, for the values
+ * printed the most.
+ */
+void finfo_buf_append_str(struct finfo_buf *buf, const char *str);
+void finfo_buf_append_uint(struct finfo_buf *buf, uint64_t value);
+void finfo_buf_append_int(struct finfo_buf *buf, int64_t value);
+// Append the LEN bytes of DATA as lowercase hex digits.
+void finfo_buf_append_hex(struct finfo_buf *buf, const unsigned char *data,
+						  size_t len);
+
+// Write the content of BUF to STREAM and empty it.
+void finfo_buf_flush(struct finfo_buf *buf, FILE *stream);
+
+/*
+ * Mark the bytes of BUF from OFFSET to its end as alternatives for KEY:
+ * the ones before OTHER_OFFSET are printed the first time KEY is flushed,
+ * the ones after it every other time.
+ * If COPY is not NULL, it is the location of a copy of the content only
+ * referenced by the first alternative, which is removed by calling
+ * REMOVE_COPY on it when that alternative is not printed.
+ */
+void finfo_buf_add_alt(struct finfo_buf *buf, uint64_t key, size_t offset,
+					   size_t other_offset, const char *copy,
+					   int (*remove_copy)(const char *));
+// True if an alternative for KEY was already flushed. Thread safe.
+bool finfo_key_flushed(uint64_t key);
+
+// Output buffer of the file currently processed by the calling thread.
+extern _Thread_local struct finfo_buf *finfo_out;
+
+// printf and putchar replacements writing into finfo_out.
+void finfo_printf(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+void finfo_putchar(char c);
+
+#endif // !FINFO_OUTPUT_H
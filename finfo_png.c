@@ -2,17 +2,25 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/ioctl.h>
 #include "finfo_png.h"
+#include "finfo_png_data.h"
+#include "finfo_crc.h"
+#include "finfo_cursor.h"
+#include "finfo_emit.h"
+#include "finfo_fields.h"
+#include "finfo_kitty.h"
+#include "finfo_options.h"
 #include "finfo_utils.h"
 
 unsigned char PNG_SIGNATURE[8] = {'\x89', '\x50', '\x4E', '\x47',
 								  '\x0D', '\x0A', '\x1A', '\x0A'};
 
-void png_chunk_free(struct png_chunk *chunk) {
-	free(chunk->data);
-	free(chunk);
-}
+const struct finfo_format png_format = {
+	.name		   = "png",
+	.signature	   = PNG_SIGNATURE,
+	.signature_len = sizeof(PNG_SIGNATURE),
+	.parse		   = try_png,
+};
 
 bool png_chunk_is_critical(struct png_chunk *ch) {
 	// Bit 5 of first byte of type equals 1 if chunk is
@@ -34,37 +42,37 @@ bool png_chunk_is_safe_to_copy(struct png_chunk *ch) {
 
 // ===== Chunk parsers =====
 
-/*
- * Parses the given byte array as a IHDR png chunk.
- * The returned struct takes ownership of the array,
- * which must not be manually freed.
- * QUESTION: is this a good pattern? Or should i copy the buffer
- * and let the caller free the input buffer to avoid cases
- * in which such buffer is stack allocated?
- * In flac non ho fatto cosi...
- */
-struct png_IHDR_chunk png_parse_IHDR(unsigned char *data) {
+// Decode the IHDR chunk at CUR, which passed png_check_chunk.
+struct png_IHDR_chunk png_parse_IHDR(struct finfo_cursor cur) {
 	struct png_IHDR_chunk ch;
 
-	// TODO: what about buffer overflow checks?
-	ch.width = BE_bytes_to_int(data, 4);
-	ch.height = BE_bytes_to_int(data+4, 4);
-	ch.bit_depth = *(data+8);
-	ch.color_type = *(data+9);
-	ch.compression_method = *(data+10);
-	ch.filter_method = *(data+11);
-	ch.interlace_method = *(data+12);
+	ch.width			  = finfo_cursor_be32(&cur);
+	ch.height			  = finfo_cursor_be32(&cur);
+	ch.bit_depth		  = finfo_cursor_u8(&cur);
+	ch.color_type		  = finfo_cursor_u8(&cur);
+	ch.compression_method = finfo_cursor_u8(&cur);
+	ch.filter_method	  = finfo_cursor_u8(&cur);
+	ch.interlace_method	  = finfo_cursor_u8(&cur);
 
 	return ch;
 }
 
 /*
- * Parses the given byte array as a PLTE png chunk.
+ * Parses the given byte array as a PLTE png chunk, long LEN bytes.
  * The returned struct takes ownership of the array,
  * which must not be manually freed.
  */
-struct png_PLTE_chunk png_parse_PLTE(unsigned char *data) {
-	// TODO:
+struct png_PLTE_chunk png_parse_PLTE(const unsigned char *data, uint32_t len) {
+	_Static_assert(sizeof(struct png_color) == 3, "unpadded palette entries");
+
+	// Each entry is a red, green and blue byte, up to 256 entries.
+	uint32_t entries_n = len / 3;
+	if (entries_n > 256) { entries_n = 256; }
+
+	return (struct png_PLTE_chunk){
+		.palette	 = (const struct png_color *)data,
+		.palette_len = entries_n,
+	};
 }
 
 /*
@@ -72,8 +80,9 @@ struct png_PLTE_chunk png_parse_PLTE(unsigned char *data) {
  * The returned struct takes ownership of the array,
  * which must not be manually freed.
  */
-struct png_IDAT_chunk png_parse_IDAT(unsigned char *data) {
-	// TODO:
+struct png_IDAT_chunk png_parse_IDAT(const unsigned char *data) {
+	// The data is inflated across all the IDAT chunks by finfo_png_data.
+	return (struct png_IDAT_chunk){.data = data};
 }
 
 /*
@@ -81,143 +90,362 @@ struct png_IDAT_chunk png_parse_IDAT(unsigned char *data) {
  * The returned struct takes ownership of the array,
  * which must not be manually freed.
  */
-struct png_IEND_chunk png_parse_IEND(unsigned char *data) {
-	// TODO:
+struct png_IEND_chunk png_parse_IEND(const unsigned char *data) {
+	// The IEND chunk has no data.
+	return (struct png_IEND_chunk){};
+}
+
+bool png_check_chunk(enum png_chunk_type type, const unsigned char *data,
+					 size_t len) {
+	struct finfo_cursor cur = finfo_cursor_make(data, len);
+	switch (type) {
+	case IHDR:
+		// Width, height, and five single byte fields.
+		return finfo_cursor_skip(&cur, 4 + 4 + 5);
+	default:
+		// The palette is as long as the chunk, the other chunks are not
+		// parsed.
+		return true;
+	}
 }
 
 // ===== ===== 
 
-enum png_chunk_type png_parse_type(char type_str[4]) {
-	return (enum png_chunk_type)BE_bytes_to_int((unsigned char *)type_str, 4);
+// Longest chunk data allowed by the specification, 2^31 - 1 bytes.
+#define PNG_MAX_CHUNK_LEN 0x7FFFFFFFu
+
+enum png_chunk_type png_parse_type(const char type_str[4]) {
+	return (enum png_chunk_type)load_be32((const unsigned char *)type_str);
 }
 
-struct png_chunk *png_parse_chunk(FILE *file) {
-	struct png_chunk *chunk = malloc(sizeof(*chunk));
+/*
+ * Walk the chunk headers of the PNG input, without reading the chunk data,
+ * and put the position of every chunk up to IEND inside DST.
+ * Returns false if the input ends before IEND, or at a chunk longer than
+ * PNG allows, in which case DST holds the chunks found before that one.
+ */
+bool png_index_chunks(struct finfo_input *in, struct png_chunk_index *dst) {
+	*dst = (struct png_chunk_index){0};
 
-	unsigned char len_btyes[4];
-	fread(len_btyes, 4, 1, file);
-	chunk->length = BE_bytes_to_int(len_btyes, 4);
+	// Chunks follow the signature, each one after the previous.
+	uint64_t offset = sizeof(PNG_SIGNATURE);
+	while (true) {
+		// Length and type of the chunk.
+		struct finfo_view header;
+		if (!finfo_input_view(in, offset, 8, &header)) { return false; }
+
+		struct png_chunk_entry entry = {
+			.offset = offset,
+			.length = load_be32(header.data),
+		};
+		memcpy(entry.type_str, header.data + 4, 4);
+		if (entry.length > PNG_MAX_CHUNK_LEN) { return false; }
+
+		// Length, type, data and CRC.
+		uint64_t chunk_end = offset + 4 + 4 + (uint64_t)entry.length + 4;
+		if (chunk_end > in->size) { return false; }
+
+		if (dst->entries_n == dst->entries_cap) {
+			dst->entries_cap = dst->entries_cap ? dst->entries_cap * 2 : 16;
+			struct png_chunk_entry *entries = realloc(
+				dst->entries, dst->entries_cap * sizeof(*dst->entries));
+			if (entries == NULL) { return false; }
+			dst->entries = entries;
+		}
+		dst->entries[dst->entries_n++] = entry;
 
-	fread(chunk->type_str, 4, 1, file);
+		if (png_parse_type(entry.type_str) == IEND) { return true; }
+		offset = chunk_end;
+	}
+}
+
+void png_chunk_index_free(struct png_chunk_index *index) {
+	free(index->entries);
+	*index = (struct png_chunk_index){0};
+}
+
+/*
+ * Read the data of the chunk ENTRY from the input and parse it inside DST.
+ * Returns false if the input ends before the end of the chunk, or if the
+ * chunk is too short for its type.
+ */
+bool png_chunk_load(struct finfo_input *in, const struct png_chunk_entry *entry,
+					struct png_chunk *dst) {
+	dst->length = entry->length;
+	memcpy(dst->type_str, entry->type_str, 4);
+
+	// Chunk data, followed by its CRC.
+	struct finfo_view data;
+	if (!finfo_input_view(in, entry->offset + 8, (size_t)dst->length + 4,
+						  &data)) {
+		return false;
+	}
 
-	unsigned char *data_buf = malloc(chunk->length);
-	fread(data_buf, chunk->length, 1, file);
+	enum png_chunk_type type = png_parse_type(dst->type_str);
+	if (!png_check_chunk(type, data.data, dst->length)) { return false; }
 
-	switch (png_parse_type(chunk->type_str)) {
+	switch (type) {
 	case IHDR:
-		chunk->data.IHDR = png_parse_IHDR(data_buf);
+		dst->data.IHDR =
+			png_parse_IHDR(finfo_cursor_make(data.data, dst->length));
 		break;
 	case PLTE:
-		chunk->data.PLTE = png_parse_PLTE(data_buf);
+		dst->data.PLTE = png_parse_PLTE(data.data, dst->length);
 		break;
 	case IDAT:
-		chunk->data.IDAT = png_parse_IDAT(data_buf);
+		dst->data.IDAT = png_parse_IDAT(data.data);
 		break;
 	case IEND:
-		chunk->data.IEND = png_parse_IEND(data_buf);
+		dst->data.IEND = png_parse_IEND(data.data);
 		break;
-	case UNKNOWN:
-		chunk->data.placeholder.data = data_buf;
+	default:
+		dst->data.placeholder.data = data.data;
 		break;
 	}
 
-	fread(chunk->CRC, 4, 1, file);
-
-	return chunk;
-}
+	memcpy(dst->CRC, data.data + dst->length, 4);
 
-void png_print_chunk(struct png_chunk *chunk) {
-	printf("%.4s, length: %d\n", chunk->type_str, chunk->length);
+	return true;
 }
 
-bool try_png(FILE *file) {
-	printf("Trying png...\n");
-	unsigned char signature[8];
-	fread(signature, 8, 1, file);
-	if (memcmp(signature, PNG_SIGNATURE, 8)) { return false; }
-
-	int data_count = 0;
-	while (true) {
-		struct png_chunk *chunk	 = png_parse_chunk(file);
-		enum png_chunk_type type = png_parse_type(chunk->type_str);
+/*
+ * Check the CRC of the chunk ENTRY, computed on its type and data, and put
+ * the stored and computed ones in CRCS.
+ * Returns false if they don't match, or if the chunk is truncated.
+ */
+bool png_chunk_verify(struct finfo_input *in,
+					  const struct png_chunk_entry *entry, uint32_t crcs[2]) {
+	// Type, data and CRC.
+	struct finfo_view chunk;
+	if (!finfo_input_view(in, entry->offset + 4, (size_t)entry->length + 8,
+						  &chunk)) {
+		crcs[0] = crcs[1] = 0;
+		return false;
+	}
 
-		if (type != IDAT || !data_count++) { png_print_chunk(chunk); }
+	crcs[0] = load_be32(chunk.data + 4 + entry->length);
+	crcs[1] = crc32_update(0, chunk.data, (size_t)entry->length + 4);
+	return crcs[0] == crcs[1];
+}
 
-		if (type == IEND) {
-			printf("Total data chunks: %d\n", data_count);
-			png_chunk_free(chunk);
-			break;
-		}
+static void png_emit_crc(const char *key, const char *label, uint32_t crc) {
+	unsigned char bytes[4] = {crc >> 24, crc >> 16, crc >> 8, crc};
+	finfo_emit_hex(key, label, bytes, sizeof(bytes));
+}
 
-		png_chunk_free(chunk);
+/*
+ * Print the chunk ENTRY, with the parsed content of the critical chunks
+ * describing the image.
+ * If BAD_CRCS is not NULL, the chunk has the stored and computed CRCs it
+ * points to, which don't match.
+ */
+void png_print_chunk(struct finfo_input *in,
+					 const struct png_chunk_entry *entry,
+					 const uint32_t *bad_crcs) {
+	finfo_emit_begin(FINFO_EMIT_OBJECT, NULL, NULL, FINFO_EMIT_INLINE);
+	finfo_emit_str("type", "type", entry->type_str, 4);
+	finfo_emit_uint("length", "length", entry->length);
+	finfo_emit_uint("offset", NULL, entry->offset);
+	if (bad_crcs != NULL) {
+		png_emit_crc("stored_crc", "stored CRC", bad_crcs[0]);
+		png_emit_crc("computed_crc", "computed CRC", bad_crcs[1]);
 	}
 
-	// Reset position to start of file for printing it
-	fseek(file, 0, SEEK_SET);
-	print_png_file(file);
+	enum png_chunk_type type = png_parse_type(entry->type_str);
+	struct png_chunk chunk;
+	if (type == IHDR && entry->length == 13 &&
+		png_chunk_load(in, entry, &chunk)) {
+		const struct png_IHDR_chunk *header = &chunk.data.IHDR;
+		finfo_emit_begin(FINFO_EMIT_OBJECT, "header", NULL, FINFO_EMIT_INDENT);
+		finfo_emit_uint("width", "Width", header->width);
+		finfo_emit_uint("height", "Height", header->height);
+		finfo_emit_uint("bit_depth", "Bit depth", header->bit_depth);
+		finfo_emit_uint("color_type", "Color type", header->color_type);
+		finfo_emit_uint("interlace", "Interlace", header->interlace_method);
+		finfo_emit_end();
+	} else if (type == PLTE && png_chunk_load(in, entry, &chunk)) {
+		finfo_emit_begin(FINFO_EMIT_OBJECT, "palette", NULL, FINFO_EMIT_INDENT);
+		finfo_emit_uint("entries_n", "Palette entries",
+						chunk.data.PLTE.palette_len);
+		finfo_emit_end();
+	}
 
-	return true;
+	finfo_emit_end();
 }
 
-// ===== Kitty image protocol printers =====
-
-#define KITTY_ESCAPE_START "\033_G"
-#define KITTY_ESCAPE_END "\033\\"
-#define KITTY_CHUNK_SIZE 4096
+/*
+ * Inflate the image data of the IDAT chunks of INDEX, and print its size
+ * and the filter types of its rows.
+ * Returns false if the data can't be inflated or doesn't match the size of
+ * the image.
+ */
+bool png_verify_data(struct finfo_input *in,
+					 const struct png_chunk_index *index) {
+	finfo_emit_begin(FINFO_EMIT_OBJECT, "image_data", NULL, 0);
+
+	// The header is always the first chunk.
+	struct png_chunk header;
+	if (index->entries_n == 0 ||
+		png_parse_type(index->entries[0].type_str) != IHDR ||
+		index->entries[0].length != 13 ||
+		!png_chunk_load(in, &index->entries[0], &header)) {
+		finfo_emit_error("Missing header chunk.");
+		finfo_emit_end();
+		return false;
+	}
 
-void print_png_file(FILE *file) {
-	struct winsize sz;
-	ioctl(0, TIOCGWINSZ, &sz);
+	struct png_row_reader reader;
+	if (png_rows_init(&reader, in, index, &header.data.IHDR)) {
+		struct png_row row;
+		while (png_rows_next(&reader, &row)) {}
+		png_rows_finish(&reader);
+	}
 
-	char control_codes[50];
-	snprintf(control_codes, sizeof(control_codes), ",a=T,f=100,c=%d",
-			 sz.ws_col);
+	uint64_t expected = png_data_expected_len(&header.data.IHDR);
+	finfo_emit_uint("compressed_size", "Compressed size", reader.compressed_n);
+	finfo_emit_uint("inflated_size", "Inflated size", reader.inflated_n);
+	finfo_emit_uint("expected_size", "Expected size", expected);
+	if (reader.compressed_n > 0) {
+		finfo_emit_double("compression_ratio", "Compression ratio",
+						  (double)reader.inflated_n / reader.compressed_n, 2);
+	}
 
-	unsigned char *buf = malloc(KITTY_CHUNK_SIZE);
-	// KITTY_CHUNK_SIZE of size 1, since fread returns how many items were read
-	size_t read_n = fread(buf, 1, KITTY_CHUNK_SIZE, file);
-	while (read_n > 0) {
-		char *encoded = base64_encode(buf, &read_n);
+	static const char *filter_names[PNG_FILTER_TYPES_N] = {
+		"none", "sub", "up", "average", "paeth",
+	};
+	finfo_emit_begin(FINFO_EMIT_OBJECT, "row_filters", "Row filters",
+					 FINFO_EMIT_INLINE);
+	for (int i = 0; i < PNG_FILTER_TYPES_N; i++) {
+		finfo_emit_uint(filter_names[i], filter_names[i], reader.filters[i]);
+	}
+	if (reader.bad_filters_n > 0) {
+		finfo_emit_uint("invalid", "invalid", reader.bad_filters_n);
+	}
+	finfo_emit_end();
+	if (reader.error != NULL) {
+		finfo_emit_str("error", "Image data error", reader.error,
+					   strlen(reader.error));
+	}
+	finfo_emit_end();
 
-		int last = read_n < KITTY_CHUNK_SIZE;
-		printf("%sm=%d%s;%.*s%s", KITTY_ESCAPE_START, !last, control_codes,
-			   (int)read_n, encoded, KITTY_ESCAPE_END);
+	bool valid = reader.error == NULL && reader.inflated_n == expected &&
+				 reader.bad_filters_n == 0;
+	png_rows_free(&reader);
+	return valid;
+}
 
-		// Control codes should be specified only in first chunk
-		*control_codes = '\0';
+/*
+ * Print the fields selected by finfo_opts.fields from the PNG input IN:
+ * width, height, bit_depth, color_type and interlace from the header, and
+ * palette_entries. Both chunks come before the image data, so the chunks
+ * are walked from their headers only up to the first IDAT, and only the
+ * ones holding selected fields are read.
+ */
+static bool png_project(struct finfo_input *in) {
+	struct finfo_projection proj;
+	if (!finfo_projection_init(&proj, finfo_opts.fields, &in->arena)) {
+		finfo_emit_error("Out of memory.");
+		return false;
+	}
 
-		read_n = fread(buf, 1, KITTY_CHUNK_SIZE, file);
+	bool want_header = false, want_palette = false;
+	for (size_t i = 0; i < proj.fields->names_n; i++) {
+		if (strcmp(proj.fields->names[i], "palette_entries") == 0) {
+			want_palette = true;
+		} else {
+			want_header = true;
+		}
 	}
 
-	putchar('\n');
-}
+	bool valid		= true;
+	uint64_t offset = sizeof(PNG_SIGNATURE);
+	while ((want_header || want_palette) && proj.left > 0) {
+		struct finfo_view header;
+		if (!finfo_input_view(in, offset, 8, &header)) {
+			valid = false;
+			break;
+		}
+		struct png_chunk_entry entry = {
+			.offset = offset,
+			.length = load_be32(header.data),
+		};
+		memcpy(entry.type_str, header.data + 4, 4);
+
+		enum png_chunk_type type = png_parse_type(entry.type_str);
+		if (type == IDAT || type == IEND) { break; }
+
+		struct png_chunk chunk;
+		if (type == IHDR && want_header) {
+			if (!png_chunk_load(in, &entry, &chunk)) {
+				valid = false;
+				break;
+			}
+			const struct png_IHDR_chunk *ihdr = &chunk.data.IHDR;
+			finfo_projection_set_uint(&proj, "width", ihdr->width);
+			finfo_projection_set_uint(&proj, "height", ihdr->height);
+			finfo_projection_set_uint(&proj, "bit_depth", ihdr->bit_depth);
+			finfo_projection_set_uint(&proj, "color_type", ihdr->color_type);
+			finfo_projection_set_uint(&proj, "interlace",
+									  ihdr->interlace_method);
+			want_header = false;
+		} else if (type == PLTE && want_palette) {
+			if (!png_chunk_load(in, &entry, &chunk)) {
+				valid = false;
+				break;
+			}
+			finfo_projection_set_uint(&proj, "palette_entries",
+									  chunk.data.PLTE.palette_len);
+			want_palette = false;
+		}
 
-void print_png(unsigned char *data, size_t data_len) {
-	struct winsize sz;
-	ioctl(0, TIOCGWINSZ, &sz);
+		// Length, type, data and CRC.
+		offset += 4 + 4 + (uint64_t)entry.length + 4;
+	}
 
-	char control_codes[50];
-	snprintf(control_codes, sizeof(control_codes), ",a=T,f=100,c=%d",
-			 sz.ws_col);
+	finfo_projection_emit(&proj);
+	if (!valid) { finfo_emit_error("Truncated chunk."); }
+	return valid;
+}
 
-	size_t read_data = 0;
-	while (data_len > read_data) {
-		size_t to_read = (data_len - read_data) < KITTY_CHUNK_SIZE
-							 ? (data_len - read_data)
-							 : KITTY_CHUNK_SIZE;
+bool try_png(struct finfo_input *in) {
+	if (finfo_opts.fields != NULL) { return png_project(in); }
 
-		size_t asd	  = to_read;
-		char *encoded = base64_encode(&data[read_data], &asd);
+	struct png_chunk_index index;
+	bool complete = png_index_chunks(in, &index);
 
-		int last = to_read < KITTY_CHUNK_SIZE;
-		printf("%sm=%d%s;%.*s%s", KITTY_ESCAPE_START, !last, control_codes,
-			   (int)asd, encoded, KITTY_ESCAPE_END);
+	finfo_emit_begin(FINFO_EMIT_ARRAY, "chunks", NULL, 0);
+	int data_count = 0;
+	int bad_crc_n  = 0;
+	for (size_t i = 0; i < index.entries_n; i++) {
+		const struct png_chunk_entry *entry = &index.entries[i];
+		uint32_t crcs[2];
+		bool bad_crc = finfo_opts.verify && !png_chunk_verify(in, entry, crcs);
+		if (bad_crc) { bad_crc_n++; }
+
+		// Only the first of the data chunks is printed, unless others are
+		// corrupt.
+		enum png_chunk_type type = png_parse_type(entry->type_str);
+		if (type != IDAT || !data_count++ || bad_crc) {
+			png_print_chunk(in, entry, bad_crc ? crcs : NULL);
+		}
+	}
+	finfo_emit_end();
 
-		// Control codes should be specified only in first chunk
-		*control_codes = '\0';
+	if (!complete) {
+		png_chunk_index_free(&index);
+		finfo_emit_error("Truncated chunk.");
+		return false;
+	}
 
-		read_data += to_read;
+	finfo_emit_uint("data_chunks", "Total data chunks", data_count);
+	bool valid = bad_crc_n == 0;
+	if (finfo_opts.verify) {
+		finfo_emit_uint("bad_crcs", "Bad CRCs", bad_crc_n);
+		valid = png_verify_data(in, &index) && valid;
 	}
+	png_chunk_index_free(&index);
+
+	if (!finfo_opts.no_images) { print_png_file(in); }
 
-	putchar('\n');
+	return valid;
 }
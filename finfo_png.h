@@ -4,8 +4,11 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include "finfo_format.h"
+#include "finfo_input.h"
 
 extern unsigned char PNG_SIGNATURE[8];
+extern const struct finfo_format png_format;
 
 /*
  * Types of PNG chunk.
@@ -32,29 +35,52 @@ struct png_IHDR_chunk {
 	unsigned char interlace_method;
 };
 
+struct png_color {
+	unsigned char r;
+	unsigned char g;
+	unsigned char b;
+};
+
 struct png_PLTE_chunk {
-	struct {
-		unsigned char r;
-		unsigned char g;
-		unsigned char b;
-	} *palette;
+	// Entries of the palette, pointing inside the chunk data.
+	const struct png_color *palette;
 	uint32_t palette_len;
 };
 
 struct png_IDAT_chunk {
-	unsigned char *data;
+	const unsigned char *data;
 };
 
 struct png_IEND_chunk {};
 
 // ===== =====
 
+/*
+ * Position of a chunk inside the file, found by walking the chunk headers
+ * without reading the chunk data.
+ */
+struct png_chunk_entry {
+	// Offset of the chunk (its length field) from the start of the file.
+	uint64_t offset;
+	// Length of the data field.
+	uint32_t length;
+	// Chunk type.
+	char type_str[4];
+};
+
+struct png_chunk_index {
+	struct png_chunk_entry *entries;
+	size_t entries_n;
+	size_t entries_cap;
+};
+
 struct png_chunk {
 	// Length of the data field.
 	uint32_t length;
 	// Chunk type.
 	char type_str[4];
-	// Chunk data.
+	// Chunk data. Raw data points inside the input the chunk was parsed from,
+	// and is valid as long as the input is open.
 	union {
 		struct png_IHDR_chunk IHDR;
 		struct png_PLTE_chunk PLTE;
@@ -66,11 +92,20 @@ struct png_chunk {
 	unsigned char CRC[4];
 };
 
-void png_chunk_free(struct png_chunk *chunk);
+enum png_chunk_type png_parse_type(const char type_str[4]);
+/*
+ * Check that DATA, the LEN bytes of a chunk of type TYPE, holds all the
+ * fields parsed for that type.
+ */
+bool png_check_chunk(enum png_chunk_type type, const unsigned char *data,
+					 size_t len);
 
-bool try_png(FILE *file);
+bool png_index_chunks(struct finfo_input *in, struct png_chunk_index *dst);
+void png_chunk_index_free(struct png_chunk_index *index);
+bool png_chunk_load(struct finfo_input *in, const struct png_chunk_entry *entry,
+					struct png_chunk *dst);
 
-void print_png_file(FILE *file);
-void print_png(unsigned char *data, size_t data_len);
+// Parse and print the PNG file IN, which starts with PNG_SIGNATURE.
+bool try_png(struct finfo_input *in);
 
 #endif // !FINFO_PNG_H
@@ -0,0 +1,326 @@
+#include <stdlib.h>
+#include <string.h>
+#include "finfo_png_data.h"
+
+// Bigger rows are not allocated, so that a forged header can't make finfo
+// allocate gigabytes.
+#define PNG_MAX_STRIDE (64u << 20)
+
+// Origin and spacing of the pixels of each pass of the Adam7 interlacing.
+static const struct {
+	uint8_t x, y, dx, dy;
+} png_adam7[7] = {
+	{0, 0, 8, 8}, {4, 0, 8, 8}, {0, 4, 4, 8}, {2, 0, 4, 4},
+	{0, 2, 2, 4}, {1, 0, 2, 2}, {0, 1, 1, 2},
+};
+
+// Return the number of samples per pixel of COLOR_TYPE, or 0 if not valid.
+static unsigned png_channels(unsigned char color_type) {
+	switch (color_type) {
+	case 0: return 1; // Grayscale.
+	case 2: return 3; // RGB.
+	case 3: return 1; // Palette index.
+	case 4: return 2; // Grayscale and alpha.
+	case 6: return 4; // RGBA.
+	default: return 0;
+	}
+}
+
+static bool png_header_valid(const struct png_IHDR_chunk *header) {
+	unsigned depth = header->bit_depth;
+	switch (header->color_type) {
+	case 0:
+		if (depth != 1 && depth != 2 && depth != 4 && depth != 8 &&
+			depth != 16) {
+			return false;
+		}
+		break;
+	case 3:
+		if (depth != 1 && depth != 2 && depth != 4 && depth != 8) {
+			return false;
+		}
+		break;
+	case 2:
+	case 4:
+	case 6:
+		if (depth != 8 && depth != 16) { return false; }
+		break;
+	default:
+		return false;
+	}
+
+	return header->width != 0 && header->height != 0 &&
+		   header->compression_method == 0 && header->filter_method == 0 &&
+		   header->interlace_method <= 1;
+}
+
+// Return the number of pixels of a pass of LEN pixels starting at START,
+// with a pixel every STEP.
+static uint32_t png_pass_len(uint32_t len, unsigned start, unsigned step) {
+	return len > start ? (len - start + step - 1) / step : 0;
+}
+
+static uint64_t png_stride(uint32_t width, unsigned bits_per_pixel) {
+	return ((uint64_t)width * bits_per_pixel + 7) / 8;
+}
+
+uint64_t png_data_expected_len(const struct png_IHDR_chunk *header) {
+	unsigned bits_per_pixel =
+		png_channels(header->color_type) * header->bit_depth;
+
+	if (header->interlace_method == 0) {
+		return header->height *
+			   (png_stride(header->width, bits_per_pixel) + 1);
+	}
+
+	uint64_t len = 0;
+	for (unsigned pass = 0; pass < 7; pass++) {
+		uint32_t width =
+			png_pass_len(header->width, png_adam7[pass].x, png_adam7[pass].dx);
+		uint32_t height =
+			png_pass_len(header->height, png_adam7[pass].y, png_adam7[pass].dy);
+		if (width == 0) { continue; }
+		len += height * (png_stride(width, bits_per_pixel) + 1);
+	}
+	return len;
+}
+
+/*
+ * Move READER to the first pass from PASS with pixels in it.
+ * Returns false if there is none left.
+ */
+static bool png_rows_start_pass(struct png_row_reader *reader,
+								unsigned pass) {
+	const struct png_IHDR_chunk *header = &reader->header;
+
+	for (; pass < (header->interlace_method ? 7u : 1u); pass++) {
+		if (header->interlace_method == 0) {
+			reader->pass_width	= header->width;
+			reader->pass_height = header->height;
+		} else {
+			reader->pass_width	= png_pass_len(header->width, png_adam7[pass].x,
+											   png_adam7[pass].dx);
+			reader->pass_height = png_pass_len(
+				header->height, png_adam7[pass].y, png_adam7[pass].dy);
+		}
+		if (reader->pass_width == 0 || reader->pass_height == 0) { continue; }
+
+		reader->pass   = pass;
+		reader->row	   = 0;
+		reader->stride = png_stride(reader->pass_width, reader->bits_per_pixel);
+		// The first row of each pass has nothing above it.
+		memset(reader->prev, 0, reader->stride + 1);
+		return true;
+	}
+
+	return false;
+}
+
+bool png_rows_init(struct png_row_reader *dst, struct finfo_input *in,
+				   const struct png_chunk_index *index,
+				   const struct png_IHDR_chunk *header) {
+	*dst = (struct png_row_reader){
+		.in		= in,
+		.index	= index,
+		.header = *header,
+	};
+
+	if (!png_header_valid(header)) {
+		dst->error = "invalid header";
+		return false;
+	}
+
+	dst->bits_per_pixel = png_channels(header->color_type) * header->bit_depth;
+	dst->filter_bpp		= dst->bits_per_pixel >= 8 ? dst->bits_per_pixel / 8 : 1;
+
+	// The first pass is never wider than the image.
+	uint64_t stride = png_stride(header->width, dst->bits_per_pixel);
+	if (stride > PNG_MAX_STRIDE) {
+		dst->error = "rows too large";
+		return false;
+	}
+
+	dst->rows = malloc(2 * (stride + 1));
+	if (dst->rows == NULL) {
+		dst->error = "out of memory";
+		return false;
+	}
+	dst->prev = dst->rows;
+	dst->cur  = dst->rows + stride + 1;
+
+	if (inflateInit(&dst->z) != Z_OK) {
+		free(dst->rows);
+		dst->rows  = NULL;
+		dst->error = "out of memory";
+		return false;
+	}
+
+	png_rows_start_pass(dst, 0);
+	return true;
+}
+
+/*
+ * Point the input of the inflater to the data of the next IDAT chunk.
+ * Returns false if there are no more.
+ */
+static bool png_rows_feed(struct png_row_reader *reader) {
+	const struct png_chunk_index *index = reader->index;
+	for (; reader->chunk < index->entries_n; reader->chunk++) {
+		const struct png_chunk_entry *entry = &index->entries[reader->chunk];
+		if (png_parse_type(entry->type_str) != IDAT || entry->length == 0) {
+			continue;
+		}
+
+		struct finfo_view data;
+		if (!finfo_input_view(reader->in, entry->offset + 8, entry->length,
+							  &data)) {
+			return false;
+		}
+
+		reader->chunk++;
+		reader->z.next_in  = (unsigned char *)data.data;
+		reader->z.avail_in = data.len;
+		reader->compressed_n += data.len;
+		return true;
+	}
+
+	return false;
+}
+
+/*
+ * Inflate up to LEN bytes into DST.
+ * Returns the number of bytes inflated, less than LEN at the end of the
+ * stream, or if the data ends early or is corrupt, in which case
+ * READER->error is set.
+ */
+static size_t png_rows_inflate(struct png_row_reader *reader,
+							   unsigned char *dst, size_t len) {
+	z_stream *z	 = &reader->z;
+	z->next_out	 = dst;
+	z->avail_out = len;
+	while (z->avail_out > 0 && !reader->z_end) {
+		if (z->avail_in == 0 && !png_rows_feed(reader)) {
+			reader->error = "data ends early";
+			break;
+		}
+
+		int status = inflate(z, Z_NO_FLUSH);
+		if (status == Z_STREAM_END) {
+			reader->z_end = true;
+		} else if (status != Z_OK && status != Z_BUF_ERROR) {
+			reader->error = z->msg != NULL ? z->msg : "corrupt data";
+			break;
+		}
+	}
+
+	size_t inflated = len - z->avail_out;
+	reader->inflated_n += inflated;
+	return inflated;
+}
+
+static unsigned char png_paeth(unsigned char a, unsigned char b,
+							   unsigned char c) {
+	int p  = a + b - c;
+	int pa = abs(p - a);
+	int pb = abs(p - b);
+	int pc = abs(p - c);
+	if (pa <= pb && pa <= pc) { return a; }
+	return pb <= pc ? b : c;
+}
+
+/*
+ * Undo the filter FILTER of the row CUR, long LEN bytes, given the row PREV
+ * above it and BPP bytes per pixel.
+ */
+static void png_unfilter(unsigned filter, unsigned char *cur,
+						 const unsigned char *prev, size_t len, unsigned bpp) {
+	switch (filter) {
+	case PNG_FILTER_SUB:
+		for (size_t i = bpp; i < len; i++) { cur[i] += cur[i - bpp]; }
+		break;
+	case PNG_FILTER_UP:
+		for (size_t i = 0; i < len; i++) { cur[i] += prev[i]; }
+		break;
+	case PNG_FILTER_AVERAGE:
+		for (size_t i = 0; i < bpp && i < len; i++) { cur[i] += prev[i] / 2; }
+		for (size_t i = bpp; i < len; i++) {
+			cur[i] += (cur[i - bpp] + prev[i]) / 2;
+		}
+		break;
+	case PNG_FILTER_PAETH:
+		for (size_t i = 0; i < bpp && i < len; i++) { cur[i] += prev[i]; }
+		for (size_t i = bpp; i < len; i++) {
+			cur[i] += png_paeth(cur[i - bpp], prev[i], prev[i - bpp]);
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+bool png_rows_next(struct png_row_reader *reader, struct png_row *row) {
+	if (reader->error != NULL) { return false; }
+
+	// The next pass starts only now, since clearing the row above the first
+	// one overwrites the last row returned.
+	if (reader->row == reader->pass_height &&
+		!png_rows_start_pass(reader, reader->pass + 1)) {
+		return false;
+	}
+
+	size_t len = reader->stride + 1;
+	if (png_rows_inflate(reader, reader->cur, len) < len) {
+		if (reader->error == NULL) { reader->error = "data ends early"; }
+		return false;
+	}
+
+	unsigned filter = reader->cur[0];
+	if (filter < PNG_FILTER_TYPES_N) {
+		reader->filters[filter]++;
+	} else {
+		// Rows with an unknown filter are left as they are.
+		reader->bad_filters_n++;
+	}
+	png_unfilter(filter, reader->cur + 1, reader->prev + 1, reader->stride,
+				 reader->filter_bpp);
+
+	*row = (struct png_row){
+		.pass	= reader->pass,
+		.y		= reader->row,
+		.dx		= 1,
+		.width	= reader->pass_width,
+		.data	= reader->cur + 1,
+		.stride = reader->stride,
+	};
+	if (reader->header.interlace_method != 0) {
+		row->x	= png_adam7[reader->pass].x;
+		row->y	= png_adam7[reader->pass].y +
+				 reader->row * png_adam7[reader->pass].dy;
+		row->dx = png_adam7[reader->pass].dx;
+	}
+
+	// The current row is above the next one.
+	unsigned char *prev = reader->prev;
+	reader->prev		= reader->cur;
+	reader->cur			= prev;
+	reader->row++;
+
+	return true;
+}
+
+void png_rows_finish(struct png_row_reader *reader) {
+	if (reader->rows == NULL) { return; }
+
+	// Whatever is left after the rows is inflated in the row buffer,
+	// and only counted.
+	size_t len = reader->stride + 1;
+	while (reader->error == NULL && !reader->z_end) {
+		png_rows_inflate(reader, reader->cur, len);
+	}
+}
+
+void png_rows_free(struct png_row_reader *reader) {
+	if (reader->rows != NULL) { inflateEnd(&reader->z); }
+	free(reader->rows);
+	reader->rows = NULL;
+}
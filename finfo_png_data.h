@@ -0,0 +1,113 @@
+#ifndef FINFO_PNG_DATA_H
+#define FINFO_PNG_DATA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <zlib.h>
+#include "finfo_input.h"
+#include "finfo_png.h"
+
+// Filter types of PNG scanlines, stored in the first byte of each one.
+enum png_filter_type {
+	PNG_FILTER_NONE,
+	PNG_FILTER_SUB,
+	PNG_FILTER_UP,
+	PNG_FILTER_AVERAGE,
+	PNG_FILTER_PAETH,
+	PNG_FILTER_TYPES_N,
+};
+
+/*
+ * Reader of the scanlines of a PNG image, inflated on the fly from the
+ * concatenated data of its IDAT chunks.
+ * Only the zlib window and two scanlines, the current one and the one above
+ * it, are kept in memory, whatever the size of the image.
+ */
+struct png_row_reader {
+	struct finfo_input *in;
+	const struct png_chunk_index *index;
+	struct png_IHDR_chunk header;
+
+	// Next chunk of the index to look for IDAT chunks from.
+	size_t chunk;
+	z_stream z;
+	bool z_end;
+
+	// Bytes per complete pixel, or 1 for pixels smaller than a byte.
+	unsigned filter_bpp;
+	// Bits per pixel.
+	unsigned bits_per_pixel;
+	// Pass of the Adam7 interlacing, 0 for images which are not interlaced.
+	unsigned pass;
+	// Size of the current pass, and current row inside it.
+	uint32_t pass_width;
+	uint32_t pass_height;
+	uint32_t row;
+	// Bytes of each row of the pass, without the filter type.
+	size_t stride;
+
+	// Rows with their filter type byte, the one above the current first.
+	unsigned char *rows;
+	unsigned char *prev;
+	unsigned char *cur;
+
+	// Bytes of compressed data read from IDAT chunks.
+	uint64_t compressed_n;
+	// Bytes inflated, including any past the last row.
+	uint64_t inflated_n;
+	// Number of rows with each filter type, and with invalid types.
+	uint64_t filters[PNG_FILTER_TYPES_N];
+	uint64_t bad_filters_n;
+	// Description of the error which stopped the reader, or NULL.
+	const char *error;
+};
+
+// Scanline returned by the row reader.
+struct png_row {
+	// Adam7 pass of the row, 0 for images which are not interlaced.
+	unsigned pass;
+	// Position of the first pixel of the row in the image, and distance
+	// between its pixels.
+	uint32_t x;
+	uint32_t y;
+	uint32_t dx;
+	// Number of pixels in the row.
+	uint32_t width;
+	// Unfiltered, packed pixels of the row, STRIDE bytes long.
+	const unsigned char *data;
+	size_t stride;
+};
+
+/*
+ * Return the number of bytes of inflated data of an image with header
+ * HEADER: the rows of each pass, each one with its filter type.
+ */
+uint64_t png_data_expected_len(const struct png_IHDR_chunk *header);
+
+/*
+ * Start reading the rows of the image IN, whose header is HEADER, from the
+ * IDAT chunks of INDEX.
+ * Returns false if the header is not valid or the rows can't be allocated,
+ * with the reason in DST->error.
+ */
+bool png_rows_init(struct png_row_reader *dst, struct finfo_input *in,
+				   const struct png_chunk_index *index,
+				   const struct png_IHDR_chunk *header);
+
+/*
+ * Read the next row of the image into ROW.
+ * Returns false after the last row, or if the data is corrupt or ends early,
+ * in which case READER->error is set.
+ */
+bool png_rows_next(struct png_row_reader *reader, struct png_row *row);
+
+/*
+ * Inflate the rest of the data after the last row, to count the extra
+ * bytes in READER->inflated_n.
+ */
+void png_rows_finish(struct png_row_reader *reader);
+
+void png_rows_free(struct png_row_reader *reader);
+
+#endif // !FINFO_PNG_DATA_H
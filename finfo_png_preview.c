@@ -0,0 +1,246 @@
+#include <stdlib.h>
+#include <string.h>
+#include "finfo_png_preview.h"
+#include "finfo_png.h"
+#include "finfo_png_data.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// The sums of the blocks are kept on 32 bits: blocks of up to 2^24 pixels
+// of 255 fit.
+#define PNG_PREVIEW_MAX_BLOCK (1u << 24)
+
+/*
+ * Convert the row SRC, of WIDTH pixels in the format of HEADER, to 8-bit
+ * RGBA pixels in DST. Palette indexes are looked up in PLTE.
+ */
+static void png_row_to_rgba(const struct png_IHDR_chunk *header,
+							const struct png_PLTE_chunk *plte,
+							const unsigned char *src, uint32_t width,
+							unsigned char *dst) {
+	unsigned depth = header->bit_depth;
+
+	// Samples smaller than a byte are packed from the high bits.
+	if (depth < 8) {
+		unsigned mask = (1u << depth) - 1;
+		for (uint32_t x = 0; x < width; x++) {
+			size_t bit = (size_t)x * depth;
+			unsigned v = (src[bit / 8] >> (8 - depth - bit % 8)) & mask;
+
+			unsigned char *px = dst + 4 * (size_t)x;
+			if (header->color_type == 3) {
+				struct png_color color = {0};
+				if (v < plte->palette_len) { color = plte->palette[v]; }
+				px[0] = color.r;
+				px[1] = color.g;
+				px[2] = color.b;
+			} else {
+				px[0] = px[1] = px[2] = v * 255 / mask;
+			}
+			px[3] = 255;
+		}
+		return;
+	}
+
+	// Only the high byte of 16-bit samples is kept.
+	size_t step = depth / 8;
+	for (uint32_t x = 0; x < width; x++) {
+		unsigned char *px = dst + 4 * (size_t)x;
+		switch (header->color_type) {
+		case 0: // Grayscale.
+			px[0] = px[1] = px[2] = src[0];
+			px[3]			   = 255;
+			src += step;
+			break;
+		case 2: // RGB.
+			px[0] = src[0];
+			px[1] = src[step];
+			px[2] = src[2 * step];
+			px[3] = 255;
+			src += 3 * step;
+			break;
+		case 3: { // Palette index.
+			struct png_color color = {0};
+			if (src[0] < plte->palette_len) { color = plte->palette[src[0]]; }
+			px[0] = color.r;
+			px[1] = color.g;
+			px[2] = color.b;
+			px[3] = 255;
+			src++;
+			break;
+		}
+		case 4: // Grayscale and alpha.
+			px[0] = px[1] = px[2] = src[0];
+			px[3]			   = src[step];
+			src += 2 * step;
+			break;
+		case 6: // RGBA.
+			px[0] = src[0];
+			px[1] = src[step];
+			px[2] = src[2 * step];
+			px[3] = src[3 * step];
+			src += 4 * step;
+			break;
+		}
+	}
+}
+
+/*
+ * Add the pixels of the RGBA row SRC to the sums SUMS of the columns of
+ * the preview, whose pixels cover the pixels from BLOCKS[d] to BLOCKS[d+1].
+ */
+static void png_preview_accumulate(const unsigned char *src,
+								   const uint32_t *blocks, uint32_t width,
+								   uint32_t *sums) {
+	for (uint32_t d = 0; d < width; d++) {
+#ifdef __SSE2__
+		// The four channels of a pixel are added at once, widened to 32 bits.
+		const __m128i zero = _mm_setzero_si128();
+		__m128i sum		   = _mm_loadu_si128((const __m128i *)(sums + 4 * d));
+		for (uint32_t x = blocks[d]; x < blocks[d + 1]; x++) {
+			uint32_t px;
+			memcpy(&px, src + 4 * (size_t)x, 4);
+			__m128i wide = _mm_unpacklo_epi8(_mm_cvtsi32_si128(px), zero);
+			sum			 = _mm_add_epi32(sum, _mm_unpacklo_epi16(wide, zero));
+		}
+		_mm_storeu_si128((__m128i *)(sums + 4 * d), sum);
+#else
+		for (uint32_t x = blocks[d]; x < blocks[d + 1]; x++) {
+			for (int c = 0; c < 4; c++) { sums[4 * d + c] += src[4 * x + c]; }
+		}
+#endif
+	}
+}
+
+/*
+ * Write the averages of the sums SUMS, over ROWS_N rows of the image, in
+ * the preview row DST, and clear the sums for the next row.
+ */
+static void png_preview_average(uint32_t *sums, const uint32_t *blocks,
+								uint32_t width, uint32_t rows_n,
+								unsigned char *dst) {
+	for (uint32_t d = 0; d < width; d++) {
+		uint32_t n = (blocks[d + 1] - blocks[d]) * rows_n;
+		for (int c = 0; c < 4; c++) {
+			dst[4 * d + c] = (sums[4 * d + c] + n / 2) / n;
+		}
+	}
+	memset(sums, 0, 4 * (size_t)width * sizeof(*sums));
+}
+
+static bool png_preview_reduce(struct png_row_reader *reader,
+							   const struct png_PLTE_chunk *plte,
+							   struct png_preview *dst) {
+	const struct png_IHDR_chunk *header = &reader->header;
+	uint32_t width						= dst->width;
+
+	unsigned char *rgba = malloc(4 * (size_t)header->width);
+	uint32_t *sums		= calloc(4 * (size_t)width, sizeof(*sums));
+	uint32_t *blocks	= malloc((width + 1) * sizeof(*blocks));
+	bool done			= false;
+	if (rgba == NULL || sums == NULL || blocks == NULL) { goto out; }
+
+	// The first column of the image covered by each column of the preview.
+	for (uint32_t d = 0; d <= width; d++) {
+		blocks[d] = ((uint64_t)d * header->width + width - 1) / width;
+	}
+
+	uint32_t out_row = 0;
+	uint32_t rows_n	 = 0;
+	struct png_row row;
+	while (png_rows_next(reader, &row)) {
+		uint32_t y = (uint64_t)row.y * dst->height / header->height;
+		if (y != out_row) {
+			png_preview_average(sums, blocks, width, rows_n,
+								dst->pixels + 4 * (size_t)out_row * width);
+			out_row = y;
+			rows_n	= 0;
+		}
+
+		png_row_to_rgba(header, plte, row.data, row.width, rgba);
+		png_preview_accumulate(rgba, blocks, width, sums);
+		rows_n++;
+	}
+	if (reader->error != NULL || out_row != dst->height - 1) { goto out; }
+
+	png_preview_average(sums, blocks, width, rows_n,
+						dst->pixels + 4 * (size_t)out_row * width);
+	done = true;
+
+out:
+	free(rgba);
+	free(sums);
+	free(blocks);
+	return done;
+}
+
+bool png_preview_decode(struct finfo_input *in, uint32_t width,
+						uint32_t height, struct png_preview *dst) {
+	*dst = (struct png_preview){0};
+
+	struct png_chunk_index index;
+	if (!png_index_chunks(in, &index)) {
+		png_chunk_index_free(&index);
+		return false;
+	}
+
+	// The header is always the first chunk, and the palette comes before
+	// the image data.
+	struct png_chunk header = {0};
+	struct png_chunk plte	= {0};
+	for (size_t i = 0; i < index.entries_n; i++) {
+		const struct png_chunk_entry *entry = &index.entries[i];
+		enum png_chunk_type type			= png_parse_type(entry->type_str);
+		if (i == 0 && type == IHDR && entry->length == 13) {
+			png_chunk_load(in, entry, &header);
+		} else if (type == PLTE) {
+			png_chunk_load(in, entry, &plte);
+		}
+	}
+
+	const struct png_IHDR_chunk *ihdr = &header.data.IHDR;
+	bool scaled						  = false;
+	// Interlaced rows don't come in order.
+	if (header.length == 0 || ihdr->interlace_method != 0 || width == 0 ||
+		ihdr->width == 0 || ihdr->height == 0 ||
+		(ihdr->width <= width && (height == 0 || ihdr->height <= height))) {
+		goto out;
+	}
+
+	// Scale by the smaller of the two ratios.
+	if (height == 0 ||
+		(uint64_t)ihdr->height * width <= (uint64_t)ihdr->width * height) {
+		dst->width	= width;
+		dst->height = (uint64_t)ihdr->height * width / ihdr->width;
+	} else {
+		dst->width	= (uint64_t)ihdr->width * height / ihdr->height;
+		dst->height = height;
+	}
+	if (dst->width == 0) { dst->width = 1; }
+	if (dst->height == 0) { dst->height = 1; }
+
+	uint64_t block_width  = (ihdr->width + dst->width - 1) / dst->width;
+	uint64_t block_height = (ihdr->height + dst->height - 1) / dst->height;
+	if (block_width * block_height > PNG_PREVIEW_MAX_BLOCK) { goto out; }
+
+	dst->pixels = malloc(4 * (size_t)dst->width * dst->height);
+	if (dst->pixels == NULL) { goto out; }
+
+	struct png_row_reader reader;
+	if (png_rows_init(&reader, in, &index, ihdr)) {
+		scaled = png_preview_reduce(&reader, &plte.data.PLTE, dst);
+	}
+	png_rows_free(&reader);
+
+out:
+	png_chunk_index_free(&index);
+	if (!scaled) { png_preview_free(dst); }
+	return scaled;
+}
+
+void png_preview_free(struct png_preview *preview) {
+	free(preview->pixels);
+	*preview = (struct png_preview){0};
+}
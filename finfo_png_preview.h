@@ -0,0 +1,30 @@
+#ifndef FINFO_PNG_PREVIEW_H
+#define FINFO_PNG_PREVIEW_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "finfo_input.h"
+
+// Downscaled copy of an image, as 8-bit RGBA pixels.
+struct png_preview {
+	uint32_t width;
+	uint32_t height;
+	unsigned char *pixels;
+};
+
+/*
+ * Decode the PNG image IN, and shrink it to fit in WIDTH by HEIGHT pixels,
+ * keeping its aspect ratio, into DST. A HEIGHT of 0 doesn't limit the
+ * height.
+ * Each pixel of the preview is the average of the block of pixels of the
+ * image it covers. The rows of the image are decoded and reduced one at
+ * a time, so that only a few of them are in memory.
+ * Returns false if the image already fits, is interlaced, or can't be
+ * decoded, in which case the image should be sent as it is.
+ */
+bool png_preview_decode(struct finfo_input *in, uint32_t width,
+						uint32_t height, struct png_preview *dst);
+
+void png_preview_free(struct png_preview *preview);
+
+#endif // !FINFO_PNG_PREVIEW_H
@@ -0,0 +1,187 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "finfo_pool.h"
+
+/*
+ * Queue of job indices owned by a worker.
+ * Jobs are dealt round-robin, so every queue is sorted and both the owner and
+ * the thieves take the lowest index first: this way the reorder window
+ * is never blocked by a job sitting at the back of a busy worker's queue.
+ */
+struct finfo_queue {
+	pthread_mutex_t lock;
+	size_t *jobs;
+	size_t head;
+	size_t tail;
+};
+
+struct finfo_pool {
+	size_t jobs_n;
+	unsigned workers_n;
+	size_t window;
+	void (*work)(void *ctx, size_t job);
+	void *ctx;
+
+	struct finfo_queue *queues;
+
+	// Protects finished and next_done.
+	pthread_mutex_t lock;
+	// Signaled when a job is finished.
+	pthread_cond_t finished_cond;
+	// Signaled when next_done advances.
+	pthread_cond_t window_cond;
+	bool *finished;
+	// Lowest job not yet passed to the done callback.
+	size_t next_done;
+};
+
+struct finfo_worker {
+	struct finfo_pool *pool;
+	unsigned id;
+};
+
+static bool finfo_queue_pop(struct finfo_queue *queue, size_t *job) {
+	bool found = false;
+
+	pthread_mutex_lock(&queue->lock);
+	if (queue->head < queue->tail) {
+		*job  = queue->jobs[queue->head++];
+		found = true;
+	}
+	pthread_mutex_unlock(&queue->lock);
+
+	return found;
+}
+
+// Take a job from the worker's own queue, or steal one from the others.
+static bool finfo_pool_next(struct finfo_pool *pool, unsigned id,
+							size_t *job) {
+	for (unsigned i = 0; i < pool->workers_n; i++) {
+		unsigned victim = (id + i) % pool->workers_n;
+		if (finfo_queue_pop(&pool->queues[victim], job)) { return true; }
+	}
+
+	return false;
+}
+
+static void *finfo_pool_worker(void *arg) {
+	struct finfo_worker *worker = arg;
+	struct finfo_pool *pool		= worker->pool;
+
+	size_t job;
+	while (finfo_pool_next(pool, worker->id, &job)) {
+		pthread_mutex_lock(&pool->lock);
+		while (job >= pool->next_done + pool->window) {
+			pthread_cond_wait(&pool->window_cond, &pool->lock);
+		}
+		pthread_mutex_unlock(&pool->lock);
+
+		pool->work(pool->ctx, job);
+
+		pthread_mutex_lock(&pool->lock);
+		pool->finished[job] = true;
+		pthread_cond_signal(&pool->finished_cond);
+		pthread_mutex_unlock(&pool->lock);
+	}
+
+	return NULL;
+}
+
+void finfo_pool_run(size_t jobs_n, unsigned workers_n, size_t window,
+					void (*work)(void *ctx, size_t job),
+					void (*done)(void *ctx, size_t job), void *ctx) {
+	if (workers_n > jobs_n) { workers_n = jobs_n; }
+	if (window < workers_n) { window = workers_n; }
+
+	if (workers_n <= 1) {
+		for (size_t i = 0; i < jobs_n; i++) {
+			work(ctx, i);
+			done(ctx, i);
+		}
+		return;
+	}
+
+	struct finfo_pool pool = {
+		.jobs_n	   = jobs_n,
+		.workers_n = workers_n,
+		.window	   = window,
+		.work	   = work,
+		.ctx	   = ctx,
+		.queues	   = calloc(workers_n, sizeof(*pool.queues)),
+		.finished  = calloc(jobs_n, sizeof(*pool.finished)),
+		.next_done = 0,
+	};
+	pthread_mutex_init(&pool.lock, NULL);
+	pthread_cond_init(&pool.finished_cond, NULL);
+	pthread_cond_init(&pool.window_cond, NULL);
+
+	size_t *all_jobs = malloc(jobs_n * sizeof(*all_jobs));
+	if (pool.queues == NULL || pool.finished == NULL || all_jobs == NULL) {
+		perror("finfo");
+		exit(1);
+	}
+
+	// Deal the jobs round-robin, each queue using a slice of ALL_JOBS.
+	size_t start = 0;
+	for (unsigned w = 0; w < workers_n; w++) {
+		struct finfo_queue *queue = &pool.queues[w];
+		pthread_mutex_init(&queue->lock, NULL);
+		queue->jobs = all_jobs + start;
+		queue->head = 0;
+		queue->tail = 0;
+		for (size_t j = w; j < jobs_n; j += workers_n) {
+			queue->jobs[queue->tail++] = j;
+		}
+		start += queue->tail;
+	}
+
+	pthread_t *threads			 = calloc(workers_n, sizeof(*threads));
+	struct finfo_worker *workers = calloc(workers_n, sizeof(*workers));
+	for (unsigned w = 0; w < workers_n; w++) {
+		workers[w].pool = &pool;
+		workers[w].id	= w;
+		if (pthread_create(&threads[w], NULL, finfo_pool_worker,
+						   &workers[w])) {
+			perror("finfo");
+			exit(1);
+		}
+	}
+
+	// Reorder buffer: hand the finished jobs to DONE in order.
+	pthread_mutex_lock(&pool.lock);
+	while (pool.next_done < jobs_n) {
+		while (!pool.finished[pool.next_done]) {
+			pthread_cond_wait(&pool.finished_cond, &pool.lock);
+		}
+		pthread_mutex_unlock(&pool.lock);
+
+		done(ctx, pool.next_done);
+
+		pthread_mutex_lock(&pool.lock);
+		pool.next_done++;
+		pthread_cond_broadcast(&pool.window_cond);
+	}
+	pthread_mutex_unlock(&pool.lock);
+
+	for (unsigned w = 0; w < workers_n; w++) { pthread_join(threads[w], NULL); }
+	for (unsigned w = 0; w < workers_n; w++) {
+		pthread_mutex_destroy(&pool.queues[w].lock);
+	}
+
+	pthread_cond_destroy(&pool.window_cond);
+	pthread_cond_destroy(&pool.finished_cond);
+	pthread_mutex_destroy(&pool.lock);
+	free(workers);
+	free(threads);
+	free(all_jobs);
+	free(pool.finished);
+	free(pool.queues);
+}
+
+unsigned finfo_pool_default_workers(void) {
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? n : 1;
+}
@@ -0,0 +1,25 @@
+#ifndef FINFO_POOL_H
+#define FINFO_POOL_H
+
+#include <stddef.h>
+
+/*
+ * Run JOBS_N independent jobs, identified by their index, on a pool of
+ * WORKERS_N threads.
+ * Each worker owns a queue of jobs and steals from the other workers'
+ * queues once its own is empty.
+ * WORK is called on a worker thread for every job, while DONE is called on
+ * the calling thread in increasing job order, as soon as all the jobs up to
+ * that one are completed. At most WINDOW jobs are completed but not yet
+ * passed to DONE at any time, which bounds the memory held by the results
+ * waiting to be reordered.
+ * With WORKERS_N <= 1 all jobs are run on the calling thread.
+ */
+void finfo_pool_run(size_t jobs_n, unsigned workers_n, size_t window,
+					void (*work)(void *ctx, size_t job),
+					void (*done)(void *ctx, size_t job), void *ctx);
+
+// Number of online processors, used as the default number of workers.
+unsigned finfo_pool_default_workers(void);
+
+#endif // !FINFO_POOL_H
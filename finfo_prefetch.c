@@ -0,0 +1,436 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include "finfo_prefetch.h"
+
+// ===== io_uring =====
+
+/*
+ * Submission and completion queues shared with the kernel, used through
+ * raw system calls.
+ */
+struct finfo_prefetch_ring {
+	int fd;
+	unsigned entries;
+
+	unsigned *sq_head;
+	unsigned *sq_tail;
+	unsigned *sq_mask;
+	unsigned *sq_array;
+	struct io_uring_sqe *sqes;
+	// Tail including the entries not submitted yet.
+	unsigned sq_next;
+
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned *cq_mask;
+	struct io_uring_cqe *cqes;
+
+	void *sq_map;
+	size_t sq_map_len;
+	void *cq_map;
+	size_t cq_map_len;
+	size_t sqes_len;
+};
+
+// Operation of a request, in the low bit of its user data.
+enum prefetch_op {
+	PREFETCH_OPEN,
+	PREFETCH_READ,
+};
+
+// True if the kernel supports the operations used.
+static bool ring_probe(int fd) {
+	size_t len = sizeof(struct io_uring_probe) +
+				 IORING_OP_LAST * sizeof(struct io_uring_probe_op);
+	struct io_uring_probe *probe = calloc(1, len);
+	if (probe == NULL) { return false; }
+
+	bool ok = syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE,
+					  probe, IORING_OP_LAST) == 0 &&
+			  probe->last_op >= IORING_OP_READ &&
+			  (probe->ops[IORING_OP_OPENAT].flags & IO_URING_OP_SUPPORTED) &&
+			  (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED);
+	free(probe);
+	return ok;
+}
+
+static void ring_destroy(struct finfo_prefetch_ring *ring) {
+	if (ring->sqes != NULL) { munmap(ring->sqes, ring->sqes_len); }
+	if (ring->cq_map != NULL && ring->cq_map != ring->sq_map) {
+		munmap(ring->cq_map, ring->cq_map_len);
+	}
+	if (ring->sq_map != NULL) { munmap(ring->sq_map, ring->sq_map_len); }
+	close(ring->fd);
+	free(ring);
+}
+
+// Return a ring of ENTRIES entries, or NULL if io_uring is not available.
+static struct finfo_prefetch_ring *ring_create(unsigned entries) {
+	struct io_uring_params params = {0};
+	int fd = syscall(__NR_io_uring_setup, entries, &params);
+	if (fd < 0) { return NULL; }
+
+	struct finfo_prefetch_ring *ring = calloc(1, sizeof(*ring));
+	if (ring == NULL) {
+		close(fd);
+		return NULL;
+	}
+	ring->fd	  = fd;
+	ring->entries = params.sq_entries;
+	if (!ring_probe(fd)) {
+		ring_destroy(ring);
+		return NULL;
+	}
+
+	ring->sq_map_len =
+		params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	ring->cq_map_len = params.cq_off.cqes +
+					   params.cq_entries * sizeof(struct io_uring_cqe);
+	bool single_map = params.features & IORING_FEAT_SINGLE_MMAP;
+	if (single_map && ring->cq_map_len > ring->sq_map_len) {
+		ring->sq_map_len = ring->cq_map_len;
+	}
+
+	void *sq_map = mmap(NULL, ring->sq_map_len, PROT_READ | PROT_WRITE,
+						MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if (sq_map == MAP_FAILED) {
+		ring_destroy(ring);
+		return NULL;
+	}
+	ring->sq_map = sq_map;
+
+	void *cq_map = sq_map;
+	if (!single_map) {
+		cq_map = mmap(NULL, ring->cq_map_len, PROT_READ | PROT_WRITE,
+					  MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+		if (cq_map == MAP_FAILED) {
+			ring_destroy(ring);
+			return NULL;
+		}
+	}
+	ring->cq_map = cq_map;
+
+	ring->sqes_len	= params.sq_entries * sizeof(struct io_uring_sqe);
+	void *sqes		= mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE,
+						   MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	if (sqes == MAP_FAILED) {
+		ring_destroy(ring);
+		return NULL;
+	}
+	ring->sqes = sqes;
+
+	unsigned char *sq = sq_map;
+	unsigned char *cq = cq_map;
+	ring->sq_head	  = (unsigned *)(sq + params.sq_off.head);
+	ring->sq_tail	  = (unsigned *)(sq + params.sq_off.tail);
+	ring->sq_mask	  = (unsigned *)(sq + params.sq_off.ring_mask);
+	ring->sq_array	  = (unsigned *)(sq + params.sq_off.array);
+	ring->sq_next	  = *ring->sq_tail;
+	ring->cq_head	  = (unsigned *)(cq + params.cq_off.head);
+	ring->cq_tail	  = (unsigned *)(cq + params.cq_off.tail);
+	ring->cq_mask	  = (unsigned *)(cq + params.cq_off.ring_mask);
+	ring->cqes		  = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+	return ring;
+}
+
+/*
+ * Queue a request for the operation OP of JOB. The caller keeps the number
+ * of requests in flight within the size of the ring.
+ */
+static struct io_uring_sqe *ring_queue(struct finfo_prefetch_ring *ring,
+									   size_t job, enum prefetch_op op) {
+	unsigned index			 = ring->sq_next++ & *ring->sq_mask;
+	struct io_uring_sqe *sqe = &ring->sqes[index];
+	ring->sq_array[index]	 = index;
+
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->user_data = (uint64_t)job << 1 | op;
+	return sqe;
+}
+
+/*
+ * Submit the queued requests, and wait for WAIT_N of them to complete.
+ * Returns false on failure.
+ */
+static bool ring_submit(struct finfo_prefetch_ring *ring, unsigned wait_n) {
+	__atomic_store_n(ring->sq_tail, ring->sq_next, __ATOMIC_RELEASE);
+
+	while (true) {
+		unsigned pending =
+			ring->sq_next - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+		if (syscall(__NR_io_uring_enter, ring->fd, pending, wait_n,
+					IORING_ENTER_GETEVENTS, NULL, 0) >= 0) {
+			return true;
+		}
+		if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+			return false;
+		}
+	}
+}
+
+// ===== Prefetching =====
+
+// Mark FILE as ready. Called with the lock held.
+static void prefetch_ready(struct finfo_prefetch_file *file, int fd, int err) {
+	file->fd	= fd;
+	file->err	= err;
+	file->ready = true;
+}
+
+/*
+ * Wait until the file of job NEXT can be opened without getting more than
+ * FINFO_PREFETCH_AHEAD files ahead, and return the job up to which files
+ * can be opened, or 0 once stopped. Files in flight are never waited for.
+ */
+static size_t prefetch_limit(struct finfo_prefetch *prefetch, size_t next,
+							 bool in_flight) {
+	pthread_mutex_lock(&prefetch->lock);
+	while (!prefetch->stop && !in_flight &&
+		   next >= prefetch->taken_n + FINFO_PREFETCH_AHEAD) {
+		pthread_cond_wait(&prefetch->taken_cond, &prefetch->lock);
+	}
+	size_t limit = prefetch->taken_n + FINFO_PREFETCH_AHEAD;
+	if (prefetch->stop) { limit = 0; }
+	pthread_mutex_unlock(&prefetch->lock);
+
+	if (limit > prefetch->jobs_n) { limit = prefetch->jobs_n; }
+	return limit;
+}
+
+/*
+ * Return the path of JOB, or NULL if the job doesn't need its file, which
+ * is then marked as ready and taken.
+ */
+static const char *prefetch_path(struct finfo_prefetch *prefetch, size_t job) {
+	const char *path = prefetch->path(prefetch->ctx, job);
+	if (path == NULL) {
+		pthread_mutex_lock(&prefetch->lock);
+		prefetch_ready(&prefetch->files[job], -1, 0);
+		prefetch->files[job].taken = true;
+		prefetch->taken_n++;
+		pthread_mutex_unlock(&prefetch->lock);
+	}
+	return path;
+}
+
+/*
+ * Leave the files not ready, once stopped or after a failure, to be opened
+ * by their parser. A read may still be in flight, so its buffer is leaked
+ * rather than freed under the feet of the kernel.
+ */
+static void prefetch_finish(struct finfo_prefetch *prefetch) {
+	pthread_mutex_lock(&prefetch->lock);
+	for (size_t i = 0; i < prefetch->jobs_n; i++) {
+		struct finfo_prefetch_file *file = &prefetch->files[i];
+		if (file->ready) { continue; }
+
+		if (file->fd >= 0) { close(file->fd); }
+		file->data = NULL;
+		prefetch_ready(file, -1, 0);
+	}
+	pthread_cond_broadcast(&prefetch->ready_cond);
+	pthread_mutex_unlock(&prefetch->lock);
+}
+
+static void prefetch_uring(struct finfo_prefetch *prefetch) {
+	struct finfo_prefetch_ring *ring = prefetch->ring;
+	unsigned depth = FINFO_PREFETCH_DEPTH;
+	if (ring->entries < depth) { depth = ring->entries; }
+
+	size_t next		   = 0;
+	unsigned in_flight = 0;
+
+	while (next < prefetch->jobs_n || in_flight > 0) {
+		size_t limit = prefetch_limit(prefetch, next, in_flight > 0);
+		// Once stopped, only wait for the requests in flight.
+		if (limit == 0) { next = prefetch->jobs_n; }
+
+		for (; in_flight < depth && next < limit; next++) {
+			const char *path = prefetch_path(prefetch, next);
+			if (path == NULL) { continue; }
+
+			struct io_uring_sqe *sqe = ring_queue(ring, next, PREFETCH_OPEN);
+			sqe->opcode				 = IORING_OP_OPENAT;
+			sqe->fd					 = AT_FDCWD;
+			sqe->addr				 = (uintptr_t)path;
+			sqe->open_flags			 = O_RDONLY | O_CLOEXEC;
+			in_flight++;
+		}
+		if (in_flight == 0) { continue; }
+
+		if (!ring_submit(ring, 1)) { break; }
+
+		// Read the start of the opened files, and release the ones read.
+		unsigned head = *ring->cq_head;
+		unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+		pthread_mutex_lock(&prefetch->lock);
+		for (; head != tail; head++) {
+			const struct io_uring_cqe *cqe =
+				&ring->cqes[head & *ring->cq_mask];
+			size_t job						 = cqe->user_data >> 1;
+			struct finfo_prefetch_file *file = &prefetch->files[job];
+			in_flight--;
+
+			if ((cqe->user_data & 1) == PREFETCH_READ) {
+				if (cqe->res > 0) {
+					file->len = cqe->res;
+				} else {
+					free(file->data);
+					file->data = NULL;
+				}
+				prefetch_ready(file, file->fd, 0);
+				continue;
+			}
+
+			if (cqe->res < 0) {
+				prefetch_ready(file, -1, -cqe->res);
+				continue;
+			}
+
+			// Pipes are left for the parser, as reading them consumes them.
+			int fd = cqe->res;
+			struct stat st;
+			if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) ||
+				st.st_size == 0) {
+				prefetch_ready(file, fd, 0);
+				continue;
+			}
+
+			size_t len = FINFO_PREFETCH_LEN;
+			if ((uint64_t)st.st_size < len) { len = st.st_size; }
+			file->fd   = fd;
+			file->data = malloc(len);
+			if (file->data == NULL) {
+				prefetch_ready(file, fd, 0);
+				continue;
+			}
+
+			struct io_uring_sqe *sqe = ring_queue(ring, job, PREFETCH_READ);
+			sqe->opcode				 = IORING_OP_READ;
+			sqe->fd					 = fd;
+			sqe->addr				 = (uintptr_t)file->data;
+			sqe->len				 = len;
+			sqe->off				 = 0;
+			in_flight++;
+		}
+		__atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+		pthread_cond_broadcast(&prefetch->ready_cond);
+		pthread_mutex_unlock(&prefetch->lock);
+	}
+
+	prefetch_finish(prefetch);
+}
+
+// Fallback without io_uring: let the kernel read the files ahead.
+static void prefetch_readahead(struct finfo_prefetch *prefetch) {
+	for (size_t next = 0; next < prefetch->jobs_n; next++) {
+		if (prefetch_limit(prefetch, next, false) == 0) { break; }
+
+		const char *path = prefetch_path(prefetch, next);
+		if (path == NULL) { continue; }
+
+		int fd	= open(path, O_RDONLY | O_CLOEXEC);
+		int err = fd < 0 ? errno : 0;
+		struct stat st;
+		if (fd >= 0 && fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+			posix_fadvise(fd, 0, FINFO_PREFETCH_LEN, POSIX_FADV_WILLNEED);
+		}
+
+		pthread_mutex_lock(&prefetch->lock);
+		prefetch_ready(&prefetch->files[next], fd, err);
+		pthread_cond_broadcast(&prefetch->ready_cond);
+		pthread_mutex_unlock(&prefetch->lock);
+	}
+
+	prefetch_finish(prefetch);
+}
+
+static void *prefetch_thread(void *arg) {
+	struct finfo_prefetch *prefetch = arg;
+	if (prefetch->ring != NULL) {
+		prefetch_uring(prefetch);
+	} else {
+		prefetch_readahead(prefetch);
+	}
+	return NULL;
+}
+
+bool finfo_prefetch_start(struct finfo_prefetch *prefetch, size_t jobs_n,
+						  const char *(*path)(void *ctx, size_t job),
+						  void *ctx) {
+	*prefetch = (struct finfo_prefetch){
+		.jobs_n = jobs_n,
+		.path	= path,
+		.ctx	= ctx,
+		.files	= calloc(jobs_n, sizeof(*prefetch->files)),
+	};
+	if (prefetch->files == NULL) { return false; }
+	for (size_t i = 0; i < jobs_n; i++) { prefetch->files[i].fd = -1; }
+
+	prefetch->ring = ring_create(FINFO_PREFETCH_DEPTH);
+	pthread_mutex_init(&prefetch->lock, NULL);
+	pthread_cond_init(&prefetch->ready_cond, NULL);
+	pthread_cond_init(&prefetch->taken_cond, NULL);
+
+	if (pthread_create(&prefetch->thread, NULL, prefetch_thread, prefetch)) {
+		if (prefetch->ring != NULL) { ring_destroy(prefetch->ring); }
+		pthread_mutex_destroy(&prefetch->lock);
+		pthread_cond_destroy(&prefetch->ready_cond);
+		pthread_cond_destroy(&prefetch->taken_cond);
+		free(prefetch->files);
+		return false;
+	}
+	return true;
+}
+
+void finfo_prefetch_stop(struct finfo_prefetch *prefetch) {
+	pthread_mutex_lock(&prefetch->lock);
+	prefetch->stop = true;
+	pthread_cond_broadcast(&prefetch->taken_cond);
+	pthread_mutex_unlock(&prefetch->lock);
+	pthread_join(prefetch->thread, NULL);
+
+	for (size_t i = 0; i < prefetch->jobs_n; i++) {
+		struct finfo_prefetch_file *file = &prefetch->files[i];
+		if (file->taken) { continue; }
+		if (file->fd >= 0) { close(file->fd); }
+		free(file->data);
+	}
+
+	if (prefetch->ring != NULL) { ring_destroy(prefetch->ring); }
+	pthread_mutex_destroy(&prefetch->lock);
+	pthread_cond_destroy(&prefetch->ready_cond);
+	pthread_cond_destroy(&prefetch->taken_cond);
+	free(prefetch->files);
+	*prefetch = (struct finfo_prefetch){0};
+}
+
+bool finfo_prefetch_open(struct finfo_prefetch *prefetch, size_t job,
+						 struct finfo_input *in, const char *path) {
+	pthread_mutex_lock(&prefetch->lock);
+	struct finfo_prefetch_file *file = &prefetch->files[job];
+	while (!file->ready) {
+		pthread_cond_wait(&prefetch->ready_cond, &prefetch->lock);
+	}
+	struct finfo_prefetch_file taken = *file;
+	file->taken						 = true;
+	prefetch->taken_n++;
+	pthread_cond_signal(&prefetch->taken_cond);
+	pthread_mutex_unlock(&prefetch->lock);
+
+	if (taken.fd < 0) {
+		if (taken.err == 0) { return finfo_input_open(in, path); }
+		*in	  = (struct finfo_input){.fd = -1};
+		errno = taken.err;
+		return false;
+	}
+	return finfo_input_adopt(in, path, taken.fd, taken.data, taken.len);
+}
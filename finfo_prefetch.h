@@ -0,0 +1,74 @@
+#ifndef FINFO_PREFETCH_H
+#define FINFO_PREFETCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+#include "finfo_input.h"
+
+// Bytes read from the start of every file, enough for most metadata.
+#define FINFO_PREFETCH_LEN (16 * 1024)
+// Files opened and read ahead of the ones taken, at most.
+#define FINFO_PREFETCH_AHEAD 512
+// Operations in flight at once.
+#define FINFO_PREFETCH_DEPTH 128
+
+struct finfo_prefetch_ring;
+
+// A file opened and read ahead of time.
+struct finfo_prefetch_file {
+	// Descriptor of the file, or -1 with ERR set.
+	int fd;
+	int err;
+	// Start of the file, NULL if it couldn't be read.
+	unsigned char *data;
+	size_t len;
+	bool ready;
+	bool taken;
+};
+
+/*
+ * Background thread opening files and reading their start ahead of the
+ * workers parsing them, in job order.
+ * With io_uring, opens and reads are submitted for many files at once, so
+ * that slow storage serves them in parallel instead of one round trip
+ * after the other. Without it, files are opened one by one and their start
+ * is only read ahead with posix_fadvise.
+ */
+struct finfo_prefetch {
+	size_t jobs_n;
+	// Path of each job, NULL for the ones that don't need their file.
+	const char *(*path)(void *ctx, size_t job);
+	void *ctx;
+	struct finfo_prefetch_file *files;
+
+	struct finfo_prefetch_ring *ring;
+	pthread_t thread;
+
+	pthread_mutex_t lock;
+	// Signaled when files are ready.
+	pthread_cond_t ready_cond;
+	// Signaled when files are taken, or when stopping.
+	pthread_cond_t taken_cond;
+	size_t taken_n;
+	bool stop;
+};
+
+/*
+ * Start prefetching the files of JOBS_N jobs, whose paths are given by PATH.
+ * Returns false if the thread can't be started.
+ */
+bool finfo_prefetch_start(struct finfo_prefetch *prefetch, size_t jobs_n,
+						  const char *(*path)(void *ctx, size_t job),
+						  void *ctx);
+// Stop the thread and release the files which weren't taken.
+void finfo_prefetch_stop(struct finfo_prefetch *prefetch);
+
+/*
+ * Open IN from the file prefetched for JOB, at PATH, waiting for it if
+ * needed. On failure returns false and sets errno. Thread safe.
+ */
+bool finfo_prefetch_open(struct finfo_prefetch *prefetch, size_t job,
+						 struct finfo_input *in, const char *path);
+
+#endif // !FINFO_PREFETCH_H
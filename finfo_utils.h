@@ -3,16 +3,86 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 // Convert a BigEndian byte array into an unsigned 64 bit int.
 // Since 64 bits are 8 bytes, the max length of the array is 8.
-uint64_t BE_bytes_to_int(unsigned char *bytes, unsigned short len);
+uint64_t BE_bytes_to_int(const unsigned char *bytes, unsigned short len);
 // Convert a LittleEndian byte array into an unsigned 64 bit int.
 // Since 64 bits are 8 bytes, the max length of the array is 8.
-uint64_t LE_bytes_to_int(unsigned char *bytes, unsigned short len);
-// Base64 encode len bytes of data. The len argument will be updated
-// with the length of the returned string.
-// Returns NULL if the provided len is 0.
-char *base64_encode(unsigned char *data, size_t *len);
+uint64_t LE_bytes_to_int(const unsigned char *bytes, unsigned short len);
+
+/*
+ * Loaders of the fixed-width integers of the file formats, at any
+ * alignment. Each one is a single unaligned load, plus a byte swap when the
+ * byte order differs from the one of the CPU.
+ */
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define FINFO_BE16(x) __builtin_bswap16(x)
+#define FINFO_BE32(x) __builtin_bswap32(x)
+#define FINFO_BE64(x) __builtin_bswap64(x)
+#define FINFO_LE32(x) (x)
+#else
+#define FINFO_BE16(x) (x)
+#define FINFO_BE32(x) (x)
+#define FINFO_BE64(x) (x)
+#define FINFO_LE32(x) __builtin_bswap32(x)
+#endif
+
+static inline uint16_t load_be16(const unsigned char *p) {
+	uint16_t x;
+	memcpy(&x, p, sizeof(x));
+	return FINFO_BE16(x);
+}
+
+// Three bytes, without reading past them.
+static inline uint32_t load_be24(const unsigned char *p) {
+	return ((uint32_t)p[0] << 16) | load_be16(p + 1);
+}
+
+static inline uint32_t load_be32(const unsigned char *p) {
+	uint32_t x;
+	memcpy(&x, p, sizeof(x));
+	return FINFO_BE32(x);
+}
+
+static inline uint64_t load_be64(const unsigned char *p) {
+	uint64_t x;
+	memcpy(&x, p, sizeof(x));
+	return FINFO_BE64(x);
+}
+
+static inline uint32_t load_le32(const unsigned char *p) {
+	uint32_t x;
+	memcpy(&x, p, sizeof(x));
+	return FINFO_LE32(x);
+}
+
+// Storers, the other way around.
+static inline void store_be24(unsigned char *p, uint32_t value) {
+	p[0] = value >> 16;
+	p[1] = value >> 8;
+	p[2] = value;
+}
+
+static inline void store_be32(unsigned char *p, uint32_t value) {
+	value = FINFO_BE32(value);
+	memcpy(p, &value, sizeof(value));
+}
+
+static inline void store_le32(unsigned char *p, uint32_t value) {
+	value = FINFO_LE32(value);
+	memcpy(p, &value, sizeof(value));
+}
+
+/*
+ * Extract the field of LEN bits starting BIT bits after the most
+ * significant bit of WORD, as laid out by the packed fields of the big
+ * endian formats. LEN goes from 1 to 64 - BIT.
+ */
+static inline uint64_t extract_bits(uint64_t word, unsigned bit, unsigned len) {
+	return (word << bit) >> (64 - len);
+}
 
 #endif // !FINFO_UTILS_H
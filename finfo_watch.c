@@ -0,0 +1,480 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include "finfo_watch.h"
+
+// Events of the files inside watched directories, and of the directories
+// created, moved or deleted there.
+#define WATCH_DIR_MASK                                                        \
+	(IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_CREATE | \
+	 IN_ONLYDIR)
+// Events of the directories holding files watched on their own.
+#define WATCH_FILE_MASK \
+	(IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE)
+
+// Directory watched through a watch descriptor.
+struct finfo_watch_dir {
+	// NULL for unused descriptors.
+	char *path;
+	// Whether every file of the directory is watched, as part of a tree.
+	bool tree;
+	// Paths of the files of the directory watched on their own, as given.
+	char **files;
+	size_t files_n;
+	size_t files_cap;
+};
+
+static volatile sig_atomic_t watch_interrupted;
+
+static void watch_on_signal(int sig) {
+	(void)sig;
+	watch_interrupted = 1;
+}
+
+static int64_t watch_now_ms(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Return the path of NAME inside the directory DIR, or NULL if out of memory.
+static char *watch_join(const char *dir, const char *name) {
+	size_t dir_len = strlen(dir);
+	size_t len	   = dir_len + 1 + strlen(name) + 1;
+	char *path	   = malloc(len);
+	if (path != NULL) {
+		snprintf(path, len, "%s%s%s", dir,
+				 dir_len > 0 && dir[dir_len - 1] == '/' ? "" : "/", name);
+	}
+	return path;
+}
+
+// Return the last component of PATH.
+static const char *watch_basename(const char *path) {
+	const char *slash = strrchr(path, '/');
+	return slash != NULL ? slash + 1 : path;
+}
+
+// Return the directory holding the file PATH, or NULL if out of memory.
+static char *watch_dirname(const char *path) {
+	const char *slash = strrchr(path, '/');
+	if (slash == NULL) { return strdup("."); }
+	if (slash == path) { return strdup("/"); }
+	return strndup(path, slash - path);
+}
+
+static bool watch_grow(void **array, size_t *cap, size_t n, size_t size) {
+	if (n < *cap) { return true; }
+
+	size_t new_cap = *cap ? *cap * 2 : 64;
+	while (new_cap <= n) { new_cap *= 2; }
+	void *new_array = realloc(*array, new_cap * size);
+	if (new_array == NULL) { return false; }
+
+	memset((char *)new_array + *cap * size, 0, (new_cap - *cap) * size);
+	*array = new_array;
+	*cap   = new_cap;
+	return true;
+}
+
+bool finfo_watch_init(struct finfo_watch *watch) {
+	*watch = (struct finfo_watch){0};
+
+	watch->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (watch->fd < 0) { return false; }
+
+	// Without SA_RESTART, so that poll returns as soon as a signal arrives.
+	struct sigaction action = {.sa_handler = watch_on_signal};
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+	return true;
+}
+
+static void watch_clear_changes(struct finfo_watch *watch) {
+	for (size_t i = 0; i < watch->changes_n; i++) {
+		free(watch->changes[i].path);
+	}
+	watch->changes_n = 0;
+	if (watch->index != NULL) {
+		memset(watch->index, 0, watch->index_cap * sizeof(*watch->index));
+	}
+}
+
+static void watch_dir_free(struct finfo_watch_dir *dir) {
+	for (size_t i = 0; i < dir->files_n; i++) { free(dir->files[i]); }
+	free(dir->files);
+	free(dir->path);
+	*dir = (struct finfo_watch_dir){0};
+}
+
+void finfo_watch_close(struct finfo_watch *watch) {
+	watch_clear_changes(watch);
+	for (size_t i = 0; i < watch->dirs_cap; i++) {
+		watch_dir_free(&watch->dirs[i]);
+	}
+	for (size_t i = 0; i < watch->roots_n; i++) { free(watch->roots[i]); }
+	free(watch->dirs);
+	free(watch->roots);
+	free(watch->changes);
+	free(watch->index);
+	if (watch->fd >= 0) { close(watch->fd); }
+	*watch = (struct finfo_watch){.fd = -1};
+}
+
+/*
+ * Remember that the watch descriptor WD watches the directory PATH, and
+ * return it, or NULL if out of memory. Watching the same inode twice gives
+ * the same descriptor: its path is only replaced if REPLACE is set.
+ */
+static struct finfo_watch_dir *watch_set_dir(struct finfo_watch *watch,
+											 int wd, const char *path,
+											 bool replace) {
+	if (!watch_grow((void **)&watch->dirs, &watch->dirs_cap, wd,
+					sizeof(*watch->dirs))) {
+		return NULL;
+	}
+
+	struct finfo_watch_dir *dir = &watch->dirs[wd];
+	if (dir->path == NULL || replace) {
+		char *copy = strdup(path);
+		if (copy == NULL) { return NULL; }
+		free(dir->path);
+		dir->path = copy;
+	}
+	return dir;
+}
+
+/*
+ * Watch the directory PATH and every directory under it.
+ * Symbolic links to directories are not followed, to avoid loops.
+ */
+static bool watch_add_dir(struct finfo_watch *watch, const char *path) {
+	int wd = inotify_add_watch(watch->fd, path, WATCH_DIR_MASK);
+	if (wd < 0) { return false; }
+	struct finfo_watch_dir *watched = watch_set_dir(watch, wd, path, true);
+	if (watched == NULL) { return false; }
+	watched->tree = true;
+
+	DIR *dir = opendir(path);
+	if (dir == NULL) { return false; }
+
+	struct dirent *entry;
+	while ((entry = readdir(dir)) != NULL) {
+		if (strcmp(entry->d_name, ".") == 0 ||
+			strcmp(entry->d_name, "..") == 0) {
+			continue;
+		}
+
+		unsigned char type = entry->d_type;
+		if (type != DT_DIR && type != DT_UNKNOWN) { continue; }
+
+		char *child = watch_join(path, entry->d_name);
+		if (child == NULL) { continue; }
+
+		struct stat st;
+		if (type == DT_UNKNOWN && lstat(child, &st) == 0 &&
+			S_ISDIR(st.st_mode)) {
+			type = DT_DIR;
+		}
+		if (type == DT_DIR && !watch_add_dir(watch, child)) {
+			fprintf(stderr, "Unable to watch directory: %s (%s).\n", child,
+					strerror(errno));
+		}
+		free(child);
+	}
+
+	closedir(dir);
+	return true;
+}
+
+// Stop watching the directory PATH and the directories under it.
+static void watch_remove_dir(struct finfo_watch *watch, const char *path) {
+	size_t len = strlen(path);
+	for (size_t wd = 0; wd < watch->dirs_cap; wd++) {
+		const char *watched = watch->dirs[wd].path;
+		if (watched == NULL || strncmp(watched, path, len) != 0 ||
+			(watched[len] != '\0' && watched[len] != '/')) {
+			continue;
+		}
+
+		inotify_rm_watch(watch->fd, wd);
+		watch_dir_free(&watch->dirs[wd]);
+	}
+}
+
+/*
+ * Watch the file PATH through the directory holding it, adding to the
+ * events already watched there.
+ */
+static bool watch_add_file(struct finfo_watch *watch, const char *path) {
+	char *parent = watch_dirname(path);
+	if (parent == NULL) { return false; }
+
+	int wd =
+		inotify_add_watch(watch->fd, parent, WATCH_FILE_MASK | IN_MASK_ADD);
+	struct finfo_watch_dir *dir =
+		wd < 0 ? NULL : watch_set_dir(watch, wd, parent, false);
+	free(parent);
+	if (dir == NULL ||
+		!watch_grow((void **)&dir->files, &dir->files_cap, dir->files_n,
+					sizeof(*dir->files))) {
+		return false;
+	}
+
+	dir->files[dir->files_n] = strdup(path);
+	if (dir->files[dir->files_n] == NULL) { return false; }
+	dir->files_n++;
+	return true;
+}
+
+bool finfo_watch_add(struct finfo_watch *watch, const char *path) {
+	struct stat st;
+	if (stat(path, &st) < 0) { return false; }
+
+	if (S_ISDIR(st.st_mode)) {
+		if (!watch_add_dir(watch, path)) { return false; }
+	} else if (!watch_add_file(watch, path)) {
+		return false;
+	}
+
+	if (!watch_grow((void **)&watch->roots, &watch->roots_cap, watch->roots_n,
+					sizeof(*watch->roots))) {
+		return false;
+	}
+	watch->roots[watch->roots_n] = strdup(path);
+	if (watch->roots[watch->roots_n] == NULL) { return false; }
+	watch->roots_n++;
+	return true;
+}
+
+// Hash the LEN first bytes of PATH.
+static uint32_t watch_hash(const char *path, size_t len) {
+	// FNV-1a.
+	uint32_t h = 2166136261u;
+	for (size_t i = 0; i < len; i++) {
+		h = (h ^ (unsigned char)path[i]) * 16777619u;
+	}
+	return h;
+}
+
+static void watch_index_insert(struct finfo_watch *watch, size_t change) {
+	const char *path = watch->changes[change].path;
+	size_t mask		 = watch->index_cap - 1;
+	size_t i		 = watch_hash(path, strlen(path)) & mask;
+	while (watch->index[i] != 0) { i = (i + 1) & mask; }
+	watch->index[i] = change + 1;
+}
+
+// Return the change of the path made of the LEN first bytes of PATH, or NULL.
+static struct finfo_watch_change *watch_find(struct finfo_watch *watch,
+											 const char *path, size_t len) {
+	if (watch->index_cap == 0) { return NULL; }
+
+	size_t mask = watch->index_cap - 1;
+	size_t i	= watch_hash(path, len) & mask;
+	for (; watch->index[i] != 0; i = (i + 1) & mask) {
+		struct finfo_watch_change *change =
+			&watch->changes[watch->index[i] - 1];
+		if (strncmp(change->path, path, len) == 0 &&
+			change->path[len] == '\0') {
+			return change;
+		}
+	}
+	return NULL;
+}
+
+// Record EVENT as the last thing that happened to PATH, which is taken over.
+static void watch_record(struct finfo_watch *watch, char *path,
+						 enum finfo_watch_event event) {
+	if (path == NULL) { return; }
+
+	struct finfo_watch_change *change = watch_find(watch, path, strlen(path));
+	if (change != NULL) {
+		change->event = event;
+		free(path);
+		return;
+	}
+
+	if (!watch_grow((void **)&watch->changes, &watch->changes_cap,
+					watch->changes_n, sizeof(*watch->changes))) {
+		free(path);
+		return;
+	}
+	watch->changes[watch->changes_n++] = (struct finfo_watch_change){
+		.path  = path,
+		.event = event,
+	};
+
+	// Keep the index at most half full.
+	if (2 * watch->changes_n > watch->index_cap) {
+		size_t cap		= watch->index_cap ? watch->index_cap * 2 : 256;
+		uint32_t *index = calloc(cap, sizeof(*index));
+		if (index == NULL) { return; }
+
+		free(watch->index);
+		watch->index	 = index;
+		watch->index_cap = cap;
+		for (size_t i = 0; i < watch->changes_n; i++) {
+			watch_index_insert(watch, i);
+		}
+	} else {
+		watch_index_insert(watch, watch->changes_n - 1);
+	}
+}
+
+static void watch_handle(struct finfo_watch *watch,
+						 const struct inotify_event *event) {
+	// Events were lost: everything may have changed.
+	if (event->mask & IN_Q_OVERFLOW) {
+		fprintf(stderr, "Too many changes, rescanning everything.\n");
+		for (size_t i = 0; i < watch->roots_n; i++) {
+			watch_record(watch, strdup(watch->roots[i]), FINFO_WATCH_CHANGED);
+		}
+		return;
+	}
+
+	if (event->wd < 0 || (size_t)event->wd >= watch->dirs_cap ||
+		watch->dirs[event->wd].path == NULL) {
+		return;
+	}
+	struct finfo_watch_dir *dir = &watch->dirs[event->wd];
+
+	if (event->mask & IN_IGNORED) {
+		watch_dir_free(dir);
+		return;
+	}
+	if (event->len == 0) { return; }
+
+	// Files watched on their own are reported by the path they were given as.
+	for (size_t i = 0; i < dir->files_n; i++) {
+		if (strcmp(watch_basename(dir->files[i]), event->name) != 0) {
+			continue;
+		}
+
+		if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+			watch_record(watch, strdup(dir->files[i]), FINFO_WATCH_CHANGED);
+		} else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+			watch_record(watch, strdup(dir->files[i]), FINFO_WATCH_DELETED);
+		}
+		return;
+	}
+	if (!dir->tree) { return; }
+
+	char *path = watch_join(dir->path, event->name);
+	if (path == NULL) { return; }
+
+	if (event->mask & IN_ISDIR) {
+		if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+			if (!watch_add_dir(watch, path)) {
+				fprintf(stderr, "Unable to watch directory: %s (%s).\n", path,
+						strerror(errno));
+			}
+			watch_record(watch, path, FINFO_WATCH_CHANGED);
+		} else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+			watch_remove_dir(watch, path);
+			watch_record(watch, path, FINFO_WATCH_DELETED);
+		} else {
+			free(path);
+		}
+	} else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+		watch_record(watch, path, FINFO_WATCH_CHANGED);
+	} else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+		watch_record(watch, path, FINFO_WATCH_DELETED);
+	} else {
+		free(path);
+	}
+}
+
+// Handle every pending event. Returns false on failure.
+static bool watch_read(struct finfo_watch *watch) {
+	char buf[64 * 1024]
+		__attribute__((aligned(__alignof__(struct inotify_event))));
+
+	while (true) {
+		ssize_t n = read(watch->fd, buf, sizeof(buf));
+		if (n < 0) { return errno == EAGAIN || errno == EINTR; }
+
+		for (ssize_t i = 0; i < n;) {
+			const struct inotify_event *event = (const void *)(buf + i);
+			watch_handle(watch, event);
+			i += sizeof(*event) + event->len;
+		}
+	}
+}
+
+/*
+ * Leave out the changes under a directory which changed, since every file
+ * under it is read again anyway.
+ */
+static void watch_drop_nested(struct finfo_watch *watch) {
+	// Find all of them first, while the index still matches the changes.
+	bool *nested = calloc(watch->changes_n, sizeof(*nested));
+	if (nested == NULL) { return; }
+
+	for (size_t i = 0; i < watch->changes_n; i++) {
+		const char *path = watch->changes[i].path;
+		for (const char *slash = strchr(path + 1, '/');
+			 slash != NULL && !nested[i]; slash = strchr(slash + 1, '/')) {
+			const struct finfo_watch_change *parent =
+				watch_find(watch, path, slash - path);
+			nested[i] = parent != NULL && parent->event == FINFO_WATCH_CHANGED;
+		}
+	}
+
+	size_t kept = 0;
+	for (size_t i = 0; i < watch->changes_n; i++) {
+		if (nested[i]) {
+			free(watch->changes[i].path);
+		} else {
+			watch->changes[kept++] = watch->changes[i];
+		}
+	}
+	free(nested);
+	if (kept == watch->changes_n) { return; }
+
+	watch->changes_n = kept;
+	memset(watch->index, 0, watch->index_cap * sizeof(*watch->index));
+	for (size_t i = 0; i < watch->changes_n; i++) {
+		watch_index_insert(watch, i);
+	}
+}
+
+bool finfo_watch_wait(struct finfo_watch *watch) {
+	watch_clear_changes(watch);
+
+	int64_t first_ms = 0;
+	while (!watch_interrupted) {
+		// Wait for the first change, then until the burst settles.
+		int timeout = -1;
+		if (watch->changes_n > 0) {
+			int64_t left = first_ms + FINFO_WATCH_MAX_DELAY_MS - watch_now_ms();
+			if (left <= 0) { break; }
+			timeout = FINFO_WATCH_SETTLE_MS;
+			if (left < timeout) { timeout = left; }
+		}
+
+		struct pollfd pfd = {.fd = watch->fd, .events = POLLIN};
+		int ready		  = poll(&pfd, 1, timeout);
+		if (ready < 0 && errno != EINTR) { return false; }
+		if (ready == 0) { break; }
+
+		size_t changes_n = watch->changes_n;
+		if (ready > 0 && !watch_read(watch)) { return false; }
+		if (changes_n == 0 && watch->changes_n > 0) {
+			first_ms = watch_now_ms();
+		}
+	}
+	if (watch_interrupted) { return false; }
+
+	watch_drop_nested(watch);
+	return true;
+}
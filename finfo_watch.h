@@ -0,0 +1,77 @@
+#ifndef FINFO_WATCH_H
+#define FINFO_WATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Time without events after which a burst of changes is reported.
+#define FINFO_WATCH_SETTLE_MS 200
+// Longest time changes are held back by a burst that doesn't end.
+#define FINFO_WATCH_MAX_DELAY_MS 2000
+
+enum finfo_watch_event {
+	// The file was written, or moved in place. For directories, every file
+	// under them may be new.
+	FINFO_WATCH_CHANGED,
+	// The file or directory was deleted, or moved away.
+	FINFO_WATCH_DELETED,
+};
+
+struct finfo_watch_change {
+	char *path;
+	enum finfo_watch_event event;
+};
+
+struct finfo_watch_dir;
+
+/*
+ * Files and directory trees watched through inotify.
+ * Directories are watched recursively, including the ones created later.
+ * Files given on their own are watched through the directory holding them,
+ * so that they are still watched once replaced by a rename.
+ * Events are coalesced into a single change per path, holding the last
+ * thing that happened to it, and the changes under a directory which
+ * changed in the same burst are left out, since it is read whole.
+ */
+struct finfo_watch {
+	int fd;
+	// Watched directory of each watch descriptor.
+	struct finfo_watch_dir *dirs;
+	size_t dirs_cap;
+	// Watched roots, rescanned whole if events are lost.
+	char **roots;
+	size_t roots_n;
+	size_t roots_cap;
+
+	// Changes of the last burst, in the order they were first seen.
+	struct finfo_watch_change *changes;
+	size_t changes_n;
+	size_t changes_cap;
+	// Open addressed hash table of the indices of CHANGES + 1, by path.
+	uint32_t *index;
+	size_t index_cap;
+};
+
+/*
+ * Start watching nothing. SIGINT and SIGTERM then interrupt
+ * finfo_watch_wait instead of terminating the program.
+ * On failure returns false and sets errno.
+ */
+bool finfo_watch_init(struct finfo_watch *watch);
+void finfo_watch_close(struct finfo_watch *watch);
+
+/*
+ * Watch the file or directory tree at PATH.
+ * On failure returns false and sets errno.
+ */
+bool finfo_watch_add(struct finfo_watch *watch, const char *path);
+
+/*
+ * Wait for a burst of events and set the changes of WATCH, which stay valid
+ * until the next call. Returns false once interrupted by a signal, or on
+ * failure.
+ */
+bool finfo_watch_wait(struct finfo_watch *watch);
+
+#endif // !FINFO_WATCH_H
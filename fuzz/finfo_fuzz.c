@@ -0,0 +1,70 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "finfo_emit.h"
+#include "finfo_format.h"
+#include "finfo_input.h"
+#include "finfo_options.h"
+#include "finfo_output.h"
+
+/*
+ * libFuzzer harness parsing every input the way finfo parses a file,
+ * checksums and audio frames included, and discarding the output.
+ * Built with FINFO_FUZZ_MAIN, it instead replays the files given on the
+ * command line, for compilers without libFuzzer.
+ */
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+	finfo_opts.emitter	 = &finfo_ndjson_emitter;
+	finfo_opts.no_images = true;
+	finfo_opts.verify	 = true;
+
+	struct finfo_buf out;
+	finfo_buf_init(&out);
+	finfo_out = &out;
+
+	struct finfo_input in;
+	finfo_input_open_memory(&in, "fuzz", data, size);
+
+	finfo_emit_record_begin("fuzz", false);
+	const struct finfo_format *format = finfo_format_detect(&in);
+	if (format != NULL) { format->parse(&in); }
+	finfo_emit_record_end();
+
+	finfo_input_close(&in);
+	finfo_out = NULL;
+	finfo_buf_free(&out);
+	return 0;
+}
+
+#ifdef FINFO_FUZZ_MAIN
+int main(int argc, char *argv[]) {
+	for (int i = 1; i < argc; i++) {
+		FILE *file = fopen(argv[i], "rb");
+		if (file == NULL) {
+			perror(argv[i]);
+			return 1;
+		}
+
+		size_t cap = 64 * 1024, len = 0;
+		uint8_t *data = malloc(cap);
+		while (data != NULL) {
+			len += fread(data + len, 1, cap - len, file);
+			if (len < cap) { break; }
+			uint8_t *new_data = realloc(data, cap *= 2);
+			if (new_data == NULL) { free(data); }
+			data = new_data;
+		}
+		fclose(file);
+		if (data == NULL) {
+			fprintf(stderr, "Out of memory reading %s\n", argv[i]);
+			return 1;
+		}
+
+		LLVMFuzzerTestOneInput(data, len);
+		free(data);
+	}
+	return 0;
+}
+#endif